@@ -6,11 +6,26 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <ctype.h>
 
 #define BUFFER_SIZE 4096
 
-// Handle WRITE command
-void handle_write(const char *filename, int sentence_num) {
+// Send a batch of word edits (WRITE_FLAG_BATCH) and wait for the one reply
+static int send_edit_batch(int ss_socket, const char *batch, int flags, struct Message *reply) {
+    struct Message request;
+    memset(&request, 0, sizeof(request));
+    request.type = MSG_WRITE;
+    request.flags = WRITE_FLAG_BATCH | flags;
+    strncpy(request.data, batch, sizeof(request.data) - 1);
+    if (send_message(ss_socket, &request) < 0) return -1;
+    
+    memset(reply, 0, sizeof(*reply));
+    return recv_message(ss_socket, reply) <= 0 ? -1 : 0;
+}
+
+// Handle WRITE command. wait_sec >= 0 queues for a locked sentence
+// (0 = server default timeout) instead of failing straight away.
+void handle_write(const char *filename, int sentence_num, int wait_sec) {
     // Request SS info from NS and lock the sentence
     struct Message msg;
     memset(&msg, 0, sizeof(msg));
@@ -61,6 +76,10 @@ void handle_write(const char *filename, int sentence_num) {
     strncpy(write_msg.filename, filename, sizeof(write_msg.filename));
     strncpy(write_msg.username, username, sizeof(write_msg.username));
     write_msg.sentence_num = sentence_num;
+    if (wait_sec >= 0) {
+        write_msg.flags = WRITE_FLAG_WAIT;
+        write_msg.word_index = wait_sec;
+    }
     
     if (send_message(ss_socket, &write_msg) < 0) {
         printf("✗ Failed to send lock request\n");
@@ -68,13 +87,20 @@ void handle_write(const char *filename, int sentence_num) {
         return;
     }
     
-    // Receive lock response
-    memset(&write_msg, 0, sizeof(write_msg));
-    if (recv_message(ss_socket, &write_msg) < 0) {
-        printf("✗ Failed to receive lock response\n");
-        close(ss_socket);
-        return;
-    }
+    // Receive lock response (after any queue position updates)
+    do {
+        memset(&write_msg, 0, sizeof(write_msg));
+        if (recv_message(ss_socket, &write_msg) <= 0) {
+            printf("✗ Failed to receive lock response\n");
+            close(ss_socket);
+            return;
+        }
+        if (write_msg.error_code == RESP_QUEUED) {
+            printf("→ Sentence %d is locked by %s - waiting, position %d in queue\n",
+                   sentence_num, write_msg.data, write_msg.word_index);
+            fflush(stdout);
+        }
+    } while (write_msg.error_code == RESP_QUEUED);
     
     if (write_msg.error_code == ERR_FILE_LOCKED) {
         printf("✗ Sentence %d is locked by another user: %s\n", sentence_num, write_msg.data);
@@ -92,14 +118,21 @@ void handle_write(const char *filename, int sentence_num) {
     
     // Display current sentence
     printf("\n✓ Sentence locked successfully!\n");
+    if (write_msg.sentence_num != sentence_num) {
+        printf("→ Other edits moved it: now sentence %d\n", write_msg.sentence_num);
+    }
     printf("Current sentence: %s\n", write_msg.data);
     printf("\nEnter word updates in format: <word_index> <content>\n");
-    printf("Type 'ETIRW' on a new line when done.\n");
+    printf("Also: DEL <word_index> [count], REP <word_index> <content>\n");
+    printf("Edits are sent together: an empty line previews them, 'ETIRW' saves.\n");
     printf("────────────────────────────────────────\n");
     
-    // Read word updates from user
+    // Edits are queued locally and sent as one batch frame (WRITE_FLAG_BATCH)
     char line[BUFFER_SIZE];
+    char batch[sizeof(write_msg.data)];
+    size_t batch_used = 0;
     int update_count = 0;
+    batch[0] = '\0';
     while (1) {
         // Check NS connection every 3 updates
         if (update_count > 0 && update_count % 3 == 0) {
@@ -120,83 +153,100 @@ void handle_write(const char *filename, int sentence_num) {
         // Remove newline
         line[strcspn(line, "\n")] = 0;
         
-        // Check for ETIRW (end of write)
+        // ETIRW sends the pending edits and the commit in one round trip
         if (strcmp(line, "ETIRW") == 0) {
             printf("\n✓ Finalizing changes...\n");
             
-            // Send ETIRW signal to SS
-            memset(&write_msg, 0, sizeof(write_msg));
-            write_msg.type = MSG_WRITE;
-            strncpy(write_msg.data, "ETIRW", sizeof(write_msg.data));
-            
-            if (send_message(ss_socket, &write_msg) < 0) {
+            if (send_edit_batch(ss_socket, batch, WRITE_FLAG_COMMIT, &write_msg) < 0) {
                 printf("✗ Failed to send ETIRW\n");
                 break;
             }
-            
-            // Receive final response
-            memset(&write_msg, 0, sizeof(write_msg));
-            if (recv_message(ss_socket, &write_msg) < 0) {
-                printf("✗ Failed to receive final response\n");
-                break;
-            }
+            batch_used = 0;
+            batch[0] = '\0';
             
             if (write_msg.error_code == RESP_SUCCESS) {
                 printf("✓ Changes saved successfully!\n");
                 printf("Updated sentence: %s\n", write_msg.data);
+            } else if (write_msg.error_code == ERR_WORD_OUT_OF_RANGE ||
+                       write_msg.error_code == ERR_INVALID_REQUEST) {
+                // Nothing was applied; the session is still open
+                printf("  ✗ %s - edits discarded, sentence has %d word(s)\n",
+                       write_msg.data, write_msg.word_index);
+                continue;
             } else {
                 printf("✗ Error saving changes: %s\n", write_msg.data);
             }
             break;
         }
         
-        // Parse word_index and content
-        char *word_idx_str = strtok(line, " ");
-        char *content = strtok(NULL, "");  // Get rest of line
-        
-        if (!word_idx_str || !content) {
-            printf("Invalid format. Use: <word_index> <content>\n");
+        // An empty line sends the queued edits for a preview
+        if (line[0] == '\0') {
+            if (batch_used == 0) continue;
+            if (send_edit_batch(ss_socket, batch, 0, &write_msg) < 0) {
+                printf("✗ Failed to send updates\n");
+                check_ns_alive();  // Check if NS is down
+                break;
+            }
+            batch_used = 0;
+            batch[0] = '\0';
+            if (write_msg.error_code == RESP_SUCCESS) {
+                printf("  ✓ Updated. New sentence: %s\n", write_msg.data);
+            } else if (write_msg.error_code == ERR_FILE_LOCKED) {
+                printf("✗ %s\n", write_msg.data);
+                break;
+            } else {
+                printf("  ✗ %s - edits discarded, sentence has %d word(s)\n",
+                       write_msg.data, write_msg.word_index);
+            }
             continue;
         }
         
-        int word_idx = atoi(word_idx_str);
-        
-        // Send update to SS
-        memset(&write_msg, 0, sizeof(write_msg));
-        write_msg.type = MSG_WRITE;
-        write_msg.word_index = word_idx;
-        strncpy(write_msg.data, content, sizeof(write_msg.data) - 1);
-        
-        if (send_message(ss_socket, &write_msg) < 0) {
-            printf("✗ Failed to send update\n");
-            check_ns_alive();  // Check if NS is down
+        // Turn the line into a batch entry
+        char entry[BUFFER_SIZE + 16];
+        char *first = strtok(line, " ");
+        char *rest = strtok(NULL, "");  // Get rest of line
+        if (first && strcmp(first, "DEL") == 0 && rest) {
+            snprintf(entry, sizeof(entry), "D %s\n", rest);
+        } else if (first && strcmp(first, "REP") == 0 && rest && strchr(rest, ' ')) {
+            snprintf(entry, sizeof(entry), "R %s\n", rest);
+        } else if (first && rest && (isdigit((unsigned char)first[0]) || first[0] == '-')) {
+            snprintf(entry, sizeof(entry), "I %s %s\n", first, rest);
+        } else {
+            printf("Invalid format. Use: <word_index> <content>\n");
             continue;
         }
         
-        update_count++;
-        
-        // Receive acknowledgment
-        memset(&write_msg, 0, sizeof(write_msg));
-        if (recv_message(ss_socket, &write_msg) < 0) {
-            printf("✗ Failed to receive acknowledgment\n");
-            check_ns_alive();  // Check if NS is down
+        size_t entry_length = strlen(entry);
+        if (entry_length >= sizeof(batch)) {
+            printf("✗ Update too long\n");
             continue;
         }
-        
-        if (write_msg.error_code == RESP_SUCCESS) {
-            printf("  ✓ Updated. New sentence: %s\n", write_msg.data);
-        } else if (write_msg.error_code == ERR_WORD_OUT_OF_RANGE) {
-            printf("  ✗ Word index %d out of range (max: %d)\n", word_idx, write_msg.word_index);
-        } else {
-            printf("  ✗ Error: %s\n", write_msg.data);
+        if (batch_used + entry_length >= sizeof(batch)) {
+            // Frame full: send what is queued so far
+            if (send_edit_batch(ss_socket, batch, 0, &write_msg) < 0) {
+                printf("✗ Failed to send updates\n");
+                break;
+            }
+            if (write_msg.error_code == ERR_FILE_LOCKED) {
+                printf("✗ %s\n", write_msg.data);
+                break;
+            } else if (write_msg.error_code != RESP_SUCCESS) {
+                printf("  ✗ %s - edits discarded\n", write_msg.data);
+            }
+            batch_used = 0;
+            batch[0] = '\0';
         }
+        memcpy(batch + batch_used, entry, entry_length + 1);
+        batch_used += entry_length;
+        update_count++;
     }
     
     close(ss_socket);
 }
 
-// Handle STREAM command - stream word-by-word from SS with 0.1s delay
-void handle_stream(const char *filename) {
+// Handle STREAM command - stream words from SS at the requested pace
+// (words per second, 0 for the SS default, STREAM_UNTHROTTLED for full speed)
+void handle_stream(const char *filename, int rate) {
     // Request SS info from NS
     struct Message msg;
     memset(&msg, 0, sizeof(msg));
@@ -242,6 +292,7 @@ void handle_stream(const char *filename) {
     struct Message stream_msg;
     memset(&stream_msg, 0, sizeof(stream_msg));
     stream_msg.type = MSG_STREAM;
+    stream_msg.word_index = rate;
     strncpy(stream_msg.filename, filename, sizeof(stream_msg.filename));
 
     if (send_message(ss_socket, &stream_msg) < 0) {
@@ -250,12 +301,12 @@ void handle_stream(const char *filename) {
         return;
     }
 
-    // Receive streamed words until RESP_SUCCESS
+    // Receive frames of words until RESP_SUCCESS
     printf("\n--- Stream Output ---\n");
-    int word_count = 0;
+    int frame_count = 0;
     while (1) {
-        // Check NS connection every 10 words
-        if (word_count % 10 == 0) {
+        // Check NS connection every 10 frames
+        if (frame_count % 10 == 0) {
             if (!check_ns_alive()) {
                 close(ss_socket);
                 return;
@@ -271,18 +322,23 @@ void handle_stream(const char *filename) {
         }
 
         if (in.error_code == RESP_DATA) {
-            word_count++;
-            // Check if it's a newline marker
-            if (strcmp(in.data, "\n") == 0) {
-                printf("\n");
-            } else {
-                // Print word with space
-                printf("%s ", in.data);
-            }
+            // Frames carry the text with its own spacing and newlines
+            frame_count++;
+            fputs(in.data, stdout);
             fflush(stdout);
         } else if (in.error_code == RESP_SUCCESS) {
-            // End of stream
-            printf("\n--- End of Stream ---\n");
+            // End of stream: "STREAM_END <words> <frames> <rate>"
+            long words = 0, frames = 0;
+            int pace = 0;
+            if (sscanf(in.data, "STREAM_END %ld %ld %d", &words, &frames, &pace) == 3) {
+                if (pace > 0) {
+                    printf("\n--- End of Stream (%ld words, %ld frames, %d words/s) ---\n", words, frames, pace);
+                } else {
+                    printf("\n--- End of Stream (%ld words, %ld frames, unthrottled) ---\n", words, frames);
+                }
+            } else {
+                printf("\n--- End of Stream ---\n");
+            }
             break;
         } else {
             // Some error occurred
@@ -295,7 +351,7 @@ void handle_stream(const char *filename) {
 }
 
 // Handle UNDO command
-void handle_undo(const char *filename) {
+void handle_undo(const char *filename, int steps) {
     // Request NS for file info and permission check
     struct Message msg;
     memset(&msg, 0, sizeof(msg));
@@ -344,6 +400,7 @@ void handle_undo(const char *filename) {
     undo_msg.type = MSG_UNDO;
     strncpy(undo_msg.filename, filename, sizeof(undo_msg.filename));
     strncpy(undo_msg.username, username, sizeof(undo_msg.username));
+    undo_msg.word_index = steps;   // Edits to step back
     
     if (send_message(ss_socket, &undo_msg) < 0) {
         printf("✗ Failed to send undo request\n");
@@ -360,7 +417,7 @@ void handle_undo(const char *filename) {
     }
     
     if (undo_msg.error_code == RESP_SUCCESS) {
-        printf("✓ Undo successful! File reverted to previous version.\n");
+        printf("✓ Undo successful! File reverted to an earlier version.\n");
         if (strlen(undo_msg.data) > 0) {
             printf("  Info: %s\n", undo_msg.data);
         }
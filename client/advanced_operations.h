@@ -2,9 +2,9 @@
 #define ADVANCED_OPERATIONS_H
 
 // Advanced operation handlers
-void handle_write(const char *filename, int sentence_num);
-void handle_stream(const char *filename);
-void handle_undo(const char *filename);
+void handle_write(const char *filename, int sentence_num, int wait_sec);
+void handle_stream(const char *filename, int rate);
+void handle_undo(const char *filename, int steps);
 void handle_exec(const char *filename);
 void handle_search(const char *pattern);
 
@@ -1,8 +1,10 @@
 #include "checkpoint_operations.h"
+#include "connection_manager.h"
 #include "../common/protocol.h"
 #include "../common/utils.h"
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 // Handle CHECKPOINT command
 void handle_checkpoint(const char *filename, const char *tag) {
@@ -35,8 +37,9 @@ void handle_checkpoint(const char *filename, const char *tag) {
     }
 }
 
-// Handle VIEWCHECKPOINT command
-void handle_viewcheckpoint(const char *filename, const char *tag) {
+// Handle VIEWCHECKPOINT command. A negative offset shows the whole
+// checkpoint; otherwise only 'length' bytes from 'offset'.
+void handle_viewcheckpoint(const char *filename, const char *tag, long offset, long length) {
     struct Message msg;
     memset(&msg, 0, sizeof(msg));
     msg.type = MSG_VIEWCHECKPOINT;
@@ -59,15 +62,126 @@ void handle_viewcheckpoint(const char *filename, const char *tag) {
         return;
     }
     
-    if (msg.error_code == RESP_SUCCESS) {
-        printf("═══════════════════════════════════════════════════════════\n");
-        printf("Checkpoint '%s' content:\n", tag);
-        printf("═══════════════════════════════════════════════════════════\n");
-        printf("%s\n", msg.data);
-        printf("═══════════════════════════════════════════════════════════\n");
-    } else {
+    if (msg.error_code != RESP_SS_INFO) {
+        printf("✗ %s\n", msg.data);
+        return;
+    }
+    
+    // The content is streamed from the storage server in RESP_DATA frames
+    int ss_socket = connect_to_ss(msg.ss_ip, msg.ss_port);
+    if (ss_socket < 0) {
+        printf("✗ Failed to connect to storage server\n");
+        return;
+    }
+    
+    struct Message request;
+    memset(&request, 0, sizeof(request));
+    request.type = MSG_VIEWCHECKPOINT;
+    strncpy(request.username, username, sizeof(request.username));
+    strncpy(request.filename, filename, sizeof(request.filename));
+    strncpy(request.checkpoint_tag, tag, sizeof(request.checkpoint_tag));
+    if (offset >= 0) {
+        snprintf(request.data, sizeof(request.data), "%ld %ld", offset, length);
+    }
+    
+    if (send_message(ss_socket, &request) < 0) {
+        printf("✗ Failed to send VIEWCHECKPOINT request\n");
+        close(ss_socket);
+        return;
+    }
+    
+    int header_shown = 0;
+    while (recv_message(ss_socket, &msg) > 0) {
+        if (msg.error_code == RESP_DATA) {
+            if (!header_shown) {
+                printf("═══════════════════════════════════════════════════════════\n");
+                printf("Checkpoint '%s' content:\n", tag);
+                printf("═══════════════════════════════════════════════════════════\n");
+                header_shown = 1;
+            }
+            fputs(msg.data, stdout);
+            continue;
+        }
+        
+        if (msg.error_code == RESP_SUCCESS) {
+            size_t from = 0, shown = 0, size = 0;
+            sscanf(msg.data, "%zu %zu %zu", &from, &shown, &size);
+            if (!header_shown) {
+                printf("═══════════════════════════════════════════════════════════\n");
+                printf("Checkpoint '%s' content:\n", tag);
+                printf("═══════════════════════════════════════════════════════════\n");
+            }
+            printf("\n═══════════════════════════════════════════════════════════\n");
+            if (offset >= 0) {
+                printf("Bytes %zu-%zu of %zu\n", from, from + shown, size);
+            }
+        } else {
+            printf("✗ %s\n", msg.data);
+        }
+        break;
+    }
+    close(ss_socket);
+}
+
+// Handle DIFF command: changes from checkpoint 'from' to checkpoint 'to'
+// (or the live file), computed on the storage server
+void handle_diff(const char *filename, const char *from, const char *to) {
+    struct Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_DIFF;
+    strncpy(msg.username, username, sizeof(msg.username));
+    strncpy(msg.filename, filename, sizeof(msg.filename));
+    strncpy(msg.checkpoint_tag, from, sizeof(msg.checkpoint_tag));
+    strncpy(msg.data, to, sizeof(msg.data) - 1);
+    
+    if (send_message(ns_socket, &msg) < 0) {
+        printf("✗ Failed to send DIFF request\n");
+        return;
+    }
+    
+    struct Message request = msg;
+    memset(&msg, 0, sizeof(msg));
+    if (recv_message(ns_socket, &msg) < 0) {
+        printf("✗ Failed to receive response\n");
+        return;
+    }
+    if (msg.error_code != RESP_SS_INFO) {
         printf("✗ %s\n", msg.data);
+        return;
+    }
+    
+    int ss_socket = connect_to_ss(msg.ss_ip, msg.ss_port);
+    if (ss_socket < 0) {
+        printf("✗ Failed to connect to storage server\n");
+        return;
+    }
+    if (send_message(ss_socket, &request) < 0) {
+        printf("✗ Failed to send DIFF request\n");
+        close(ss_socket);
+        return;
+    }
+    
+    printf("--- %s@%s\n+++ %s@%s\n", filename, from, filename, to);
+    while (recv_message(ss_socket, &msg) > 0) {
+        if (msg.error_code == RESP_DATA) {
+            fputs(msg.data, stdout);
+            continue;
+        }
+        if (msg.error_code == RESP_SUCCESS) {
+            int hunks = 0, added = 0, removed = 0, changed = 0;
+            sscanf(msg.data, "%d %d %d %d", &hunks, &added, &removed, &changed);
+            if (hunks == 0) {
+                printf("✓ No differences\n");
+            } else {
+                printf("✓ %d hunk(s): %d sentence(s) added, %d removed, %d changed\n",
+                       hunks, added, removed, changed);
+            }
+        } else {
+            printf("✗ %s\n", msg.data);
+        }
+        break;
     }
+    close(ss_socket);
 }
 
 // Handle REVERT command
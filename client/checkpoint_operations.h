@@ -3,8 +3,9 @@
 
 // Checkpoint operation handlers
 void handle_checkpoint(const char *filename, const char *tag);
-void handle_viewcheckpoint(const char *filename, const char *tag);
+void handle_viewcheckpoint(const char *filename, const char *tag, long offset, long length);
 void handle_revert(const char *filename, const char *tag);
+void handle_diff(const char *filename, const char *from, const char *to);
 void handle_listcheckpoints(const char *filename);
 
 // External globals
@@ -8,6 +8,7 @@
 #include "../common/utils.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -23,6 +24,8 @@ void print_help() {
     printf("║ Basic Operations:                                              ║\n");
     printf("║  CREATE <filename>          - Create a new file                ║\n");
     printf("║  READ <filename>            - Read file content                ║\n");
+    printf("║  READ <file> <off> <len>    - Read a byte range                ║\n");
+    printf("║  READ <file> sentences a..b - Read sentences a to b            ║\n");
     printf("║  DELETE <filename>          - Delete a file                    ║\n");
     printf("║  VIEW [-a] [-l]             - List files                       ║\n");
     printf("║  INFO <filename>            - Get file information             ║\n");
@@ -31,8 +34,9 @@ void print_help() {
     printf("╠════════════════════════════════════════════════════════════════╣\n");
     printf("║ Advanced Operations:                                           ║\n");
     printf("║  WRITE <file> <sent#>       - Write to file (interactive)      ║\n");
-    printf("║  STREAM <filename>          - Stream file content              ║\n");
-    printf("║  UNDO <filename>            - Undo last change                 ║\n");
+    printf("║  WRITE <f> <n> -w [secs]    - Queue for a locked sentence      ║\n");
+    printf("║  STREAM <file> [wps|max]    - Stream file content              ║\n");
+    printf("║  UNDO <filename> [n]        - Undo the last n changes          ║\n");
     printf("║  EXEC <filename>            - Execute file as commands         ║\n");
     printf("║  SEARCH <pattern>           - Search for files by name         ║\n");
     printf("╠════════════════════════════════════════════════════════════════╣\n");
@@ -47,7 +51,8 @@ void print_help() {
     printf("╠════════════════════════════════════════════════════════════════╣\n");
     printf("║ Checkpoint Operations:                                         ║\n");
     printf("║  CHECKPOINT <file> <tag>    - Create checkpoint with tag       ║\n");
-    printf("║  VIEWCHECKPOINT <file> <tag>- View checkpoint content          ║\n");
+    printf("║  VIEWCHECKPOINT <f> <t> [o n] - View checkpoint (byte range)   ║\n");
+    printf("║  DIFF <file> <tag> [tag|live] - Changes since checkpoint       ║\n");
     printf("║  REVERT <file> <tag>        - Revert to checkpoint             ║\n");
     printf("║  LISTCHECKPOINTS <file>     - List all checkpoints             ║\n");
     printf("╠════════════════════════════════════════════════════════════════╣\n");
@@ -78,10 +83,28 @@ void execute_command(char *command) {
     }
     else if (strcmp(cmd, "READ") == 0) {
         char *filename = strtok(NULL, " \n");
-        if (filename) {
-            handle_read(filename);
+        char *first_arg = strtok(NULL, " \n");
+        char *second_arg = strtok(NULL, " \n");
+        long start = 0, length = 0;
+        int flags = -1;
+        if (filename && !first_arg) {
+            flags = 0;
+        } else if (filename && second_arg &&
+                   (strcmp(first_arg, "sentences") == 0 || strcmp(first_arg, "sentence") == 0)) {
+            // "a..b", "a.." (to the end) or a single sentence "a"
+            char *dots = strstr(second_arg, "..");
+            start = atol(second_arg);
+            length = !dots ? start : dots[2] ? atol(dots + 2) : INT_MAX;
+            if (start >= 0 && length >= start) flags = READ_FLAG_SENTENCES;
+        } else if (filename && second_arg) {
+            start = atol(first_arg);
+            length = atol(second_arg);
+            if (start >= 0 && length > 0) flags = READ_FLAG_RANGE;
+        }
+        if (flags >= 0) {
+            handle_read(filename, flags, start, length);
         } else {
-            printf("Usage: READ <filename>\n");
+            printf("Usage: READ <filename> [<offset> <length> | sentences <a>..<b>]\n");
         }
     }
     else if (strcmp(cmd, "DELETE") == 0) {
@@ -112,27 +135,37 @@ void execute_command(char *command) {
     else if (strcmp(cmd, "WRITE") == 0) {
         char *filename = strtok(NULL, " \n");
         char *sentence_num_str = strtok(NULL, " \n");
-        if (filename && sentence_num_str) {
+        char *wait_flag = strtok(NULL, " \n");
+        char *wait_str = wait_flag ? strtok(NULL, " \n") : NULL;
+        if (filename && sentence_num_str && (!wait_flag || strcmp(wait_flag, "-w") == 0)) {
             int sentence_num = atoi(sentence_num_str);
-            handle_write(filename, sentence_num);
+            // -w queues for a locked sentence (optionally for <seconds>) instead of failing
+            int wait_sec = wait_flag ? (wait_str ? atoi(wait_str) : 0) : -1;
+            handle_write(filename, sentence_num, wait_sec);
         } else {
-            printf("Usage: WRITE <filename> <sentence_number>\n");
+            printf("Usage: WRITE <filename> <sentence_number> [-w [seconds]]\n");
         }
     }
     else if (strcmp(cmd, "STREAM") == 0) {
         char *filename = strtok(NULL, " \n");
-        if (filename) {
-            handle_stream(filename);
+        char *rate_str = strtok(NULL, " \n");
+        // Optional pace in words per second, or "max" for no pacing
+        int rate = 0;
+        if (rate_str) rate = strcmp(rate_str, "max") == 0 ? STREAM_UNTHROTTLED : atoi(rate_str);
+        if (filename && (!rate_str || rate > 0 || rate == STREAM_UNTHROTTLED)) {
+            handle_stream(filename, rate);
         } else {
-            printf("Usage: STREAM <filename>\n");
+            printf("Usage: STREAM <filename> [words_per_second|max]\n");
         }
     }
     else if (strcmp(cmd, "UNDO") == 0) {
         char *filename = strtok(NULL, " \n");
-        if (filename) {
-            handle_undo(filename);
+        char *steps_str = strtok(NULL, " \n");
+        int steps = steps_str ? atoi(steps_str) : 1;
+        if (filename && steps > 0) {
+            handle_undo(filename, steps);
         } else {
-            printf("Usage: UNDO <filename>\n");
+            printf("Usage: UNDO <filename> [steps]\n");
         }
     }
     else if (strcmp(cmd, "LIST") == 0) {
@@ -151,7 +184,7 @@ void execute_command(char *command) {
             printf("\n╔════════════════════════════════════════════════════════════════╗\n");
             printf("║               Storage Servers                                  ║\n");
             printf("╠════════════════════════════════════════════════════════════════╣\n");
-            printf("║ ID         Address           Status                           ║\n");
+            printf("║ ID         Address           Status (load below each server)  ║\n");
             printf("╠════════════════════════════════════════════════════════════════╣\n");
             printf("%s", msg.data);
             printf("╚════════════════════════════════════════════════════════════════╝\n");
@@ -243,10 +276,25 @@ void execute_command(char *command) {
     else if (strcmp(cmd, "VIEWCHECKPOINT") == 0) {
         char *filename = strtok(NULL, " \n");
         char *tag = strtok(NULL, " \n");
-        if (filename && tag) {
-            handle_viewcheckpoint(filename, tag);
+        char *offset_str = strtok(NULL, " \n");
+        char *length_str = offset_str ? strtok(NULL, " \n") : NULL;
+        if (filename && tag && (!offset_str || length_str)) {
+            // Optional byte range: <offset> <length>
+            long offset = offset_str ? atol(offset_str) : -1;
+            long length = length_str ? atol(length_str) : 0;
+            handle_viewcheckpoint(filename, tag, offset, length);
+        } else {
+            printf("Usage: VIEWCHECKPOINT <filename> <checkpoint_tag> [offset length]\n");
+        }
+    }
+    else if (strcmp(cmd, "DIFF") == 0) {
+        char *filename = strtok(NULL, " \n");
+        char *from = strtok(NULL, " \n");
+        char *to = strtok(NULL, " \n");
+        if (filename && from) {
+            handle_diff(filename, from, to ? to : "live");
         } else {
-            printf("Usage: VIEWCHECKPOINT <filename> <checkpoint_tag>\n");
+            printf("Usage: DIFF <filename> <checkpoint_tag> [checkpoint_tag|live]\n");
         }
     }
     else if (strcmp(cmd, "REVERT") == 0) {
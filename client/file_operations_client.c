@@ -99,12 +99,15 @@ void handle_create(const char *filename) {
     }
 }
 
-// Handle READ command
-void handle_read(const char *filename) {
+// Handle READ command. flags selects part of the file: READ_FLAG_RANGE
+// reads 'length' bytes from byte 'start', READ_FLAG_SENTENCES sentences
+// start..length (inclusive); 0 reads it all.
+void handle_read(const char *filename, int flags, long start, long length) {
     // Request SS info from NS
     struct Message msg;
     memset(&msg, 0, sizeof(msg));
     msg.type = MSG_READ;
+    msg.flags = flags;
     strncpy(msg.username, username, sizeof(msg.username));
     strncpy(msg.filename, filename, sizeof(msg.filename));
     
@@ -153,6 +156,7 @@ void handle_read(const char *filename) {
         printf("\n╔════════════════════════════════════════╗\n");
         printf("║ Content of: %-24s║\n", filename);
         printf("║ (served from NS cache/backup)          ║\n");
+        if (flags) printf("║ (whole file: range not available)      ║\n");
         printf("╚════════════════════════════════════════╝\n");
         if (strlen(msg.data) > 0) {
             printf("%s\n", msg.data);
@@ -178,11 +182,18 @@ void handle_read(const char *filename) {
         return;
     }
     
-    // Request file content
+    // Request file content (or the part asked for)
     struct Message read_msg;
     memset(&read_msg, 0, sizeof(read_msg));
     read_msg.type = MSG_READ;
+    read_msg.flags = flags;
     strncpy(read_msg.filename, filename, sizeof(read_msg.filename));
+    if (flags & READ_FLAG_SENTENCES) {
+        read_msg.sentence_num = (int)start;
+        read_msg.word_index = (int)length;
+    } else if (flags & READ_FLAG_RANGE) {
+        snprintf(read_msg.data, sizeof(read_msg.data), "%ld %ld", start, length);
+    }
     
     if (send_message(ss_socket, &read_msg) < 0) {
         printf("Error: Failed to send read request to SS\n");
@@ -190,28 +201,59 @@ void handle_read(const char *filename) {
         return;
     }
     
-    // Clear message buffer before receiving to avoid stale data
-    memset(&read_msg, 0, sizeof(read_msg));
-    
-    if (recv_message(ss_socket, &read_msg) < 0) {
-        printf("Error: Failed to receive data from SS\n");
-        close(ss_socket);
-        return;
-    }
-    
-    if (read_msg.error_code == RESP_SUCCESS) {
-        printf("\n╔════════════════════════════════════════╗\n");
-        printf("║ Content of: %-24s║\n", filename);
-        printf("╚════════════════════════════════════════╝\n");
-        if (strlen(read_msg.data) > 0) {
-            printf("%s\n", read_msg.data);
+    // Content arrives as RESP_DATA frames, then a closing RESP_SUCCESS
+    int frames = 0;
+    char last_char = '\n';
+    while (1) {
+        // Clear message buffer before receiving to avoid stale data
+        memset(&read_msg, 0, sizeof(read_msg));
+        if (recv_message(ss_socket, &read_msg) <= 0) {
+            printf("%s✗ Connection lost while reading\n", frames ? "\n" : "");
+            break;
+        }
+        
+        if (read_msg.error_code == RESP_DATA) {
+            if (frames++ == 0) {
+                printf("\n╔════════════════════════════════════════╗\n");
+                printf("║ Content of: %-24s║\n", filename);
+                printf("╚════════════════════════════════════════╝\n");
+            }
+            fputs(read_msg.data, stdout);
+            size_t piece = strlen(read_msg.data);
+            if (piece > 0) last_char = read_msg.data[piece - 1];
+        } else if (read_msg.error_code == RESP_SUCCESS) {
+            if (frames == 0) {
+                printf("\n╔════════════════════════════════════════╗\n");
+                printf("║ Content of: %-24s║\n", filename);
+                printf("╚════════════════════════════════════════╝\n");
+                printf(flags ? "(empty range)" : "(empty file)");
+                last_char = ' ';
+            }
+            if (last_char != '\n') printf("\n");
+            
+            // Closing frame: "<offset> <length> <size>" [" <first> <last> <count>"]
+            long offset = 0, bytes = 0, size = 0;
+            int first = 0, last = 0, count = 0;
+            int fields = sscanf(read_msg.data, "%ld %ld %ld %d %d %d",
+                                &offset, &bytes, &size, &first, &last, &count);
+            if ((flags & READ_FLAG_SENTENCES) && fields == 6) {
+                if (first <= last) {
+                    printf("─── sentences %d..%d of %d (bytes %ld-%ld of %ld) ───\n",
+                           first, last, count, offset, offset + bytes, size);
+                } else {
+                    printf("─── no such sentences (file has %d) ───\n", count);
+                }
+            } else if ((flags & READ_FLAG_RANGE) && fields >= 3) {
+                printf("─── bytes %ld-%ld of %ld ───\n", offset, offset + bytes, size);
+            } else {
+                printf("────────────────────────────────────────\n");
+            }
+            break;
         } else {
-            printf("(empty file)\n");
+            printf("%s✗ Error reading file: %s (code: %d)\n", frames ? "\n" : "",
+                   read_msg.data, read_msg.error_code);
+            break;
         }
-        printf("────────────────────────────────────────\n");
-    } else {
-        printf("✗ Error reading file: %s (code: %d)\n", 
-               read_msg.data, read_msg.error_code);
     }
     
     close(ss_socket);
@@ -3,7 +3,7 @@
 
 // File operation handlers
 void handle_create(const char *filename);
-void handle_read(const char *filename);
+void handle_read(const char *filename, int flags, long start, long length);
 void handle_delete(const char *filename);
 void handle_view(int show_all, int show_details);
 void handle_info(const char *filename);
@@ -0,0 +1,140 @@
+#include "compress.h"
+#include <stdint.h>
+#include <string.h>
+
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+#define LZ_LAST_LITERALS 5   // Tail always sent as literals
+
+static uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned int hash4(const unsigned char *p) {
+    return (read32(p) * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+// Write a length continuation (after the nibble hit 15)
+static unsigned char* put_length(unsigned char *op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (unsigned char)length;
+    return op;
+}
+
+static unsigned char* put_sequence(unsigned char *op, const unsigned char *literals,
+                                   size_t literal_len, size_t match_len, size_t offset) {
+    unsigned char *token = op++;
+    *token = (unsigned char)((literal_len >= 15 ? 15 : literal_len) << 4);
+    if (literal_len >= 15) op = put_length(op, literal_len - 15);
+    memcpy(op, literals, literal_len);
+    op += literal_len;
+
+    if (match_len > 0) {
+        *op++ = (unsigned char)(offset & 0xff);
+        *op++ = (unsigned char)(offset >> 8);
+        size_t code = match_len - LZ_MIN_MATCH;
+        *token |= (unsigned char)(code >= 15 ? 15 : code);
+        if (code >= 15) op = put_length(op, code - 15);
+    }
+    return op;
+}
+
+// Compress 'len' bytes. Returns the compressed size, or 0 if out_size is
+// smaller than LZ_COMPRESS_BOUND(len).
+size_t lz_compress(const char *in, size_t len, char *out, size_t out_size) {
+    if (out_size < LZ_COMPRESS_BOUND(len)) return 0;
+
+    const unsigned char *src = (const unsigned char*)in;
+    const unsigned char *ip = src;
+    const unsigned char *anchor = src;
+    const unsigned char *end = src + len;
+    unsigned char *op = (unsigned char*)out;
+
+    if (len > LZ_LAST_LITERALS + LZ_MIN_MATCH) {
+        const unsigned char *match_limit = end - LZ_LAST_LITERALS;
+        uint32_t table[LZ_HASH_SIZE];
+        memset(table, 0, sizeof(table));
+
+        // table stores position + 1 so that 0 means "empty"
+        while (ip + LZ_MIN_MATCH <= match_limit) {
+            unsigned int h = hash4(ip);
+            const unsigned char *ref = table[h] ? src + table[h] - 1 : NULL;
+            table[h] = (uint32_t)(ip - src) + 1;
+
+            if (ref == NULL || ip - ref > LZ_MAX_OFFSET || read32(ref) != read32(ip)) {
+                ip++;
+                continue;
+            }
+
+            size_t match_len = LZ_MIN_MATCH;
+            while (ip + match_len < match_limit && ref[match_len] == ip[match_len]) {
+                match_len++;
+            }
+
+            op = put_sequence(op, anchor, ip - anchor, match_len, ip - ref);
+            ip += match_len;
+            anchor = ip;
+        }
+    }
+
+    op = put_sequence(op, anchor, end - anchor, 0, 0);
+    return op - (unsigned char*)out;
+}
+
+// Decompress into out. Returns the decompressed size, or -1 on corrupt
+// input or if the output would not fit.
+long lz_decompress(const char *in, size_t len, char *out, size_t out_size) {
+    const unsigned char *ip = (const unsigned char*)in;
+    const unsigned char *end = ip + len;
+    unsigned char *op = (unsigned char*)out;
+    unsigned char *op_end = op + out_size;
+
+    while (ip < end) {
+        unsigned char token = *ip++;
+
+        size_t literal_len = token >> 4;
+        if (literal_len == 15) {
+            unsigned char b;
+            do {
+                if (ip >= end) return -1;
+                b = *ip++;
+                literal_len += b;
+            } while (b == 255);
+        }
+        if ((size_t)(end - ip) < literal_len || (size_t)(op_end - op) < literal_len) return -1;
+        memcpy(op, ip, literal_len);
+        ip += literal_len;
+        op += literal_len;
+
+        if (ip == end) break;   // Final literals-only sequence
+
+        if (end - ip < 2) return -1;
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - (unsigned char*)out)) return -1;
+
+        size_t match_len = token & 0x0f;
+        if (match_len == 15) {
+            unsigned char b;
+            do {
+                if (ip >= end) return -1;
+                b = *ip++;
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += LZ_MIN_MATCH;
+        if ((size_t)(op_end - op) < match_len) return -1;
+
+        // Byte copy: the match may overlap the bytes it produces
+        const unsigned char *ref = op - offset;
+        for (size_t i = 0; i < match_len; i++) {
+            op[i] = ref[i];
+        }
+        op += match_len;
+    }
+    return op - (unsigned char*)out;
+}
@@ -0,0 +1,24 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+
+// Small LZ77 codec (LZ4-style sequences) for shipping file contents between
+// servers. Not a general archive format: the caller stores the raw length.
+//
+// Each sequence is a token byte (high nibble literal count, low nibble match
+// length - 4; 15 means more length bytes follow, each adding up to 255),
+// the literals, then a 2-byte little-endian match offset. The final
+// sequence has literals only.
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+
+// Worst-case compressed size for 'len' input bytes
+#define LZ_COMPRESS_BOUND(len) ((len) + (len) / 255 + 16)
+
+// Compression functions
+size_t lz_compress(const char *in, size_t len, char *out, size_t out_size);
+long lz_decompress(const char *in, size_t len, char *out, size_t out_size);
+
+#endif // COMPRESS_H
@@ -0,0 +1,412 @@
+#define _GNU_SOURCE
+#include "event_loop.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+// Event loop: one thread waits in epoll for every connection of a server,
+// reads requests as they arrive and queues them for a fixed pool of
+// workers. Connections are registered EPOLLONESHOT, so a socket is silent
+// while a worker has it and is re-armed with whatever the handler asked
+// for next (input, writability, a timer) when the handler returns.
+// Handlers that block are moved to a second pool, and the connection stays
+// busy (and silent) until that pool is done with it.
+static int epoll_fd = -1;
+static int wake_fd = -1;                 // Tells the loop thread to recompute timers
+static int worker_count = DEFAULT_EVENT_WORKERS;
+static int blocking_count = DEFAULT_BLOCKING_WORKERS;
+static int max_connections = DEFAULT_MAX_CONNECTIONS;
+static int send_timeout_sec = DEFAULT_SEND_TIMEOUT_SEC;
+
+static Connection *connections = NULL;   // Every open connection
+static Connection *closed = NULL;        // Freed by the loop thread, once no event can name them
+static int limited_count = 0;
+static Connection *queue_head = NULL;
+static Connection *queue_tail = NULL;
+static int queued_requests = 0;          // Requests waiting for a worker
+static Connection *blocking_head = NULL; // Offloaded events
+static Connection *blocking_tail = NULL;
+static long long next_timer_us = LLONG_MAX;
+static pthread_mutex_t loop_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t blocking_ready = PTHREAD_COND_INITIALIZER;
+
+static long long now_us() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// Sizes come from the server's own settings; out of range values get the defaults
+void init_event_loop(int workers, int blocking_workers, int connections, int send_timeout) {
+    worker_count = workers > 0 ? workers : DEFAULT_EVENT_WORKERS;
+    blocking_count = blocking_workers > 0 ? blocking_workers : DEFAULT_BLOCKING_WORKERS;
+    max_connections = connections > 0 ? connections : DEFAULT_MAX_CONNECTIONS;
+    send_timeout_sec = send_timeout;
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+}
+
+static void poke_loop() {
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0) {
+        // Already pending - the loop wakes either way
+    }
+}
+
+// Hand a connection to the workers (loop_mutex held)
+static void dispatch_locked(Connection *conn, int event) {
+    conn->busy = 1;
+    conn->pending = event;
+    conn->queued_us = now_us();
+    conn->queue_next = NULL;
+    if (queue_tail) queue_tail->queue_next = conn;
+    else queue_head = conn;
+    queue_tail = conn;
+    if (event == CONN_EVENT_MESSAGE && conn->limited) queued_requests++;
+    pthread_cond_signal(&work_ready);
+}
+
+static void dispatch(Connection *conn, int event) {
+    pthread_mutex_lock(&loop_mutex);
+    dispatch_locked(conn, event);
+    pthread_mutex_unlock(&loop_mutex);
+}
+
+static Connection* add_connection(int fd, ConnectionHandler handler, int limited) {
+    Connection *conn = calloc(1, sizeof(Connection));
+    conn->fd = fd;
+    conn->handler = handler;
+    conn->limited = limited;
+
+    // Registered disarmed; the OPEN event's handler decides what to wait for
+    struct epoll_event event = { .events = EPOLLONESHOT, .data.ptr = conn };
+    pthread_mutex_lock(&loop_mutex);
+    conn->next = connections;
+    if (connections) connections->prev = conn;
+    connections = conn;
+    if (limited) limited_count++;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        pthread_mutex_unlock(&loop_mutex);
+        log_error("event_loop", "Failed to register connection");
+        return conn;
+    }
+    dispatch_locked(conn, CONN_EVENT_OPEN);
+    pthread_mutex_unlock(&loop_mutex);
+    return conn;
+}
+
+// Close a connection whose handler has seen CLOSE. The loop thread may
+// still hold an event naming it from its current batch, so the memory is
+// released there before the next epoll_wait. It stays busy until then.
+static void close_connection(Connection *conn) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+
+    pthread_mutex_lock(&loop_mutex);
+    if (conn->prev) conn->prev->next = conn->next;
+    else connections = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    if (conn->limited) limited_count--;
+    conn->next = closed;
+    closed = conn;
+    pthread_mutex_unlock(&loop_mutex);
+    poke_loop();
+}
+
+// Re-arm a connection after its handler returned, as the handler asked
+static void rearm(Connection *conn) {
+    uint32_t events = EPOLLONESHOT | EPOLLRDHUP;
+    if (conn->want_input) events |= EPOLLIN;
+    if (conn->want_writable) events |= EPOLLOUT;
+
+    int poke = 0;
+    pthread_mutex_lock(&loop_mutex);
+    long long due = conn->woken ? 1 : conn->wake_us;
+    if (due != 0 && due < next_timer_us) {
+        next_timer_us = due;
+        poke = 1;
+    }
+    conn->busy = 0;
+    struct epoll_event event = { .events = events, .data.ptr = conn };
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+    pthread_mutex_unlock(&loop_mutex);
+    if (poke) poke_loop();
+}
+
+// Run one event's handler, then pass the connection on: to the blocking
+// pool if the handler offloaded the rest, otherwise back to epoll
+static void run_handler(Connection *conn, ConnectionHandler handler, int event) {
+    conn->offload = NULL;
+    handler(conn, event);
+
+    if (conn->offload != NULL && event != CONN_EVENT_CLOSE) {
+        pthread_mutex_lock(&loop_mutex);
+        conn->pending = event;
+        conn->queue_next = NULL;
+        if (blocking_tail) blocking_tail->queue_next = conn;
+        else blocking_head = conn;
+        blocking_tail = conn;
+        pthread_cond_signal(&blocking_ready);
+        pthread_mutex_unlock(&loop_mutex);
+        return;
+    }
+    if (event != CONN_EVENT_CLOSE && conn->closing) {
+        conn->handler(conn, CONN_EVENT_CLOSE);
+        event = CONN_EVENT_CLOSE;
+    }
+    if (event == CONN_EVENT_CLOSE) close_connection(conn);
+    else rearm(conn);
+}
+
+static void* worker(void *arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&loop_mutex);
+        while (queue_head == NULL) pthread_cond_wait(&work_ready, &loop_mutex);
+        Connection *conn = queue_head;
+        queue_head = conn->queue_next;
+        if (queue_head == NULL) queue_tail = NULL;
+        int event = conn->pending;
+        if (event == CONN_EVENT_MESSAGE && conn->limited) queued_requests--;
+        pthread_mutex_unlock(&loop_mutex);
+
+        // Timers are one-shot; the handler sets the next one
+        conn->wake_us = 0;
+        run_handler(conn, conn->handler, event);
+    }
+    return NULL;
+}
+
+// Runs offloaded events. Waiting here holds none of the workers, so the
+// rest of the server keeps moving (and the stall check keeps passing)
+static void* blocking_worker(void *arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&loop_mutex);
+        while (blocking_head == NULL) pthread_cond_wait(&blocking_ready, &loop_mutex);
+        Connection *conn = blocking_head;
+        blocking_head = conn->queue_next;
+        if (blocking_head == NULL) blocking_tail = NULL;
+        int event = conn->pending;
+        pthread_mutex_unlock(&loop_mutex);
+
+        run_handler(conn, conn->offload, event);
+    }
+    return NULL;
+}
+
+// Read what has arrived of the next request. Returns the event to deliver,
+// or -1 if the request is still incomplete.
+static int read_request(Connection *conn) {
+    char *buffer = (char*)&conn->request;
+    while (1) {
+        if (conn->received == 0) memset(&conn->request, 0, sizeof(conn->request));
+        ssize_t bytes = recv(conn->fd, buffer + conn->received,
+                             sizeof(conn->request) - conn->received, MSG_DONTWAIT);
+        if (bytes == 0) return CONN_EVENT_CLOSE;
+        if (bytes < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? -1 : CONN_EVENT_CLOSE;
+        }
+        conn->received += bytes;
+        if (conn->received == sizeof(conn->request)) {
+            conn->received = 0;
+            conn->request_us = now_us();
+            return CONN_EVENT_MESSAGE;
+        }
+    }
+}
+
+static void accept_connections(Connection *listener) {
+    while (1) {
+        int fd = accept4(listener->fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) return;
+
+        pthread_mutex_lock(&loop_mutex);
+        int full = listener->limited && limited_count >= max_connections;
+        pthread_mutex_unlock(&loop_mutex);
+        if (full) {
+            // Answer the first request with "busy" so the client need not time out
+            struct Message busy;
+            memset(&busy, 0, sizeof(busy));
+            busy.error_code = ERR_SS_UNAVAILABLE;
+            snprintf(busy.data, sizeof(busy.data), "Storage server busy (%d connections)", max_connections);
+            send(fd, &busy, sizeof(busy), MSG_DONTWAIT | MSG_NOSIGNAL);
+            close(fd);
+            log_message("event_loop", "Connection refused: connection limit reached");
+            continue;
+        }
+
+        if (send_timeout_sec > 0) {
+            struct timeval timeout = { .tv_sec = send_timeout_sec, .tv_usec = 0 };
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        }
+        add_connection(fd, listener->handler, listener->limited);
+    }
+}
+
+// Deliver due timers (loop thread)
+static void fire_timers() {
+    long long now = now_us();
+    pthread_mutex_lock(&loop_mutex);
+    if (now >= next_timer_us) {
+        long long next = LLONG_MAX;
+        for (Connection *conn = connections; conn != NULL; conn = conn->next) {
+            if (conn->busy || (conn->wake_us == 0 && !conn->woken)) continue;
+            if (conn->woken || conn->wake_us <= now) {
+                conn->woken = 0;
+                conn->wake_us = 0;
+                dispatch_locked(conn, CONN_EVENT_TIMER);
+            } else if (conn->wake_us < next) {
+                next = conn->wake_us;
+            }
+        }
+        next_timer_us = next;
+    }
+    pthread_mutex_unlock(&loop_mutex);
+}
+
+static void* loop_thread(void *arg) {
+    (void)arg;
+    struct epoll_event events[EVENT_BATCH];
+    while (1) {
+        pthread_mutex_lock(&loop_mutex);
+        long long next = next_timer_us;
+        Connection *dead = closed;
+        closed = NULL;
+        pthread_mutex_unlock(&loop_mutex);
+        while (dead != NULL) {
+            Connection *following = dead->next;
+            free(dead);
+            dead = following;
+        }
+        int timeout_ms = -1;
+        if (next != LLONG_MAX) {
+            long long wait = (next - now_us() + 999) / 1000;
+            timeout_ms = wait < 0 ? 0 : wait > INT_MAX ? INT_MAX : (int)wait;
+        }
+
+        int ready = epoll_wait(epoll_fd, events, EVENT_BATCH, timeout_ms);
+        for (int i = 0; i < ready; i++) {
+            Connection *conn = events[i].data.ptr;
+            if (conn == NULL) {
+                uint64_t count;
+                if (read(wake_fd, &count, sizeof(count)) < 0) {
+                    // Nothing pending
+                }
+                continue;
+            }
+            if (conn->listening) {
+                accept_connections(conn);
+                continue;
+            }
+
+            pthread_mutex_lock(&loop_mutex);
+            int busy = conn->busy;
+            pthread_mutex_unlock(&loop_mutex);
+            if (busy) continue;  // Re-armed (and re-reported) when its worker is done
+
+            uint32_t flags = events[i].events;
+            int event = -1;
+            if ((flags & EPOLLIN) && conn->want_input) {
+                event = read_request(conn);
+            } else if (flags & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) {
+                event = CONN_EVENT_CLOSE;
+            } else if (flags & EPOLLOUT) {
+                event = CONN_EVENT_WRITABLE;
+            }
+
+            if (event >= 0) {
+                dispatch(conn, event);
+            } else {
+                struct epoll_event again = { .events = EPOLLONESHOT | EPOLLRDHUP | EPOLLIN, .data.ptr = conn };
+                if (conn->want_writable) again.events |= EPOLLOUT;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &again);
+            }
+        }
+        fire_timers();
+    }
+    return NULL;
+}
+
+// Serve connections accepted on a listening socket with handler
+int event_loop_listen(int listener, ConnectionHandler handler, int limited) {
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+    Connection *conn = calloc(1, sizeof(Connection));
+    conn->fd = listener;
+    conn->handler = handler;
+    conn->limited = limited;
+    conn->listening = 1;
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = conn };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener, &event) != 0) {
+        free(conn);
+        return -1;
+    }
+    return 0;
+}
+
+// Serve an already connected socket (the NS registration connection)
+int event_loop_add(int fd, ConnectionHandler handler) {
+    return add_connection(fd, handler, 0) != NULL ? 0 : -1;
+}
+
+int event_loop_start() {
+    pthread_t thread;
+    for (int i = 0; i < worker_count; i++) {
+        if (pthread_create(&thread, NULL, worker, NULL) != 0) return -1;
+        pthread_detach(thread);
+    }
+    for (int i = 0; i < blocking_count; i++) {
+        if (pthread_create(&thread, NULL, blocking_worker, NULL) != 0) return -1;
+        pthread_detach(thread);
+    }
+    if (pthread_create(&thread, NULL, loop_thread, NULL) != 0) return -1;
+    pthread_detach(thread);
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "Event loop started: %d worker(s), %d blocking, up to %d client connection(s)",
+             worker_count, blocking_count, max_connections);
+    log_message("event_loop", log_msg);
+    return 0;
+}
+
+// Deliver CONN_EVENT_TIMER as soon as possible, from any thread. The
+// connection must still be open (its handler has not seen CLOSE).
+void event_loop_wake(Connection *conn) {
+    pthread_mutex_lock(&loop_mutex);
+    conn->woken = 1;
+    if (!conn->busy) next_timer_us = 1;
+    pthread_mutex_unlock(&loop_mutex);
+    poke_loop();
+}
+
+void event_loop_stats(int *open_connections, int *requests) {
+    pthread_mutex_lock(&loop_mutex);
+    *open_connections = limited_count;
+    *requests = queued_requests;
+    pthread_mutex_unlock(&loop_mutex);
+}
+
+// Whether the workers have stopped making progress: the oldest queued
+// event has waited longer than limit_us for a worker to take it
+int event_loop_stalled(long long limit_us) {
+    pthread_mutex_lock(&loop_mutex);
+    int stalled = queue_head != NULL && now_us() - queue_head->queued_us > limit_us;
+    pthread_mutex_unlock(&loop_mutex);
+    return stalled;
+}
@@ -0,0 +1,67 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "protocol.h"
+
+#define DEFAULT_EVENT_WORKERS 8           // Threads running handlers
+#define DEFAULT_BLOCKING_WORKERS 4        // Threads running handlers that wait on commits or the disk
+#define DEFAULT_MAX_CONNECTIONS 1024      // Limited connections beyond this are turned away
+#define DEFAULT_SEND_TIMEOUT_SEC 30       // A reply blocked this long drops the connection
+#define DEFAULT_STALL_MS 10000            // A request waiting this long for a worker means the pool is wedged
+#define EVENT_BATCH 64
+
+// Why a handler is called. A connection is handed to one worker at a time,
+// so the handler's per-connection state needs no locking of its own.
+#define CONN_EVENT_OPEN 0       // Just accepted (or added)
+#define CONN_EVENT_MESSAGE 1    // A whole struct Message arrived in request
+#define CONN_EVENT_TIMER 2      // wake_us passed, or event_loop_wake() was called
+#define CONN_EVENT_WRITABLE 3   // The socket has room (want_writable was set)
+#define CONN_EVENT_CLOSE 4      // Peer hung up or the handler set closing: release state
+
+typedef struct Connection Connection;
+typedef void (*ConnectionHandler)(Connection *conn, int event);
+
+// One socket in the event loop. Requests are read by the loop thread
+// without blocking; handlers run on the worker pool and reply with the
+// usual blocking send_message. Between events a connection holds no thread.
+// A handler that would wait on something slow (a commit turn, an fsync, a
+// long reply) sets offload instead: the same event is then handed to that
+// function on the blocking pool, so the workers stay free for everyone else.
+// Times are gettimeofday() microseconds.
+struct Connection {
+    int fd;
+    ConnectionHandler handler;
+    void *state;                   // Owned by the handler
+    struct Message request;        // Valid for CONN_EVENT_MESSAGE
+    long long request_us;          // When the request was fully received
+
+    // Set by the handler before it returns
+    int want_input;                // Read the next request (otherwise only watch for hangup)
+    int want_writable;
+    ConnectionHandler offload;     // Finish this event here, on the blocking pool
+    long long wake_us;             // Deliver CONN_EVENT_TIMER at this time, 0 for none
+    int closing;
+
+    // Owned by the loop
+    int listening;                 // A listener: accepted sockets get 'handler'
+    int limited;                   // Counts against the connection limit
+    size_t received;               // Bytes of the next request read so far
+    int busy;                      // Queued for or held by a worker
+    int woken;                     // event_loop_wake() while busy
+    int pending;                   // Event to deliver
+    long long queued_us;           // When it was queued for a worker
+    struct Connection *prev;       // All connections
+    struct Connection *next;
+    struct Connection *queue_next; // Work queue
+};
+
+// Event loop functions
+void init_event_loop(int workers, int blocking_workers, int max_connections, int send_timeout_sec);
+int event_loop_listen(int listener, ConnectionHandler handler, int limited);
+int event_loop_add(int fd, ConnectionHandler handler);
+int event_loop_start();
+void event_loop_wake(Connection *conn);
+void event_loop_stats(int *connections, int *queued_requests);
+int event_loop_stalled(long long limit_us);
+
+#endif // EVENT_LOOP_H
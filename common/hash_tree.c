@@ -0,0 +1,244 @@
+#define _GNU_SOURCE
+#include "hash_tree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#define FNV_OFFSET 1469598103934665603ULL
+#define FNV_PRIME 1099511628211ULL
+#define HASH_CACHE_BUCKETS 1024
+
+// Content hashes are cached by path and only recomputed when the file's
+// size, mtime or inode changes, so repeated rounds over an idle tree are cheap.
+typedef struct HashCacheEntry {
+    char path[MAX_PATH];
+    off_t size;
+    struct timespec mtime;
+    ino_t ino;
+    uint64_t hash;
+    struct HashCacheEntry *next;
+} HashCacheEntry;
+
+static HashCacheEntry *hash_cache[HASH_CACHE_BUCKETS];
+static pthread_mutex_t hash_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// Finalizer so that summing leaf entries does not cancel out
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Files the tree ignores: hidden/temporary files and undo snapshots
+static int skip_name(const char *name) {
+    if (name[0] == '.') return 1;
+    size_t len = strlen(name);
+    return len > 7 && strcmp(name + len - 7, ".backup") == 0;
+}
+
+int htree_level_offset(int level) {
+    if (level <= 0) return 0;
+    if (level == 1) return 1;
+    return 1 + HTREE_FANOUT;
+}
+
+int htree_level_size(int level) {
+    if (level <= 0) return 1;
+    if (level == 1) return HTREE_FANOUT;
+    return HTREE_LEAVES;
+}
+
+unsigned int htree_bucket(const char *name) {
+    return (unsigned int)(fnv1a(FNV_OFFSET, name, strlen(name)) % HTREE_LEAVES);
+}
+
+static uint64_t hash_contents(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    char buffer[65536];
+    uint64_t hash = FNV_OFFSET;
+    ssize_t bytes;
+    while ((bytes = read(fd, buffer, sizeof(buffer))) > 0) {
+        hash = fnv1a(hash, buffer, bytes);
+    }
+    close(fd);
+    return hash;
+}
+
+// Hash a file's contents (cached by size/mtime/inode)
+uint64_t htree_hash_file(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) return 0;
+
+    unsigned int index = (unsigned int)(fnv1a(FNV_OFFSET, path, strlen(path)) % HASH_CACHE_BUCKETS);
+
+    pthread_mutex_lock(&hash_cache_lock);
+    HashCacheEntry *entry = hash_cache[index];
+    while (entry != NULL && strcmp(entry->path, path) != 0) {
+        entry = entry->next;
+    }
+    if (entry != NULL && entry->size == st.st_size && entry->ino == st.st_ino &&
+        entry->mtime.tv_sec == st.st_mtim.tv_sec && entry->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+        uint64_t hash = entry->hash;
+        pthread_mutex_unlock(&hash_cache_lock);
+        return hash;
+    }
+    pthread_mutex_unlock(&hash_cache_lock);
+
+    uint64_t hash = hash_contents(path);
+
+    pthread_mutex_lock(&hash_cache_lock);
+    entry = hash_cache[index];
+    while (entry != NULL && strcmp(entry->path, path) != 0) {
+        entry = entry->next;
+    }
+    if (entry == NULL) {
+        entry = calloc(1, sizeof(HashCacheEntry));
+        strncpy(entry->path, path, sizeof(entry->path) - 1);
+        entry->next = hash_cache[index];
+        hash_cache[index] = entry;
+    }
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtim;
+    entry->ino = st.st_ino;
+    entry->hash = hash;
+    pthread_mutex_unlock(&hash_cache_lock);
+    return hash;
+}
+
+static uint64_t entry_hash(const char *name, uint64_t content_hash) {
+    return mix64(fnv1a(FNV_OFFSET, name, strlen(name)) ^ mix64(content_hash));
+}
+
+typedef void (*FileVisitor)(const char *name, const char *path, void *context);
+
+// Call visit(name, path) for every regular file under dir/prefix, where
+// name is the path relative to dir. Returns -1 if dir cannot be opened.
+static int walk_files(const char *dir, const char *prefix, FileVisitor visit, void *context) {
+    char path[MAX_PATH];
+    if (snprintf(path, sizeof(path), "%s%s", dir, prefix) >= (int)sizeof(path)) return -1;
+    DIR *d = opendir(path);
+    if (!d) return -1;
+
+    struct dirent *entry;
+    char name[MAX_FILENAME];
+    while ((entry = readdir(d)) != NULL) {
+        if (skip_name(entry->d_name)) continue;
+        int len = snprintf(name, sizeof(name), "%s%s", prefix, entry->d_name);
+        if (len >= (int)sizeof(name) - 1) continue;
+        if (entry->d_type == DT_DIR) {
+            if (prefix[0] == '\0' && strcmp(entry->d_name, HTREE_RESERVED_DIR) == 0) continue;
+            strcat(name, "/");
+            walk_files(dir, name, visit, context);
+        } else if (entry->d_type == DT_REG) {
+            if (snprintf(path, sizeof(path), "%s%s", dir, name) >= (int)sizeof(path)) continue;
+            visit(name, path, context);
+        }
+    }
+    closedir(d);
+    return 0;
+}
+
+static void add_to_tree(const char *name, const char *path, void *context) {
+    HashTree *tree = context;
+    uint64_t *leaves = tree->nodes + htree_level_offset(2);
+    // Order-independent combine so readdir order does not matter
+    leaves[htree_bucket(name)] += entry_hash(name, htree_hash_file(path));
+    tree->file_count++;
+}
+
+// Build the tree for every regular file under 'dir'
+int htree_build(HashTree *tree, const char *dir) {
+    memset(tree, 0, sizeof(*tree));
+    if (walk_files(dir, "", add_to_tree, tree) != 0) return -1;
+
+    for (int level = HTREE_LEVELS - 2; level >= 0; level--) {
+        uint64_t *parents = tree->nodes + htree_level_offset(level);
+        uint64_t *children = tree->nodes + htree_level_offset(level + 1);
+        for (int i = 0; i < htree_level_size(level); i++) {
+            parents[i] = fnv1a(FNV_OFFSET, children + i * HTREE_FANOUT,
+                               sizeof(uint64_t) * HTREE_FANOUT);
+        }
+    }
+    return tree->file_count;
+}
+
+typedef struct {
+    int bucket;
+    HashTreeFile *files;
+    int count;
+    int capacity;
+} BucketListing;
+
+static void add_to_bucket(const char *name, const char *path, void *context) {
+    BucketListing *listing = context;
+    if ((int)htree_bucket(name) != listing->bucket) return;
+    if (listing->count == listing->capacity) {
+        listing->capacity = listing->capacity ? listing->capacity * 2 : 8;
+        listing->files = realloc(listing->files, sizeof(HashTreeFile) * listing->capacity);
+    }
+    HashTreeFile *file = &listing->files[listing->count++];
+    strncpy(file->name, name, MAX_FILENAME - 1);
+    file->name[MAX_FILENAME - 1] = '\0';
+    file->hash = htree_hash_file(path);
+}
+
+// List the files in one leaf bucket with their content hashes.
+// Returns the count; *files is malloc'd and owned by the caller.
+int htree_bucket_files(const char *dir, int bucket, HashTreeFile **files) {
+    BucketListing listing = { bucket, NULL, 0, 0 };
+    walk_files(dir, "", add_to_bucket, &listing);
+    *files = listing.files;
+    return listing.count;
+}
+
+// Run the calling thread at the lowest CPU priority. Only for threads that
+// do nothing but background work: an unprivileged thread cannot raise its
+// priority again afterwards.
+void htree_lower_priority() {
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+}
+
+typedef struct {
+    void (*work)(void *);
+    void *arg;
+} LowPriorityJob;
+
+static void* low_priority_thread(void *arg) {
+    LowPriorityJob *job = arg;
+    htree_lower_priority();
+    job->work(job->arg);
+    return NULL;
+}
+
+// Run work(arg) on a short-lived thread at the lowest CPU priority and wait
+// for it, so the caller (e.g. a request worker) keeps its own priority
+void htree_run_low_priority(void (*work)(void *), void *arg) {
+    LowPriorityJob job = { work, arg };
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, low_priority_thread, &job) != 0) {
+        work(arg);
+        return;
+    }
+    pthread_join(thread, NULL);
+}
@@ -0,0 +1,38 @@
+#ifndef HASH_TREE_H
+#define HASH_TREE_H
+
+#include <stdint.h>
+#include "protocol.h"
+
+// Fixed-shape hash tree over the files under one directory, named by their
+// path relative to it ("folder/file.txt"). Hidden files and the SS's
+// top-level checkpoints/ directory are left out. Files are placed in leaf
+// buckets by name hash, so two directories with the same files always
+// produce the same shape and can be compared level by level.
+#define HTREE_FANOUT 16
+#define HTREE_LEVELS 3                        // root, interior, leaves
+#define HTREE_LEAVES (HTREE_FANOUT * HTREE_FANOUT)
+#define HTREE_NODES (1 + HTREE_FANOUT + HTREE_LEAVES)
+#define HTREE_RESERVED_DIR "checkpoints"
+
+typedef struct {
+    uint64_t nodes[HTREE_NODES];  // Level-ordered: root, interior, leaves
+    int file_count;
+} HashTree;
+
+typedef struct {
+    char name[MAX_FILENAME];
+    uint64_t hash;
+} HashTreeFile;
+
+// Hash tree functions
+int htree_build(HashTree *tree, const char *dir);
+int htree_level_offset(int level);
+int htree_level_size(int level);
+unsigned int htree_bucket(const char *name);
+int htree_bucket_files(const char *dir, int bucket, HashTreeFile **files);
+uint64_t htree_hash_file(const char *path);
+void htree_lower_priority();
+void htree_run_low_priority(void (*work)(void *), void *arg);
+
+#endif // HASH_TREE_H
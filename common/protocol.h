@@ -33,12 +33,22 @@
 #define MSG_SHUTDOWN 34
 #define MSG_REPLICATE 35
 #define MSG_LIST_SS 36
+#define MSG_SYNC_REQUEST 37
+#define MSG_SYNC_DELTA 38
+#define MSG_TREE_NODES 39
+#define MSG_TREE_BUCKET 40
+#define MSG_FETCH_BACKUP 41
+#define MSG_VERSION_PUSH 42
+#define MSG_BACKUP_PUSH 43
+#define MSG_BACKUP_DATA 44
+#define MSG_DIFF 45
 
 // Response types
 #define RESP_SUCCESS 200
 #define RESP_SS_INFO 201
 #define RESP_DATA 202
 #define RESP_ACK 203
+#define RESP_QUEUED 204
 
 // Error codes
 #define ERR_FILE_NOT_FOUND 404
@@ -95,12 +105,98 @@ struct FileInfo {
     int char_count;
 };
 
+// Delta sync: MSG_SYNC_DELTA carries manifest entries in data, one per line,
+// formatted as "<generation>\t<deleted>\t<filename>\n". The sender's manifest
+// epoch is in checkpoint_tag. The last batch of an exchange has SYNC_FLAG_LAST
+// set in flags.
+#define SYNC_FLAG_LAST 1
+
+// Version push: the SS opens its own connection to the NS and sends
+// MSG_VERSION_PUSH with data "<ss_id> <epoch> <generation>". The NS answers
+// with "SINCE <generation>", then the SS pushes MSG_SYNC_DELTA exchanges as
+// files change and the NS acks each one with RESP_ACK, data "<generation>".
+
+// Backup stream: the SS opens another connection with MSG_BACKUP_PUSH, data
+// "<ss_id> <epoch>", and is answered "SINCE <generation>" (the newest backup
+// generation the NS holds). Each batch is a run of MSG_BACKUP_DATA messages:
+// per file, LZ-compressed contents split across messages with filename set,
+// checkpoint_tag "<generation> <raw length>" and BACKUP_FLAG_END on the last
+// piece; then a trailer with no filename, checkpoint_tag "<generation>" and
+// SYNC_FLAG_LAST, which the NS acks with RESP_ACK.
+#define BACKUP_FLAG_DELETED 2   // File was deleted; no contents follow
+#define BACKUP_FLAG_END 4       // Last piece of this file
+#define BACKUP_FLAG_RAW 8       // Contents sent uncompressed (did not shrink)
+
+// Waiting WRITE: a MSG_WRITE to the SS with WRITE_FLAG_WAIT in flags queues
+// for a locked sentence instead of failing, for up to word_index seconds (0
+// means the SS default). While queued the SS sends RESP_QUEUED with the
+// queue position in word_index and the holder in data; then the usual
+// reply follows, with sentence_num set to where the sentence is now.
+#define WRITE_FLAG_WAIT 1
+
+// Batched edits: inside a WRITE session, a message with WRITE_FLAG_BATCH
+// carries an ordered list of word edits in data, one per line:
+//   I <index> <text>     insert the words of text before word index
+//   D <index> [count]    delete count words (default 1) from index
+//   R <index> <text>     replace the word at index with the words of text
+// I and R need text (an empty one is ERR_INVALID_REQUEST; D deletes).
+// Indexes refer to the sentence as left by the previous line. The list is
+// applied all or nothing and answered once: RESP_SUCCESS with the new word
+// count in word_index and the sentence in data, or ERR_WORD_OUT_OF_RANGE /
+// ERR_INVALID_REQUEST naming the failing line. With WRITE_FLAG_COMMIT as
+// well, a successful batch is committed as if ETIRW followed.
+#define WRITE_FLAG_BATCH 2
+#define WRITE_FLAG_COMMIT 4
+
+// STREAM pacing: a MSG_STREAM to the SS asks for word_index words per
+// second (0 means the SS default, STREAM_UNTHROTTLED as fast as the client
+// reads). Text arrives as RESP_DATA frames holding whole words with their
+// whitespace, word_index counting the words completed in the frame; the
+// closing RESP_SUCCESS carries "STREAM_END <words> <frames> <rate>".
+#define STREAM_UNTHROTTLED -1
+
+// Ranged READ: a MSG_READ with READ_FLAG_RANGE reads only the bytes
+// "<offset> <length>" given in data; with READ_FLAG_SENTENCES it reads
+// sentences sentence_num..word_index (inclusive, numbered as in WRITE).
+// The SS answers every READ with RESP_DATA frames and a closing
+// RESP_SUCCESS carrying "<offset> <length> <size>", plus
+// " <first> <last> <sentence count>" for sentence reads.
+#define READ_FLAG_RANGE 1
+#define READ_FLAG_SENTENCES 2
+
+// Anti-entropy: MSG_TREE_NODES asks for hash tree nodes with data
+// "<level> <index> <index> ..." and is answered with "<index> <hash>\n" lines
+// (hash in hex). MSG_TREE_BUCKET asks for leaf bucket "<index>" and
+// MSG_FETCH_BACKUP for a file's contents; both answer in batches, the last
+// one flagged SYNC_FLAG_LAST.
+
+// Storage server load report, piggybacked on heartbeat replies
+// (see format_load_report/parse_load_report). Latencies are in microseconds
+// over the most recent requests of each kind.
+#define LOAD_OP_READ 0
+#define LOAD_OP_WRITE 1    // Commit of a WRITE session (ETIRW), not think time
+#define LOAD_OP_STREAM 2
+#define LOAD_OP_OTHER 3
+#define LOAD_OP_COUNT 4
+
+struct SSLoadReport {
+    int active_connections;
+    int active_locks;
+    int queued_requests;          // Requests waiting for a worker
+    long long bytes_stored;
+    long long disk_free;
+    long p50_us[LOAD_OP_COUNT];
+    long p99_us[LOAD_OP_COUNT];
+};
+
 // Storage server registration info
 struct SSRegistration {
     char ss_id[64];
     char ip[16];
     int nm_port;
     int client_port;
+    unsigned long epoch;        // Manifest identity (0 = no delta sync support)
+    unsigned long generation;   // Highest manifest generation on the SS
     int file_count;
     char files[MAX_FILES][MAX_FILENAME];
 };
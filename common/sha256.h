@@ -0,0 +1,26 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SHA-256 (FIPS 180-4), for naming content that is deduplicated by hash:
+// unlike the FNV hashes used for change detection, two different inputs
+// will not collide in practice.
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_HEX_SIZE 64
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;          // Bytes hashed so far
+    unsigned char block[64];
+    size_t used;              // Bytes waiting in block
+} Sha256;
+
+// SHA-256 functions
+void sha256_init(Sha256 *ctx);
+void sha256_update(Sha256 *ctx, const void *data, size_t length);
+void sha256_final(Sha256 *ctx, unsigned char digest[SHA256_DIGEST_SIZE]);
+void sha256_hex(const void *data, size_t length, char hex[SHA256_HEX_SIZE + 1]);
+
+#endif // SHA256_H
@@ -0,0 +1,215 @@
+#include "text_count.h"
+#include "utils.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+#define CLASS_SPACE 1
+#define CLASS_EOL 2
+#define CLASS_DELIM 4
+#define READ_BUFFER_SIZE (1024 * 1024)   // When a file cannot be mmap'd
+
+typedef void (*CountKernel)(TextCounts *counts, const unsigned char *data, size_t length);
+
+static unsigned char byte_class[256];
+static CountKernel kernel;
+static const char *kernel_name;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+// Fold the masks of one 64-byte block (bit i = byte i) into the counts
+static void count_masks(TextCounts *counts, uint64_t space, uint64_t eol, uint64_t delim) {
+    uint64_t word = ~space;
+    uint64_t starts = word & ~((word << 1) | (uint64_t)counts->in_word);
+    counts->words += __builtin_popcountll(starts);
+    counts->in_word = word >> 63;
+    counts->bytes += 64;
+    counts->chars += 64 - __builtin_popcountll(eol);
+
+    uint64_t text = word & ~delim;
+    if (delim) {
+        counts->sentences += __builtin_popcountll(delim);
+        int last = 63 - __builtin_clzll(delim);
+        counts->open_sentence = ((text >> last) >> 1) != 0;
+    } else if (text) {
+        counts->open_sentence = 1;
+    }
+}
+
+// One table lookup per byte; also counts the tails of the SIMD kernels
+static void count_scalar(TextCounts *counts, const unsigned char *data, size_t length) {
+    unsigned long long eol = 0, words = 0, sentences = 0;
+    int in_word = counts->in_word, open_sentence = counts->open_sentence;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char cls = byte_class[data[i]];
+        eol += (cls & CLASS_EOL) != 0;
+        if (cls & CLASS_SPACE) {
+            in_word = 0;
+            continue;
+        }
+        words += !in_word;
+        in_word = 1;
+        if (cls & CLASS_DELIM) {
+            sentences++;
+            open_sentence = 0;
+        } else {
+            open_sentence = 1;
+        }
+    }
+    counts->bytes += length;
+    counts->chars += length - eol;
+    counts->words += words;
+    counts->sentences += sentences;
+    counts->in_word = in_word;
+    counts->open_sentence = open_sentence;
+}
+
+#ifdef HAVE_X86_KERNELS
+// Whitespace is ' ' or 0x09..0x0d: (b - 9) <= 4 unsigned, tested as
+// min(b - 9, 4) == b - 9 since SSE2 has no unsigned compare
+static void count_sse2(TextCounts *counts, const unsigned char *data, size_t length) {
+    const __m128i blank = _mm_set1_epi8(' '), nine = _mm_set1_epi8(9), four = _mm_set1_epi8(4);
+    const __m128i newline = _mm_set1_epi8('\n'), ret = _mm_set1_epi8('\r');
+    const __m128i dot = _mm_set1_epi8('.'), bang = _mm_set1_epi8('!'), ask = _mm_set1_epi8('?');
+    while (length >= 64) {
+        uint64_t space = 0, eol = 0, delim = 0;
+        for (int i = 0; i < 4; i++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(data + 16 * i));
+            __m128i shifted = _mm_sub_epi8(v, nine);
+            __m128i s = _mm_or_si128(_mm_cmpeq_epi8(v, blank),
+                                     _mm_cmpeq_epi8(_mm_min_epu8(shifted, four), shifted));
+            __m128i e = _mm_or_si128(_mm_cmpeq_epi8(v, newline), _mm_cmpeq_epi8(v, ret));
+            __m128i d = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, dot), _mm_cmpeq_epi8(v, bang)),
+                                     _mm_cmpeq_epi8(v, ask));
+            space |= (uint64_t)(uint16_t)_mm_movemask_epi8(s) << (16 * i);
+            eol |= (uint64_t)(uint16_t)_mm_movemask_epi8(e) << (16 * i);
+            delim |= (uint64_t)(uint16_t)_mm_movemask_epi8(d) << (16 * i);
+        }
+        count_masks(counts, space, eol, delim);
+        data += 64;
+        length -= 64;
+    }
+    count_scalar(counts, data, length);
+}
+
+__attribute__((target("avx2")))
+static void count_avx2(TextCounts *counts, const unsigned char *data, size_t length) {
+    const __m256i blank = _mm256_set1_epi8(' '), nine = _mm256_set1_epi8(9), four = _mm256_set1_epi8(4);
+    const __m256i newline = _mm256_set1_epi8('\n'), ret = _mm256_set1_epi8('\r');
+    const __m256i dot = _mm256_set1_epi8('.'), bang = _mm256_set1_epi8('!'), ask = _mm256_set1_epi8('?');
+    while (length >= 64) {
+        uint64_t space = 0, eol = 0, delim = 0;
+        for (int i = 0; i < 2; i++) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(data + 32 * i));
+            __m256i shifted = _mm256_sub_epi8(v, nine);
+            __m256i s = _mm256_or_si256(_mm256_cmpeq_epi8(v, blank),
+                                        _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, four), shifted));
+            __m256i e = _mm256_or_si256(_mm256_cmpeq_epi8(v, newline), _mm256_cmpeq_epi8(v, ret));
+            __m256i d = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, dot), _mm256_cmpeq_epi8(v, bang)),
+                                        _mm256_cmpeq_epi8(v, ask));
+            space |= (uint64_t)(uint32_t)_mm256_movemask_epi8(s) << (32 * i);
+            eol |= (uint64_t)(uint32_t)_mm256_movemask_epi8(e) << (32 * i);
+            delim |= (uint64_t)(uint32_t)_mm256_movemask_epi8(d) << (32 * i);
+        }
+        count_masks(counts, space, eol, delim);
+        data += 64;
+        length -= 64;
+    }
+    count_scalar(counts, data, length);
+}
+#endif
+
+static void choose_kernel() {
+    for (int c = 0x09; c <= 0x0d; c++) byte_class[c] |= CLASS_SPACE;
+    byte_class[' '] |= CLASS_SPACE;
+    byte_class['\n'] |= CLASS_EOL;
+    byte_class['\r'] |= CLASS_EOL;
+    byte_class['.'] |= CLASS_DELIM;
+    byte_class['!'] |= CLASS_DELIM;
+    byte_class['?'] |= CLASS_DELIM;
+
+    const char *forced = get_config_string("DOCSPP_COUNT_KERNEL", "");
+    kernel = count_scalar;
+    kernel_name = "scalar";
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (strcasecmp(forced, "scalar") == 0) return;
+    if (strcasecmp(forced, "sse2") != 0 && __builtin_cpu_supports("avx2")) {
+        kernel = count_avx2;
+        kernel_name = "avx2";
+    } else {
+        kernel = count_sse2;
+        kernel_name = "sse2";
+    }
+#else
+    (void)forced;
+#endif
+}
+
+void text_count_init(TextCounts *counts) {
+    memset(counts, 0, sizeof(*counts));
+}
+
+// Add more of the same text; may be called with pieces of any size
+void text_count_update(TextCounts *counts, const char *data, size_t length) {
+    pthread_once(&kernel_once, choose_kernel);
+    kernel(counts, (const unsigned char *)data, length);
+}
+
+// Count the unterminated last sentence, once all text has been added
+void text_count_finish(TextCounts *counts) {
+    if (counts->open_sentence) counts->sentences++;
+    counts->open_sentence = 0;
+}
+
+void text_count_buffer(const char *data, size_t length, TextCounts *counts) {
+    text_count_init(counts);
+    text_count_update(counts, data, length);
+    text_count_finish(counts);
+}
+
+// Count a whole file, mapped if possible. Returns 0, or -1 if it cannot
+// be opened or read.
+int text_count_file(const char *path, TextCounts *counts) {
+    text_count_init(counts);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    int result = 0;
+    void *map = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (map != MAP_FAILED) {
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        text_count_update(counts, map, st.st_size);
+        munmap(map, st.st_size);
+    } else {
+        char *buffer = malloc(READ_BUFFER_SIZE);
+        ssize_t bytes;
+        while ((bytes = read(fd, buffer, READ_BUFFER_SIZE)) > 0) {
+            text_count_update(counts, buffer, bytes);
+        }
+        if (bytes < 0) result = -1;
+        free(buffer);
+    }
+    close(fd);
+    text_count_finish(counts);
+    return result;
+}
+
+const char* text_count_kernel() {
+    pthread_once(&kernel_once, choose_kernel);
+    return kernel_name;
+}
@@ -0,0 +1,32 @@
+#ifndef TEXT_COUNT_H
+#define TEXT_COUNT_H
+
+#include <stddef.h>
+
+// One-pass text statistics for INFO, VIEW -l and backup stats. Counted the
+// way the storage server parses files:
+//   bytes     - every byte
+//   chars     - bytes other than '\n' and '\r'
+//   words     - runs of non-whitespace (isspace in the C locale)
+//   sentences - one per '.', '!' or '?', plus a trailing unterminated one
+// Input is classified 64 bytes at a time into bitmasks by an SSE2 or AVX2
+// kernel (picked at startup from the CPU, or forced with
+// DOCSPP_COUNT_KERNEL=scalar|sse2|avx2), so counting runs at memory speed.
+typedef struct {
+    unsigned long long bytes;
+    unsigned long long chars;
+    unsigned long long words;
+    unsigned long long sentences;
+    int in_word;          // Last byte seen was part of a word
+    int open_sentence;    // Text seen since the last delimiter
+} TextCounts;
+
+// Text counting functions
+void text_count_init(TextCounts *counts);
+void text_count_update(TextCounts *counts, const char *data, size_t length);
+void text_count_finish(TextCounts *counts);
+void text_count_buffer(const char *data, size_t length, TextCounts *counts);
+int text_count_file(const char *path, TextCounts *counts);
+const char* text_count_kernel();
+
+#endif // TEXT_COUNT_H
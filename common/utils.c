@@ -1,11 +1,13 @@
 #include "utils.h"
 #include "protocol.h"
+#include "text_count.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <ctype.h>
+#include <errno.h>
 
 // Logging functions
 void log_message(const char *component, const char *message) {
@@ -79,12 +81,21 @@ char* trim_whitespace(char *str) {
 
 // Network utilities
 int send_message(int socket, struct Message *msg) {
-    int bytes_sent = send(socket, msg, sizeof(struct Message), 0);
-    if (bytes_sent < 0) {
-        log_error("network", "Failed to send message");
-        return -1;
+    const char *buffer = (const char*)msg;
+    size_t sent = 0;
+    while (sent < sizeof(struct Message)) {
+        ssize_t bytes = send(socket, buffer + sent, sizeof(struct Message) - sent, MSG_NOSIGNAL);
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) {
+            // A message cut short (send timeout) would desynchronize the
+            // stream; end the connection rather than send the rest late
+            if (sent > 0) shutdown(socket, SHUT_RDWR);
+            log_error("network", "Failed to send message");
+            return -1;
+        }
+        sent += bytes;
     }
-    return bytes_sent;
+    return (int)sent;
 }
 
 int recv_message(int socket, struct Message *msg) {
@@ -119,37 +130,16 @@ long get_file_size(const char *filename) {
 }
 
 int count_words(const char *filename) {
-    FILE *fp = fopen(filename, "r");
-    if (!fp) return 0;
-    
-    int count = 0;
-    char ch;
-    int in_word = 0;
-    
-    while ((ch = fgetc(fp)) != EOF) {
-        if (isspace(ch)) {
-            in_word = 0;
-        } else if (!in_word) {
-            in_word = 1;
-            count++;
-        }
-    }
-    
-    fclose(fp);
-    return count;
+    TextCounts counts;
+    if (text_count_file(filename, &counts) != 0) return 0;
+    return (int)counts.words;
 }
 
+// Every byte, newlines included (INFO leaves them out)
 int count_chars(const char *filename) {
-    FILE *fp = fopen(filename, "r");
-    if (!fp) return 0;
-    
-    int count = 0;
-    while (fgetc(fp) != EOF) {
-        count++;
-    }
-    
-    fclose(fp);
-    return count;
+    TextCounts counts;
+    if (text_count_file(filename, &counts) != 0) return 0;
+    return (int)counts.bytes;
 }
 
 // Time utilities
@@ -159,3 +149,55 @@ char* format_time(time_t t) {
     strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", tm_info);
     return buffer;
 }
+
+// Encode a load report as "L1 <conns> <locks> <queued> <stored> <free>"
+// followed by "<p50> <p99>" for each operation kind
+int format_load_report(const struct SSLoadReport *report, char *buffer, size_t size) {
+    int len = snprintf(buffer, size, "L1 %d %d %d %lld %lld",
+                       report->active_connections, report->active_locks,
+                       report->queued_requests, report->bytes_stored, report->disk_free);
+    for (int op = 0; op < LOAD_OP_COUNT && len > 0 && (size_t)len < size; op++) {
+        len += snprintf(buffer + len, size - len, " %ld %ld", report->p50_us[op], report->p99_us[op]);
+    }
+    return len;
+}
+
+// Decode a report produced by format_load_report; returns 0 on success
+int parse_load_report(const char *text, struct SSLoadReport *report) {
+    const char *p = strstr(text, "L1 ");
+    if (p == NULL) return -1;
+
+    memset(report, 0, sizeof(*report));
+    int offset = 0;
+    if (sscanf(p, "L1 %d %d %d %lld %lld%n", &report->active_connections,
+               &report->active_locks, &report->queued_requests,
+               &report->bytes_stored, &report->disk_free, &offset) != 5) {
+        return -1;
+    }
+    p += offset;
+    for (int op = 0; op < LOAD_OP_COUNT; op++) {
+        if (sscanf(p, " %ld %ld%n", &report->p50_us[op], &report->p99_us[op], &offset) != 2) break;
+        p += offset;
+    }
+    return 0;
+}
+
+// Read an integer setting from the environment, falling back to a default
+int get_config_int(const char *name, int default_value) {
+    const char *value = getenv(name);
+    if (value == NULL || *value == '\0') {
+        return default_value;
+    }
+    char *end;
+    long parsed = strtol(value, &end, 10);
+    if (*end != '\0') {
+        return default_value;
+    }
+    return (int)parsed;
+}
+
+// Read a string setting from the environment, falling back to a default
+const char* get_config_string(const char *name, const char *default_value) {
+    const char *value = getenv(name);
+    return value != NULL && *value != '\0' ? value : default_value;
+}
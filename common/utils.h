@@ -28,4 +28,12 @@ int count_chars(const char *filename);
 // Time utilities
 char* format_time(time_t t);
 
+// Load report utilities (compact text form used in heartbeat replies)
+int format_load_report(const struct SSLoadReport *report, char *buffer, size_t size);
+int parse_load_report(const char *text, struct SSLoadReport *report);
+
+// Configuration utilities (DOCSPP_* environment variables)
+int get_config_int(const char *name, int default_value);
+const char* get_config_string(const char *name, const char *default_value);
+
 #endif // UTILS_H
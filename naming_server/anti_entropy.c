@@ -0,0 +1,313 @@
+#include "anti_entropy.h"
+#include "content_cache.h"
+#include "../common/hash_tree.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define NODE_BATCH 128  // Node indices per MSG_TREE_NODES request
+
+// Per-round traffic counters (only touched by the anti-entropy thread)
+static int round_messages;
+static long round_bytes;
+
+static int ae_connect(StorageServer *ss) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(ss->nm_port);
+    inet_pton(AF_INET, ss->ip, &addr.sin_addr);
+
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static int ae_recv(int sock, struct Message *msg) {
+    if (recv_message(sock, msg) <= 0) return -1;
+    round_messages++;
+    round_bytes += msg->data_length;
+    return 0;
+}
+
+// Fetch the hashes of the given nodes of one level into out[index]
+static int fetch_nodes(int sock, int level, const int *indices, int count, uint64_t *out) {
+    struct Message msg;
+    for (int start = 0; start < count; start += NODE_BATCH) {
+        memset(&msg, 0, sizeof(msg));
+        msg.type = MSG_TREE_NODES;
+        size_t used = snprintf(msg.data, sizeof(msg.data), "%d", level);
+        for (int i = start; i < count && i < start + NODE_BATCH; i++) {
+            used += snprintf(msg.data + used, sizeof(msg.data) - used, " %d", indices[i]);
+        }
+        if (send_message(sock, &msg) < 0 || ae_recv(sock, &msg) < 0) return -1;
+        if (msg.error_code != RESP_SUCCESS) return -1;
+
+        char *saveptr = NULL;
+        char *line = strtok_r(msg.data, "\n", &saveptr);
+        while (line != NULL) {
+            int index;
+            unsigned long long hash;
+            if (sscanf(line, "%d %llx", &index, &hash) == 2 &&
+                index >= 0 && index < htree_level_size(level)) {
+                out[index] = hash;
+            }
+            line = strtok_r(NULL, "\n", &saveptr);
+        }
+    }
+    return 0;
+}
+
+// Fetch the remote file list of one leaf bucket
+static int fetch_bucket(int sock, int bucket, HashTreeFile **files) {
+    struct Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_TREE_BUCKET;
+    snprintf(msg.data, sizeof(msg.data), "%d", bucket);
+    if (send_message(sock, &msg) < 0) return -1;
+
+    int count = 0, capacity = 0;
+    *files = NULL;
+    do {
+        if (ae_recv(sock, &msg) < 0 || msg.error_code != RESP_SUCCESS) {
+            free(*files);
+            *files = NULL;
+            return -1;
+        }
+        msg.data[sizeof(msg.data) - 1] = '\0';
+
+        char *saveptr = NULL;
+        char *line = strtok_r(msg.data, "\n", &saveptr);
+        while (line != NULL) {
+            unsigned long long hash;
+            int name_offset = 0;
+            if (sscanf(line, "%llx\t%n", &hash, &name_offset) == 1 && name_offset > 0) {
+                if (count == capacity) {
+                    capacity = capacity ? capacity * 2 : 8;
+                    *files = realloc(*files, sizeof(HashTreeFile) * capacity);
+                }
+                strncpy((*files)[count].name, line + name_offset, MAX_FILENAME - 1);
+                (*files)[count].name[MAX_FILENAME - 1] = '\0';
+                (*files)[count].hash = hash;
+                count++;
+            }
+            line = strtok_r(NULL, "\n", &saveptr);
+        }
+    } while (!(msg.flags & SYNC_FLAG_LAST));
+    return count;
+}
+
+static void make_parent_dirs(const char *path) {
+    char dirpath[MAX_PATH];
+    strncpy(dirpath, path, sizeof(dirpath) - 1);
+    dirpath[sizeof(dirpath) - 1] = '\0';
+    for (char *p = dirpath + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(dirpath, 0777);
+            *p = '/';
+        }
+    }
+}
+
+// Replace the backup copy of one file with the SS's current contents
+static int repair_file(int sock, const char *dir, const char *name) {
+    struct Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_FETCH_BACKUP;
+    strncpy(msg.filename, name, sizeof(msg.filename) - 1);
+    if (send_message(sock, &msg) < 0) return -1;
+
+    // Files in folders are repaired in place; the temp file is a hidden
+    // sibling so the tree walk skips it
+    char path[MAX_PATH], tmp_path[MAX_PATH];
+    const char *slash = strrchr(name, '/');
+    int folder_len = slash ? (int)(slash - name + 1) : 0;
+    int fd = -1;
+    if (name[0] != '/' && strstr(name, "..") == NULL &&
+        snprintf(path, sizeof(path), "%s%s", dir, name) < (int)sizeof(path) &&
+        snprintf(tmp_path, sizeof(tmp_path), "%s%.*s.%s.ae_tmp", dir, folder_len, name,
+                 name + folder_len) < (int)sizeof(tmp_path)) {
+        make_parent_dirs(path);
+        fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    int ok = (fd >= 0);
+    do {
+        if (ae_recv(sock, &msg) < 0) {
+            if (fd >= 0) {
+                close(fd);
+                unlink(tmp_path);
+            }
+            return -1;
+        }
+        if (msg.error_code != RESP_SUCCESS) {
+            ok = 0;
+        } else if (ok && msg.data_length > 0 &&
+                   write(fd, msg.data, msg.data_length) != msg.data_length) {
+            ok = 0;
+        }
+    } while (!(msg.flags & SYNC_FLAG_LAST));
+
+    if (fd < 0) return 0;
+    close(fd);
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return 0;  // File vanished on the SS - next round will see it
+    }
+    // A cached copy may be the version this repair replaced
+    cache_invalidate(name + folder_len);
+    return 1;
+}
+
+static int find_file(HashTreeFile *files, int count, const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(files[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+// Repair one leaf bucket: fetch changed/missing files, drop stale copies
+static int repair_bucket(int sock, const char *dir, int bucket) {
+    HashTreeFile *remote = NULL, *local = NULL;
+    int remote_count = fetch_bucket(sock, bucket, &remote);
+    if (remote_count < 0) return -1;
+    int local_count = htree_bucket_files(dir, bucket, &local);
+
+    int repaired = 0;
+    for (int i = 0; i < remote_count; i++) {
+        int j = find_file(local, local_count, remote[i].name);
+        if (j >= 0 && local[j].hash == remote[i].hash) continue;
+        int result = repair_file(sock, dir, remote[i].name);
+        if (result < 0) {
+            repaired = -1;
+            break;
+        }
+        repaired += result;
+    }
+
+    for (int j = 0; repaired >= 0 && j < local_count; j++) {
+        if (find_file(remote, remote_count, local[j].name) < 0) {
+            char path[MAX_PATH];
+            snprintf(path, sizeof(path), "%s%s", dir, local[j].name);
+            if (unlink(path) == 0) repaired++;
+        }
+    }
+
+    free(remote);
+    free(local);
+    return repaired;
+}
+
+// Compare the NS backup of one SS with the SS itself, descending only into
+// subtrees whose hashes differ. Returns the number of files repaired.
+int anti_entropy_round(StorageServer *ss) {
+    char dir[MAX_PATH];
+    snprintf(dir, sizeof(dir), "%s%s/", BACKUP_BASE_DIR, ss->id);
+    mkdir(BACKUP_BASE_DIR, 0777);
+    mkdir(dir, 0777);
+
+    if (ss->ae_socket < 0) {
+        ss->ae_socket = ae_connect(ss);
+        if (ss->ae_socket < 0) return -1;
+    }
+    int sock = ss->ae_socket;
+
+    HashTree local;
+    htree_build(&local, dir);
+    round_messages = 0;
+    round_bytes = 0;
+
+    uint64_t remote[HTREE_LEAVES];
+    int candidates[HTREE_LEAVES];
+    int candidate_count = 1;
+    candidates[0] = 0;
+    int nodes_compared = 0;
+
+    // Walk down the tree keeping only the nodes that differ
+    int level;
+    for (level = 0; level < HTREE_LEVELS && candidate_count > 0; level++) {
+        if (fetch_nodes(sock, level, candidates, candidate_count, remote) < 0) goto fail;
+        nodes_compared += candidate_count;
+
+        uint64_t *mine = local.nodes + htree_level_offset(level);
+        int differing[HTREE_LEAVES];
+        int differing_count = 0;
+        for (int i = 0; i < candidate_count; i++) {
+            if (mine[candidates[i]] != remote[candidates[i]]) {
+                differing[differing_count++] = candidates[i];
+            }
+        }
+
+        if (level == HTREE_LEVELS - 1) {
+            memcpy(candidates, differing, sizeof(int) * differing_count);
+            candidate_count = differing_count;
+            break;
+        }
+
+        candidate_count = 0;
+        for (int i = 0; i < differing_count; i++) {
+            for (int c = 0; c < HTREE_FANOUT; c++) {
+                candidates[candidate_count++] = differing[i] * HTREE_FANOUT + c;
+            }
+        }
+    }
+
+    int repaired = 0;
+    if (level == HTREE_LEVELS - 1) {
+        for (int i = 0; i < candidate_count; i++) {
+            int result = repair_bucket(sock, dir, candidates[i]);
+            if (result < 0) goto fail;
+            repaired += result;
+        }
+    }
+
+    if (repaired > 0 || candidate_count > 0) {
+        char log_msg[256];
+        snprintf(log_msg, sizeof(log_msg),
+                 "Anti-entropy %s: %d nodes compared, %d buckets differed, %d files repaired, %ld bytes in %d messages",
+                 ss->id, nodes_compared, candidate_count, repaired, round_bytes, round_messages);
+        log_message("naming_server", log_msg);
+        printf("✓ Anti-entropy repaired %d backup file(s) for %s\n", repaired, ss->id);
+    }
+    return repaired;
+
+fail:
+    close(ss->ae_socket);
+    ss->ae_socket = -1;
+    return -1;
+}
+
+// Background thread: periodically reconciles every active SS at low priority
+void* anti_entropy_worker(void *arg) {
+    (void)arg;
+    int interval = get_config_int("DOCSPP_ANTI_ENTROPY_INTERVAL", DEFAULT_ANTI_ENTROPY_INTERVAL);
+    if (interval <= 0) return NULL;
+
+    htree_lower_priority();
+    printf("✓ Anti-entropy worker started (every %d s)\n", interval);
+
+    while (!shutdown_flag) {
+        sleep(interval);
+
+        for (StorageServer *ss = storage_servers; ss != NULL; ss = ss->next) {
+            if (!ss->is_active || ss->failed || ss->nm_port <= 0) continue;
+            // A stale connection from before an SS restart fails once; retry fresh
+            if (anti_entropy_round(ss) < 0) {
+                anti_entropy_round(ss);
+            }
+        }
+    }
+    return NULL;
+}
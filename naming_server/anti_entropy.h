@@ -0,0 +1,13 @@
+#ifndef ANTI_ENTROPY_H
+#define ANTI_ENTROPY_H
+
+#include "storage_server_manager.h"
+
+#define BACKUP_BASE_DIR "./backups/"
+#define DEFAULT_ANTI_ENTROPY_INTERVAL 60   // Seconds between rounds (0 = off)
+
+// Anti-entropy functions
+int anti_entropy_round(StorageServer *ss);
+void* anti_entropy_worker(void *arg);
+
+#endif // ANTI_ENTROPY_H
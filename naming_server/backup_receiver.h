@@ -0,0 +1,11 @@
+#ifndef BACKUP_RECEIVER_H
+#define BACKUP_RECEIVER_H
+
+#include "storage_server_manager.h"
+
+#define BACKUP_MAX_FILE_BYTES (256L * 1024 * 1024)   // Refuse larger streamed files
+
+// Backup receiver functions
+void serve_backup_stream(StorageServer *ss, int socket, unsigned long epoch);
+
+#endif // BACKUP_RECEIVER_H
@@ -0,0 +1,243 @@
+#include "content_cache.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+typedef struct {
+    CacheEntry *buckets[CACHE_SHARD_BUCKETS];
+    CacheEntry *lru_head;
+    CacheEntry *lru_tail;
+    size_t bytes_used;
+    size_t budget;
+    unsigned long hits;
+    unsigned long misses;
+    pthread_mutex_t lock;
+} CacheShard;
+
+static CacheShard shards[CACHE_SHARDS];
+static int hot_reads = DEFAULT_CACHE_HOT_READS;
+
+static unsigned int cache_hash(const char *str) {
+    unsigned int hash = 5381;
+    int c;
+    while ((c = *str++))
+        hash = ((hash << 5) + hash) + c;
+    return hash;
+}
+
+static CacheShard* shard_for(const char *filename, unsigned int *bucket) {
+    unsigned int hash = cache_hash(filename);
+    *bucket = (hash / CACHE_SHARDS) % CACHE_SHARD_BUCKETS;
+    return &shards[hash % CACHE_SHARDS];
+}
+
+// Initialize the cache; the memory budget is split evenly across shards
+void init_content_cache() {
+    int budget_mb = get_config_int("DOCSPP_NS_CACHE_MB", DEFAULT_CACHE_BUDGET_MB);
+    if (budget_mb < 0) budget_mb = 0;
+    size_t shard_budget = ((size_t)budget_mb * 1024 * 1024) / CACHE_SHARDS;
+    hot_reads = get_config_int("DOCSPP_NS_READ_CACHE", DEFAULT_CACHE_HOT_READS);
+
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        memset(&shards[i], 0, sizeof(CacheShard));
+        shards[i].budget = shard_budget;
+        pthread_mutex_init(&shards[i].lock, NULL);
+    }
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "Content cache initialized (%d MB budget)", budget_mb);
+    log_message("naming_server", log_msg);
+}
+
+// Whether READs may be answered from memory while the owning SS is up
+int cache_hot_reads_enabled() {
+    return hot_reads;
+}
+
+static void lru_unlink(CacheShard *shard, CacheEntry *entry) {
+    if (entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+    else shard->lru_head = entry->lru_next;
+    if (entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+    else shard->lru_tail = entry->lru_prev;
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void lru_push_front(CacheShard *shard, CacheEntry *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = shard->lru_head;
+    if (shard->lru_head) shard->lru_head->lru_prev = entry;
+    else shard->lru_tail = entry;
+    shard->lru_head = entry;
+}
+
+static CacheEntry* find_entry(CacheShard *shard, unsigned int bucket, const char *filename) {
+    CacheEntry *entry = shard->buckets[bucket];
+    while (entry != NULL && strcmp(entry->filename, filename) != 0) {
+        entry = entry->hash_next;
+    }
+    return entry;
+}
+
+// Unlink from hash chain and LRU and free (shard lock held)
+static void remove_entry(CacheShard *shard, CacheEntry *entry) {
+    unsigned int bucket = (cache_hash(entry->filename) / CACHE_SHARDS) % CACHE_SHARD_BUCKETS;
+    CacheEntry **link = &shard->buckets[bucket];
+    while (*link != NULL && *link != entry) {
+        link = &(*link)->hash_next;
+    }
+    if (*link == entry) *link = entry->hash_next;
+
+    lru_unlink(shard, entry);
+    shard->bytes_used -= entry->size;
+    free(entry->data);
+    free(entry);
+}
+
+// Copy a cached file into buffer if present at exactly 'version'.
+// Returns bytes copied, or -1 on a miss.
+long cache_get(const char *filename, unsigned long version, char *buffer, size_t size) {
+    unsigned int bucket;
+    CacheShard *shard = shard_for(filename, &bucket);
+
+    pthread_mutex_lock(&shard->lock);
+    CacheEntry *entry = find_entry(shard, bucket, filename);
+    if (entry == NULL || entry->version != version) {
+        if (entry != NULL) remove_entry(shard, entry);  // Stale - drop it
+        shard->misses++;
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    size_t bytes = entry->size < size ? entry->size : size;
+    memcpy(buffer, entry->data, bytes);
+    lru_unlink(shard, entry);
+    lru_push_front(shard, entry);
+    shard->hits++;
+    pthread_mutex_unlock(&shard->lock);
+    return (long)bytes;
+}
+
+// Insert or replace a file's contents, evicting least recently used entries
+// until the shard is back under budget
+void cache_put(const char *filename, const char *data, size_t size, unsigned long version) {
+    unsigned int bucket;
+    CacheShard *shard = shard_for(filename, &bucket);
+    if (size > CACHE_MAX_ENTRY_BYTES || size > shard->budget) return;
+
+    char *copy = malloc(size > 0 ? size : 1);
+    if (copy == NULL) return;
+    memcpy(copy, data, size);
+
+    pthread_mutex_lock(&shard->lock);
+    CacheEntry *entry = find_entry(shard, bucket, filename);
+    if (entry != NULL) {
+        remove_entry(shard, entry);
+    }
+
+    while (shard->lru_tail != NULL && shard->bytes_used + size > shard->budget) {
+        remove_entry(shard, shard->lru_tail);
+    }
+
+    entry = calloc(1, sizeof(CacheEntry));
+    strncpy(entry->filename, filename, sizeof(entry->filename) - 1);
+    entry->data = copy;
+    entry->size = size;
+    entry->version = version;
+    entry->hash_next = shard->buckets[bucket];
+    shard->buckets[bucket] = entry;
+    lru_push_front(shard, entry);
+    shard->bytes_used += size;
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void cache_invalidate(const char *filename) {
+    unsigned int bucket;
+    CacheShard *shard = shard_for(filename, &bucket);
+
+    pthread_mutex_lock(&shard->lock);
+    CacheEntry *entry = find_entry(shard, bucket, filename);
+    if (entry != NULL) {
+        remove_entry(shard, entry);
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// Read a whole file (up to the entry limit) into a malloc'd buffer
+static char* read_whole_file(const char *path, size_t *size) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) return NULL;
+
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0 || st.st_size > CACHE_MAX_ENTRY_BYTES) {
+        fclose(fp);
+        return NULL;
+    }
+
+    char *data = malloc(st.st_size > 0 ? st.st_size : 1);
+    *size = fread(data, 1, st.st_size, fp);
+    fclose(fp);
+    return data;
+}
+
+// Serve a file while its SS is unavailable: memory cache first, then the
+// on-disk cache/backup copies (which refill the memory cache).
+// Returns bytes copied into buffer, or -1 if no copy exists.
+long cache_load_file(const char *filename, const char *ss_id, unsigned long version,
+                     char *buffer, size_t size, int *source) {
+    long bytes = cache_get(filename, version, buffer, size);
+    if (bytes >= 0) {
+        *source = CACHE_SRC_MEMORY;
+        return bytes;
+    }
+
+    char path[MAX_PATH];
+    size_t file_size = 0;
+    snprintf(path, sizeof(path), "./cache/%s", filename);
+    char *data = read_whole_file(path, &file_size);
+    *source = CACHE_SRC_DISK;
+    if (data == NULL) {
+        snprintf(path, sizeof(path), "./backups/%s/%s", ss_id, filename);
+        data = read_whole_file(path, &file_size);
+        *source = CACHE_SRC_BACKUP;
+    }
+    if (data == NULL) return -1;
+
+    cache_put(filename, data, file_size, version);
+    bytes = file_size < size ? file_size : size;
+    memcpy(buffer, data, bytes);
+    free(data);
+    return bytes;
+}
+
+const char* cache_source_name(int source) {
+    switch (source) {
+        case CACHE_SRC_MEMORY: return "memory cache";
+        case CACHE_SRC_DISK: return "cache";
+        default: return "backup";
+    }
+}
+
+void cache_stats(unsigned long *hits, unsigned long *misses, size_t *bytes_used) {
+    *hits = *misses = 0;
+    *bytes_used = 0;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        pthread_mutex_lock(&shards[i].lock);
+        *hits += shards[i].hits;
+        *misses += shards[i].misses;
+        *bytes_used += shards[i].bytes_used;
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+}
+
+void cleanup_content_cache() {
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        pthread_mutex_lock(&shards[i].lock);
+        while (shards[i].lru_head != NULL) {
+            remove_entry(&shards[i], shards[i].lru_head);
+        }
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+}
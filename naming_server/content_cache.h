@@ -0,0 +1,42 @@
+#ifndef CONTENT_CACHE_H
+#define CONTENT_CACHE_H
+
+#include <stddef.h>
+#include "../common/protocol.h"
+
+#define CACHE_SHARDS 16
+#define CACHE_SHARD_BUCKETS 256
+#define DEFAULT_CACHE_BUDGET_MB 64          // DOCSPP_NS_CACHE_MB
+#define CACHE_MAX_ENTRY_BYTES (1024 * 1024) // Larger files are not cached
+#define DEFAULT_CACHE_HOT_READS 0           // DOCSPP_NS_READ_CACHE=1: serve hits while SS is up
+
+// Where cache_load_file found the content
+#define CACHE_SRC_MEMORY 0
+#define CACHE_SRC_DISK 1     // Legacy ./cache/<file> copy
+#define CACHE_SRC_BACKUP 2   // ./backups/<ss>/<file>
+
+// Cached file contents. Each entry is stamped with the file version it was
+// filled at; lookups for any other version miss.
+typedef struct CacheEntry {
+    char filename[MAX_FILENAME];
+    char *data;
+    size_t size;
+    unsigned long version;
+    struct CacheEntry *hash_next;
+    struct CacheEntry *lru_prev;   // Most recently used at the head
+    struct CacheEntry *lru_next;
+} CacheEntry;
+
+// Content cache functions
+void init_content_cache();
+int cache_hot_reads_enabled();
+long cache_get(const char *filename, unsigned long version, char *buffer, size_t size);
+void cache_put(const char *filename, const char *data, size_t size, unsigned long version);
+void cache_invalidate(const char *filename);
+long cache_load_file(const char *filename, const char *ss_id, unsigned long version,
+                     char *buffer, size_t size, int *source);
+const char* cache_source_name(int source);
+void cache_stats(unsigned long *hits, unsigned long *misses, size_t *bytes_used);
+void cleanup_content_cache();
+
+#endif // CONTENT_CACHE_H
@@ -0,0 +1,182 @@
+#include "failure_detector.h"
+#include "storage_server_manager.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static int heartbeat_interval_ms = DEFAULT_HEARTBEAT_INTERVAL_MS;
+static double min_stddev_ms = DEFAULT_PHI_MIN_STDDEV_MS;
+
+static long long now_millis() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+void phi_reset(PhiWindow *window) {
+    memset(window, 0, sizeof(*window));
+}
+
+// Record a heartbeat arrival
+void phi_heartbeat(PhiWindow *window, long long now_ms) {
+    if (window->last_arrival_ms > 0) {
+        double interval = (double)(now_ms - window->last_arrival_ms);
+        if (window->count == PHI_WINDOW) {
+            double old = window->intervals[window->next];
+            window->sum -= old;
+            window->sum_sq -= old * old;
+        } else {
+            window->count++;
+        }
+        window->intervals[window->next] = interval;
+        window->next = (window->next + 1) % PHI_WINDOW;
+        window->sum += interval;
+        window->sum_sq += interval * interval;
+    }
+    window->last_arrival_ms = now_ms;
+}
+
+// Suspicion level: -log10 of the probability that a heartbeat is merely late,
+// assuming normally distributed inter-arrival times (logistic approximation).
+double phi_value(PhiWindow *window, long long now_ms) {
+    if (window->last_arrival_ms == 0) return 0.0;
+
+    double mean = heartbeat_interval_ms;
+    double variance = 0.0;
+    if (window->count > 1) {
+        mean = window->sum / window->count;
+        variance = window->sum_sq / window->count - mean * mean;
+    }
+    double stddev = variance > 0 ? sqrt(variance) : 0.0;
+    if (stddev < min_stddev_ms) stddev = min_stddev_ms;
+
+    double elapsed = (double)(now_ms - window->last_arrival_ms);
+    double y = (elapsed - mean) / stddev;
+    double e = exp(-y * (1.5976 + 0.070566 * y * y));
+    if (elapsed > mean) {
+        return -log10(e / (1.0 + e));
+    }
+    return -log10(1.0 - 1.0 / (1.0 + e));
+}
+
+// Catch a recovered SS up on changes without blocking the detector loop
+static void* recovery_sync(void *arg) {
+    request_delta_sync((StorageServer*)arg);
+    return NULL;
+}
+
+static void mark_failed(StorageServer *ss, double phi) {
+    ss->failed = 1;
+    ss->is_active = 0;
+    printf("⚠ Storage server %s suspected failed (phi=%.1f)\n", ss->id, phi);
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "Storage server %s suspected failed (phi=%.1f)", ss->id, phi);
+    log_message("naming_server", log_msg);
+}
+
+static void mark_recovered(StorageServer *ss) {
+    ss->failed = 0;
+    ss->is_active = 1;
+    printf("✓ Storage server %s recovered\n", ss->id);
+    log_message("naming_server", "Storage server recovered (heartbeats resumed)");
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, recovery_sync, ss) == 0) {
+        pthread_detach(thread);
+    }
+}
+
+// "PONG <seq> <ss_id> <load report>"
+static void handle_pong(const char *datagram, long long now_ms) {
+    char ss_id[64];
+    unsigned long seq;
+    if (sscanf(datagram, "PONG %lu %63s", &seq, ss_id) != 2) return;
+
+    StorageServer *ss = find_ss_by_id(ss_id);
+    if (ss == NULL) return;
+
+    // A gap from an outage is not a normal interval - start a fresh window
+    if (ss->failed || !ss->udp_heartbeat) phi_reset(&ss->phi);
+    phi_heartbeat(&ss->phi, now_ms);
+    ss->udp_heartbeat = 1;
+    ss->last_heartbeat = time(NULL);
+
+    update_load_report(ss, datagram);
+
+    if (ss->failed && ss->ss_socket >= 0) {
+        mark_recovered(ss);
+    }
+}
+
+// Failure detector thread: pings every SS over UDP each interval (all at
+// once, on one socket) and judges liveness from the phi of each server.
+void* failure_detector(void *arg) {
+    (void)arg;
+    heartbeat_interval_ms = get_config_int("DOCSPP_HEARTBEAT_INTERVAL_MS", DEFAULT_HEARTBEAT_INTERVAL_MS);
+    if (heartbeat_interval_ms < 10) heartbeat_interval_ms = 10;
+    min_stddev_ms = get_config_int("DOCSPP_PHI_MIN_STDDEV_MS", DEFAULT_PHI_MIN_STDDEV_MS);
+    double threshold = get_config_int("DOCSPP_PHI_THRESHOLD", DEFAULT_PHI_THRESHOLD);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        log_error("naming_server", "Failed to create heartbeat socket");
+        return NULL;
+    }
+
+    printf("✓ Failure detector started (UDP ping every %d ms, phi threshold %.0f)\n",
+           heartbeat_interval_ms, threshold);
+
+    unsigned long seq = 0;
+    while (!shutdown_flag) {
+        long long tick_start = now_millis();
+        seq++;
+
+        // Ping all servers without waiting on any of them
+        for (StorageServer *ss = storage_servers; ss != NULL; ss = ss->next) {
+            if (ss->nm_port <= 0 || ss->ip[0] == '\0') continue;
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(ss->nm_port);
+            if (inet_pton(AF_INET, ss->ip, &addr.sin_addr) != 1) continue;
+
+            char ping[96];
+            int len = snprintf(ping, sizeof(ping), "PING %lu %s", seq, ss->id);
+            sendto(sock, ping, len, MSG_DONTWAIT, (struct sockaddr*)&addr, sizeof(addr));
+        }
+
+        // Collect replies until the next tick
+        long long remaining;
+        while ((remaining = tick_start + heartbeat_interval_ms - now_millis()) > 0) {
+            struct pollfd pfd = { .fd = sock, .events = POLLIN };
+            if (poll(&pfd, 1, (int)remaining) <= 0) continue;
+
+            char datagram[512];
+            ssize_t bytes = recvfrom(sock, datagram, sizeof(datagram) - 1, 0, NULL, NULL);
+            if (bytes <= 0) continue;
+            datagram[bytes] = '\0';
+            handle_pong(datagram, now_millis());
+        }
+
+        // Judge every server that speaks the UDP heartbeat protocol
+        long long now_ms = now_millis();
+        for (StorageServer *ss = storage_servers; ss != NULL; ss = ss->next) {
+            if (!ss->udp_heartbeat || ss->failed) continue;
+            double phi = phi_value(&ss->phi, now_ms);
+            if (phi > threshold) {
+                mark_failed(ss, phi);
+            }
+        }
+    }
+
+    close(sock);
+    return NULL;
+}
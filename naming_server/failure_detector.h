@@ -0,0 +1,25 @@
+#ifndef FAILURE_DETECTOR_H
+#define FAILURE_DETECTOR_H
+
+#define PHI_WINDOW 100                      // Inter-arrival samples kept per SS
+#define DEFAULT_HEARTBEAT_INTERVAL_MS 200   // UDP ping period
+#define DEFAULT_PHI_THRESHOLD 8             // Suspect SS when phi exceeds this
+#define DEFAULT_PHI_MIN_STDDEV_MS 50        // Floor for the interval std deviation
+
+// Sliding window of heartbeat inter-arrival times (phi-accrual detector)
+typedef struct {
+    double intervals[PHI_WINDOW];
+    int count;
+    int next;
+    double sum;
+    double sum_sq;
+    long long last_arrival_ms;  // 0 = no heartbeat seen yet
+} PhiWindow;
+
+// Failure detector functions
+void phi_reset(PhiWindow *window);
+void phi_heartbeat(PhiWindow *window, long long now_ms);
+double phi_value(PhiWindow *window, long long now_ms);
+void* failure_detector(void *arg);
+
+#endif // FAILURE_DETECTOR_H
@@ -34,6 +34,8 @@ void add_file(struct FileInfo *info, const char *ss_id) {
     entry->acl = NULL;
     entry->checkpoints = NULL;
     entry->access_requests = NULL;
+    entry->generation = 0;
+    entry->backup_generation = 0;
     entry->next = file_table[index];
     file_table[index] = entry;
     
@@ -63,6 +65,13 @@ FileEntry* lookup_file(const char *filename) {
 
 // Delete file entry from hash table
 int delete_file_entry(const char *filename) {
+    return delete_owned_file_entry(filename, NULL, NULL);
+}
+
+// Delete a file entry only if ss_id (NULL = any server) still owns it and
+// it is still in folder (NULL = any); the check and the unlink happen
+// under one hold of table_lock
+int delete_owned_file_entry(const char *filename, const char *ss_id, const char *folder) {
     unsigned int index = hash_function(filename);
     
     pthread_mutex_lock(&table_lock);
@@ -72,6 +81,8 @@ int delete_file_entry(const char *filename) {
     
     while (current != NULL) {
         if (strcmp(current->info.name, filename) == 0) {
+            if (ss_id != NULL && strcmp(current->info.storage_server_id, ss_id) != 0) break;
+            if (folder != NULL && strcmp(current->info.folder, folder) != 0) break;
             if (prev == NULL) {
                 file_table[index] = current->next;
             } else {
@@ -114,6 +125,25 @@ int delete_file_entry(const char *filename) {
     return 0;
 }
 
+// Record that ss_id holds 'generation' of a file. Returns -1 if the file is
+// not registered, 1 if this is newer than the version known so far, else 0.
+int update_file_generation(const char *filename, const char *ss_id, unsigned long generation) {
+    unsigned int index = hash_function(filename);
+    int result = -1;
+    
+    pthread_mutex_lock(&table_lock);
+    for (FileEntry *current = file_table[index]; current != NULL; current = current->next) {
+        if (strcmp(current->info.name, filename) == 0) {
+            strncpy(current->info.storage_server_id, ss_id, sizeof(current->info.storage_server_id));
+            result = generation > current->generation;
+            current->generation = generation;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&table_lock);
+    return result;
+}
+
 // Cleanup file table (call on shutdown)
 void cleanup_file_table() {
     pthread_mutex_lock(&table_lock);
@@ -45,6 +45,8 @@ typedef struct FileEntry {
     struct AccessControl *acl;
     struct CheckpointEntry *checkpoints;
     struct AccessRequestNode *access_requests;
+    unsigned long generation;  // Last manifest generation seen from the SS
+    unsigned long backup_generation;  // Version of the streamed backup copy (0 = unknown)
     struct FileEntry *next;  // For hash table chaining
 } FileEntry;
 
@@ -54,6 +56,8 @@ unsigned int hash_function(const char *str);
 void add_file(struct FileInfo *info, const char *ss_id);
 FileEntry* lookup_file(const char *filename);
 int delete_file_entry(const char *filename);
+int delete_owned_file_entry(const char *filename, const char *ss_id, const char *folder);
+int update_file_generation(const char *filename, const char *ss_id, unsigned long generation);
 void cleanup_file_table();
 
 // External global variables
@@ -1,6 +1,7 @@
 #include "persistence.h"
 #include "file_manager.h"
 #include "access_control.h"
+#include "storage_server_manager.h"
 #include "../common/utils.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -38,12 +39,20 @@ int save_file_registry(const char *filename) {
     fprintf(fp, "REGISTRY_V1\n");
     fprintf(fp, "%d\n", file_count);
     
+    // Storage server sync positions (so a restarted NS can still delta sync)
+    for (StorageServer *ss = storage_servers; ss != NULL; ss = ss->next) {
+        if (ss->sync_epoch != 0) {
+            fprintf(fp, "SS:%s:%s:%d:%lu:%lu\n", ss->id, ss->ip, ss->client_port,
+                    ss->sync_epoch, ss->synced_generation);
+        }
+    }
+    
     // Write each file entry
     for (int i = 0; i < HASH_TABLE_SIZE; i++) {
         FileEntry *entry = file_table[i];
         while (entry != NULL) {
             // Write file info
-            fprintf(fp, "FILE:%s:%s:%s:%ld:%ld:%ld:%ld:%d:%d\n",
+            fprintf(fp, "FILE:%s:%s:%s:%ld:%ld:%ld:%ld:%d:%d:%lu\n",
                     entry->info.name,
                     entry->info.owner,
                     entry->info.storage_server_id,
@@ -52,7 +61,8 @@ int save_file_registry(const char *filename) {
                     entry->info.last_accessed,
                     entry->info.size,
                     entry->info.word_count,
-                    entry->info.char_count);
+                    entry->info.char_count,
+                    entry->generation);
             
             // Write ACLs
             AccessControl *acl = entry->acl;
@@ -105,7 +115,15 @@ int load_file_registry(const char *filename) {
     
     // Read file entries
     while (fgets(line, sizeof(line), fp)) {
-        if (strncmp(line, "FILE:", 5) == 0) {
+        if (strncmp(line, "SS:", 3) == 0) {
+            char ss_id[64], ip[16];
+            int client_port;
+            unsigned long epoch, generation;
+            if (sscanf(line, "SS:%63[^:]:%15[^:]:%d:%lu:%lu", ss_id, ip, &client_port,
+                       &epoch, &generation) == 5) {
+                restore_storage_server(ss_id, ip, client_port, epoch, generation);
+            }
+        } else if (strncmp(line, "FILE:", 5) == 0) {
             struct FileInfo info;
             char *token = strtok(line + 5, ":");
             
@@ -127,12 +145,15 @@ int load_file_registry(const char *filename) {
             if (token) info.word_count = atoi(token);
             token = strtok(NULL, ":");
             if (token) info.char_count = atoi(token);
+            token = strtok(NULL, ":");
+            unsigned long generation = token ? strtoul(token, NULL, 10) : 0;
             
             // Add file to registry
             add_file(&info, info.storage_server_id);
             
             // Get the newly added file entry
             FileEntry *entry = lookup_file(info.name);
+            if (entry) entry->generation = generation;
             
             // Read ACLs until END
             while (fgets(line, sizeof(line), fp)) {
@@ -1,31 +1,96 @@
 #include "storage_server_manager.h"
 #include "file_manager.h"
+#include "content_cache.h"
 #include "../common/utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
 #include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
 
 StorageServer *storage_servers = NULL;
 volatile int shutdown_flag = 0;
+static int reply_timeout_sec = DEFAULT_SS_REPLY_TIMEOUT_SEC;
 
 // Initialize storage servers
 void init_storage_servers() {
     storage_servers = NULL;
+    reply_timeout_sec = get_config_int("DOCSPP_NS_SS_TIMEOUT_SEC", DEFAULT_SS_REPLY_TIMEOUT_SEC);
+    if (reply_timeout_sec < 0) reply_timeout_sec = 0;
 }
 
-// Get first active storage server (simple selection)
+// Get the least loaded active storage server. Servers low on disk are only
+// chosen when nothing else is available.
 StorageServer* get_available_ss() {
+    StorageServer *best = NULL;
+    int best_low_disk = 1;
     StorageServer *ss = storage_servers;
     while (ss != NULL) {
         if (ss->is_active) {
-            return ss;
+            int low_disk = ss->load_updated != 0 && ss->load.disk_free < MIN_PLACEMENT_DISK_FREE;
+            if (best == NULL || (best_low_disk && !low_disk) ||
+                (low_disk == best_low_disk && ss->load_score < best->load_score)) {
+                best = ss;
+                best_low_disk = low_disk;
+            }
         }
         ss = ss->next;
     }
-    return NULL;
+    return best;
+}
+
+// Store a load report from a heartbeat reply and fold it into the rolling score
+void update_load_report(StorageServer *ss, const char *text) {
+    struct SSLoadReport report;
+    if (parse_load_report(text, &report) != 0) return;
+
+    double score = report.active_connections + 2.0 * report.queued_requests +
+                   0.5 * report.active_locks +
+                   (report.p99_us[LOAD_OP_READ] + report.p99_us[LOAD_OP_STREAM]) / 100000.0;
+
+    ss->load = report;
+    if (ss->load_updated == 0) {
+        ss->load_score = score;
+    } else {
+        ss->load_score = LOAD_SCORE_ALPHA * score + (1.0 - LOAD_SCORE_ALPHA) * ss->load_score;
+    }
+    ss->load_updated = time(NULL);
+}
+
+static void format_bytes(long long bytes, char *buffer, size_t size) {
+    const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+    double value = (double)bytes;
+    int unit = 0;
+    while (value >= 1024 && unit < 4) {
+        value /= 1024;
+        unit++;
+    }
+    snprintf(buffer, size, unit == 0 ? "%.0f %s" : "%.1f %s", value, units[unit]);
+}
+
+// Human-readable load summary for LISTSS (two lines)
+int format_ss_load(StorageServer *ss, char *buffer, size_t size) {
+    if (ss->load_updated == 0) {
+        return snprintf(buffer, size, "    (no load report yet)\n");
+    }
+
+    char stored[32], free_space[32];
+    format_bytes(ss->load.bytes_stored, stored, sizeof(stored));
+    format_bytes(ss->load.disk_free, free_space, sizeof(free_space));
+    const struct SSLoadReport *r = &ss->load;
+    return snprintf(buffer, size,
+                    "    conns %d  locks %d  queued %d  stored %s  free %s  score %.1f\n"
+                    "    p50/p99 ms  read %.1f/%.1f  write %.1f/%.1f  stream %.1f/%.1f  other %.1f/%.1f\n",
+                    r->active_connections, r->active_locks, r->queued_requests,
+                    stored, free_space, ss->load_score,
+                    r->p50_us[LOAD_OP_READ] / 1000.0, r->p99_us[LOAD_OP_READ] / 1000.0,
+                    r->p50_us[LOAD_OP_WRITE] / 1000.0, r->p99_us[LOAD_OP_WRITE] / 1000.0,
+                    r->p50_us[LOAD_OP_STREAM] / 1000.0, r->p99_us[LOAD_OP_STREAM] / 1000.0,
+                    r->p50_us[LOAD_OP_OTHER] / 1000.0, r->p99_us[LOAD_OP_OTHER] / 1000.0);
 }
 
 // Find storage server by ID
@@ -54,6 +119,8 @@ void register_storage_server(struct SSRegistration *reg) {
         existing_ss->is_active = 1;
         existing_ss->failed = 0;
         existing_ss->last_heartbeat = time(NULL);
+        existing_ss->udp_heartbeat = 0;  // Legacy checks until UDP pings are answered
+        phi_reset(&existing_ss->phi);
         
         char msg[256];
         snprintf(msg, sizeof(msg), "Storage Server reconnected: %s at %s:%d (ACLs preserved)", 
@@ -65,6 +132,7 @@ void register_storage_server(struct SSRegistration *reg) {
         for (int i = 0; i < reg->file_count; i++) {
             char cache_path[MAX_PATH];
             snprintf(cache_path, sizeof(cache_path), "../cache/%s", reg->files[i]);
+            cache_invalidate(reg->files[i]);
             if (remove(cache_path) == 0) {
                 printf("  \u2713 Removed cached: %s\n", reg->files[i]);
             }
@@ -107,6 +175,15 @@ void register_storage_server(struct SSRegistration *reg) {
     ss->is_active = 1;
     ss->last_heartbeat = time(NULL);
     ss->failed = 0;
+    ss->sync_epoch = 0;
+    ss->synced_generation = 0;
+    ss->backup_epoch = 0;
+    ss->backup_generation = 0;
+    ss->ae_socket = -1;
+    ss->udp_heartbeat = 0;
+    ss->version_push = 0;
+    phi_reset(&ss->phi);
+    pthread_mutex_init(&ss->sock_lock, NULL);
     ss->next = storage_servers;
     storage_servers = ss;
     
@@ -131,6 +208,253 @@ void register_storage_server(struct SSRegistration *reg) {
     }
 }
 
+// Recreate a storage server entry saved in the registry. It stays inactive
+// until the server reconnects, but remembers how far it was synced.
+void restore_storage_server(const char *ss_id, const char *ip, int client_port,
+                            unsigned long epoch, unsigned long generation) {
+    if (find_ss_by_id(ss_id) != NULL) return;
+
+    StorageServer *ss = calloc(1, sizeof(StorageServer));
+    strncpy(ss->id, ss_id, sizeof(ss->id) - 1);
+    strncpy(ss->ip, ip, sizeof(ss->ip) - 1);
+    ss->client_port = client_port;
+    ss->ss_socket = -1;
+    ss->is_active = 0;
+    ss->failed = 1;
+    ss->sync_epoch = epoch;
+    ss->synced_generation = generation;
+    ss->ae_socket = -1;
+    pthread_mutex_init(&ss->sock_lock, NULL);
+    ss->next = storage_servers;
+    storage_servers = ss;
+}
+
+// Next message on the persistent SS socket, if it arrives within the reply
+// timeout (sock_lock held)
+static int recv_reply(StorageServer *ss, struct Message *response) {
+    struct pollfd pfd = { .fd = ss->ss_socket, .events = POLLIN };
+    int ready;
+    do {
+        ready = poll(&pfd, 1, reply_timeout_sec > 0 ? reply_timeout_sec * 1000 : -1);
+    } while (ready < 0 && errno == EINTR);
+    return ready > 0 && recv_message(ss->ss_socket, response) > 0 ? 0 : -1;
+}
+
+// The SS answers its NS commands in order, so replies to requests that
+// timed out still come first; skip them (sock_lock held)
+static int skip_stale_replies(StorageServer *ss) {
+    struct Message stale;
+    while (ss->stale_replies > 0) {
+        if (recv_reply(ss, &stale) != 0) return -1;
+        ss->stale_replies--;
+    }
+    return 0;
+}
+
+// Send a request over the persistent SS socket and wait for its reply.
+// The lock keeps concurrent client threads from interleaving replies; a
+// reply that does not come within DOCSPP_NS_SS_TIMEOUT_SEC fails the
+// request instead of holding the lock (and every request behind it).
+int ss_request(StorageServer *ss, struct Message *request, struct Message *response) {
+    pthread_mutex_lock(&ss->sock_lock);
+    if (ss->ss_socket < 0) {
+        pthread_mutex_unlock(&ss->sock_lock);
+        return -1;
+    }
+    int result = -1;
+    if (skip_stale_replies(ss) == 0 && send_message(ss->ss_socket, request) > 0) {
+        if (recv_reply(ss, response) == 0) result = 0;
+        else ss->stale_replies++;
+    }
+    pthread_mutex_unlock(&ss->sock_lock);
+    if (result != 0) {
+        char log_msg[128];
+        snprintf(log_msg, sizeof(log_msg), "No reply from storage server %s", ss->id);
+        log_error("naming_server", log_msg);
+        if (response != request) memset(response, 0, sizeof(*response));  // Callers fill in the error
+    }
+    return result;
+}
+
+// Bound the waits on a direct connection to an SS client port the same way
+void ss_reply_timeout(int socket) {
+    struct timeval timeout = { .tv_sec = reply_timeout_sec, .tv_usec = 0 };
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+// Generation to resume from, or 0 for a full resync (new or rebuilt manifest)
+unsigned long sync_start_generation(StorageServer *ss, unsigned long epoch, unsigned long generation) {
+    if (ss == NULL || ss->sync_epoch != epoch) return 0;
+    if (generation < ss->synced_generation) return 0;
+    return ss->synced_generation;
+}
+
+// Apply one "<generation>\t<deleted>\t<path>" delta entry
+// Pushed entries never add files: a CREATE in flight registers the file
+// itself once the SS answers, with the right owner. The SS names a file by
+// its path ("folder/name" after a MOVE); the NS by its name, with the
+// folder alongside, so a tombstone for the old path of a moved file leaves
+// the entry alone.
+static void apply_delta_entry(StorageServer *ss, unsigned long generation, int deleted,
+                              const char *path, int pushed) {
+    char folder[MAX_FILENAME] = "";
+    const char *filename = strrchr(path, '/');
+    if (filename != NULL) {
+        snprintf(folder, sizeof(folder), "%.*s", (int)(filename - path), path);
+        filename++;
+    } else {
+        filename = path;
+    }
+
+    char cache_path[MAX_PATH];
+    snprintf(cache_path, sizeof(cache_path), "./cache/%s", filename);
+
+    if (deleted) {
+        if (delete_owned_file_entry(filename, ss->id, folder)) {
+            remove(cache_path);
+            cache_invalidate(filename);
+            printf("  - Removed deleted file: %s\n", filename);
+        }
+        return;
+    }
+
+    int updated = update_file_generation(filename, ss->id, generation);
+    if (updated > 0) {
+        remove(cache_path);  // Cached copy is stale
+        cache_invalidate(filename);
+    }
+    if (updated >= 0 || pushed) return;
+
+    struct FileInfo info;
+    memset(&info, 0, sizeof(info));
+    strncpy(info.name, filename, sizeof(info.name) - 1);
+    strncpy(info.folder, folder, sizeof(info.folder) - 1);
+    strncpy(info.owner, "system", sizeof(info.owner));
+    info.created_at = time(NULL);
+    info.last_modified = time(NULL);
+    info.last_accessed = time(NULL);
+    add_file(&info, ss->id);
+    update_file_generation(filename, ss->id, generation);
+    printf("  + Added new file: %s\n", filename);
+}
+
+// Receive MSG_SYNC_DELTA batches until the one flagged SYNC_FLAG_LAST
+static int receive_delta(StorageServer *ss, int socket, int pushed) {
+    struct Message msg;
+    unsigned long epoch = 0;
+    int applied = 0;
+    unsigned long max_generation = 0;
+
+    while (1) {
+        if (recv_message(socket, &msg) <= 0 || msg.type != MSG_SYNC_DELTA) {
+            return -1;
+        }
+        msg.data[sizeof(msg.data) - 1] = '\0';
+        epoch = strtoul(msg.checkpoint_tag, NULL, 10);
+
+        char *saveptr = NULL;
+        char *line = strtok_r(msg.data, "\n", &saveptr);
+        while (line != NULL) {
+            unsigned long generation;
+            int deleted;
+            int name_offset = 0;
+            if (sscanf(line, "%lu\t%d\t%n", &generation, &deleted, &name_offset) >= 2 &&
+                name_offset > 0 && line[name_offset] != '\0') {
+                apply_delta_entry(ss, generation, deleted, line + name_offset, pushed);
+                if (generation > max_generation) max_generation = generation;
+                applied++;
+            }
+            line = strtok_r(NULL, "\n", &saveptr);
+        }
+
+        if (msg.flags & SYNC_FLAG_LAST) break;
+    }
+
+    if (ss->sync_epoch != epoch) ss->synced_generation = 0;
+    ss->sync_epoch = epoch;
+    if (max_generation > ss->synced_generation) ss->synced_generation = max_generation;
+    return applied;
+}
+
+int receive_delta_sync(StorageServer *ss, int socket) {
+    int applied = receive_delta(ss, socket, 0);
+    if (applied < 0) {
+        log_error("naming_server", "Delta sync interrupted");
+        return -1;
+    }
+
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "Delta sync from %s: %d entries applied, now at generation %lu",
+             ss->id, applied, ss->synced_generation);
+    log_message("naming_server", log_msg);
+    printf("✓ Delta sync from %s: %d change(s)\n", ss->id, applied);
+    return applied;
+}
+
+// Serve a storage server's version push channel: apply each pushed delta
+// (invalidating cached copies of changed files) and ack the generation
+// reached. Returns when the channel closes.
+static void drop_cached_files(StorageServer *ss) {
+    pthread_mutex_lock(&table_lock);
+    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
+        for (FileEntry *entry = file_table[i]; entry != NULL; entry = entry->next) {
+            if (strcmp(entry->info.storage_server_id, ss->id) == 0) {
+                cache_invalidate(entry->info.name);
+            }
+        }
+    }
+    pthread_mutex_unlock(&table_lock);
+}
+
+void serve_version_push(StorageServer *ss, int socket, unsigned long epoch, unsigned long generation) {
+    struct Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.error_code = RESP_SUCCESS;
+    snprintf(msg.data, sizeof(msg.data), "SINCE %lu", sync_start_generation(ss, epoch, generation));
+    if (send_message(socket, &msg) < 0) return;
+
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "Version push channel opened by %s", ss->id);
+    log_message("naming_server", log_msg);
+
+    // The SS opens with a catch-up delta; cached copies are trusted for
+    // hot reads only once it has been applied and acked
+    while (receive_delta(ss, socket, 1) >= 0) {
+        memset(&msg, 0, sizeof(msg));
+        msg.error_code = RESP_ACK;
+        snprintf(msg.data, sizeof(msg.data), "%lu", ss->synced_generation);
+        if (send_message(socket, &msg) < 0) break;
+        ss->version_push = 1;
+    }
+    ss->version_push = 0;
+
+    // Without pushes the NS no longer hears about new versions, so cached
+    // copies of this server's files cannot be trusted to be current
+    drop_cached_files(ss);
+
+    snprintf(log_msg, sizeof(log_msg), "Version push channel from %s closed", ss->id);
+    log_message("naming_server", log_msg);
+}
+
+// Ask a recovered storage server for everything it changed since the last sync
+int request_delta_sync(StorageServer *ss) {
+    if (ss->sync_epoch == 0) return 0;  // Server does not keep a manifest
+
+    struct Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_SYNC_REQUEST;
+    snprintf(msg.data, sizeof(msg.data), "%lu %lu", ss->synced_generation, ss->sync_epoch);
+
+    pthread_mutex_lock(&ss->sock_lock);
+    int result = -1;
+    if (ss->ss_socket >= 0 && skip_stale_replies(ss) == 0 && send_message(ss->ss_socket, &msg) > 0) {
+        // The SS answers with a full resync if its manifest was rebuilt
+        result = receive_delta_sync(ss, ss->ss_socket);
+    }
+    pthread_mutex_unlock(&ss->sock_lock);
+    return result;
+}
+
 // Replicate operation to all storage servers (async)
 void replicate_to_all_ss(struct Message *msg) {
     StorageServer *ss = storage_servers;
@@ -146,7 +470,8 @@ void replicate_to_all_ss(struct Message *msg) {
     }
 }
 
-// Heartbeat thread - checks storage servers
+// Heartbeat thread - checks storage servers that do not answer UDP pings
+// (servers that do are judged by the failure detector instead)
 void* heartbeat_monitor(void *arg) {
     printf("✓ Heartbeat monitor started\n");
     
@@ -157,14 +482,14 @@ void* heartbeat_monitor(void *arg) {
         time_t now = time(NULL);
         
         while (ss != NULL) {
-            if (ss->is_active) {
+            // Failed servers keep being pinged so they can be caught up
+            // (delta sync) as soon as they answer again
+            if ((ss->is_active || ss->failed) && !ss->udp_heartbeat) {
                 // Check if SS has missed heartbeat (timeout: 60 seconds)
-                if (now - ss->last_heartbeat > 60) {
-                    if (!ss->failed) {
-                        printf("⚠ Storage server %s failed (no heartbeat)\n", ss->id);
-                        ss->failed = 1;
-                        ss->is_active = 0;
-                    }
+                if (!ss->failed && now - ss->last_heartbeat > 60) {
+                    printf("⚠ Storage server %s failed (no heartbeat)\n", ss->id);
+                    ss->failed = 1;
+                    ss->is_active = 0;
                 } else {
                     // Try to ping the storage server using persistent socket
                     if (ss->ss_socket >= 0) {
@@ -172,15 +497,17 @@ void* heartbeat_monitor(void *arg) {
                         memset(&ping, 0, sizeof(ping));
                         ping.type = MSG_HEARTBEAT;
                         
-                        if (send_message(ss->ss_socket, &ping) > 0 && recv_message(ss->ss_socket, &ping) > 0) {
+                        if (ss_request(ss, &ping, &ping) == 0) {
                             ss->last_heartbeat = now;
+                            update_load_report(ss, ping.data);
                             
                             // If it was previously failed, mark as recovered
                             if (ss->failed) {
                                 printf("✓ Storage server %s recovered\n", ss->id);
                                 ss->failed = 0;
                                 ss->is_active = 1;
-                                // TODO: Trigger data synchronization
+                                // Catch up on changes made while it was unreachable
+                                request_delta_sync(ss);
                             }
                         } else {
                             if (!ss->failed) {
@@ -188,10 +515,12 @@ void* heartbeat_monitor(void *arg) {
                                 ss->failed = 1;
                                 ss->is_active = 0;
                                 // Close bad socket
+                                pthread_mutex_lock(&ss->sock_lock);
                                 if (ss->ss_socket >= 0) {
                                     close(ss->ss_socket);
                                     ss->ss_socket = -1;
                                 }
+                                pthread_mutex_unlock(&ss->sock_lock);
                             }
                         }
                     } else {
@@ -2,7 +2,13 @@
 #define STORAGE_SERVER_MANAGER_H
 
 #include <time.h>
+#include <pthread.h>
 #include "../common/protocol.h"
+#include "failure_detector.h"
+
+#define LOAD_SCORE_ALPHA 0.3           // Weight of the newest report in load_score
+#define MIN_PLACEMENT_DISK_FREE (16LL * 1024 * 1024)
+#define DEFAULT_SS_REPLY_TIMEOUT_SEC 30  // DOCSPP_NS_SS_TIMEOUT_SEC: wait for a storage server reply (0 = forever)
 
 // Storage server structure
 typedef struct StorageServer {
@@ -14,14 +20,37 @@ typedef struct StorageServer {
     int is_active;
     time_t last_heartbeat;
     int failed;  // 1 if detected as failed
+    unsigned long sync_epoch;         // Manifest epoch of the last delta sync
+    unsigned long synced_generation;  // Manifest generation already applied
+    unsigned long backup_epoch;       // Manifest epoch of the backup stream
+    unsigned long backup_generation;  // Every change up to here is in ./backups
+    pthread_mutex_t sock_lock;        // Serializes request/response on ss_socket
+    int stale_replies;                // Replies still owed to requests that timed out
+    int ae_socket;                    // Anti-entropy connection to nm_port
+    int udp_heartbeat;                // 1 once the SS has answered a UDP ping
+    int version_push;                 // 1 while the version push channel is open
+    PhiWindow phi;                    // Heartbeat arrival history
+    struct SSLoadReport load;         // Latest report piggybacked on heartbeats
+    time_t load_updated;              // 0 = no report received yet
+    double load_score;                // Smoothed load used for placement
     struct StorageServer *next;
 } StorageServer;
 
 // Function declarations
 void init_storage_servers();
 StorageServer* get_available_ss();
+void update_load_report(StorageServer *ss, const char *text);
+int format_ss_load(StorageServer *ss, char *buffer, size_t size);
 StorageServer* find_ss_by_id(const char *ss_id);
 void register_storage_server(struct SSRegistration *reg);
+void restore_storage_server(const char *ss_id, const char *ip, int client_port,
+                            unsigned long epoch, unsigned long generation);
+int ss_request(StorageServer *ss, struct Message *request, struct Message *response);
+void ss_reply_timeout(int socket);
+unsigned long sync_start_generation(StorageServer *ss, unsigned long epoch, unsigned long generation);
+int receive_delta_sync(StorageServer *ss, int socket);
+void serve_version_push(StorageServer *ss, int socket, unsigned long epoch, unsigned long generation);
+int request_delta_sync(StorageServer *ss);
 void replicate_to_all_ss(struct Message *msg);
 void* heartbeat_monitor(void *arg);
 
@@ -139,6 +139,17 @@ void remove_active_session(const char *username) {
     pthread_mutex_unlock(&session_lock);
 }
 
+// Count logged in users
+int count_active_sessions() {
+    pthread_mutex_lock(&session_lock);
+    int count = 0;
+    for (ActiveSession *session = active_sessions; session != NULL; session = session->next) {
+        count++;
+    }
+    pthread_mutex_unlock(&session_lock);
+    return count;
+}
+
 // Cleanup users and sessions (call on shutdown)
 void cleanup_users_and_sessions() {
     pthread_mutex_lock(&user_lock);
@@ -28,6 +28,7 @@ char* get_all_users();
 ActiveSession* find_active_session(const char *username);
 int add_active_session(const char *username, int client_socket, const char *client_ip);
 void remove_active_session(const char *username);
+int count_active_sessions();
 void cleanup_users_and_sessions();
 
 // External global variables
@@ -0,0 +1,145 @@
+#include "anti_entropy.h"
+#include "file_operations.h"
+#include "../common/hash_tree.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// Tree is rebuilt whenever the NS starts a new comparison (asks for the root)
+static HashTree tree;
+static int tree_built = 0;
+static pthread_mutex_t tree_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void send_error(int socket, struct Message *msg, int error_code, const char *text) {
+    msg->error_code = error_code;
+    msg->flags = SYNC_FLAG_LAST;
+    snprintf(msg->data, sizeof(msg->data), "%s", text);
+    msg->data_length = strlen(msg->data);
+    send_message(socket, msg);
+}
+
+// Hashing runs at low priority on its own thread (see htree_run_low_priority)
+static void build_tree(void *arg) {
+    htree_build(arg, storage_dir);
+}
+
+typedef struct {
+    int bucket;
+    HashTreeFile *files;
+    int count;
+} BucketJob;
+
+static void list_bucket(void *arg) {
+    BucketJob *job = arg;
+    job->count = htree_bucket_files(storage_dir, job->bucket, &job->files);
+}
+
+// Answer "<level> <index>..." with the hashes of those nodes
+void handle_tree_nodes(int socket, struct Message *msg) {
+    int level = 0, offset = 0;
+    char *p = msg->data;
+    if (sscanf(p, "%d%n", &level, &offset) != 1 || level < 0 || level >= HTREE_LEVELS) {
+        send_error(socket, msg, ERR_INVALID_REQUEST, "Invalid tree level");
+        return;
+    }
+    p += offset;
+
+    pthread_mutex_lock(&tree_lock);
+    if (level == 0 || !tree_built) {
+        htree_run_low_priority(build_tree, &tree);
+        tree_built = 1;
+    }
+
+    char response[MAX_DATA];
+    size_t used = 0;
+    int index;
+    while (sscanf(p, "%d%n", &index, &offset) == 1) {
+        p += offset;
+        if (index < 0 || index >= htree_level_size(level)) continue;
+        int len = snprintf(response + used, sizeof(response) - used, "%d %016llx\n", index,
+                           (unsigned long long)tree.nodes[htree_level_offset(level) + index]);
+        if (len < 0 || used + len >= sizeof(response)) break;
+        used += len;
+    }
+    pthread_mutex_unlock(&tree_lock);
+
+    memcpy(msg->data, response, used);
+    msg->data[used] = '\0';
+    msg->data_length = used;
+    msg->flags = SYNC_FLAG_LAST;
+    msg->error_code = RESP_SUCCESS;
+    send_message(socket, msg);
+}
+
+// Answer a leaf bucket with "<hash>\t<name>" lines, in as many batches as needed
+void handle_tree_bucket(int socket, struct Message *msg) {
+    int bucket = atoi(msg->data);
+    if (bucket < 0 || bucket >= HTREE_LEAVES) {
+        send_error(socket, msg, ERR_INVALID_REQUEST, "Invalid bucket");
+        return;
+    }
+
+    BucketJob job = { bucket, NULL, 0 };
+    htree_run_low_priority(list_bucket, &job);
+    HashTreeFile *files = job.files;
+    int count = job.count;
+
+    int i = 0;
+    do {
+        size_t used = 0;
+        while (i < count) {
+            char line[MAX_FILENAME + 32];
+            int len = snprintf(line, sizeof(line), "%016llx\t%s\n",
+                               (unsigned long long)files[i].hash, files[i].name);
+            if (used + len >= sizeof(msg->data)) break;
+            memcpy(msg->data + used, line, len);
+            used += len;
+            i++;
+        }
+        msg->data[used] = '\0';
+        msg->data_length = used;
+        msg->flags = (i >= count) ? SYNC_FLAG_LAST : 0;
+        msg->error_code = RESP_SUCCESS;
+        if (send_message(socket, msg) < 0) break;
+    } while (i < count);
+
+    free(files);
+}
+
+// Stream one file's contents so the NS can repair its backup copy
+void handle_fetch_backup(int socket, struct Message *msg) {
+    char filepath[MAX_PATH];
+    if (snprintf(filepath, sizeof(filepath), "%s%s", storage_dir, msg->filename) >= (int)sizeof(filepath) ||
+        strstr(msg->filename, "..") != NULL) {
+        send_error(socket, msg, ERR_INVALID_REQUEST, "Invalid file name");
+        return;
+    }
+
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) {
+        send_error(socket, msg, ERR_FILE_NOT_FOUND, "File not found");
+        return;
+    }
+
+    ssize_t bytes;
+    long total = 0;
+    do {
+        bytes = read(fd, msg->data, sizeof(msg->data));
+        if (bytes < 0) bytes = 0;
+        msg->data_length = bytes;
+        msg->error_code = RESP_SUCCESS;
+        msg->flags = (bytes < (ssize_t)sizeof(msg->data)) ? SYNC_FLAG_LAST : 0;
+        if (send_message(socket, msg) < 0) break;
+        total += bytes;
+    } while (bytes == (ssize_t)sizeof(msg->data));
+    close(fd);
+
+    char log_msg[512];
+    snprintf(log_msg, sizeof(log_msg), "Anti-entropy: sent %ld bytes of '%s' for backup repair",
+             total, msg->filename);
+    log_message("storage_server", log_msg);
+}
@@ -0,0 +1,12 @@
+#ifndef ANTI_ENTROPY_H
+#define ANTI_ENTROPY_H
+
+#include "../common/protocol.h"
+
+// Anti-entropy request handlers (NS compares its backup copy against this
+// server's storage directory through a hash tree)
+void handle_tree_nodes(int socket, struct Message *msg);
+void handle_tree_bucket(int socket, struct Message *msg);
+void handle_fetch_backup(int socket, struct Message *msg);
+
+#endif // ANTI_ENTROPY_H
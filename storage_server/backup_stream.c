@@ -0,0 +1,220 @@
+#include "backup_stream.h"
+#include "manifest.h"
+#include "file_operations.h"
+#include "../common/utils.h"
+#include "../common/protocol.h"
+#include "../common/compress.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Backup stream: ships committed file contents to the NS so failover copies
+// exist there without a shared filesystem. Runs behind the commit path -
+// it follows the manifest generation counter, so a busy file is sent once
+// per batch no matter how many times it was written in between.
+static char stream_ss_id[64];
+static char stream_ns_ip[16];
+static int stream_ns_port;
+static int batch_ms = DEFAULT_BACKUP_BATCH_MS;
+
+static unsigned long files_sent = 0;
+static unsigned long long raw_bytes_sent = 0;
+static unsigned long long wire_bytes_sent = 0;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int connect_to_ns() {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+
+    struct sockaddr_in ns_addr;
+    memset(&ns_addr, 0, sizeof(ns_addr));
+    ns_addr.sin_family = AF_INET;
+    ns_addr.sin_port = htons(stream_ns_port);
+    inet_pton(AF_INET, stream_ns_ip, &ns_addr.sin_addr);
+
+    if (connect(sock, (struct sockaddr*)&ns_addr, sizeof(ns_addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Hello handshake. Returns the backup generation the NS already holds, or -1.
+static long handshake(int sock) {
+    struct Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_BACKUP_PUSH;
+    snprintf(msg.data, sizeof(msg.data), "%s %lu", stream_ss_id, manifest_epoch());
+    msg.data_length = strlen(msg.data);
+    if (send_message(sock, &msg) < 0) return -1;
+
+    unsigned long since = 0;
+    if (recv_message(sock, &msg) <= 0 || msg.error_code != RESP_SUCCESS ||
+        sscanf(msg.data, "SINCE %lu", &since) != 1) {
+        return -1;
+    }
+    return (long)since;
+}
+
+// Read a whole file into a malloc'd buffer
+static char* read_contents(const char *filename, size_t *size) {
+    char filepath[MAX_PATH];
+    snprintf(filepath, sizeof(filepath), "%s%s", storage_dir, filename);
+    FILE *fp = fopen(filepath, "r");
+    if (!fp) return NULL;
+
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0) {
+        fclose(fp);
+        return NULL;
+    }
+    char *data = malloc(st.st_size > 0 ? st.st_size : 1);
+    *size = fread(data, 1, st.st_size, fp);
+    fclose(fp);
+    return data;
+}
+
+// Send one file as compressed MSG_BACKUP_DATA pieces
+static int send_file(int sock, const ManifestChange *change) {
+    struct Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_BACKUP_DATA;
+    strncpy(msg.filename, change->filename, sizeof(msg.filename) - 1);
+
+    size_t raw_size = 0;
+    char *raw = change->deleted ? NULL : read_contents(change->filename, &raw_size);
+    if (raw == NULL) {
+        // Deleted (or gone again before we got to it)
+        msg.flags = BACKUP_FLAG_DELETED | BACKUP_FLAG_END;
+        snprintf(msg.checkpoint_tag, sizeof(msg.checkpoint_tag), "%lu 0", change->generation);
+        return send_message(sock, &msg);
+    }
+
+    char *packed = malloc(LZ_COMPRESS_BOUND(raw_size));
+    size_t packed_size = lz_compress(raw, raw_size, packed, LZ_COMPRESS_BOUND(raw_size));
+    const char *payload = packed;
+    int raw_flag = 0;
+    if (packed_size == 0 || packed_size >= raw_size) {
+        payload = raw;
+        packed_size = raw_size;
+        raw_flag = BACKUP_FLAG_RAW;
+    }
+
+    size_t offset = 0;
+    int result = 0;
+    do {
+        size_t piece = packed_size - offset;
+        if (piece > sizeof(msg.data)) piece = sizeof(msg.data);
+        memcpy(msg.data, payload + offset, piece);
+        msg.data_length = piece;
+        offset += piece;
+        msg.flags = raw_flag | (offset >= packed_size ? BACKUP_FLAG_END : 0);
+        snprintf(msg.checkpoint_tag, sizeof(msg.checkpoint_tag), "%lu %zu",
+                 change->generation, raw_size);
+        if (send_message(sock, &msg) < 0) {
+            result = -1;
+            break;
+        }
+    } while (offset < packed_size);
+
+    pthread_mutex_lock(&stats_mutex);
+    files_sent++;
+    raw_bytes_sent += raw_size;
+    wire_bytes_sent += packed_size;
+    pthread_mutex_unlock(&stats_mutex);
+
+    free(packed);
+    free(raw);
+    return result;
+}
+
+// Send everything changed since 'since' (up to one batch) and wait for the ack.
+// Returns the generation the NS now holds, or -1 if the stream broke.
+static long send_batch(int sock, unsigned long since) {
+    ManifestChange *changes;
+    int count = manifest_changes_since(since, &changes);
+    if (count == 0) return (long)since;
+    if (count > BACKUP_BATCH_MAX_FILES) count = BACKUP_BATCH_MAX_FILES;
+    unsigned long through = changes[count - 1].generation;
+
+    for (int i = 0; i < count; i++) {
+        if (send_file(sock, &changes[i]) < 0) {
+            free(changes);
+            return -1;
+        }
+    }
+    free(changes);
+
+    struct Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_BACKUP_DATA;
+    msg.flags = SYNC_FLAG_LAST;
+    snprintf(msg.checkpoint_tag, sizeof(msg.checkpoint_tag), "%lu", through);
+    if (send_message(sock, &msg) < 0) return -1;
+
+    if (recv_message(sock, &msg) <= 0 || msg.error_code != RESP_ACK) return -1;
+    return (long)through;
+}
+
+static void* backup_stream_worker(void *arg) {
+    (void)arg;
+    while (1) {
+        int sock = connect_to_ns();
+        long since = sock >= 0 ? handshake(sock) : -1;
+        if (since < 0) {
+            if (sock >= 0) close(sock);
+            sleep(BACKUP_STREAM_RETRY_SEC);
+            continue;
+        }
+
+        char log_msg[256];
+        snprintf(log_msg, sizeof(log_msg), "Backup stream connected (NS holds generation %ld)", since);
+        log_message("storage_server", log_msg);
+
+        while (1) {
+            unsigned long high_water = manifest_wait_for_change((unsigned long)since, 1000);
+            if (high_water <= (unsigned long)since) continue;
+            // Let a burst of commits settle into one batch
+            if (batch_ms > 0) usleep(batch_ms * 1000);
+            long through = send_batch(sock, (unsigned long)since);
+            if (through < 0) break;
+            since = through;
+        }
+
+        log_error("storage_server", "Backup stream lost, reconnecting");
+        close(sock);
+        sleep(BACKUP_STREAM_RETRY_SEC);
+    }
+    return NULL;
+}
+
+int start_backup_stream(const char *id, const char *ip, int port) {
+    strncpy(stream_ss_id, id, sizeof(stream_ss_id) - 1);
+    strncpy(stream_ns_ip, ip, sizeof(stream_ns_ip) - 1);
+    stream_ns_port = port;
+    batch_ms = get_config_int("DOCSPP_BACKUP_BATCH_MS", DEFAULT_BACKUP_BATCH_MS);
+    if (batch_ms < 0) batch_ms = 0;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, backup_stream_worker, NULL) != 0) {
+        log_error("storage_server", "Failed to start backup stream thread");
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+void backup_stream_stats(unsigned long *files, unsigned long long *raw_bytes,
+                         unsigned long long *sent_bytes) {
+    pthread_mutex_lock(&stats_mutex);
+    *files = files_sent;
+    *raw_bytes = raw_bytes_sent;
+    *sent_bytes = wire_bytes_sent;
+    pthread_mutex_unlock(&stats_mutex);
+}
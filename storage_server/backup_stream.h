@@ -0,0 +1,13 @@
+#ifndef BACKUP_STREAM_H
+#define BACKUP_STREAM_H
+
+#define BACKUP_STREAM_RETRY_SEC 1       // Reconnect delay after the stream drops
+#define DEFAULT_BACKUP_BATCH_MS 50      // DOCSPP_BACKUP_BATCH_MS: wait this long to gather a batch
+#define BACKUP_BATCH_MAX_FILES 64       // Files per acknowledged batch
+
+// Backup stream functions
+int start_backup_stream(const char *id, const char *ip, int port);
+void backup_stream_stats(unsigned long *files, unsigned long long *raw_bytes,
+                         unsigned long long *sent_bytes);
+
+#endif // BACKUP_STREAM_H
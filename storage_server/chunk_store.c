@@ -0,0 +1,577 @@
+#define _GNU_SOURCE
+#include "chunk_store.h"
+#include "file_operations.h"
+#include "durable_io.h"
+#include "io_engine.h"
+#include "undo_manager.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+// One chunk as listed in a manifest
+typedef struct {
+    char hash[CHUNK_HASH_HEX + 1];
+    size_t length;
+} ChunkEntry;
+
+static ChunkRef *chunk_table[CHUNK_TABLE_BUCKETS];
+static pthread_mutex_t chunk_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t gear[256];
+static char chunk_dir[MAX_PATH + 8];
+static int stored_chunks = 0;
+static size_t stored_bytes = 0;
+
+static unsigned int chunk_bucket(const char *hash) {
+    unsigned int bucket = 0;
+    for (int i = 0; i < 8 && hash[i]; i++) bucket = bucket * 31 + (unsigned char)hash[i];
+    return bucket % CHUNK_TABLE_BUCKETS;
+}
+
+static void chunk_path(const char *hash, char *path, size_t size) {
+    snprintf(path, size, "%s%.2s/%s", chunk_dir, hash, hash);
+}
+
+static void manifest_path(const char *filename, const char *tag, char *path, size_t size) {
+    snprintf(path, size, "%scheckpoints/%s.%s", storage_dir, filename, tag);
+}
+
+// Create every missing directory above 'path'
+static void make_parents(const char *path) {
+    char dir_path[MAX_PATH];
+    snprintf(dir_path, sizeof(dir_path), "%s", path);
+    for (char *p = dir_path + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(dir_path, 0777);
+            *p = '/';
+        }
+    }
+}
+
+// Refcounts (chunk_mutex held)
+static ChunkRef* find_ref(const char *hash, int create) {
+    unsigned int bucket = chunk_bucket(hash);
+    for (ChunkRef *ref = chunk_table[bucket]; ref != NULL; ref = ref->next) {
+        if (strcmp(ref->hash, hash) == 0) return ref;
+    }
+    if (!create) return NULL;
+    ChunkRef *ref = calloc(1, sizeof(ChunkRef));
+    strncpy(ref->hash, hash, CHUNK_HASH_HEX);
+    ref->next = chunk_table[bucket];
+    chunk_table[bucket] = ref;
+    return ref;
+}
+
+static void delete_chunk(const char *hash) {
+    char path[MAX_PATH];
+    struct stat st;
+    chunk_path(hash, path, sizeof(path));
+    if (stat(path, &st) == 0 && unlink(path) == 0) {
+        stored_chunks--;
+        stored_bytes -= st.st_size;
+    }
+}
+
+// Drop one reference; the chunk goes with the last one
+static void unref_chunk(const char *hash) {
+    unsigned int bucket = chunk_bucket(hash);
+    ChunkRef **link = &chunk_table[bucket];
+    while (*link != NULL && strcmp((*link)->hash, hash) != 0) link = &(*link)->next;
+    if (*link == NULL) return;
+    if (--(*link)->refs > 0) return;
+    ChunkRef *ref = *link;
+    *link = ref->next;
+    free(ref);
+    delete_chunk(hash);
+}
+
+// Gear table from a fixed seed, so boundaries are stable across restarts
+static void init_gear() {
+    uint64_t state = 0x646f637370707321ULL;
+    for (int i = 0; i < 256; i++) {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        gear[i] = z ^ (z >> 31);
+    }
+}
+
+// Length of the next chunk: cut where the top CHUNK_AVG_BITS bits of the
+// rolling hash are zero, within the min and max sizes
+static size_t next_boundary(const unsigned char *data, size_t length) {
+    if (length <= CHUNK_MIN_SIZE) return length;
+    const uint64_t mask = ((1ULL << CHUNK_AVG_BITS) - 1) << (64 - CHUNK_AVG_BITS);
+    size_t limit = length < CHUNK_MAX_SIZE ? length : CHUNK_MAX_SIZE;
+    uint64_t hash = 0;
+    for (size_t i = CHUNK_MIN_SIZE; i < limit; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        if ((hash & mask) == 0) return i + 1;
+    }
+    return limit;
+}
+
+// Read a manifest. Returns 1 for a chunk list, 0 for a plain-copy
+// checkpoint, -1 if there is no checkpoint.
+static int read_manifest(const char *path, ChunkEntry **entries, int *count, size_t *size) {
+    *entries = NULL;
+    *count = 0;
+    *size = 0;
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+
+    char line[128];
+    if (!fgets(line, sizeof(line), fp) || strncmp(line, CHUNK_MAGIC " ", strlen(CHUNK_MAGIC) + 1) != 0) {
+        fclose(fp);
+        return 0;
+    }
+    *size = strtoull(line + strlen(CHUNK_MAGIC) + 1, NULL, 10);
+
+    int capacity = 0;
+    char hash[CHUNK_HASH_HEX + 1];
+    size_t length;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%64s %zu", hash, &length) != 2) continue;
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            *entries = realloc(*entries, sizeof(ChunkEntry) * capacity);
+        }
+        strcpy((*entries)[*count].hash, hash);
+        (*entries)[*count].length = length;
+        (*count)++;
+    }
+    fclose(fp);
+    return 1;
+}
+
+// Write one chunk to a temp file next to its final path; the caller
+// commits it. A chunk that starts on a block boundary is reflinked from the
+// source where the filesystem allows, sharing its extents instead of
+// copying. Returns the temp fd or -1.
+static int write_chunk_temp(int src_fd, size_t src_size, const unsigned char *data, size_t offset,
+                            size_t length, const char *path, char *temp_path, size_t size) {
+    make_parents(path);
+    int fd = durable_open_temp(path, temp_path, size);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    int cloned = 0;
+    if (fstat(src_fd, &st) == 0 && st.st_blksize > 0 && offset % st.st_blksize == 0 &&
+        (length % st.st_blksize == 0 || offset + length == src_size)) {
+        struct file_clone_range range = { src_fd, offset, length, 0 };
+        cloned = ioctl(fd, FICLONERANGE, &range) == 0;
+    }
+    if (!cloned && io_pwrite(fd, data + offset, length, 0) != (ssize_t)length) {
+        close(fd);
+        unlink(temp_path);
+        return -1;
+    }
+    return fd;
+}
+
+// Chunks of one checkpoint waiting to be committed together
+typedef struct {
+    int count;
+    int fds[CHUNK_WRITE_BATCH];
+    char *temp_paths[CHUNK_WRITE_BATCH];
+    char *paths[CHUNK_WRITE_BATCH];
+    const ChunkEntry *entries[CHUNK_WRITE_BATCH];
+} ChunkBatch;
+
+// Make the batch durable and mark its chunks stored
+static int commit_chunks(ChunkBatch *batch, ChunkStats *stats) {
+    int result = durable_commit_temps(batch->count, batch->fds, batch->temp_paths, batch->paths);
+    pthread_mutex_lock(&chunk_mutex);
+    for (int i = 0; i < batch->count; i++) {
+        ChunkRef *ref = find_ref(batch->entries[i]->hash, 0);
+        if (result == 0 && ref != NULL && !ref->stored) {
+            ref->stored = 1;
+            stored_chunks++;
+            stored_bytes += batch->entries[i]->length;
+            stats->new_chunks++;
+            stats->new_bytes += batch->entries[i]->length;
+        }
+        free(batch->temp_paths[i]);
+        free(batch->paths[i]);
+    }
+    pthread_mutex_unlock(&chunk_mutex);
+    batch->count = 0;
+    return result;
+}
+
+// Count references from every manifest under checkpoints/
+static void scan_manifests(const char *dir_path) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char path[MAX_PATH];
+        snprintf(path, sizeof(path), "%s%s", dir_path, entry->d_name);
+        if (entry->d_type == DT_DIR) {
+            strncat(path, "/", sizeof(path) - strlen(path) - 1);
+            scan_manifests(path);
+            continue;
+        }
+        ChunkEntry *entries;
+        int count;
+        size_t size;
+        if (read_manifest(path, &entries, &count, &size) == 1) {
+            for (int i = 0; i < count; i++) find_ref(entries[i].hash, 1)->refs++;
+        }
+        free(entries);
+    }
+    closedir(dir);
+}
+
+// Delete chunks no manifest refers to (and temps left by a crash)
+static void sweep_chunks() {
+    DIR *dir = opendir(chunk_dir);
+    if (!dir) return;
+    struct dirent *sub;
+    while ((sub = readdir(dir)) != NULL) {
+        if (sub->d_name[0] == '.') continue;
+        char sub_path[sizeof(chunk_dir) + MAX_FILENAME + 1];
+        snprintf(sub_path, sizeof(sub_path), "%s%s/", chunk_dir, sub->d_name);
+        DIR *inner = opendir(sub_path);
+        if (!inner) continue;
+        struct dirent *entry;
+        while ((entry = readdir(inner)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+            char path[sizeof(sub_path) + MAX_FILENAME];
+            struct stat st;
+            snprintf(path, sizeof(path), "%s%s", sub_path, entry->d_name);
+            ChunkRef *ref = entry->d_name[0] == '.' ? NULL : find_ref(entry->d_name, 0);
+            if (ref == NULL) {
+                unlink(path);
+            } else if (stat(path, &st) == 0) {
+                ref->stored = 1;
+                stored_chunks++;
+                stored_bytes += st.st_size;
+            }
+        }
+        closedir(inner);
+    }
+    closedir(dir);
+}
+
+void init_chunk_store() {
+    init_gear();
+    snprintf(chunk_dir, sizeof(chunk_dir), "%schunks/", meta_dir);
+    mkdir(chunk_dir, 0777);
+
+    char checkpoints_dir[MAX_PATH + 16];
+    snprintf(checkpoints_dir, sizeof(checkpoints_dir), "%scheckpoints/", storage_dir);
+    pthread_mutex_lock(&chunk_mutex);
+    scan_manifests(checkpoints_dir);
+    sweep_chunks();
+    pthread_mutex_unlock(&chunk_mutex);
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "Chunk store: %d chunk(s), %zu bytes", stored_chunks, stored_bytes);
+    log_message("storage_server", log_msg);
+}
+
+// Checkpoint the current contents of a file. Only chunks not already in the
+// store are written, and they are synced together before the manifest that
+// lists them; re-using a tag replaces the old checkpoint.
+int checkpoint_create(const char *filename, const char *tag, ChunkStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    char src_path[MAX_PATH], path[MAX_PATH];
+    snprintf(src_path, sizeof(src_path), "%s%s", storage_dir, filename);
+    manifest_path(filename, tag, path, sizeof(path));
+
+    int src_fd = open(src_path, O_RDONLY);
+    struct stat st;
+    if (src_fd < 0 || fstat(src_fd, &st) != 0) {
+        if (src_fd >= 0) close(src_fd);
+        return ERR_FILE_NOT_FOUND;
+    }
+    size_t size = st.st_size;
+    unsigned char *data = NULL;
+    if (size > 0) {
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, src_fd, 0);
+        if (data == MAP_FAILED) {
+            close(src_fd);
+            return ERR_SERVER_ERROR;
+        }
+    }
+
+    // Cut and hash every chunk without holding the store lock
+    ChunkEntry *added = malloc(sizeof(ChunkEntry) * (size / CHUNK_MIN_SIZE + 1));
+    size_t *offsets = malloc(sizeof(size_t) * (size / CHUNK_MIN_SIZE + 1));
+    size_t offset = 0;
+    while (offset < size) {
+        size_t length = next_boundary(data + offset, size - offset);
+        ChunkEntry *entry = &added[stats->chunks];
+        sha256_hex(data + offset, length, entry->hash);
+        entry->length = length;
+        offsets[stats->chunks++] = offset;
+        offset += length;
+    }
+    stats->bytes = size;
+
+    // Reference every chunk first, so that a concurrent replacement of
+    // another checkpoint cannot delete one under us, and note which are
+    // not on disk yet
+    char *missing = calloc(stats->chunks + 1, 1);
+    pthread_mutex_lock(&chunk_mutex);
+    for (int i = 0; i < stats->chunks; i++) {
+        ChunkRef *ref = find_ref(added[i].hash, 1);
+        ref->refs++;
+        missing[i] = !ref->stored;
+    }
+    pthread_mutex_unlock(&chunk_mutex);
+
+    int result = RESP_SUCCESS;
+    ChunkBatch batch;
+    batch.count = 0;
+    for (int i = 0; i < stats->chunks && result == RESP_SUCCESS; i++) {
+        if (!missing[i]) continue;
+        char chunk_file[MAX_PATH], temp_path[MAX_PATH + 32];
+        chunk_path(added[i].hash, chunk_file, sizeof(chunk_file));
+        int fd = write_chunk_temp(src_fd, size, data, offsets[i], added[i].length,
+                                  chunk_file, temp_path, sizeof(temp_path));
+        if (fd < 0) {
+            result = ERR_SERVER_ERROR;
+            break;
+        }
+        batch.fds[batch.count] = fd;
+        batch.temp_paths[batch.count] = strdup(temp_path);
+        batch.paths[batch.count] = strdup(chunk_file);
+        batch.entries[batch.count] = &added[i];
+        if (++batch.count == CHUNK_WRITE_BATCH && commit_chunks(&batch, stats) != 0) {
+            result = ERR_SERVER_ERROR;
+        }
+    }
+    if (commit_chunks(&batch, stats) != 0) result = ERR_SERVER_ERROR;
+
+    size_t capacity = 64 + (size_t)stats->chunks * (CHUNK_HASH_HEX + 24);
+    char *manifest = malloc(capacity);
+    size_t used = snprintf(manifest, capacity, "%s %zu\n", CHUNK_MAGIC, size);
+    for (int i = 0; i < stats->chunks; i++) {
+        used += snprintf(manifest + used, capacity - used, "%s %zu\n", added[i].hash, added[i].length);
+    }
+
+    // Swapping the manifest and dropping the old one's references is one
+    // step, so two checkpoints under the same tag cannot release it twice
+    pthread_mutex_lock(&chunk_mutex);
+    ChunkEntry *old_entries = NULL;
+    int old_count = 0;
+    size_t old_size;
+    if (result == RESP_SUCCESS) {
+        int had_manifest = read_manifest(path, &old_entries, &old_count, &old_size) == 1;
+        make_parents(path);
+        if (durable_write_file(path, manifest, used) != 0) {
+            result = ERR_SERVER_ERROR;
+        } else if (had_manifest) {
+            for (int i = 0; i < old_count; i++) unref_chunk(old_entries[i].hash);
+        }
+    }
+    if (result != RESP_SUCCESS) {
+        for (int i = 0; i < stats->chunks; i++) unref_chunk(added[i].hash);
+    }
+    pthread_mutex_unlock(&chunk_mutex);
+
+    free(old_entries);
+    free(missing);
+    free(offsets);
+    free(added);
+    free(manifest);
+    if (data) munmap(data, size);
+    close(src_fd);
+    return result;
+}
+
+// Size of a checkpoint. Returns a protocol code.
+int checkpoint_size(const char *filename, const char *tag, size_t *size) {
+    char path[MAX_PATH];
+    manifest_path(filename, tag, path, sizeof(path));
+    ChunkEntry *entries;
+    int count;
+    int kind = read_manifest(path, &entries, &count, size);
+    free(entries);
+    if (kind < 0) return ERR_CHECKPOINT_NOT_FOUND;
+
+    struct stat st;
+    if (kind == 0) {
+        if (stat(path, &st) != 0) return ERR_CHECKPOINT_NOT_FOUND;
+        *size = st.st_size;
+    }
+    return RESP_SUCCESS;
+}
+
+// Pass bytes [offset, offset + length) of a checkpoint to 'sink' piece by
+// piece, at most one chunk in memory at a time. Only the chunks that
+// overlap the range are read. Returns a protocol code.
+int checkpoint_read(const char *filename, const char *tag, size_t offset, size_t length,
+                    ChunkSink sink, void *context) {
+    char path[MAX_PATH];
+    manifest_path(filename, tag, path, sizeof(path));
+    ChunkEntry *entries;
+    int count;
+    size_t size;
+    int kind = read_manifest(path, &entries, &count, &size);
+    if (kind < 0) return ERR_CHECKPOINT_NOT_FOUND;
+
+    if (kind == 0) {
+        // Plain copy from before the chunk store: one pseudo-chunk
+        struct stat st;
+        size = stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+        entries = malloc(sizeof(ChunkEntry));
+        entries[0].length = size;
+        count = 1;
+    }
+    size_t end = (length > size || offset + length > size) ? size : offset + length;
+
+    char *buffer = malloc(CHUNK_MAX_SIZE);
+    int result = RESP_SUCCESS;
+    size_t chunk_start = 0;
+    for (int i = 0; i < count && chunk_start < end && result == RESP_SUCCESS; i++) {
+        size_t chunk_end = chunk_start + entries[i].length;
+        if (chunk_end > offset) {
+            char source[MAX_PATH];
+            if (kind == 0) snprintf(source, sizeof(source), "%s", path);
+            else chunk_path(entries[i].hash, source, sizeof(source));
+            int fd = open(source, O_RDONLY);
+            if (fd < 0) {
+                log_error("storage_server", "Checkpoint chunk missing");
+                result = ERR_SERVER_ERROR;
+                break;
+            }
+            size_t pos = offset > chunk_start ? offset : chunk_start;
+            size_t stop = chunk_end < end ? chunk_end : end;
+            while (pos < stop && result == RESP_SUCCESS) {
+                size_t want = stop - pos < CHUNK_MAX_SIZE ? stop - pos : CHUNK_MAX_SIZE;
+                if (io_pread(fd, buffer, want, pos - chunk_start) != (ssize_t)want) {
+                    log_error("storage_server", "Checkpoint chunk damaged");
+                    result = ERR_SERVER_ERROR;
+                } else if (sink(context, buffer, want) != 0) {
+                    result = ERR_SERVER_ERROR;
+                }
+                pos += want;
+            }
+            close(fd);
+        }
+        chunk_start = chunk_end;
+    }
+    free(buffer);
+    free(entries);
+    return result;
+}
+
+typedef struct {
+    char *data;
+    size_t used;
+    size_t capacity;
+} LoadBuffer;
+
+static int load_sink(void *context, const char *data, size_t length) {
+    LoadBuffer *buffer = context;
+    if (buffer->used + length > buffer->capacity) return -1;
+    memcpy(buffer->data + buffer->used, data, length);
+    buffer->used += length;
+    return 0;
+}
+
+// Whole contents of a checkpoint. Returns a protocol code; *data is
+// allocated (NUL-terminated) on success.
+int checkpoint_load(const char *filename, const char *tag, char **data, size_t *length) {
+    *data = NULL;
+    *length = 0;
+    size_t size;
+    int result = checkpoint_size(filename, tag, &size);
+    if (result != RESP_SUCCESS) return result;
+
+    LoadBuffer buffer = { malloc(size + 1), 0, size };
+    result = checkpoint_read(filename, tag, 0, size, load_sink, &buffer);
+    if (result == RESP_SUCCESS && buffer.used != size) result = ERR_SERVER_ERROR;
+    if (result != RESP_SUCCESS) {
+        free(buffer.data);
+        return result;
+    }
+    buffer.data[size] = '\0';
+    *data = buffer.data;
+    *length = size;
+    return RESP_SUCCESS;
+}
+
+typedef struct {
+    int fd;
+    off_t offset;
+} WriteTarget;
+
+static int write_sink(void *context, const char *data, size_t length) {
+    WriteTarget *target = context;
+    if (io_pwrite(target->fd, data, length, target->offset) != (ssize_t)length) return -1;
+    target->offset += length;
+    return 0;
+}
+
+static char* map_file(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    char *data = NULL;
+    *size = 0;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) data = NULL;
+        else *size = st.st_size;
+    }
+    if (fd >= 0) close(fd);
+    return data;
+}
+
+// Replace a file with one of its checkpoints, streamed chunk by chunk into
+// the commit temp file. The change is journaled so it can be undone.
+// Callers order this with other commits on the file.
+int checkpoint_restore(const char *filename, const char *tag) {
+    size_t size;
+    int result = checkpoint_size(filename, tag, &size);
+    if (result != RESP_SUCCESS) return result;
+
+    char path[MAX_PATH], temp_path[MAX_PATH + 32];
+    snprintf(path, sizeof(path), "%s%s", storage_dir, filename);
+    if (!file_exists(path)) return ERR_FILE_NOT_FOUND;
+    int fd = durable_open_temp(path, temp_path, sizeof(temp_path));
+    if (fd < 0) return ERR_SERVER_ERROR;
+
+    WriteTarget target = { fd, 0 };
+    result = checkpoint_read(filename, tag, 0, size, write_sink, &target);
+    if (result != RESP_SUCCESS) {
+        close(fd);
+        unlink(temp_path);
+        return result;
+    }
+
+    // Both versions are mapped, not copied, for the journal's delta, which
+    // is written before the rename
+    size_t old_size, new_size;
+    char *old_text = map_file(path, &old_size);
+    char *new_text = map_file(temp_path, &new_size);
+    int journaled = new_size == size && (old_text || old_size == 0) &&
+                    journal_record(filename, 0, old_text ? old_text : "", old_size,
+                                   new_text ? new_text : "", new_size, new_size) > 0;
+    if (durable_commit_temp(fd, temp_path, path) != 0) {
+        if (journaled) journal_cancel(filename);
+        result = ERR_SERVER_ERROR;
+    }
+    if (old_text) munmap(old_text, old_size);
+    if (new_text) munmap(new_text, new_size);
+    return result;
+}
+
+void chunk_store_stats(int *chunks, size_t *bytes) {
+    pthread_mutex_lock(&chunk_mutex);
+    *chunks = stored_chunks;
+    *bytes = stored_bytes;
+    pthread_mutex_unlock(&chunk_mutex);
+}
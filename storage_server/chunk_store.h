@@ -0,0 +1,56 @@
+#ifndef CHUNK_STORE_H
+#define CHUNK_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../common/protocol.h"
+#include "../common/sha256.h"
+
+// Checkpoints are stored as lists of content-defined chunks. A gear rolling
+// hash picks chunk boundaries from the content itself, so an edit only
+// changes the chunks around it and every other chunk is shared with earlier
+// checkpoints. Chunks live once per SS in meta/<SS>/chunks/, named by the
+// SHA-256 of their content (so equal names mean equal bytes), and are
+// refcounted by the manifests that list them; a chunk is deleted when its
+// last checkpoint goes. A checkpoint's new chunks are written first and
+// made durable together, then the manifest replaces the full copy at
+// checkpoints/<file>.<tag>:
+//   DOCSPP-CHUNKS 1 <size>\n
+//   <hash> <length>\n ...
+// Checkpoints written before the chunk store (plain copies) are still read.
+#define CHUNK_MAGIC "DOCSPP-CHUNKS 1"
+#define CHUNK_MIN_SIZE 2048
+#define CHUNK_AVG_BITS 13                // ~8 KB average chunk
+#define CHUNK_MAX_SIZE 65536
+#define CHUNK_HASH_HEX SHA256_HEX_SIZE
+#define CHUNK_TABLE_BUCKETS 1024
+#define CHUNK_WRITE_BATCH 64             // New chunks synced together
+
+typedef struct ChunkRef {
+    char hash[CHUNK_HASH_HEX + 1];
+    int refs;
+    int stored;                          // The chunk file is on disk
+    struct ChunkRef *next;
+} ChunkRef;
+
+typedef struct {
+    int chunks;                          // Chunks in the checkpoint
+    int new_chunks;                      // Of those, not already stored
+    size_t bytes;                        // Checkpoint size
+    size_t new_bytes;                    // Bytes actually written
+} ChunkStats;
+
+// Receives checkpoint contents piece by piece; nonzero stops the read
+typedef int (*ChunkSink)(void *context, const char *data, size_t length);
+
+// Chunk store functions
+void init_chunk_store();
+int checkpoint_create(const char *filename, const char *tag, ChunkStats *stats);
+int checkpoint_size(const char *filename, const char *tag, size_t *size);
+int checkpoint_read(const char *filename, const char *tag, size_t offset, size_t length,
+                    ChunkSink sink, void *context);
+int checkpoint_load(const char *filename, const char *tag, char **data, size_t *length);
+int checkpoint_restore(const char *filename, const char *tag);
+void chunk_store_stats(int *chunks, size_t *bytes);
+
+#endif // CHUNK_STORE_H
@@ -0,0 +1,284 @@
+#include "diff_engine.h"
+#include "sentence_parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+// Sentences or words being compared; hashes make most mismatches cheap
+typedef struct {
+    char **items;
+    uint64_t *hashes;
+    int count;
+} TokenList;
+
+// Growing edit script
+typedef struct {
+    char *data;
+    size_t used;
+    size_t capacity;
+} Script;
+
+static uint64_t token_hash(const char *text) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        hash = (hash ^ *p) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void hash_tokens(TokenList *list) {
+    list->hashes = malloc(sizeof(uint64_t) * (list->count + 1));
+    for (int i = 0; i < list->count; i++) list->hashes[i] = token_hash(list->items[i]);
+}
+
+static void sentence_tokens(const char *text, TokenList *list) {
+    list->items = parse_sentences(text ? text : "", &list->count);
+    hash_tokens(list);
+}
+
+static void word_tokens(const char *sentence, TokenList *list) {
+    list->items = parse_words(sentence, &list->count);
+    hash_tokens(list);
+}
+
+static void free_tokens(TokenList *list) {
+    for (int i = 0; i < list->count; i++) free(list->items[i]);
+    free(list->items);
+    free(list->hashes);
+}
+
+static int same_token(const TokenList *a, int i, const TokenList *b, int j) {
+    return a->hashes[i] == b->hashes[j] && strcmp(a->items[i], b->items[j]) == 0;
+}
+
+static void script_append(Script *script, const char *text, size_t length) {
+    if (script->used + length + 1 > script->capacity) {
+        while (script->used + length + 1 > script->capacity) {
+            script->capacity = script->capacity ? script->capacity * 2 : 4096;
+        }
+        script->data = realloc(script->data, script->capacity);
+    }
+    memcpy(script->data + script->used, text, length);
+    script->used += length;
+    script->data[script->used] = '\0';
+}
+
+static void script_printf(Script *script, const char *format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    script_append(script, line, length < (int)sizeof(line) ? (size_t)length : sizeof(line) - 1);
+}
+
+// Sentences may span lines; the script keeps one change per line
+static void script_flat(Script *script, const char *text) {
+    size_t start = script->used;
+    script_append(script, text, strlen(text));
+    for (size_t i = start; i < script->used; i++) {
+        if (script->data[i] == '\n' || script->data[i] == '\r') script->data[i] = ' ';
+    }
+}
+
+// Myers' greedy shortest edit script between a[a0, a0+n) and b[b0, b0+m).
+// Writes '=' (keep), '-' (only in a) and '+' (only in b) to ops in order
+// and returns their number, or -1 if more than max_edits are needed.
+static int myers(const TokenList *a, int a0, int n, const TokenList *b, int b0, int m,
+                 int max_edits, char *ops) {
+    int limit = n + m < max_edits ? n + m : max_edits;
+    int offset = limit + 1;
+    int *v = calloc(2 * limit + 3, sizeof(int));
+    int **trace = calloc(limit + 1, sizeof(int*));
+    int found = -1;
+
+    for (int d = 0; d <= limit && found < 0; d++) {
+        // Furthest x on each diagonal before this step, for the backtrack
+        trace[d] = malloc(sizeof(int) * (2 * d + 1));
+        memcpy(trace[d], v + offset - d, sizeof(int) * (2 * d + 1));
+        for (int k = -d; k <= d; k += 2) {
+            int x;
+            if (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) {
+                x = v[offset + k + 1];
+            } else {
+                x = v[offset + k - 1] + 1;
+            }
+            int y = x - k;
+            while (x < n && y < m && same_token(a, a0 + x, b, b0 + y)) {
+                x++;
+                y++;
+            }
+            v[offset + k] = x;
+            if (x >= n && y >= m) {
+                found = d;
+                break;
+            }
+        }
+    }
+
+    int count = 0;
+    if (found >= 0) {
+        int x = n, y = m;
+        for (int d = found; d > 0; d--) {
+            int *previous = trace[d];
+            int k = x - y;
+            int prev_k = (k == -d || (k != d && previous[k - 1 + d] < previous[k + 1 + d])) ? k + 1 : k - 1;
+            int prev_x = previous[prev_k + d];
+            int prev_y = prev_x - prev_k;
+            while (x > prev_x && y > prev_y) {
+                ops[count++] = '=';
+                x--;
+                y--;
+            }
+            ops[count++] = prev_k == k + 1 ? '+' : '-';
+            x = prev_x;
+            y = prev_y;
+        }
+        while (x > 0 && y > 0) {
+            ops[count++] = '=';
+            x--;
+            y--;
+        }
+        for (int i = 0; i < count / 2; i++) {
+            char op = ops[i];
+            ops[i] = ops[count - 1 - i];
+            ops[count - 1 - i] = op;
+        }
+    }
+
+    for (int d = 0; d <= limit; d++) free(trace[d]);
+    free(trace);
+    free(v);
+    return found >= 0 ? count : -1;
+}
+
+// Edit ops for the whole lists. Common leading and trailing tokens are
+// matched up front; a middle that needs too many edits is replaced whole.
+static int edit_script(const TokenList *a, const TokenList *b, char **ops_out) {
+    char *ops = malloc(a->count + b->count + 1);
+    int prefix = 0;
+    while (prefix < a->count && prefix < b->count && same_token(a, prefix, b, prefix)) prefix++;
+    int suffix = 0;
+    while (suffix < a->count - prefix && suffix < b->count - prefix &&
+           same_token(a, a->count - 1 - suffix, b, b->count - 1 - suffix)) {
+        suffix++;
+    }
+
+    int count = 0;
+    for (int i = 0; i < prefix; i++) ops[count++] = '=';
+    int n = a->count - prefix - suffix, m = b->count - prefix - suffix;
+    int middle = myers(a, prefix, n, b, prefix, m, DIFF_MAX_EDITS, ops + count);
+    if (middle >= 0) {
+        count += middle;
+    } else {
+        for (int i = 0; i < n; i++) ops[count++] = '-';
+        for (int i = 0; i < m; i++) ops[count++] = '+';
+    }
+    for (int i = 0; i < suffix; i++) ops[count++] = '=';
+    *ops_out = ops;
+    return count;
+}
+
+// "~ " line showing one sentence edited word by word
+static void render_words(Script *script, const char *old_sentence, const char *new_sentence) {
+    TokenList a, b;
+    word_tokens(old_sentence, &a);
+    word_tokens(new_sentence, &b);
+    char *ops;
+    int count = edit_script(&a, &b, &ops);
+
+    int kept = 0;
+    for (int i = 0; i < count; i++) kept += ops[i] == '=';
+    if (kept == 0 && a.count > 0 && b.count > 0) {
+        // Nothing in common: a plain replacement reads better
+        script_append(script, "- ", 2);
+        script_flat(script, old_sentence);
+        script_append(script, "\n+ ", 3);
+        script_flat(script, new_sentence);
+        script_append(script, "\n", 1);
+    } else {
+        script_append(script, "~", 1);
+        int ai = 0, bi = 0;
+        if (kept == count) script_append(script, " (whitespace only)", 18);
+        for (int i = 0; i < count; ) {
+            char op = ops[i];
+            script_append(script, " ", 1);
+            if (op == '=') {
+                script_append(script, a.items[ai], strlen(a.items[ai]));
+                ai++;
+                bi++;
+                i++;
+                continue;
+            }
+            script_append(script, op == '-' ? "[-" : "{+", 2);
+            for (int first = 1; i < count && ops[i] == op; i++, first = 0) {
+                if (!first) script_append(script, " ", 1);
+                const char *word = op == '-' ? a.items[ai++] : b.items[bi++];
+                script_append(script, word, strlen(word));
+            }
+            script_append(script, op == '-' ? "-]" : "+}", 2);
+        }
+        script_append(script, "\n", 1);
+    }
+    free(ops);
+    free_tokens(&a);
+    free_tokens(&b);
+}
+
+// Edit script turning old_text into new_text; empty if they have the same
+// sentences. Returns an allocated string.
+char* diff_texts(const char *old_text, const char *new_text, size_t *length, DiffStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    TokenList a, b;
+    sentence_tokens(old_text, &a);
+    sentence_tokens(new_text, &b);
+    char *ops;
+    int count = edit_script(&a, &b, &ops);
+
+    Script script = { NULL, 0, 0 };
+    script_append(&script, "", 0);
+    int ai = 0, bi = 0;
+    for (int i = 0; i < count; ) {
+        if (ops[i] == '=') {
+            ai++;
+            bi++;
+            i++;
+            continue;
+        }
+        // A hunk: the run of changes up to the next kept sentence
+        int removed = 0, added = 0;
+        for (; i < count && ops[i] != '='; i++) {
+            if (ops[i] == '-') removed++;
+            else added++;
+        }
+        script_printf(&script, "@@ -%d,%d +%d,%d @@\n", ai, removed, bi, added);
+        if (removed == added) {
+            for (int k = 0; k < removed; k++) render_words(&script, a.items[ai + k], b.items[bi + k]);
+            stats->changed += removed;
+        } else {
+            for (int k = 0; k < removed; k++) {
+                script_append(&script, "- ", 2);
+                script_flat(&script, a.items[ai + k]);
+                script_append(&script, "\n", 1);
+            }
+            for (int k = 0; k < added; k++) {
+                script_append(&script, "+ ", 2);
+                script_flat(&script, b.items[bi + k]);
+                script_append(&script, "\n", 1);
+            }
+            stats->removed += removed;
+            stats->added += added;
+        }
+        stats->hunks++;
+        ai += removed;
+        bi += added;
+    }
+
+    free(ops);
+    free_tokens(&a);
+    free_tokens(&b);
+    *length = script.used;
+    return script.data;
+}
@@ -0,0 +1,27 @@
+#ifndef DIFF_ENGINE_H
+#define DIFF_ENGINE_H
+
+#include <stddef.h>
+
+// Sentence-aware diff for DIFF. The texts are split into sentences (same
+// rules as WRITE) and compared with Myers' shortest edit script; a hunk
+// that replaces sentences one for one is diffed again word by word. The
+// edit script is plain text, one line per change, sentences numbered from
+// 0 as in WRITE:
+//   @@ -<first old>,<count> +<first new>,<count> @@
+//   - <removed sentence>
+//   + <added sentence>
+//   ~ <sentence with [-removed-]{+added+} words>
+#define DIFF_MAX_EDITS 1000   // Longer scripts: the differing middle is shown as replaced
+
+typedef struct {
+    int hunks;
+    int added;                // Sentences only in the new text
+    int removed;              // Sentences only in the old text
+    int changed;              // Sentences edited in place
+} DiffStats;
+
+// Diff functions
+char* diff_texts(const char *old_text, const char *new_text, size_t *length, DiffStats *stats);
+
+#endif // DIFF_ENGINE_H
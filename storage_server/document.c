@@ -0,0 +1,1111 @@
+#include "document.h"
+#include "sentence_parser.h"
+#include "file_operations.h"
+#include "sentence_index.h"
+#include "durable_io.h"
+#include "io_engine.h"
+#include "undo_manager.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#define DOC_CLEAN ((size_t)-1)   // dirty_from when the disk file matches the text
+#define INDEX_CLEAN (-1)         // index_dirty_from when the sidecar index is current
+
+// Open documents by filename. Idle ones (refcount 0) stay in the table and
+// in the LRU list while their memory fits the budget.
+static Document *doc_table[DOC_TABLE_BUCKETS];
+static Document *lru_head = NULL;
+static Document *lru_tail = NULL;
+static size_t cache_bytes = 0;
+static size_t cache_budget = (size_t)DEFAULT_DOC_CACHE_MB * 1024 * 1024;
+static unsigned long cache_hits = 0;
+static unsigned long cache_misses = 0;
+static pthread_mutex_t doc_table_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int doc_hash(const char *str) {
+    unsigned int hash = 5381;
+    int c;
+    while ((c = *str++))
+        hash = ((hash << 5) + hash) + c;
+    return hash % DOC_TABLE_BUCKETS;
+}
+
+static void doc_path(Document *doc, char *path, size_t size) {
+    snprintf(path, size, "%s%s", storage_dir, doc->filename);
+}
+
+static void record_disk_identity(Document *doc, const struct stat *st) {
+    doc->disk_size = st->st_size;
+    doc->disk_mtime = st->st_mtim;
+    doc->disk_ino = st->st_ino;
+}
+
+static int same_disk_identity(Document *doc, const struct stat *st) {
+    return doc->disk_size == st->st_size && doc->disk_ino == st->st_ino &&
+           doc->disk_mtime.tv_sec == st->st_mtim.tv_sec &&
+           doc->disk_mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static void trim_trailing_space(char *str) {
+    size_t len = strlen(str);
+    while (len > 0 && isspace((unsigned char)str[len - 1])) {
+        str[--len] = '\0';
+    }
+}
+
+static void free_sentences(char **sentences, int count) {
+    for (int i = 0; i < count; i++) {
+        free(sentences[i]);
+    }
+    free(sentences);
+}
+
+static void ensure_span_capacity(Document *doc, int needed) {
+    if (needed <= doc->span_capacity) return;
+    int capacity = doc->span_capacity ? doc->span_capacity : 16;
+    while (capacity < needed) capacity *= 2;
+    doc->spans = realloc(doc->spans, sizeof(SentenceSpan) * capacity);
+    doc->span_capacity = capacity;
+}
+
+static void ensure_piece_capacity(Document *doc, int needed) {
+    if (needed <= doc->piece_capacity) return;
+    int capacity = doc->piece_capacity ? doc->piece_capacity : 16;
+    while (capacity < needed) capacity *= 2;
+    doc->pieces = realloc(doc->pieces, sizeof(Piece) * capacity);
+    doc->piece_capacity = capacity;
+}
+
+static void release_contents(Document *doc) {
+    free(doc->original);
+    free(doc->add);
+    free(doc->pieces);
+    free(doc->spans);
+    doc->original = doc->add = NULL;
+    doc->pieces = NULL;
+    doc->spans = NULL;
+    doc->original_length = doc->add_length = doc->add_capacity = 0;
+    doc->piece_count = doc->piece_capacity = 0;
+    doc->sentence_count = doc->span_capacity = 0;
+    doc->length = 0;
+    doc->loaded = 0;
+}
+
+static size_t document_memory(Document *doc) {
+    return sizeof(Document) + doc->original_length + doc->add_capacity +
+           sizeof(Piece) * doc->piece_capacity + sizeof(SentenceSpan) * doc->span_capacity;
+}
+
+// LRU and table helpers; callers hold doc_table_mutex
+static void lru_unlink(Document *doc) {
+    if (doc->lru_prev) doc->lru_prev->lru_next = doc->lru_next;
+    else lru_head = doc->lru_next;
+    if (doc->lru_next) doc->lru_next->lru_prev = doc->lru_prev;
+    else lru_tail = doc->lru_prev;
+    doc->lru_prev = doc->lru_next = NULL;
+    cache_bytes -= doc->cached_bytes;
+    doc->cached_bytes = 0;
+}
+
+static void lru_push_front(Document *doc) {
+    doc->cached_bytes = document_memory(doc);
+    doc->lru_prev = NULL;
+    doc->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = doc;
+    else lru_tail = doc;
+    lru_head = doc;
+    cache_bytes += doc->cached_bytes;
+}
+
+static void table_unlink(Document *doc) {
+    Document **link = &doc_table[doc_hash(doc->filename)];
+    while (*link != NULL && *link != doc) {
+        link = &(*link)->next;
+    }
+    if (*link == doc) *link = doc->next;
+}
+
+static void free_document(Document *doc) {
+    release_contents(doc);
+    pthread_cond_destroy(&doc->commit_turn);
+    pthread_mutex_destroy(&doc->lock);
+    free(doc);
+}
+
+// Make 'text' the whole original buffer, with one piece covering it
+static void set_original(Document *doc, char *text, size_t length) {
+    free(doc->original);
+    doc->original = text;
+    doc->original_length = length;
+    doc->add_length = 0;
+    doc->piece_count = 0;
+    if (length > 0) {
+        ensure_piece_capacity(doc, 1);
+        doc->pieces[0].source = PIECE_ORIGINAL;
+        doc->pieces[0].start = 0;
+        doc->pieces[0].length = length;
+        doc->piece_count = 1;
+    }
+    doc->length = length;
+}
+
+// Write the sidecar index for sentences [index_dirty_from, count)
+static void update_index(Document *doc, const struct stat *st) {
+    if (doc->index_dirty_from == INDEX_CLEAN || doc->dirty_from != DOC_CLEAN) return;
+
+    int from = doc->index_dirty_from;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int count = doc->sentence_count - from;
+        uint64_t *entries = malloc(sizeof(uint64_t) * (count > 0 ? count : 1));
+        for (int i = 0; i < count; i++) {
+            entries[i] = doc->spans[from + i].offset;
+        }
+        int result = sidx_write(doc->filename, entries, from, doc->sentence_count, st);
+        free(entries);
+        if (result != 1) break;
+        from = 0;   // Existing index too short to patch - rewrite it whole
+    }
+    doc->index_dirty_from = INDEX_CLEAN;
+}
+
+static int read_raw(const char *path, char **raw, size_t *raw_length, struct stat *st) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    if (fstat(fd, st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    *raw = malloc(st->st_size + 2);
+    *raw_length = 0;
+    ssize_t bytes = io_pread(fd, *raw, st->st_size, 0);
+    if (bytes > 0) *raw_length = bytes;
+    close(fd);
+    (*raw)[*raw_length] = '\0';
+    return 0;
+}
+
+// Bytes [*offset, *offset + *length) of a file, clamped to its size (both
+// updated); *size receives the file size
+static int read_raw_range(const char *path, size_t *offset, size_t *length, char **text, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    *size = st.st_size;
+    if (*offset > *size) *offset = *size;
+    if (*length > *size - *offset) *length = *size - *offset;
+    *text = malloc(*length + 1);
+    ssize_t bytes = io_pread(fd, *text, *length, *offset);
+    size_t used = bytes > 0 ? bytes : 0;
+    close(fd);
+    *length = used;
+    (*text)[used] = '\0';
+    return 0;
+}
+
+// Take sentence boundaries from a current sidecar index instead of parsing
+static int load_from_index(Document *doc, char *raw, size_t raw_length, const struct stat *st) {
+    SidxHeader header;
+    int fd = sidx_open(doc->filename, &header);
+    if (fd < 0) return -1;
+    if (header.file_size != raw_length || header.sentence_count > (uint64_t)INT32_MAX) {
+        close(fd);
+        return -1;
+    }
+
+    int count = (int)header.sentence_count;
+    uint64_t *offsets = malloc(sizeof(uint64_t) * (count > 0 ? count : 1));
+    int result = sidx_read_offsets(fd, &header, offsets);
+    close(fd);
+    if (result != 0) {
+        free(offsets);
+        return -1;
+    }
+
+    release_contents(doc);
+    ensure_span_capacity(doc, count > 0 ? count : 1);
+    for (int i = 0; i < count; i++) {
+        uint64_t end = i + 1 < count ? offsets[i + 1] - 1 : raw_length;
+        doc->spans[i].offset = offsets[i];
+        doc->spans[i].length = end - offsets[i];
+    }
+    free(offsets);
+    doc->sentence_count = count;
+    doc->dirty_from = DOC_CLEAN;
+    doc->index_dirty_from = INDEX_CLEAN;
+    set_original(doc, raw, raw_length);
+    record_disk_identity(doc, st);
+    doc->loaded = 1;
+    return 0;
+}
+
+// Read the file and normalize it the way WRITE always has: line breaks
+// become spaces and sentences are rejoined with single spaces.
+static int load_document(Document *doc) {
+    char path[MAX_PATH];
+    doc_path(doc, path, sizeof(path));
+
+    char *raw;
+    size_t raw_length;
+    struct stat st;
+    if (read_raw(path, &raw, &raw_length, &st) != 0) return -1;
+    if (load_from_index(doc, raw, raw_length, &st) == 0) return 0;
+
+    // Line breaks (LF or CRLF) read as word separators
+    char *content = malloc(raw_length + 2);
+    size_t used = 0;
+    for (size_t i = 0; i < raw_length; i++) {
+        if (raw[i] == '\r' && i + 1 < raw_length && raw[i + 1] == '\n') continue;
+        content[used++] = raw[i] == '\n' ? ' ' : raw[i];
+    }
+    content[used] = '\0';
+
+    int count = 0;
+    char **sentences = parse_sentences(content, &count);
+    free(content);
+
+    release_contents(doc);
+    ensure_span_capacity(doc, count > 0 ? count : 1);
+
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        trim_trailing_space(sentences[i]);
+        total += strlen(sentences[i]) + 1;
+    }
+    char *text = malloc(total + 1);
+    size_t offset = 0;
+    for (int i = 0; i < count; i++) {
+        if (i > 0) text[offset++] = ' ';
+        size_t len = strlen(sentences[i]);
+        memcpy(text + offset, sentences[i], len);
+        doc->spans[i].offset = offset;
+        doc->spans[i].length = len;
+        offset += len;
+    }
+    text[offset] = '\0';
+    doc->sentence_count = count;
+    if (sentences) free_sentences(sentences, count);
+
+    // Only rewrite the file on the first commit if normalizing changed it
+    doc->dirty_from = (offset == raw_length && memcmp(text, raw, offset) == 0) ? DOC_CLEAN : 0;
+    free(raw);
+
+    set_original(doc, text, offset);
+    record_disk_identity(doc, &st);
+    doc->loaded = 1;
+
+    // Missing or stale index: rebuild it now (if the file is already normalized)
+    doc->index_dirty_from = 0;
+    update_index(doc, &st);
+    return 0;
+}
+
+static void copy_range(Document *doc, size_t offset, size_t length, char *out) {
+    size_t position = 0;
+    for (int i = 0; i < doc->piece_count && length > 0; i++) {
+        Piece *piece = &doc->pieces[i];
+        if (offset >= position + piece->length) {
+            position += piece->length;
+            continue;
+        }
+        size_t skip = offset > position ? offset - position : 0;
+        size_t take = piece->length - skip;
+        if (take > length) take = length;
+        const char *base = piece->source == PIECE_ORIGINAL ? doc->original : doc->add;
+        memcpy(out, base + piece->start + skip, take);
+        out += take;
+        length -= take;
+        offset += take;
+        position += piece->length;
+    }
+}
+
+// Make sure a piece boundary falls at 'offset'; returns the index of the
+// piece that starts there (piece_count if offset is the end of the text)
+static int split_at(Document *doc, size_t offset) {
+    size_t position = 0;
+    for (int i = 0; i < doc->piece_count; i++) {
+        Piece *piece = &doc->pieces[i];
+        if (position == offset) return i;
+        if (offset < position + piece->length) {
+            ensure_piece_capacity(doc, doc->piece_count + 1);
+            piece = &doc->pieces[i];
+            memmove(&doc->pieces[i + 2], &doc->pieces[i + 1],
+                    sizeof(Piece) * (doc->piece_count - i - 1));
+            size_t head = offset - position;
+            doc->pieces[i + 1].source = piece->source;
+            doc->pieces[i + 1].start = piece->start + head;
+            doc->pieces[i + 1].length = piece->length - head;
+            piece->length = head;
+            doc->piece_count++;
+            return i + 1;
+        }
+        position += piece->length;
+    }
+    return doc->piece_count;
+}
+
+// Collapse all pieces into a fresh original buffer
+static void flatten(Document *doc) {
+    char *text = malloc(doc->length + 1);
+    copy_range(doc, 0, doc->length, text);
+    text[doc->length] = '\0';
+    set_original(doc, text, doc->length);
+}
+
+// Replace text[start, end) with 'text'. Cost depends on the piece count
+// and the inserted length, not on the document size.
+static void replace_range(Document *doc, size_t start, size_t end, const char *text, size_t length) {
+    size_t add_start = doc->add_length;
+    if (length > 0) {
+        if (doc->add_length + length > doc->add_capacity) {
+            size_t capacity = doc->add_capacity ? doc->add_capacity : 1024;
+            while (capacity < doc->add_length + length) capacity *= 2;
+            doc->add = realloc(doc->add, capacity);
+            doc->add_capacity = capacity;
+        }
+        memcpy(doc->add + doc->add_length, text, length);
+        doc->add_length += length;
+    }
+
+    int first = split_at(doc, start);
+    int last = split_at(doc, end);
+    memmove(&doc->pieces[first], &doc->pieces[last], sizeof(Piece) * (doc->piece_count - last));
+    doc->piece_count -= last - first;
+
+    if (length > 0) {
+        Piece *prev = first > 0 ? &doc->pieces[first - 1] : NULL;
+        if (prev && prev->source == PIECE_ADD && prev->start + prev->length == add_start) {
+            prev->length += length;   // Typing at the end of the last insert
+        } else {
+            ensure_piece_capacity(doc, doc->piece_count + 1);
+            memmove(&doc->pieces[first + 1], &doc->pieces[first],
+                    sizeof(Piece) * (doc->piece_count - first));
+            doc->pieces[first].source = PIECE_ADD;
+            doc->pieces[first].start = add_start;
+            doc->pieces[first].length = length;
+            doc->piece_count++;
+        }
+    }
+    doc->length = doc->length - (end - start) + length;
+
+    if (start < doc->dirty_from) doc->dirty_from = start;
+    if (doc->piece_count > DOC_MAX_PIECES) flatten(doc);
+}
+
+// Redo records live flat in meta_dir next to the undo journals
+static void redo_path(const char *filename, char *path, size_t size) {
+    char flat[MAX_FILENAME];
+    strncpy(flat, filename, sizeof(flat) - 1);
+    flat[sizeof(flat) - 1] = '\0';
+    for (char *p = flat; *p; p++) {
+        if (*p == '/') *p = '#';
+    }
+    snprintf(path, size, "%s%s.redo", meta_dir, flat);
+}
+
+static uint64_t redo_hash(const char *data, size_t length) {
+    uint64_t hash = 1469598103934665603ULL;   // FNV-1a
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Write and sync the redo record for 'length' bytes at 'offset' leaving the
+// file 'size' bytes long. Returns the open record fd, or -1.
+static int redo_begin(const char *filename, ino_t ino, size_t offset, const char *tail, size_t length,
+                      size_t size) {
+    char path[MAX_PATH];
+    redo_path(filename, path, sizeof(path));
+    int created = 1;
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (fd < 0) {
+        created = 0;
+        fd = open(path, O_RDWR);
+    }
+    if (fd < 0) return -1;
+
+    RedoRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = REDO_MAGIC;
+    record.ino = ino;
+    record.offset = offset;
+    record.length = length;
+    record.size = size;
+    record.hash = redo_hash(tail, length);
+    uint64_t total = sizeof(record) + length + sizeof(uint64_t);
+
+    char *buffer = malloc(total);
+    memcpy(buffer, &record, sizeof(record));
+    memcpy(buffer + sizeof(record), tail, length);
+    memcpy(buffer + sizeof(record) + length, &total, sizeof(total));
+    int ok = pwrite(fd, buffer, total, 0) == (ssize_t)total && ftruncate(fd, total) == 0 &&
+             durable_sync_in_place(fd, path) == 0;
+    free(buffer);
+    if (!ok) {
+        close(fd);
+        return -1;
+    }
+    if (created && durability_level() != DURABILITY_NONE) durable_sync_parent(path);
+    return fd;
+}
+
+// Replay a redo record a crash left behind, then empty it
+static void redo_recover(const char *record_path, const char *filename) {
+    int fd = open(record_path, O_RDWR);
+    if (fd < 0) return;
+    struct stat st;
+    RedoRecord record;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)(sizeof(record) + sizeof(uint64_t)) ||
+        pread(fd, &record, sizeof(record), 0) != sizeof(record) || record.magic != REDO_MAGIC ||
+        st.st_size != (off_t)(sizeof(record) + record.length + sizeof(uint64_t))) {
+        close(fd);
+        return;   // Empty or torn: the data file was never touched
+    }
+
+    char *tail = malloc(record.length + 1);
+    uint64_t trailer = 0;
+    int intact = pread(fd, tail, record.length, sizeof(record)) == (ssize_t)record.length &&
+                 pread(fd, &trailer, sizeof(trailer), sizeof(record) + record.length) == sizeof(trailer) &&
+                 trailer == (uint64_t)st.st_size && record.hash == redo_hash(tail, record.length);
+
+    char data_path[MAX_PATH], log_msg[MAX_PATH + 64];
+    snprintf(data_path, sizeof(data_path), "%s%s", storage_dir, filename);
+    int data_fd = intact ? open(data_path, O_RDWR) : -1;
+    struct stat data_st;
+    if (data_fd >= 0 && fstat(data_fd, &data_st) == 0 && data_st.st_ino == (ino_t)record.ino) {
+        if (pwrite(data_fd, tail, record.length, record.offset) == (ssize_t)record.length &&
+            ftruncate(data_fd, record.size) == 0 && fdatasync(data_fd) == 0) {
+            snprintf(log_msg, sizeof(log_msg), "Finished interrupted commit of '%s'", filename);
+            log_message("storage_server", log_msg);
+        } else {
+            log_error("storage_server", "Failed to finish interrupted commit");
+            intact = 0;   // Keep the record for the next start
+        }
+    }
+    if (data_fd >= 0) close(data_fd);
+    free(tail);
+    if (intact && ftruncate(fd, 0) == 0) fdatasync(fd);
+    close(fd);
+}
+
+// Finish in-place rewrites a crash interrupted
+static void recover_in_place_commits() {
+    DIR *dir = opendir(meta_dir);
+    if (!dir) return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len <= 5 || len >= MAX_FILENAME || strcmp(entry->d_name + len - 5, ".redo") != 0) continue;
+
+        char filename[MAX_FILENAME], record_path[MAX_PATH];
+        snprintf(filename, sizeof(filename), "%.*s", (int)(len - 5), entry->d_name);
+        for (char *p = filename; *p; p++) {
+            if (*p == '#') *p = '/';
+        }
+        if (snprintf(record_path, sizeof(record_path), "%s%s", meta_dir, entry->d_name) >= (int)sizeof(record_path)) continue;
+        redo_recover(record_path, filename);
+    }
+    closedir(dir);
+}
+
+// Finish interrupted in-place commits and set the idle-document budget
+void init_document_cache() {
+    recover_in_place_commits();
+
+    int budget_mb = get_config_int("DOCSPP_SS_DOC_CACHE_MB", DEFAULT_DOC_CACHE_MB);
+    if (budget_mb < 0) budget_mb = 0;
+    pthread_mutex_lock(&doc_table_mutex);
+    cache_budget = (size_t)budget_mb * 1024 * 1024;
+    pthread_mutex_unlock(&doc_table_mutex);
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "Document cache initialized (%d MB budget)", budget_mb);
+    log_message("storage_server", log_msg);
+}
+
+// Open (or share) the document for a file. Returns NULL if it does not exist.
+// Nothing is read until document_peek or document_load.
+Document* document_open(const char *filename) {
+    unsigned int index = doc_hash(filename);
+
+    pthread_mutex_lock(&doc_table_mutex);
+    Document *doc = doc_table[index];
+    while (doc != NULL && strcmp(doc->filename, filename) != 0) {
+        doc = doc->next;
+    }
+    if (doc != NULL) {
+        if (doc->refcount++ == 0) lru_unlink(doc);
+        pthread_mutex_unlock(&doc_table_mutex);
+        return doc;
+    }
+
+    char path[MAX_PATH];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s%s", storage_dir, filename);
+    if (stat(path, &st) != 0) {
+        pthread_mutex_unlock(&doc_table_mutex);
+        return NULL;
+    }
+
+    // The text is loaded lazily - opening a WRITE session only needs the index
+    doc = calloc(1, sizeof(Document));
+    strncpy(doc->filename, filename, sizeof(doc->filename) - 1);
+    pthread_mutex_init(&doc->lock, NULL);
+    pthread_cond_init(&doc->commit_turn, NULL);
+    doc->dirty_from = DOC_CLEAN;
+    doc->index_dirty_from = INDEX_CLEAN;
+    doc->refcount = 1;
+    doc->next = doc_table[index];
+    doc_table[index] = doc;
+    pthread_mutex_unlock(&doc_table_mutex);
+    return doc;
+}
+
+// Drop a reference. The last one parks a clean, loaded document in the LRU
+// (evicting the least recently used idle ones beyond the budget); anything
+// else is freed straight away.
+void document_close(Document *doc) {
+    Document *evicted = NULL;
+
+    pthread_mutex_lock(&doc_table_mutex);
+    if (--doc->refcount > 0) {
+        pthread_mutex_unlock(&doc_table_mutex);
+        return;
+    }
+    if (doc->loaded && doc->dirty_from == DOC_CLEAN && document_memory(doc) <= cache_budget) {
+        lru_push_front(doc);
+        doc = NULL;
+    } else {
+        table_unlink(doc);
+    }
+    while (cache_bytes > cache_budget && lru_tail != NULL) {
+        Document *victim = lru_tail;
+        lru_unlink(victim);
+        table_unlink(victim);
+        victim->next = evicted;
+        evicted = victim;
+    }
+    pthread_mutex_unlock(&doc_table_mutex);
+
+    if (doc) free_document(doc);
+    while (evicted != NULL) {
+        Document *next = evicted->next;
+        free_document(evicted);
+        evicted = next;
+    }
+}
+
+// Reload if the file was changed behind our back (UNDO, REVERT, edits made
+// while offline). Returns 1 if reloaded, 0 if current, -1 if the file is gone.
+int document_refresh(Document *doc) {
+    char path[MAX_PATH];
+    doc_path(doc, path, sizeof(path));
+    struct stat st;
+    if (stat(path, &st) != 0) return -1;
+    if (!doc->loaded || same_disk_identity(doc, &st)) return 0;
+    return load_document(doc) == 0 ? 1 : -1;
+}
+
+// Make sure the full text and sentence spans are in memory
+int document_load(Document *doc) {
+    if (doc->loaded) return 0;
+    return load_document(doc);
+}
+
+// Read one sentence for opening a WRITE session, plus the sentence count.
+// A document that is not in memory is served from the sidecar index with
+// two index reads and one read of the sentence itself, instead of parsing
+// the whole file. Returns a malloc'd copy ("" past the end), or NULL.
+char* document_peek(Document *doc, int index, int *count) {
+    if (!doc->loaded) {
+        SidxHeader header;
+        int fd = sidx_open(doc->filename, &header);
+        if (fd >= 0) {
+            *count = (int)header.sentence_count;
+            uint64_t offset = 0, length = 0;
+            int found = index >= 0 && index < *count &&
+                        sidx_span(fd, &header, index, &offset, &length) == 0;
+            close(fd);
+            if (index < 0 || index >= *count) return strdup("");
+
+            char path[MAX_PATH];
+            doc_path(doc, path, sizeof(path));
+            int data_fd = found ? open(path, O_RDONLY) : -1;
+            if (data_fd >= 0) {
+                char *sentence = malloc(length + 1);
+                ssize_t bytes = pread(data_fd, sentence, length, offset);
+                close(data_fd);
+                if (bytes == (ssize_t)length) {
+                    sentence[length] = '\0';
+                    return sentence;
+                }
+                free(sentence);
+            }
+        }
+        // No usable index - parse the document (which rebuilds the index)
+        if (load_document(doc) != 0) return NULL;
+    }
+    *count = doc->sentence_count;
+    return document_sentence(doc, index);
+}
+
+// Copy of one sentence (malloc'd)
+char* document_sentence(Document *doc, int index) {
+    if (index < 0 || index >= doc->sentence_count) return strdup("");
+    SentenceSpan *span = &doc->spans[index];
+    char *sentence = malloc(span->length + 1);
+    copy_range(doc, span->offset, span->length, sentence);
+    sentence[span->length] = '\0';
+    return sentence;
+}
+
+// Copy of the whole text (malloc'd)
+char* document_text(Document *doc) {
+    char *text = malloc(doc->length + 1);
+    copy_range(doc, 0, doc->length, text);
+    text[doc->length] = '\0';
+    return text;
+}
+
+// Replace sentence 'index' (or append one when index == sentence_count)
+// with 'text', re-splitting it the way a fresh load would: delimiters
+// inside it start new sentences, and a sentence left without a delimiter
+// runs into the next one. Returns the new sentence count; *first and *last
+// (if given) receive the range of old sentences that was replaced.
+int document_replace_sentence(Document *doc, int index, const char *text, int *first_out, int *last_out) {
+    if (index < 0 || index > doc->sentence_count) return -1;
+
+    char *owned = NULL;
+    if (index == doc->sentence_count && index > 0) {
+        char *previous = document_sentence(doc, index - 1);
+        if (!sentence_has_delimiter(previous)) {
+            // Appending after an open sentence just continues it
+            owned = malloc(strlen(previous) + strlen(text) + 2);
+            sprintf(owned, "%s %s", previous, text);
+            text = owned;
+            index--;
+        }
+        free(previous);
+    }
+
+    int first = index, last = index;
+    size_t start, end;
+    char *region;
+    if (index == doc->sentence_count) {
+        // Append after the last sentence
+        start = end = doc->length;
+        last = index - 1;
+        region = strdup(text);
+    } else {
+        start = doc->spans[index].offset;
+        end = start + doc->spans[index].length;
+        region = strdup(text);
+        trim_trailing_space(region);
+        size_t len = strlen(region);
+        int open_ended = len == 0 || !(region[len - 1] == '.' || region[len - 1] == '!' ||
+                                       region[len - 1] == '?');
+        if (open_ended && len > 0 && index + 1 < doc->sentence_count) {
+            // No delimiter: on disk this would merge with the next sentence
+            char *next = document_sentence(doc, index + 1);
+            char *merged = malloc(len + strlen(next) + 2);
+            sprintf(merged, "%s %s", region, next);
+            free(next);
+            free(region);
+            region = merged;
+            last = index + 1;
+            end = doc->spans[last].offset + doc->spans[last].length;
+        }
+    }
+
+    int count = 0;
+    char **sentences = parse_sentences(region, &count);
+    free(region);
+    free(owned);
+
+    // Join the new sentences with single spaces
+    size_t total = 1;
+    for (int i = 0; i < count; i++) {
+        trim_trailing_space(sentences[i]);
+        total += strlen(sentences[i]) + 1;
+    }
+    char *joined = malloc(total + 1);
+    size_t joined_length = 0;
+    int appending = index == doc->sentence_count;
+    if (appending && doc->sentence_count > 0 && count > 0) joined[joined_length++] = ' ';
+    size_t *offsets = malloc(sizeof(size_t) * (count > 0 ? count : 1));
+    for (int i = 0; i < count; i++) {
+        if (i > 0) joined[joined_length++] = ' ';
+        offsets[i] = start + joined_length;
+        size_t len = strlen(sentences[i]);
+        memcpy(joined + joined_length, sentences[i], len);
+        joined_length += len;
+    }
+
+    // A sentence that vanished takes one separator with it
+    if (count == 0 && !appending) {
+        if (last + 1 < doc->sentence_count) {
+            end = doc->spans[last + 1].offset;
+        } else if (first > 0) {
+            start = doc->spans[first - 1].offset + doc->spans[first - 1].length;
+        }
+    }
+
+    replace_range(doc, start, end, joined, joined_length);
+    long delta = (long)joined_length - (long)(end - start);
+
+    if (doc->index_dirty_from == INDEX_CLEAN || first < doc->index_dirty_from) {
+        doc->index_dirty_from = first;
+    }
+
+    // Splice the sentence index: spans [first, last] become the new ones
+    int removed = last - first + 1;
+    int new_count = doc->sentence_count - removed + count;
+    ensure_span_capacity(doc, new_count > 0 ? new_count : 1);
+    memmove(&doc->spans[first + count], &doc->spans[last + 1],
+            sizeof(SentenceSpan) * (doc->sentence_count - last - 1));
+    for (int i = 0; i < count; i++) {
+        doc->spans[first + i].offset = offsets[i];
+        doc->spans[first + i].length = strlen(sentences[i]);
+    }
+    for (int i = first + count; i < new_count; i++) {
+        doc->spans[i].offset += delta;
+    }
+    doc->sentence_count = new_count;
+    if (first_out) *first_out = first;
+    if (last_out) *last_out = last;
+
+    free(offsets);
+    free(joined);
+    if (sentences) free_sentences(sentences, count);
+    return new_count;
+}
+
+// Take the document lock for a commit. Commits queue up in arrival order,
+// so a steady stream of writers on one file cannot starve any of them.
+void document_commit_begin(Document *doc) {
+    pthread_mutex_lock(&doc->lock);
+    unsigned long ticket = doc->commit_next++;
+    while (ticket != doc->commit_serving) {
+        pthread_cond_wait(&doc->commit_turn, &doc->lock);
+    }
+}
+
+void document_commit_end(Document *doc) {
+    doc->commit_serving++;
+    pthread_cond_broadcast(&doc->commit_turn);
+    pthread_mutex_unlock(&doc->lock);
+}
+
+// Patch the changed tail into the file itself: redo record, undo record,
+// then the bytes. On failure the old tail is put back.
+static int flush_in_place(Document *doc, int fd, const char *path, size_t start, const char *tail, size_t length,
+                          const char *old_tail, size_t old_length, struct stat *st) {
+    if (fstat(fd, st) != 0) return -1;
+    int redo_fd = redo_begin(doc->filename, st->st_ino, start, tail, length, doc->length);
+    if (redo_fd < 0) return -1;
+
+    int journaled = journal_record(doc->filename, start, old_tail, old_length, tail, length, doc->length) > 0;
+    int result = (io_pwrite(fd, tail, length, start) == (ssize_t)length && ftruncate(fd, doc->length) == 0 &&
+                  durable_sync_in_place(fd, path) == 0 && fstat(fd, st) == 0) ? 0 : -1;
+    if (result != 0) {
+        if (journaled) journal_cancel(doc->filename);
+        if (io_pwrite(fd, old_tail, old_length, start) != (ssize_t)old_length ||
+            ftruncate(fd, start + old_length) != 0) {
+            // Half written: leave the redo record to complete it at restart
+            close(redo_fd);
+            return -1;
+        }
+    }
+    if (ftruncate(redo_fd, 0) != 0) log_error("storage_server", "Failed to clear redo record");
+    close(redo_fd);
+    return result;
+}
+
+// Write the whole text to a temp file renamed over the old one. Where the
+// filesystem can share extents (reflink), the temp file starts as a clone
+// of the old one and only the changed tail is written.
+static int flush_replace(Document *doc, int old_fd, const char *path, size_t start, const char *tail,
+                         size_t length, const char *old_tail, size_t old_length, struct stat *st) {
+    char temp_path[MAX_PATH + 32];
+    int fd = durable_open_temp(path, temp_path, sizeof(temp_path));
+    if (fd < 0) return -1;
+
+    int ok = 1;
+    if (start > 0 && (old_fd < 0 || ioctl(fd, FICLONE, old_fd) != 0)) {
+        char *head = malloc(start);
+        copy_range(doc, 0, start, head);
+        ok = io_pwrite(fd, head, start, 0) == (ssize_t)start;
+        free(head);
+    }
+    if (!ok || io_pwrite(fd, tail, length, start) != (ssize_t)length ||
+        ftruncate(fd, doc->length) != 0 || fstat(fd, st) != 0) {
+        close(fd);
+        unlink(temp_path);
+        return -1;
+    }
+
+    // Journal first: a crash after the rename must not lose the undo step
+    int journaled = old_tail != NULL &&
+                    journal_record(doc->filename, start, old_tail, old_length, tail, length, doc->length) > 0;
+    int result = durable_commit_temp(fd, temp_path, path);
+    if (result != 0 && journaled) journal_cancel(doc->filename);
+    return result;
+}
+
+// Write the text back from dirty_from on. A tail shorter than the unchanged
+// head is patched into the file in place behind a redo record, so a commit
+// costs I/O for the bytes it changed; larger rewrites (and files with no
+// old version to patch) go through a temp file and a rename. Readers under
+// the document lock never see either half done; the unlocked ones (backup
+// streaming, anti-entropy hashing) are re-run by the commit's version bump.
+int document_flush(Document *doc) {
+    if (doc->dirty_from == DOC_CLEAN) return 0;
+
+    char path[MAX_PATH];
+    doc_path(doc, path, sizeof(path));
+
+    // The replaced bytes of the old file become the edit's undo record
+    size_t start = doc->dirty_from > doc->length ? doc->length : doc->dirty_from;
+    char *old_tail = NULL;
+    size_t old_length = 0;
+    int old_fd = open(path, O_RDWR);
+    if (old_fd >= 0) {
+        struct stat old_st;
+        if (fstat(old_fd, &old_st) == 0 && (size_t)old_st.st_size >= start) {
+            old_length = old_st.st_size - start;
+            old_tail = malloc(old_length + 1);
+            if (io_pread(old_fd, old_tail, old_length, start) != (ssize_t)old_length) {
+                free(old_tail);
+                old_tail = NULL;
+            }
+        }
+    }
+
+    size_t length = doc->length - start;
+    char *tail = malloc(length + 1);
+    copy_range(doc, start, length, tail);
+
+    struct stat st;
+    int result = old_tail != NULL && length < start ?
+                 flush_in_place(doc, old_fd, path, start, tail, length, old_tail, old_length, &st) :
+                 flush_replace(doc, old_fd, path, start, tail, length, old_tail, old_length, &st);
+    if (old_fd >= 0) close(old_fd);
+
+    if (result == 0) {
+        record_disk_identity(doc, &st);
+        doc->dirty_from = DOC_CLEAN;
+        update_index(doc, &st);
+    } else {
+        // Forget the unsaved edit so the next commit starts from the disk text
+        log_error("storage_server", "Failed to write document back to disk");
+        release_contents(doc);
+        doc->dirty_from = DOC_CLEAN;
+        doc->index_dirty_from = INDEX_CLEAN;
+    }
+    free(old_tail);
+    free(tail);
+    return result;
+}
+
+// Whole contents of a file, served from the document cache. Only a cached
+// text that matches the disk bytes is used; a file that load would
+// normalize is read as stored. Returns RESP_SUCCESS or an error code.
+int document_read(const char *filename, char **text, size_t *length) {
+    Document *doc = document_open(filename);
+    if (doc == NULL) return ERR_FILE_NOT_FOUND;
+
+    pthread_mutex_lock(&doc->lock);
+    int hit = doc->loaded;
+    int refreshed = document_refresh(doc);
+    int result = RESP_SUCCESS;
+    if (refreshed < 0) {
+        result = ERR_FILE_NOT_FOUND;
+    } else if (document_load(doc) != 0) {
+        result = ERR_SERVER_ERROR;
+    } else if (doc->dirty_from == DOC_CLEAN) {
+        *text = document_text(doc);
+        *length = doc->length;
+    } else {
+        char path[MAX_PATH];
+        struct stat st;
+        doc_path(doc, path, sizeof(path));
+        if (read_raw(path, text, length, &st) != 0) result = ERR_SERVER_ERROR;
+        hit = 0;
+    }
+    pthread_mutex_unlock(&doc->lock);
+
+    pthread_mutex_lock(&doc_table_mutex);
+    if (hit && refreshed == 0) cache_hits++;
+    else cache_misses++;
+    pthread_mutex_unlock(&doc_table_mutex);
+
+    document_close(doc);
+    return result;
+}
+
+// Part of what document_read returns: bytes [*offset, *offset + *length),
+// clamped to the text (both updated), with the full size in *size. A
+// document in memory is served from its text; otherwise only the range is
+// read from disk and nothing is parsed.
+int document_read_range(const char *filename, size_t *offset, size_t *length, char **text, size_t *size) {
+    Document *doc = document_open(filename);
+    if (doc == NULL) return ERR_FILE_NOT_FOUND;
+
+    pthread_mutex_lock(&doc->lock);
+    int refreshed = document_refresh(doc);
+    int hit = refreshed == 0 && doc->loaded && doc->dirty_from == DOC_CLEAN;
+    int result = RESP_SUCCESS;
+    if (refreshed < 0) {
+        result = ERR_FILE_NOT_FOUND;
+    } else if (doc->loaded && doc->dirty_from == DOC_CLEAN) {
+        *size = doc->length;
+        if (*offset > *size) *offset = *size;
+        if (*length > *size - *offset) *length = *size - *offset;
+        *text = malloc(*length + 1);
+        copy_range(doc, *offset, *length, *text);
+        (*text)[*length] = '\0';
+    } else {
+        char path[MAX_PATH];
+        doc_path(doc, path, sizeof(path));
+        if (read_raw_range(path, offset, length, text, size) != 0) result = ERR_SERVER_ERROR;
+    }
+    pthread_mutex_unlock(&doc->lock);
+
+    pthread_mutex_lock(&doc_table_mutex);
+    if (hit) cache_hits++;
+    else cache_misses++;
+    pthread_mutex_unlock(&doc_table_mutex);
+
+    document_close(doc);
+    return result;
+}
+
+// Sentences [*first, *last] (numbered as in WRITE, clamped to the document
+// and both updated) as one run of text at *offset, with the sentence count
+// and text size. A document that is not in memory is served through the
+// sidecar index: two index lookups and one read of the range.
+int document_read_sentences(const char *filename, int *first, int *last, int *count,
+                            size_t *offset, size_t *length, char **text, size_t *size) {
+    Document *doc = document_open(filename);
+    if (doc == NULL) return ERR_FILE_NOT_FOUND;
+
+    pthread_mutex_lock(&doc->lock);
+    int refreshed = document_refresh(doc);
+    int result = RESP_SUCCESS, served = 0, hit = refreshed == 0 && doc->loaded;
+    if (refreshed < 0) {
+        result = ERR_FILE_NOT_FOUND;
+        served = 1;
+    } else if (!doc->loaded) {
+        SidxHeader header;
+        int fd = sidx_open(doc->filename, &header);
+        if (fd >= 0) {
+            *count = (int)header.sentence_count;
+            if (*first < 0) *first = 0;
+            if (*last >= *count) *last = *count - 1;
+            uint64_t start = header.file_size, end = header.file_size, span_length = 0;
+            int found = 1;
+            if (*first <= *last) {
+                found = sidx_span(fd, &header, *first, &start, &span_length) == 0 &&
+                        sidx_span(fd, &header, *last, &end, &span_length) == 0;
+                end += span_length;
+            }
+            close(fd);
+
+            char path[MAX_PATH];
+            doc_path(doc, path, sizeof(path));
+            *offset = start;
+            *length = end - start;
+            int fetched = found && read_raw_range(path, offset, length, text, size) == 0;
+            if (fetched && *length == end - start) served = 1;
+            else if (fetched) free(*text);
+        }
+        // No usable index - parse the document (which rebuilds the index)
+        if (!served && document_load(doc) != 0) {
+            result = ERR_SERVER_ERROR;
+            served = 1;
+        }
+    }
+    if (!served) {
+        *count = doc->sentence_count;
+        *size = doc->length;
+        if (*first < 0) *first = 0;
+        if (*last >= *count) *last = *count - 1;
+        *offset = *first <= *last ? doc->spans[*first].offset : doc->length;
+        *length = *first <= *last ? doc->spans[*last].offset + doc->spans[*last].length - *offset : 0;
+        *text = malloc(*length + 1);
+        copy_range(doc, *offset, *length, *text);
+        (*text)[*length] = '\0';
+    }
+    pthread_mutex_unlock(&doc->lock);
+
+    pthread_mutex_lock(&doc_table_mutex);
+    if (hit) cache_hits++;
+    else cache_misses++;
+    pthread_mutex_unlock(&doc_table_mutex);
+
+    document_close(doc);
+    return result;
+}
+
+// Drop the cached text of a file rewritten outside the document (UNDO,
+// REVERT, MOVE, CREATE, DELETE). Timestamps alone can miss a same-size
+// rewrite within one clock tick, so those paths say so explicitly.
+void document_invalidate(const char *filename) {
+    sidx_remove(filename);
+    char path[MAX_PATH];
+    redo_path(filename, path, sizeof(path));
+    unlink(path);
+
+    unsigned int index = doc_hash(filename);
+    pthread_mutex_lock(&doc_table_mutex);
+    Document *doc = doc_table[index];
+    while (doc != NULL && strcmp(doc->filename, filename) != 0) {
+        doc = doc->next;
+    }
+    if (doc == NULL) {
+        pthread_mutex_unlock(&doc_table_mutex);
+        return;
+    }
+    if (doc->refcount == 0) {
+        lru_unlink(doc);
+        table_unlink(doc);
+        pthread_mutex_unlock(&doc_table_mutex);
+        free_document(doc);
+        return;
+    }
+    doc->refcount++;
+    pthread_mutex_unlock(&doc_table_mutex);
+
+    // In use: the next operation reloads from disk
+    pthread_mutex_lock(&doc->lock);
+    release_contents(doc);
+    doc->dirty_from = DOC_CLEAN;
+    doc->index_dirty_from = INDEX_CLEAN;
+    pthread_mutex_unlock(&doc->lock);
+    document_close(doc);
+}
+
+void document_cache_stats(unsigned long *hits, unsigned long *misses, size_t *bytes_used) {
+    pthread_mutex_lock(&doc_table_mutex);
+    *hits = cache_hits;
+    *misses = cache_misses;
+    *bytes_used = cache_bytes;
+    pthread_mutex_unlock(&doc_table_mutex);
+}
@@ -0,0 +1,104 @@
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+#include "../common/protocol.h"
+
+#define DOC_MAX_PIECES 256       // Flatten the piece table beyond this many pieces
+#define DOC_TABLE_BUCKETS 256
+#define DEFAULT_DOC_CACHE_MB 64  // DOCSPP_SS_DOC_CACHE_MB: idle documents kept in memory
+
+// Redo record: meta/<file>.redo holds the tail an in-place commit is about
+// to write (header, length bytes, then a uint64 copy of the record length),
+// synced before the file is touched. A crash mid-write is finished from it
+// at startup; it is emptied once the data is durable. Only the inode it
+// names is patched, so a file replaced since by a rename is left alone.
+#define REDO_MAGIC 0x31444552u   // "RED1"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t unused;
+    uint64_t ino;
+    uint64_t offset;
+    uint64_t length;                // Tail bytes that follow the header
+    uint64_t size;                  // File size after the commit
+    uint64_t hash;                  // FNV-1a of the tail bytes
+} RedoRecord;
+
+// Piece table: the document text is the concatenation of pieces, each a
+// span of either the original buffer (file as loaded) or the append-only
+// add buffer (text inserted by edits). Edits never move existing bytes.
+#define PIECE_ORIGINAL 0
+#define PIECE_ADD 1
+
+typedef struct {
+    int source;
+    size_t start;
+    size_t length;
+} Piece;
+
+// One sentence of the document text. Sentences are separated by exactly
+// one space, so offsets are enough to splice a sentence in place.
+typedef struct {
+    size_t offset;
+    size_t length;
+} SentenceSpan;
+
+// An open document, shared by every READ, STREAM, INFO and WRITE on the
+// file. Documents nobody holds stay loaded in an LRU until the budget runs out.
+typedef struct Document {
+    char filename[MAX_FILENAME];
+    char *original;
+    size_t original_length;
+    char *add;
+    size_t add_length;
+    size_t add_capacity;
+    Piece *pieces;
+    int piece_count;
+    int piece_capacity;
+    size_t length;                 // Logical text length
+    SentenceSpan *spans;
+    int sentence_count;
+    int span_capacity;
+    int loaded;                    // 0 until a commit needs the full text
+    size_t dirty_from;             // Disk file differs from the text from here on
+    int index_dirty_from;          // Sidecar index is stale from this sentence on
+    off_t disk_size;               // Identity of the file as last read/written,
+    struct timespec disk_mtime;    // to notice changes made by other paths
+    ino_t disk_ino;
+    int refcount;
+    size_t cached_bytes;           // Memory charged to the cache while idle
+    pthread_mutex_t lock;          // Held by callers around every operation below
+    pthread_cond_t commit_turn;    // Commit queue: tickets are served in arrival order
+    unsigned long commit_next;
+    unsigned long commit_serving;
+    struct Document *next;
+    struct Document *lru_prev;     // Idle documents, most recently used at the head
+    struct Document *lru_next;
+} Document;
+
+// Document functions
+void init_document_cache();
+Document* document_open(const char *filename);
+void document_close(Document *doc);
+int document_refresh(Document *doc);
+int document_load(Document *doc);
+char* document_peek(Document *doc, int index, int *count);
+char* document_sentence(Document *doc, int index);
+int document_replace_sentence(Document *doc, int index, const char *text, int *first, int *last);
+void document_commit_begin(Document *doc);
+void document_commit_end(Document *doc);
+int document_flush(Document *doc);
+char* document_text(Document *doc);
+int document_read(const char *filename, char **text, size_t *length);
+int document_read_range(const char *filename, size_t *offset, size_t *length, char **text, size_t *size);
+int document_read_sentences(const char *filename, int *first, int *last, int *count,
+                            size_t *offset, size_t *length, char **text, size_t *size);
+void document_invalidate(const char *filename);
+void document_cache_stats(unsigned long *hits, unsigned long *misses, size_t *bytes_used);
+
+#endif // DOCUMENT_H
@@ -0,0 +1,344 @@
+#include "durable_io.h"
+#include "file_operations.h"
+#include "io_engine.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#define COPY_BUFFER_SIZE (256 * 1024)
+
+static int level = DEFAULT_DURABILITY;
+static int group_window_us = DEFAULT_GROUP_COMMIT_US;
+static unsigned long temp_counter = 0;
+static unsigned long commit_count = 0;
+static unsigned long sync_count = 0;
+
+// Group commit: a commit waiting for its sync
+typedef struct PendingCommit {
+    int fd;
+    const char *temp_path;
+    const char *path;
+    int result;
+    int done;
+    struct PendingCommit *next;
+} PendingCommit;
+
+static PendingCommit *pending_head = NULL;
+static PendingCommit *pending_tail = NULL;
+static int sync_leader = 0;
+static pthread_mutex_t durable_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sync_done = PTHREAD_COND_INITIALIZER;
+
+// Remove temp files left behind by a crash mid-commit
+static void remove_stale_temps(const char *dir_path) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (entry->d_name[0] == '.' && len > 4 && strcmp(entry->d_name + len - 4, ".tmp") == 0) {
+            char path[MAX_PATH];
+            snprintf(path, sizeof(path), "%s%s", dir_path, entry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+}
+
+void init_durable_io() {
+    const char *value = getenv("DOCSPP_SS_DURABILITY");
+    if (value && strcasecmp(value, "none") == 0) level = DURABILITY_NONE;
+    else if (value && strcasecmp(value, "batch") == 0) level = DURABILITY_BATCH;
+    else if (value && strcasecmp(value, "commit") == 0) level = DURABILITY_COMMIT;
+    else level = get_config_int("DOCSPP_SS_DURABILITY", DEFAULT_DURABILITY);
+    if (level < DURABILITY_NONE || level > DURABILITY_COMMIT) level = DEFAULT_DURABILITY;
+    group_window_us = get_config_int("DOCSPP_SS_GROUP_COMMIT_US", DEFAULT_GROUP_COMMIT_US);
+    if (group_window_us < 0) group_window_us = 0;
+
+    remove_stale_temps(storage_dir);
+    remove_stale_temps(backup_dir);
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "Durable commits: %s", durability_name(level));
+    log_message("storage_server", log_msg);
+}
+
+int durability_level() {
+    return level;
+}
+
+const char* durability_name(int which) {
+    switch (which) {
+        case DURABILITY_NONE: return "none";
+        case DURABILITY_BATCH: return "batch";
+        default: return "commit";
+    }
+}
+
+// Directory part of 'path' including the trailing '/', or "."
+static void parent_dir(const char *path, char *dir_path, size_t size) {
+    const char *slash = strrchr(path, '/');
+    if (slash) snprintf(dir_path, size, "%.*s", (int)(slash - path + 1), path);
+    else snprintf(dir_path, size, ".");
+}
+
+void durable_sync_parent(const char *path) {
+    char dir_path[MAX_PATH];
+    parent_dir(path, dir_path, sizeof(dir_path));
+
+    int dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY);
+    if (dir_fd < 0) return;
+    io_fsync(dir_fd, 0);
+    close(dir_fd);
+}
+
+// Make one batch durable: the data of every file, then the renames, then
+// each directory they were renamed in (once, however many files it got).
+// Each step is submitted as one batch so the I/O engine can overlap it.
+// Files written in place (no temp_path) only need the data step.
+static void commit_batch(PendingCommit *batch) {
+    int count = 0;
+    for (PendingCommit *commit = batch; commit != NULL; commit = commit->next) count++;
+    PendingCommit **commits = malloc(count * sizeof(PendingCommit *));
+    int *fds = malloc(count * sizeof(int));
+    int *results = malloc(count * sizeof(int));
+    const char **from = malloc(count * sizeof(char *));
+    const char **to = malloc(count * sizeof(char *));
+    char (*dirs)[MAX_PATH] = malloc(count * sizeof(*dirs));
+
+    int n = 0;
+    for (PendingCommit *commit = batch; commit != NULL; commit = commit->next) {
+        commits[n] = commit;
+        fds[n++] = commit->fd;
+    }
+    io_fsync_batch(count, fds, 1, results);
+    for (int i = 0; i < count; i++) commits[i]->result = results[i] == 0 ? 0 : -1;
+
+    int renames = 0;
+    for (int i = 0; i < count; i++) {
+        if (commits[i]->result != 0 || commits[i]->temp_path == NULL) continue;
+        commits[renames] = commits[i];
+        from[renames] = commits[i]->temp_path;
+        to[renames++] = commits[i]->path;
+    }
+    io_rename_batch(renames, from, to, results);
+
+    int dir_count = 0;
+    for (int i = 0; i < renames; i++) {
+        if (results[i] != 0) {
+            commits[i]->result = -1;
+            continue;
+        }
+        char dir_path[MAX_PATH];
+        parent_dir(commits[i]->path, dir_path, sizeof(dir_path));
+        int seen = 0;
+        for (int d = 0; d < dir_count && !seen; d++) seen = strcmp(dirs[d], dir_path) == 0;
+        if (seen) continue;
+        int dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY);
+        if (dir_fd < 0) continue;
+        strcpy(dirs[dir_count], dir_path);
+        fds[dir_count++] = dir_fd;
+    }
+    io_fsync_batch(dir_count, fds, 0, results);
+    for (int d = 0; d < dir_count; d++) close(fds[d]);
+
+    free(commits);
+    free(fds);
+    free(results);
+    free(from);
+    free(to);
+    free(dirs);
+}
+
+// Sync and rename a temp file together with whatever other commits are
+// waiting. The first committer to find no sync running leads: it takes
+// every queued commit (after a short window, if others are already queued
+// and more may be on the way) and makes them durable at once; commits that
+// arrive meanwhile form the next batch. Returns 0 once 'path' is durable.
+static int group_commit(int fd, const char *temp_path, const char *path) {
+    PendingCommit self = { .fd = fd, .temp_path = temp_path, .path = path };
+
+    pthread_mutex_lock(&durable_mutex);
+    if (pending_tail) pending_tail->next = &self;
+    else pending_head = &self;
+    pending_tail = &self;
+
+    while (!self.done) {
+        if (sync_leader) {
+            pthread_cond_wait(&sync_done, &durable_mutex);
+            continue;
+        }
+        sync_leader = 1;
+        if (group_window_us > 0 && pending_head != pending_tail) {
+            pthread_mutex_unlock(&durable_mutex);
+            usleep(group_window_us);
+            pthread_mutex_lock(&durable_mutex);
+        }
+        PendingCommit *batch = pending_head;
+        pending_head = pending_tail = NULL;
+        pthread_mutex_unlock(&durable_mutex);
+
+        commit_batch(batch);
+
+        pthread_mutex_lock(&durable_mutex);
+        for (PendingCommit *commit = batch; commit != NULL; commit = commit->next) {
+            commit->done = 1;
+        }
+        sync_count++;
+        sync_leader = 0;
+        pthread_cond_broadcast(&sync_done);
+    }
+    pthread_mutex_unlock(&durable_mutex);
+    return self.result;
+}
+
+// Create the temp file that will replace 'path'. Returns an fd or -1.
+int durable_open_temp(const char *path, char *temp_path, size_t size) {
+    pthread_mutex_lock(&durable_mutex);
+    unsigned long n = ++temp_counter;
+    pthread_mutex_unlock(&durable_mutex);
+
+    const char *slash = strrchr(path, '/');
+    const char *base = slash ? slash + 1 : path;
+    int dir_len = slash ? (int)(slash - path + 1) : 0;
+    snprintf(temp_path, size, "%.*s.%s.%lu.tmp", dir_len, path, base, n);
+    return open(temp_path, O_WRONLY | O_CREAT | O_EXCL, 0666);
+}
+
+// Sync the temp file as the durability level asks, then rename it over
+// 'path'. Closes fd. Returns 0, or -1 (the temp file is removed).
+int durable_commit_temp(int fd, const char *temp_path, const char *path) {
+    int result = 0;
+    if (level == DURABILITY_BATCH) {
+        result = group_commit(fd, temp_path, path);
+        close(fd);  // Data already synced
+    } else {
+        if (level == DURABILITY_COMMIT && io_fsync(fd, 1) != 0) result = -1;
+        if (close(fd) != 0) result = -1;
+        if (result == 0 && io_rename(temp_path, path) != 0) result = -1;
+    }
+    if (result != 0) {
+        unlink(temp_path);
+        log_error("storage_server", "Atomic file replace failed");
+        return -1;
+    }
+    if (level == DURABILITY_COMMIT) durable_sync_parent(path);
+
+    pthread_mutex_lock(&durable_mutex);
+    commit_count++;
+    pthread_mutex_unlock(&durable_mutex);
+    return 0;
+}
+
+// Sync and rename several temp files together (chunks of one checkpoint):
+// one pass of data syncs, then the renames, then one fsync per directory.
+// Closes the fds. Returns 0, or -1 if any failed (their temps are removed).
+int durable_commit_temps(int count, const int *fds, char *const *temp_paths, char *const *paths) {
+    PendingCommit *commits = calloc(count, sizeof(PendingCommit));
+    for (int i = 0; i < count; i++) {
+        commits[i].fd = fds[i];
+        commits[i].temp_path = temp_paths[i];
+        commits[i].path = paths[i];
+        commits[i].next = i + 1 < count ? &commits[i + 1] : NULL;
+    }
+    if (level == DURABILITY_NONE) {
+        for (int i = 0; i < count; i++) {
+            commits[i].result = io_rename(temp_paths[i], paths[i]) == 0 ? 0 : -1;
+        }
+    } else if (count > 0) {
+        commit_batch(commits);
+    }
+
+    int result = 0, committed = 0;
+    for (int i = 0; i < count; i++) {
+        close(fds[i]);
+        if (commits[i].result != 0) {
+            unlink(temp_paths[i]);
+            result = -1;
+        } else {
+            committed++;
+        }
+    }
+    free(commits);
+    if (result != 0) log_error("storage_server", "Atomic file replace failed");
+
+    pthread_mutex_lock(&durable_mutex);
+    commit_count += committed;
+    if (level != DURABILITY_NONE && count > 0) sync_count++;
+    pthread_mutex_unlock(&durable_mutex);
+    return result;
+}
+
+// Sync a file written in place (no rename) as the durability level asks;
+// under batch it joins the queued group commit. Returns 0 or -1.
+int durable_sync_in_place(int fd, const char *path) {
+    int result = 0;
+    if (level == DURABILITY_BATCH) result = group_commit(fd, NULL, path);
+    else if (level == DURABILITY_COMMIT) result = io_fsync(fd, 1) == 0 ? 0 : -1;
+    if (result != 0) {
+        log_error("storage_server", "In-place file sync failed");
+        return -1;
+    }
+
+    pthread_mutex_lock(&durable_mutex);
+    commit_count++;
+    pthread_mutex_unlock(&durable_mutex);
+    return 0;
+}
+
+// Replace a whole file with 'data'
+int durable_write_file(const char *path, const char *data, size_t length) {
+    char temp_path[MAX_PATH + 32];
+    int fd = durable_open_temp(path, temp_path, sizeof(temp_path));
+    if (fd < 0) return -1;
+
+    if (io_pwrite(fd, data, length, 0) < 0) {
+        close(fd);
+        unlink(temp_path);
+        return -1;
+    }
+    return durable_commit_temp(fd, temp_path, path);
+}
+
+// Replace 'to' with a copy of 'from'
+int durable_copy_file(const char *from, const char *to) {
+    int src = open(from, O_RDONLY);
+    if (src < 0) return -1;
+
+    char temp_path[MAX_PATH + 32];
+    int fd = durable_open_temp(to, temp_path, sizeof(temp_path));
+    if (fd < 0) {
+        close(src);
+        return -1;
+    }
+
+    char *buffer = malloc(COPY_BUFFER_SIZE);
+    off_t offset = 0;
+    ssize_t bytes;
+    int ok = 1;
+    while (ok && (bytes = io_pread(src, buffer, COPY_BUFFER_SIZE, offset)) > 0) {
+        ok = io_pwrite(fd, buffer, bytes, offset) == bytes;
+        offset += bytes;
+    }
+    free(buffer);
+    close(src);
+    if (!ok || bytes < 0) {
+        close(fd);
+        unlink(temp_path);
+        return -1;
+    }
+    return durable_commit_temp(fd, temp_path, to);
+}
+
+void durable_stats(unsigned long *commits, unsigned long *syncs) {
+    pthread_mutex_lock(&durable_mutex);
+    *commits = commit_count;
+    *syncs = sync_count;
+    pthread_mutex_unlock(&durable_mutex);
+}
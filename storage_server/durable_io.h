@@ -0,0 +1,37 @@
+#ifndef DURABLE_IO_H
+#define DURABLE_IO_H
+
+#include <stddef.h>
+
+// Atomic file replacement: new contents go to a hidden temp file next to the
+// target (".<name>.<n>.tmp") which is then renamed over it, so readers and
+// crashes only ever see the old or the new version. Documents may instead
+// patch a file in place (durable_sync_in_place) behind their own redo
+// record. How much is synced before a commit is acknowledged is set by
+// DOCSPP_SS_DURABILITY:
+//   none   - no fsync; a process crash is safe, but a system crash may lose
+//            recent commits (or leave an in-place patch half applied)
+//   batch  - group commit: commits that queue up while a sync runs are made
+//            durable together (data, rename, one fsync per directory) before
+//            any of them is acknowledged
+//   commit - fsync of the data and of the directory on every commit
+#define DURABILITY_NONE 0
+#define DURABILITY_BATCH 1
+#define DURABILITY_COMMIT 2
+#define DEFAULT_DURABILITY DURABILITY_BATCH
+#define DEFAULT_GROUP_COMMIT_US 2000   // DOCSPP_SS_GROUP_COMMIT_US: gathering window, only when commits are queued
+
+// Durable I/O functions
+void init_durable_io();
+int durability_level();
+const char* durability_name(int level);
+int durable_open_temp(const char *path, char *temp_path, size_t size);
+int durable_commit_temp(int fd, const char *temp_path, const char *path);
+int durable_commit_temps(int count, const int *fds, char *const *temp_paths, char *const *paths);
+int durable_sync_in_place(int fd, const char *path);
+void durable_sync_parent(const char *path);
+int durable_write_file(const char *path, const char *data, size_t length);
+int durable_copy_file(const char *from, const char *to);
+void durable_stats(unsigned long *commits, unsigned long *syncs);
+
+#endif // DURABLE_IO_H
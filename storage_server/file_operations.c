@@ -1,4 +1,7 @@
 #include "file_operations.h"
+#include "manifest.h"
+#include "document.h"
+#include "undo_manager.h"
 #include "../common/utils.h"
 #include "../common/protocol.h"
 #include <stdio.h>
@@ -11,11 +14,13 @@
 
 #define BASE_STORAGE_DIR "./storage/"
 #define BASE_BACKUP_DIR "./backups/"
+#define BASE_META_DIR "./meta/"
 
 // External globals (defined in storage_server_modular.c)
 extern char ss_id[64];
 extern char storage_dir[MAX_PATH];
 extern char backup_dir[MAX_PATH];
+extern char meta_dir[MAX_PATH];
 
 // Initialize storage directories
 void init_storage() {
@@ -28,13 +33,16 @@ void init_storage() {
     // Create base directories if they don't exist
     mkdir(BASE_STORAGE_DIR, 0777);
     mkdir(BASE_BACKUP_DIR, 0777);
+    mkdir(BASE_META_DIR, 0777);
     
-    // Create SS-specific subdirectories: ./storage/SS1/ and ./backups/SS1/
+    // Create SS-specific subdirectories: ./storage/SS1/, ./backups/SS1/ and ./meta/SS1/
     snprintf(storage_dir, sizeof(storage_dir), "%s%s/", BASE_STORAGE_DIR, ss_id);
     snprintf(backup_dir, sizeof(backup_dir), "%s%s/", BASE_BACKUP_DIR, ss_id);
+    snprintf(meta_dir, sizeof(meta_dir), "%s%s/", BASE_META_DIR, ss_id);
     
     mkdir(storage_dir, 0777);
     mkdir(backup_dir, 0777);
+    mkdir(meta_dir, 0777);
     
     char log_msg[256];
     snprintf(log_msg, sizeof(log_msg), "Storage directories initialized: %s and %s", storage_dir, backup_dir);
@@ -65,7 +73,9 @@ int list_files(char files[][MAX_FILENAME]) {
     int count = 0;
     struct dirent *entry;
     while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_type == DT_REG) {  // Regular file
+        size_t len = strlen(entry->d_name);
+        int commit_temp = entry->d_name[0] == '.' && len > 4 && strcmp(entry->d_name + len - 4, ".tmp") == 0;
+        if (entry->d_type == DT_REG && !commit_temp) {  // Regular file
             strncpy(files[count], entry->d_name, MAX_FILENAME);
             count++;
             if (count >= MAX_FILES) break;
@@ -112,6 +122,8 @@ int create_file(const char *filename) {
     }
     
     fclose(fp);
+    document_invalidate(filename);
+    journal_remove(filename);
     
     // Create initial backup copy
     char backup_path[MAX_PATH];
@@ -142,6 +154,8 @@ int create_file(const char *filename) {
         fclose(backup_fp);
     }
     
+    manifest_bump(filename);
+    
     char msg[256];
     snprintf(msg, sizeof(msg), "Created file: %s (with backup)", filename);
     log_message("storage_server", msg);
@@ -184,6 +198,10 @@ int delete_file(const char *filename) {
         return ERR_SERVER_ERROR;
     }
     
+    manifest_remove(filename);
+    document_invalidate(filename);
+    journal_remove(filename);
+    
     char msg[256];
     snprintf(msg, sizeof(msg), "Deleted file: %s", filename);
     log_message("storage_server", msg);
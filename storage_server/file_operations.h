@@ -14,6 +14,7 @@ int file_info(const char *filename);
 // External global variables (defined in main)
 extern char storage_dir[MAX_PATH];
 extern char backup_dir[MAX_PATH];
+extern char meta_dir[MAX_PATH];
 extern char ss_id[64];
 
 #endif // FILE_OPERATIONS_H
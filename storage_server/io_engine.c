@@ -0,0 +1,489 @@
+#define _GNU_SOURCE
+#include "io_engine.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+
+#define IO_OP_READ 0
+#define IO_OP_WRITE 1
+#define IO_OP_FSYNC 2
+#define IO_OP_RENAME 3
+#define IO_MAX_TRANSFER (1 << 30)   // One request moves at most this much
+
+typedef struct IORequest {
+    int op;
+    int fd;
+    void *buffer;
+    size_t length;
+    off_t offset;
+    int datasync;
+    const char *from;
+    const char *to;
+    long result;                    // Bytes moved or 0, -errno on failure
+    int done;
+    pthread_cond_t done_cond;
+    struct IORequest *next;
+} IORequest;
+
+static int engine = DEFAULT_IO_ENGINE;
+static unsigned long submitted = 0;
+static int in_flight = 0;
+static pthread_mutex_t io_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Thread-pool engine: FIFO of requests waiting for an I/O thread
+static IORequest *queue_head = NULL;
+static IORequest *queue_tail = NULL;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+// Run a request with plain syscalls
+static long execute(IORequest *request) {
+    long result;
+    switch (request->op) {
+        case IO_OP_READ:
+            result = pread(request->fd, request->buffer, request->length, request->offset);
+            break;
+        case IO_OP_WRITE:
+            result = pwrite(request->fd, request->buffer, request->length, request->offset);
+            break;
+        case IO_OP_FSYNC:
+            result = request->datasync ? fdatasync(request->fd) : fsync(request->fd);
+            break;
+        default:
+            result = rename(request->from, request->to);
+            break;
+    }
+    return result < 0 ? -errno : result;
+}
+
+static void complete(IORequest *request, long result) {
+    request->result = result;
+    request->done = 1;
+    in_flight--;
+    pthread_cond_signal(&request->done_cond);
+}
+
+static void* io_thread(void *arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&io_mutex);
+        while (queue_head == NULL) pthread_cond_wait(&queue_cond, &io_mutex);
+        IORequest *request = queue_head;
+        queue_head = request->next;
+        if (queue_head == NULL) queue_tail = NULL;
+        pthread_mutex_unlock(&io_mutex);
+
+        long result = execute(request);
+
+        pthread_mutex_lock(&io_mutex);
+        complete(request, result);
+        pthread_mutex_unlock(&io_mutex);
+    }
+    return NULL;
+}
+
+static int start_io_threads(int count) {
+    int started = 0;
+    for (int i = 0; i < count; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, io_thread, NULL) != 0) continue;
+        pthread_detach(thread);
+        started++;
+    }
+    return started;
+}
+
+#ifdef HAVE_IO_URING
+// io_uring engine: requests are written to the submission ring (serialized
+// by ring_mutex) and one thread reaps the completion ring. At most 'depth'
+// requests are in flight, so neither ring can overflow.
+static int ring_fd = -1;
+static int depth = DEFAULT_IO_DEPTH;
+static struct io_uring_sqe *sqes;
+static unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+static unsigned *cq_head, *cq_tail, *cq_mask;
+static struct io_uring_cqe *cqes;
+static unsigned char op_supported[IO_OP_RENAME + 1];
+static pthread_mutex_t ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_space = PTHREAD_COND_INITIALIZER;
+
+static const int uring_ops[] = { IORING_OP_READ, IORING_OP_WRITE, IORING_OP_FSYNC, IORING_OP_RENAMEAT };
+
+static int uring_enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+// Which of our operations this kernel's io_uring can run
+static void probe_ops() {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+        for (int i = 0; i <= IO_OP_RENAME; i++) {
+            int op = uring_ops[i];
+            op_supported[i] = op < probe->ops_len && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+        }
+    }
+    free(probe);
+}
+
+static void* reap_completions(void *arg) {
+    (void)arg;
+    while (1) {
+        if (uring_enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            log_error("storage_server", "io_uring completion wait failed");
+            usleep(1000);
+            continue;
+        }
+        pthread_mutex_lock(&io_mutex);
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        int reaped = 0;
+        while (head != tail) {
+            struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+            complete((IORequest *)(uintptr_t)cqe->user_data, cqe->res);
+            head++;
+            reaped++;
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        if (reaped > 0) pthread_cond_broadcast(&ring_space);
+        pthread_mutex_unlock(&io_mutex);
+    }
+    return NULL;
+}
+
+static int setup_uring() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd = syscall(__NR_io_uring_setup, depth, &params);
+    if (ring_fd < 0) return -1;
+    depth = params.sq_entries;
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_size > sq_size) sq_size = cq_size;
+        cq_size = sq_size;
+    }
+    char *sq_ring = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring_fd, IORING_OFF_SQ_RING);
+    char *cq_ring = sq_ring;
+    if (sq_ring != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq_ring = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd, IORING_OFF_CQ_RING);
+    }
+    void *sqe_map = MAP_FAILED;
+    if (sq_ring != MAP_FAILED && cq_ring != MAP_FAILED) {
+        sqe_map = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    }
+    if (sqe_map == MAP_FAILED) {
+        close(ring_fd);
+        ring_fd = -1;
+        return -1;
+    }
+
+    sqes = sqe_map;
+    sq_head = (unsigned *)(sq_ring + params.sq_off.head);
+    sq_tail = (unsigned *)(sq_ring + params.sq_off.tail);
+    sq_mask = (unsigned *)(sq_ring + params.sq_off.ring_mask);
+    sq_array = (unsigned *)(sq_ring + params.sq_off.array);
+    cq_head = (unsigned *)(cq_ring + params.cq_off.head);
+    cq_tail = (unsigned *)(cq_ring + params.cq_off.tail);
+    cq_mask = (unsigned *)(cq_ring + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(cq_ring + params.cq_off.cqes);
+
+    probe_ops();
+    if (!op_supported[IO_OP_READ] || !op_supported[IO_OP_WRITE] || !op_supported[IO_OP_FSYNC]) {
+        close(ring_fd);
+        ring_fd = -1;
+        return -1;
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, reap_completions, NULL) != 0) {
+        close(ring_fd);
+        ring_fd = -1;
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+// Fill the submission queue entry at ring position 'position'
+static void prepare_sqe(IORequest *request, unsigned position) {
+    unsigned index = position & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = uring_ops[request->op];
+    sqe->user_data = (uintptr_t)request;
+    switch (request->op) {
+        case IO_OP_READ:
+        case IO_OP_WRITE:
+            sqe->fd = request->fd;
+            sqe->addr = (uintptr_t)request->buffer;
+            sqe->len = request->length;
+            sqe->off = request->offset;
+            break;
+        case IO_OP_FSYNC:
+            sqe->fd = request->fd;
+            if (request->datasync) sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+            break;
+        default:
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uintptr_t)request->from;
+            sqe->len = AT_FDCWD;
+            sqe->addr2 = (uintptr_t)request->to;
+            break;
+    }
+    sq_array[index] = index;
+}
+
+// Write requests into the submission ring and hand them to the kernel, as
+// many per io_uring_enter as the ring has room for. If the kernel refuses
+// them, the ones it did not take are removed from the ring again and fail
+// with its error, so no caller waits for a completion that cannot come.
+static void uring_submit(IORequest **requests, int count) {
+    pthread_mutex_lock(&ring_mutex);
+    int next = 0;
+    while (next < count) {
+        pthread_mutex_lock(&io_mutex);
+        while (in_flight >= depth) pthread_cond_wait(&ring_space, &io_mutex);
+        int take = count - next < depth - in_flight ? count - next : depth - in_flight;
+        in_flight += take;
+        pthread_mutex_unlock(&io_mutex);
+
+        unsigned tail = *sq_tail;
+        for (int i = 0; i < take; i++) prepare_sqe(requests[next + i], tail + i);
+        __atomic_store_n(sq_tail, tail + take, __ATOMIC_RELEASE);
+
+        int error = 0;
+        while (__atomic_load_n(sq_head, __ATOMIC_ACQUIRE) != tail + take) {
+            unsigned unsent = tail + take - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+            int consumed = uring_enter(unsent, 0, 0);
+            if (consumed > 0) continue;
+            if (consumed == 0 || errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                usleep(100);
+                continue;
+            }
+            error = errno;
+            break;
+        }
+        if (error) {
+            unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+            __atomic_store_n(sq_tail, head, __ATOMIC_RELEASE);
+            pthread_mutex_lock(&io_mutex);
+            for (int i = take - (int)(tail + take - head); i < take; i++) {
+                complete(requests[next + i], -error);
+            }
+            pthread_cond_broadcast(&ring_space);
+            pthread_mutex_unlock(&io_mutex);
+            log_error("storage_server", "io_uring submission failed");
+        }
+        next += take;
+    }
+    pthread_mutex_unlock(&ring_mutex);
+}
+#endif
+
+// Run requests on the configured engine and wait for all of them. They are
+// queued together, so the thread pool and io_uring run them side by side.
+static void run_requests(IORequest *requests, int count) {
+    IORequest **queued = malloc(count * sizeof(IORequest *));
+    int queued_count = 0;
+    for (int i = 0; i < count; i++) {
+        IORequest *request = &requests[i];
+        int use = engine;
+#ifdef HAVE_IO_URING
+        if (use == IO_ENGINE_URING && !op_supported[request->op]) use = IO_ENGINE_SYNC;
+#endif
+        if (use == IO_ENGINE_SYNC) {
+            request->result = execute(request);
+            request->done = 1;
+            continue;
+        }
+        request->done = 0;
+        request->next = NULL;
+        pthread_cond_init(&request->done_cond, NULL);
+        queued[queued_count++] = request;
+    }
+
+    if (queued_count > 0 && engine == IO_ENGINE_THREADS) {
+        pthread_mutex_lock(&io_mutex);
+        for (int i = 0; i < queued_count; i++) {
+            if (queue_tail) queue_tail->next = queued[i];
+            else queue_head = queued[i];
+            queue_tail = queued[i];
+        }
+        in_flight += queued_count;
+        pthread_cond_broadcast(&queue_cond);
+        pthread_mutex_unlock(&io_mutex);
+    }
+#ifdef HAVE_IO_URING
+    else if (queued_count > 0) {
+        uring_submit(queued, queued_count);
+    }
+#endif
+
+    pthread_mutex_lock(&io_mutex);
+    submitted += count;
+    for (int i = 0; i < queued_count; i++) {
+        while (!queued[i]->done) pthread_cond_wait(&queued[i]->done_cond, &io_mutex);
+    }
+    pthread_mutex_unlock(&io_mutex);
+    for (int i = 0; i < queued_count; i++) pthread_cond_destroy(&queued[i]->done_cond);
+    free(queued);
+}
+
+static long run_request(IORequest *request) {
+    run_requests(request, 1);
+    return request->result;
+}
+
+void init_io_engine() {
+    const char *value = getenv("DOCSPP_SS_IO_ENGINE");
+    if (value && strcasecmp(value, "sync") == 0) engine = IO_ENGINE_SYNC;
+    else if (value && strcasecmp(value, "threads") == 0) engine = IO_ENGINE_THREADS;
+    else if (value && strcasecmp(value, "uring") == 0) engine = IO_ENGINE_URING;
+    else engine = get_config_int("DOCSPP_SS_IO_ENGINE", DEFAULT_IO_ENGINE);
+    if (engine < IO_ENGINE_SYNC || engine > IO_ENGINE_URING) engine = DEFAULT_IO_ENGINE;
+
+    if (engine == IO_ENGINE_URING) {
+#ifdef HAVE_IO_URING
+        depth = get_config_int("DOCSPP_SS_IO_DEPTH", DEFAULT_IO_DEPTH);
+        if (depth < 1) depth = DEFAULT_IO_DEPTH;
+        if (setup_uring() != 0)
+#endif
+        {
+            log_error("storage_server", "io_uring unavailable, using the I/O thread pool");
+            engine = IO_ENGINE_THREADS;
+        }
+    }
+    if (engine == IO_ENGINE_THREADS) {
+        int threads = get_config_int("DOCSPP_SS_IO_THREADS", DEFAULT_IO_THREADS);
+        if (threads < 1) threads = DEFAULT_IO_THREADS;
+        if (start_io_threads(threads) == 0) engine = IO_ENGINE_SYNC;
+    }
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "File I/O engine: %s", io_engine_name(engine));
+    log_message("storage_server", log_msg);
+}
+
+int io_engine() {
+    return engine;
+}
+
+const char* io_engine_name(int which) {
+    switch (which) {
+        case IO_ENGINE_THREADS: return "threads";
+        case IO_ENGINE_URING: return "uring";
+        default: return "sync";
+    }
+}
+
+// Read up to 'length' bytes at 'offset', stopping early only at end of
+// file. Returns the bytes read, or -1 (errno set) if none could be.
+ssize_t io_pread(int fd, void *buffer, size_t length, off_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        size_t want = length - done < IO_MAX_TRANSFER ? length - done : IO_MAX_TRANSFER;
+        IORequest request = { .op = IO_OP_READ, .fd = fd, .buffer = (char *)buffer + done,
+                              .length = want, .offset = offset + done };
+        long result = run_request(&request);
+        if (result == -EINTR || result == -EAGAIN) continue;
+        if (result < 0) {
+            if (done > 0) break;
+            errno = -result;
+            return -1;
+        }
+        if (result == 0) break;
+        done += result;
+    }
+    return done;
+}
+
+// Write all of 'buffer' at 'offset'. Returns 'length', or -1 (errno set).
+ssize_t io_pwrite(int fd, const void *buffer, size_t length, off_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        size_t want = length - done < IO_MAX_TRANSFER ? length - done : IO_MAX_TRANSFER;
+        IORequest request = { .op = IO_OP_WRITE, .fd = fd, .buffer = (char *)buffer + done,
+                              .length = want, .offset = offset + done };
+        long result = run_request(&request);
+        if (result == -EINTR || result == -EAGAIN) continue;
+        if (result <= 0) {
+            errno = result < 0 ? -result : EIO;
+            return -1;
+        }
+        done += result;
+    }
+    return done;
+}
+
+int io_fsync(int fd, int datasync) {
+    IORequest request = { .op = IO_OP_FSYNC, .fd = fd, .datasync = datasync };
+    long result = run_request(&request);
+    if (result < 0) {
+        errno = -result;
+        return -1;
+    }
+    return 0;
+}
+
+int io_rename(const char *from, const char *to) {
+    IORequest request = { .op = IO_OP_RENAME, .from = from, .to = to };
+    long result = run_request(&request);
+    if (result < 0) {
+        errno = -result;
+        return -1;
+    }
+    return 0;
+}
+
+// Sync several files at once. results[i] is 0, or -errno for fds[i].
+void io_fsync_batch(int count, const int *fds, int datasync, int *results) {
+    if (count <= 0) return;
+    IORequest *requests = calloc(count, sizeof(IORequest));
+    for (int i = 0; i < count; i++) {
+        requests[i].op = IO_OP_FSYNC;
+        requests[i].fd = fds[i];
+        requests[i].datasync = datasync;
+    }
+    run_requests(requests, count);
+    for (int i = 0; i < count; i++) results[i] = (int)requests[i].result;
+    free(requests);
+}
+
+// Rename several files at once (the targets must all differ). results[i]
+// is 0, or -errno for from[i].
+void io_rename_batch(int count, const char *const *from, const char *const *to, int *results) {
+    if (count <= 0) return;
+    IORequest *requests = calloc(count, sizeof(IORequest));
+    for (int i = 0; i < count; i++) {
+        requests[i].op = IO_OP_RENAME;
+        requests[i].from = from[i];
+        requests[i].to = to[i];
+    }
+    run_requests(requests, count);
+    for (int i = 0; i < count; i++) results[i] = (int)requests[i].result;
+    free(requests);
+}
+
+void io_engine_stats(unsigned long *requests, int *pending) {
+    pthread_mutex_lock(&io_mutex);
+    *requests = submitted;
+    *pending = in_flight;
+    pthread_mutex_unlock(&io_mutex);
+}
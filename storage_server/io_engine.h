@@ -0,0 +1,38 @@
+#ifndef IO_ENGINE_H
+#define IO_ENGINE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// File I/O engine for the bulk reads, writes, syncs and renames behind READ,
+// WRITE commits and checkpoint/backup copies. DOCSPP_SS_IO_ENGINE picks it:
+//   sync    - plain syscalls in the calling worker thread
+//   threads - requests queue to a pool of I/O threads, so a slow device
+//             ties up those threads instead of event loop workers
+//   uring   - requests are submitted to an io_uring and reaped by a
+//             completion thread, letting concurrent commits and checkpoint
+//             copies use the device's queue depth; falls back to threads
+//             where the kernel has no io_uring
+// Callers see the same blocking calls whichever engine runs them. The
+// _batch calls submit all their requests before waiting, so one caller (a
+// group commit, a checkpoint's chunks) keeps many in flight.
+#define IO_ENGINE_SYNC 0
+#define IO_ENGINE_THREADS 1
+#define IO_ENGINE_URING 2
+#define DEFAULT_IO_ENGINE IO_ENGINE_SYNC
+#define DEFAULT_IO_THREADS 4      // DOCSPP_SS_IO_THREADS: thread-pool size
+#define DEFAULT_IO_DEPTH 64       // DOCSPP_SS_IO_DEPTH: io_uring queue depth
+
+// I/O engine functions
+void init_io_engine();
+int io_engine();
+const char* io_engine_name(int engine);
+ssize_t io_pread(int fd, void *buffer, size_t length, off_t offset);
+ssize_t io_pwrite(int fd, const void *buffer, size_t length, off_t offset);
+int io_fsync(int fd, int datasync);
+int io_rename(const char *from, const char *to);
+void io_fsync_batch(int count, const int *fds, int datasync, int *results);
+void io_rename_batch(int count, const char *const *from, const char *const *to, int *results);
+void io_engine_stats(unsigned long *requests, int *pending);
+
+#endif // IO_ENGINE_H
@@ -0,0 +1,130 @@
+#include "load_stats.h"
+#include "lock_manager.h"
+#include "file_operations.h"
+#include "../common/event_loop.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+typedef struct {
+    long samples[LATENCY_SAMPLES];
+    int count;
+    int next;
+} LatencyRing;
+
+static LatencyRing latencies[LOAD_OP_COUNT];
+static long long cached_bytes_stored = 0;
+static long long cached_disk_free = 0;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+long long load_now_us() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+void load_record_latency(int op, long long latency_us) {
+    if (op < 0 || op >= LOAD_OP_COUNT) return;
+    pthread_mutex_lock(&stats_mutex);
+    LatencyRing *ring = &latencies[op];
+    ring->samples[ring->next] = (long)latency_us;
+    ring->next = (ring->next + 1) % LATENCY_SAMPLES;
+    if (ring->count < LATENCY_SAMPLES) ring->count++;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+// Operation kind a client request is accounted under (-1 = not timed here)
+int load_op_for_message(int type) {
+    switch (type) {
+        case MSG_READ: return LOAD_OP_READ;
+        case MSG_STREAM: return LOAD_OP_STREAM;
+        case MSG_WRITE: return -1;  // Timed at commit, sessions include think time
+        default: return LOAD_OP_OTHER;
+    }
+}
+
+static int compare_long(const void *a, const void *b) {
+    long x = *(const long*)a, y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+static long long directory_bytes(const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) return 0;
+
+    long long total = 0;
+    struct dirent *entry;
+    char child[MAX_PATH];
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        struct stat st;
+        if (lstat(child, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            total += directory_bytes(child);
+        } else if (S_ISREG(st.st_mode)) {
+            total += st.st_size;
+        }
+    }
+    closedir(dir);
+    return total;
+}
+
+static void refresh_storage_usage() {
+    long long bytes = directory_bytes(storage_dir);
+    long long free_bytes = 0;
+    struct statvfs vfs;
+    if (statvfs(storage_dir, &vfs) == 0) {
+        free_bytes = (long long)vfs.f_bavail * vfs.f_frsize;
+    }
+    pthread_mutex_lock(&stats_mutex);
+    cached_bytes_stored = bytes;
+    cached_disk_free = free_bytes;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+// The storage scan walks every file, so it runs here rather than in the
+// heartbeat responder, which only copies the last result
+static void* storage_usage_refresher(void *arg) {
+    (void)arg;
+    while (1) {
+        sleep(BYTES_STORED_REFRESH);
+        refresh_storage_usage();
+    }
+    return NULL;
+}
+
+void init_load_stats() {
+    refresh_storage_usage();
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, storage_usage_refresher, NULL) == 0) {
+        pthread_detach(thread);
+    }
+}
+
+void load_fill_report(struct SSLoadReport *report) {
+    memset(report, 0, sizeof(*report));
+
+    long sorted[LATENCY_SAMPLES];
+    pthread_mutex_lock(&stats_mutex);
+    report->bytes_stored = cached_bytes_stored;
+    report->disk_free = cached_disk_free;
+    for (int op = 0; op < LOAD_OP_COUNT; op++) {
+        int count = latencies[op].count;
+        if (count == 0) continue;
+        memcpy(sorted, latencies[op].samples, sizeof(long) * count);
+        qsort(sorted, count, sizeof(long), compare_long);
+        report->p50_us[op] = sorted[(count - 1) / 2];
+        report->p99_us[op] = sorted[(count * 99 - 1) / 100];
+    }
+    pthread_mutex_unlock(&stats_mutex);
+
+    report->active_locks = count_sentence_locks();
+    event_loop_stats(&report->active_connections, &report->queued_requests);
+}
@@ -0,0 +1,16 @@
+#ifndef LOAD_STATS_H
+#define LOAD_STATS_H
+
+#include "../common/protocol.h"
+
+#define LATENCY_SAMPLES 256          // Recent samples kept per operation kind
+#define BYTES_STORED_REFRESH 5       // Seconds between storage directory and free-space scans
+
+// Load statistics functions
+void init_load_stats();
+void load_record_latency(int op, long long latency_us);
+long long load_now_us();
+int load_op_for_message(int type);
+void load_fill_report(struct SSLoadReport *report);
+
+#endif // LOAD_STATS_H
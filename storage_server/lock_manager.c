@@ -1,84 +1,402 @@
 #include "lock_manager.h"
+#include "../common/utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 
-// Global lock list
-SentenceLock *locks = NULL;
+// Sentence locks, grouped per file in a hash table by filename
+FileLocks *lock_table[LOCK_TABLE_BUCKETS];
 pthread_mutex_t lock_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long next_lock_id = 1;
+static int lease_sec = DEFAULT_LOCK_LEASE_SEC;
+static int total_locks = 0;
 
-// Check if sentence is locked
-SentenceLock* find_sentence_lock(const char *filename, int sentence_num) {
+static unsigned int lock_hash(const char *str) {
+    unsigned int hash = 5381;
+    int c;
+    while ((c = *str++))
+        hash = ((hash << 5) + hash) + c;
+    return hash % LOCK_TABLE_BUCKETS;
+}
+
+void init_lock_manager() {
+    lease_sec = get_config_int("DOCSPP_SS_LOCK_LEASE_SEC", DEFAULT_LOCK_LEASE_SEC);
+    if (lease_sec <= 0) lease_sec = DEFAULT_LOCK_LEASE_SEC;
+}
+
+// Callers hold lock_mutex
+static FileLocks* find_file(const char *filename, int create) {
+    unsigned int index = lock_hash(filename);
+    FileLocks *file = lock_table[index];
+    while (file != NULL && strcmp(file->filename, filename) != 0) {
+        file = file->next;
+    }
+    if (file == NULL && create) {
+        file = calloc(1, sizeof(FileLocks));
+        strncpy(file->filename, filename, sizeof(file->filename) - 1);
+        file->next = lock_table[index];
+        lock_table[index] = file;
+    }
+    return file;
+}
+
+static void drop_file_if_empty(FileLocks *file) {
+    if (file->locks != NULL || file->waiters != NULL) return;
+    FileLocks **link = &lock_table[lock_hash(file->filename)];
+    while (*link != NULL && *link != file) {
+        link = &(*link)->next;
+    }
+    if (*link == file) *link = file->next;
+    free(file);
+}
+
+static void unlink_lock(FileLocks *file, SentenceLock **link) {
+    SentenceLock *lock = *link;
+    *link = lock->next;
+    file->count--;
+    total_locks--;
+    free(lock);
+}
+
+static SentenceLock* new_lock_for(FileLocks *file, int sentence_num, const char *username) {
+    SentenceLock *new_lock = malloc(sizeof(SentenceLock));
+    new_lock->id = next_lock_id++;
+    strncpy(new_lock->filename, file->filename, sizeof(new_lock->filename));
+    new_lock->sentence_num = sentence_num;
+    strncpy(new_lock->username, username, sizeof(new_lock->username));
+    new_lock->locked_at = time(NULL);
+    new_lock->expires_at = new_lock->locked_at + lease_sec;
+    new_lock->next = file->locks;
+    file->locks = new_lock;
+    file->count++;
+    total_locks++;
+    return new_lock;
+}
+
+static SentenceLock** find_by_sentence(FileLocks *file, int sentence_num) {
+    for (SentenceLock **link = &file->locks; *link != NULL; link = &(*link)->next) {
+        if ((*link)->sentence_num == sentence_num) return link;
+    }
+    return NULL;
+}
+
+static LockWaiter* first_waiter(FileLocks *file, int sentence_num) {
+    for (LockWaiter *waiter = file->waiters; waiter != NULL; waiter = waiter->next) {
+        if (waiter->granted == 0 && waiter->sentence_num == sentence_num) return waiter;
+    }
+    return NULL;
+}
+
+static int waiter_position(FileLocks *file, LockWaiter *target) {
+    int position = 1;
+    for (LockWaiter *waiter = file->waiters; waiter != NULL && waiter != target; waiter = waiter->next) {
+        if (waiter->granted == 0 && waiter->sentence_num == target->sentence_num) position++;
+    }
+    return position;
+}
+
+static void wake_waiters(FileLocks *file) {
+    for (LockWaiter *waiter = file->waiters; waiter != NULL; waiter = waiter->next) {
+        pthread_cond_signal(&waiter->wake);
+        if (waiter->notify) waiter->notify(waiter->notify_context);
+    }
+}
+
+// A sentence lock was released: give it to the first writer queued for it
+static void hand_off(FileLocks *file, int sentence_num) {
+    LockWaiter *waiter = first_waiter(file, sentence_num);
+    if (waiter == NULL) return;
+    waiter->granted = new_lock_for(file, sentence_num, waiter->username)->id;
+    wake_waiters(file);
+}
+
+static void unlink_waiter(FileLocks *file, LockWaiter *target) {
+    for (LockWaiter **link = &file->waiters; *link != NULL; link = &(*link)->next) {
+        if (*link == target) {
+            *link = target->next;
+            break;
+        }
+    }
+    pthread_cond_destroy(&target->wake);
+    free(target);
+    wake_waiters(file);
+}
+
+static SentenceLock** find_by_id(FileLocks *file, unsigned long id) {
+    if (file == NULL) return NULL;
+    for (SentenceLock **link = &file->locks; *link != NULL; link = &(*link)->next) {
+        if ((*link)->id == id) return link;
+    }
+    return NULL;
+}
+
+// Check if sentence is locked; copies the holder's name if so
+int find_sentence_lock(const char *filename, int sentence_num, char *holder, size_t size) {
     pthread_mutex_lock(&lock_mutex);
-    
-    SentenceLock *current = locks;
+
+    FileLocks *file = find_file(filename, 0);
+    SentenceLock *current = file ? file->locks : NULL;
     while (current != NULL) {
-        if (strcmp(current->filename, filename) == 0 && 
-            current->sentence_num == sentence_num) {
+        if (current->sentence_num == sentence_num) {
+            if (holder) snprintf(holder, size, "%s", current->username);
             pthread_mutex_unlock(&lock_mutex);
-            return current;
+            return 1;
         }
         current = current->next;
     }
-    
+
     pthread_mutex_unlock(&lock_mutex);
-    return NULL;
+    return 0;
 }
 
-// Add sentence lock
-int add_sentence_lock(const char *filename, int sentence_num, const char *username) {
+// Add sentence lock. A lock whose lease ran out is taken over. Returns the
+// lock id, or 0 if already locked.
+unsigned long add_sentence_lock(const char *filename, int sentence_num, const char *username) {
     pthread_mutex_lock(&lock_mutex);
-    
-    // Check if already locked
-    SentenceLock *current = locks;
-    while (current != NULL) {
-        if (strcmp(current->filename, filename) == 0 && 
-            current->sentence_num == sentence_num) {
-            pthread_mutex_unlock(&lock_mutex);
-            return 0;  // Already locked
+
+    FileLocks *file = find_file(filename, 1);
+    time_t now = time(NULL);
+
+    // Check if already locked; writers already queued for the sentence go first
+    SentenceLock **link = &file->locks;
+    while (*link != NULL) {
+        SentenceLock *current = *link;
+        if (current->sentence_num == sentence_num) {
+            if (current->expires_at > now || first_waiter(file, sentence_num) != NULL) {
+                pthread_mutex_unlock(&lock_mutex);
+                return 0;  // Already locked
+            }
+            char log_msg[512];
+            snprintf(log_msg, sizeof(log_msg), "Lease expired: '%s' sentence %d held by %s",
+                     filename, sentence_num, current->username);
+            log_message("storage_server", log_msg);
+            unlink_lock(file, link);
+            continue;
         }
-        current = current->next;
+        link = &current->next;
+    }
+    if (first_waiter(file, sentence_num) != NULL) {
+        pthread_mutex_unlock(&lock_mutex);
+        return 0;
     }
-    
+
     // Add new lock
-    SentenceLock *new_lock = malloc(sizeof(SentenceLock));
-    strncpy(new_lock->filename, filename, sizeof(new_lock->filename));
-    new_lock->sentence_num = sentence_num;
-    strncpy(new_lock->username, username, sizeof(new_lock->username));
-    new_lock->locked_at = time(NULL);
-    new_lock->next = locks;
-    locks = new_lock;
-    
+    unsigned long id = new_lock_for(file, sentence_num, username)->id;
+
     pthread_mutex_unlock(&lock_mutex);
-    return 1;  // Lock acquired
+    return id;  // Lock acquired
 }
 
-// Remove sentence lock
-void remove_sentence_lock(const char *filename, int sentence_num, const char *username) {
+// Join the queue for a sentence lock; *position is 1 for the next in line
+LockWaiter* queue_sentence_lock(const char *filename, int sentence_num, const char *username, int *position,
+                                void (*notify)(void *context), void *notify_context) {
+    LockWaiter *waiter = calloc(1, sizeof(LockWaiter));
+    waiter->sentence_num = sentence_num;
+    waiter->notify = notify;
+    waiter->notify_context = notify_context;
+    strncpy(waiter->username, username, sizeof(waiter->username) - 1);
+    pthread_cond_init(&waiter->wake, NULL);
+
     pthread_mutex_lock(&lock_mutex);
-    
-    SentenceLock *current = locks;
-    SentenceLock *prev = NULL;
-    
-    while (current != NULL) {
-        if (strcmp(current->filename, filename) == 0 && 
-            current->sentence_num == sentence_num &&
-            strcmp(current->username, username) == 0) {
-            
-            if (prev == NULL) {
-                locks = current->next;
-            } else {
-                prev->next = current->next;
+    FileLocks *file = find_file(filename, 1);
+    LockWaiter **link = &file->waiters;
+    while (*link != NULL) link = &(*link)->next;
+    *link = waiter;
+    *position = waiter_position(file, waiter);
+    pthread_mutex_unlock(&lock_mutex);
+    return waiter;
+}
+
+// Wait up to timeout_ms for the lock. Returns its id once granted (the waiter
+// is freed), or 0 when the time is up or *position changed, so the caller can
+// report progress and decide whether to keep waiting. A timeout of 0 only
+// checks, for waiters driven by their notify hook.
+unsigned long await_sentence_lock(const char *filename, LockWaiter *waiter, int timeout_ms, int *position) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&lock_mutex);
+    FileLocks *file = find_file(filename, 0);
+    int started_at = waiter_position(file, waiter);
+    unsigned long id = 0;
+    while (1) {
+        if (waiter->granted == 0 && first_waiter(file, waiter->sentence_num) == waiter) {
+            // Next in line and nobody holds the sentence (or the holder's lease ran out)
+            SentenceLock **held = find_by_sentence(file, waiter->sentence_num);
+            if (held != NULL && (*held)->expires_at <= time(NULL)) {
+                unlink_lock(file, held);
+                held = NULL;
+            }
+            if (held == NULL) {
+                waiter->granted = new_lock_for(file, waiter->sentence_num, waiter->username)->id;
             }
-            
-            free(current);
-            pthread_mutex_unlock(&lock_mutex);
-            return;
         }
-        prev = current;
-        current = current->next;
+        if (waiter->granted != 0) {
+            id = waiter->granted;
+            unlink_waiter(file, waiter);
+            break;
+        }
+        *position = waiter_position(file, waiter);
+        if (*position != started_at) break;
+
+        // Wake at least once a second to notice expired leases
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += 1;
+        if (until.tv_sec > deadline.tv_sec ||
+            (until.tv_sec == deadline.tv_sec && until.tv_nsec > deadline.tv_nsec)) {
+            until = deadline;
+        }
+        if (pthread_cond_timedwait(&waiter->wake, &lock_mutex, &until) != 0 &&
+            until.tv_sec == deadline.tv_sec && until.tv_nsec == deadline.tv_nsec) {
+            *position = waiter_position(file, waiter);
+            if (waiter->granted == 0) break;
+        }
+    }
+    pthread_mutex_unlock(&lock_mutex);
+    return id;
+}
+
+// Leave the queue. A lock handed over in the meantime is passed on.
+void cancel_sentence_wait(const char *filename, LockWaiter *waiter) {
+    pthread_mutex_lock(&lock_mutex);
+    FileLocks *file = find_file(filename, 0);
+    unsigned long granted = waiter->granted;
+    unlink_waiter(file, waiter);
+    SentenceLock **link = granted ? find_by_id(file, granted) : NULL;
+    if (link) {
+        int sentence_num = (*link)->sentence_num;
+        unlink_lock(file, link);
+        hand_off(file, sentence_num);
     }
-    
+    drop_file_if_empty(file);
+    pthread_mutex_unlock(&lock_mutex);
+}
+
+// Extend the lease of an active session. Returns 0 if the lock is gone or
+// its lease already ran out (the lock is then released to the next writer).
+int renew_sentence_lock(const char *filename, unsigned long id) {
+    pthread_mutex_lock(&lock_mutex);
+    FileLocks *file = find_file(filename, 0);
+    SentenceLock **link = find_by_id(file, id);
+    int renewed = 0;
+    time_t now = time(NULL);
+    if (link && (*link)->expires_at > now) {
+        (*link)->expires_at = now + lease_sec;
+        renewed = 1;
+    } else if (link) {
+        int sentence_num = (*link)->sentence_num;
+        unlink_lock(file, link);
+        hand_off(file, sentence_num);
+        drop_file_if_empty(file);
+    }
+    pthread_mutex_unlock(&lock_mutex);
+    return renewed;
+}
+
+// Sentence a lock currently covers, or -1 if it is gone
+int sentence_lock_position(const char *filename, unsigned long id) {
+    pthread_mutex_lock(&lock_mutex);
+    SentenceLock **link = find_by_id(find_file(filename, 0), id);
+    int position = link ? (*link)->sentence_num : -1;
+    pthread_mutex_unlock(&lock_mutex);
+    return position;
+}
+
+// Remove sentence lock (no-op if it was already released or taken over)
+void remove_sentence_lock(const char *filename, unsigned long id) {
+    pthread_mutex_lock(&lock_mutex);
+    FileLocks *file = find_file(filename, 0);
+    SentenceLock **link = find_by_id(file, id);
+    if (link) {
+        int sentence_num = (*link)->sentence_num;
+        unlink_lock(file, link);
+        hand_off(file, sentence_num);
+        drop_file_if_empty(file);
+    }
+    pthread_mutex_unlock(&lock_mutex);
+}
+
+// A commit replaced sentences [first, last] with 'count' new ones. Move the
+// other writers' locks so they keep pointing at the sentence they opened:
+// later ones shift by the change in count, and one whose sentence was
+// merged into the new text follows it to the last new sentence. Writers
+// queued for the committed sentence itself wait for where it now starts.
+void remap_sentence_locks(const char *filename, int first, int last, int count, unsigned long committer) {
+    int delta = count - (last - first + 1);
+    pthread_mutex_lock(&lock_mutex);
+    FileLocks *file = find_file(filename, 0);
+    SentenceLock **own = file ? find_by_id(file, committer) : NULL;
+    int own_sentence = own ? (*own)->sentence_num : -1;
+    for (SentenceLock *lock = file ? file->locks : NULL; lock != NULL; lock = lock->next) {
+        if (lock->id == committer) {
+            lock->sentence_num = first;
+        } else if (lock->sentence_num > last) {
+            lock->sentence_num += delta;
+        } else if (lock->sentence_num >= first) {
+            lock->sentence_num = count > 0 ? first + count - 1 : first;
+        }
+    }
+    for (LockWaiter *waiter = file ? file->waiters : NULL; waiter != NULL; waiter = waiter->next) {
+        if (waiter->sentence_num == own_sentence) {
+            waiter->sentence_num = first;
+        } else if (waiter->sentence_num > last) {
+            waiter->sentence_num += delta;
+        } else if (waiter->sentence_num >= first) {
+            waiter->sentence_num = count > 0 ? first + count - 1 : first;
+        }
+    }
+    pthread_mutex_unlock(&lock_mutex);
+}
+
+// Admin view of every held lock
+void print_sentence_locks() {
+    pthread_mutex_lock(&lock_mutex);
+    time_t now = time(NULL);
+    printf("  %d sentence lock(s) held\n", total_locks);
+    for (int i = 0; i < LOCK_TABLE_BUCKETS; i++) {
+        for (FileLocks *file = lock_table[i]; file != NULL; file = file->next) {
+            for (SentenceLock *lock = file->locks; lock != NULL; lock = lock->next) {
+                long left = (long)(lock->expires_at - now);
+                printf("  %s '%s' sentence %d by %s, held %lds, lease %s%lds\n",
+                       left > 0 ? "→" : "⚠", file->filename, lock->sentence_num,
+                       lock->username, (long)(now - lock->locked_at),
+                       left > 0 ? "" : "expired ", left > 0 ? left : -left);
+            }
+        }
+    }
+    pthread_mutex_unlock(&lock_mutex);
+}
+
+// Release every lock
+void cleanup_locks() {
+    pthread_mutex_lock(&lock_mutex);
+    for (int i = 0; i < LOCK_TABLE_BUCKETS; i++) {
+        FileLocks *file = lock_table[i];
+        while (file != NULL) {
+            FileLocks *next_file = file->next;
+            while (file->locks != NULL) {
+                unlink_lock(file, &file->locks);
+            }
+            free(file);
+            file = next_file;
+        }
+        lock_table[i] = NULL;
+    }
+    pthread_mutex_unlock(&lock_mutex);
+}
+
+// Number of sentence locks currently held
+int count_sentence_locks() {
+    pthread_mutex_lock(&lock_mutex);
+    int count = total_locks;
     pthread_mutex_unlock(&lock_mutex);
+    return count;
 }
@@ -2,25 +2,65 @@
 #define LOCK_MANAGER_H
 
 #include <pthread.h>
+#include <stddef.h>
+#include <time.h>
 #include "../common/protocol.h"
 
+#define LOCK_TABLE_BUCKETS 256
+#define DEFAULT_LOCK_LEASE_SEC 300   // DOCSPP_SS_LOCK_LEASE_SEC: idle edit sessions lose their lock after this
+#define DEFAULT_LOCK_WAIT_SEC 30     // WRITE -w without a timeout waits this long
+#define MAX_LOCK_WAIT_SEC 600
+
 // Sentence lock structure
 typedef struct SentenceLock {
+    unsigned long id;
     char filename[MAX_FILENAME];
-    int sentence_num;
+    int sentence_num;              // Current position; moved as other commits add or remove sentences
     char username[MAX_USERNAME];
     time_t locked_at;
+    time_t expires_at;             // Lease; renewed on every edit, others may take it once past
     struct SentenceLock *next;
 } SentenceLock;
 
+// A writer queued for a sentence lock. Waiters are served in arrival order;
+// a released lock is handed straight to the first one waiting for it.
+typedef struct LockWaiter {
+    int sentence_num;              // Remapped along with the locks
+    char username[MAX_USERNAME];
+    unsigned long granted;         // Id of the lock handed over, 0 while waiting
+    pthread_cond_t wake;
+    void (*notify)(void *context); // Waiters without a thread of their own are
+    void *notify_context;          // told through this (under lock_mutex) instead
+    struct LockWaiter *next;
+} LockWaiter;
+
+// All locks held on one file
+typedef struct FileLocks {
+    char filename[MAX_FILENAME];
+    SentenceLock *locks;
+    int count;
+    LockWaiter *waiters;           // Oldest first
+    struct FileLocks *next;
+} FileLocks;
+
 // Lock management functions
-SentenceLock* find_sentence_lock(const char *filename, int sentence_num);
-int add_sentence_lock(const char *filename, int sentence_num, const char *username);
-void remove_sentence_lock(const char *filename, int sentence_num, const char *username);
+void init_lock_manager();
+int find_sentence_lock(const char *filename, int sentence_num, char *holder, size_t size);
+unsigned long add_sentence_lock(const char *filename, int sentence_num, const char *username);
+LockWaiter* queue_sentence_lock(const char *filename, int sentence_num, const char *username, int *position,
+                                void (*notify)(void *context), void *notify_context);
+unsigned long await_sentence_lock(const char *filename, LockWaiter *waiter, int timeout_ms, int *position);
+void cancel_sentence_wait(const char *filename, LockWaiter *waiter);
+int renew_sentence_lock(const char *filename, unsigned long id);
+int sentence_lock_position(const char *filename, unsigned long id);
+void remove_sentence_lock(const char *filename, unsigned long id);
+void remap_sentence_locks(const char *filename, int first, int last, int count, unsigned long committer);
+void print_sentence_locks();
 void cleanup_locks();
+int count_sentence_locks();
 
 // External global variables
-extern SentenceLock *locks;
+extern FileLocks *lock_table[LOCK_TABLE_BUCKETS];
 extern pthread_mutex_t lock_mutex;
 
 #endif // LOCK_MANAGER_H
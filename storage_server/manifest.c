@@ -0,0 +1,370 @@
+#include "manifest.h"
+#include "file_operations.h"
+#include "../common/utils.h"
+#include "../common/protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#define MANIFEST_LOG "manifest.log"
+
+// Manifest state
+static ManifestEntry *manifest_table[MANIFEST_BUCKETS];
+static ManifestEntry *gen_head = NULL;   // Oldest generation
+static ManifestEntry *gen_tail = NULL;   // Newest generation
+static unsigned long epoch = 0;
+static unsigned long high_water = 0;
+static int entry_count = 0;
+static pthread_mutex_t manifest_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t manifest_changed = PTHREAD_COND_INITIALIZER;
+
+static unsigned int manifest_hash(const char *str) {
+    unsigned int hash = 5381;
+    int c;
+    while ((c = *str++))
+        hash = ((hash << 5) + hash) + c;
+    return hash % MANIFEST_BUCKETS;
+}
+
+static void manifest_log_path(char *path, size_t size) {
+    snprintf(path, size, "%s%s", meta_dir, MANIFEST_LOG);
+}
+
+static ManifestEntry* find_entry(const char *filename) {
+    ManifestEntry *entry = manifest_table[manifest_hash(filename)];
+    while (entry != NULL) {
+        if (strcmp(entry->filename, filename) == 0) {
+            return entry;
+        }
+        entry = entry->next;
+    }
+    return NULL;
+}
+
+static void unlink_gen(ManifestEntry *entry) {
+    if (entry->prev_gen) entry->prev_gen->next_gen = entry->next_gen;
+    else gen_head = entry->next_gen;
+    if (entry->next_gen) entry->next_gen->prev_gen = entry->prev_gen;
+    else gen_tail = entry->prev_gen;
+    entry->prev_gen = entry->next_gen = NULL;
+}
+
+static void append_gen(ManifestEntry *entry) {
+    entry->prev_gen = gen_tail;
+    entry->next_gen = NULL;
+    if (gen_tail) gen_tail->next_gen = entry;
+    else gen_head = entry;
+    gen_tail = entry;
+}
+
+// Create or move an entry to the newest end of the generation list
+static ManifestEntry* stamp_entry(const char *filename, unsigned long generation) {
+    ManifestEntry *entry = find_entry(filename);
+    if (entry == NULL) {
+        entry = calloc(1, sizeof(ManifestEntry));
+        strncpy(entry->filename, filename, sizeof(entry->filename) - 1);
+        unsigned int index = manifest_hash(filename);
+        entry->next = manifest_table[index];
+        manifest_table[index] = entry;
+        entry_count++;
+    } else {
+        unlink_gen(entry);
+    }
+    entry->generation = generation;
+    append_gen(entry);
+    if (generation > high_water) high_water = generation;
+    return entry;
+}
+
+static void append_record(FILE *fp, ManifestEntry *entry) {
+    fprintf(fp, "%lu\t%d\t%ld\t%ld\t%s\n", entry->generation, entry->deleted,
+            entry->size, (long)entry->mtime, entry->filename);
+}
+
+static void persist_entry(ManifestEntry *entry) {
+    char path[MAX_PATH];
+    manifest_log_path(path, sizeof(path));
+    FILE *fp = fopen(path, "a");
+    if (!fp) {
+        log_error("storage_server", "Failed to append to manifest log");
+        return;
+    }
+    append_record(fp, entry);
+    fclose(fp);
+}
+
+// Rewrite the log with one record per file (drops superseded records)
+static void compact_log() {
+    char path[MAX_PATH], tmp_path[MAX_PATH + 8];
+    manifest_log_path(path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp) {
+        log_error("storage_server", "Failed to compact manifest log");
+        return;
+    }
+    fprintf(fp, "MANIFEST_V1 %lu\n", epoch);
+    for (ManifestEntry *entry = gen_head; entry != NULL; entry = entry->next_gen) {
+        append_record(fp, entry);
+    }
+    fclose(fp);
+    rename(tmp_path, path);
+}
+
+static void record_stat(ManifestEntry *entry) {
+    char filepath[MAX_PATH + MAX_FILENAME];
+    struct stat st;
+    snprintf(filepath, sizeof(filepath), "%s%s", storage_dir, entry->filename);
+    if (stat(filepath, &st) == 0) {
+        entry->size = st.st_size;
+        entry->mtime = st.st_mtime;
+    } else {
+        entry->size = 0;
+        entry->mtime = 0;
+    }
+}
+
+// Load manifest log and reconcile it with the files actually on disk
+void init_manifest() {
+    char path[MAX_PATH];
+    manifest_log_path(path, sizeof(path));
+
+    int records = 0;
+    FILE *fp = fopen(path, "r");
+    if (fp) {
+        char line[MAX_FILENAME + 128];
+        if (fgets(line, sizeof(line), fp) && sscanf(line, "MANIFEST_V1 %lu", &epoch) == 1) {
+            while (fgets(line, sizeof(line), fp)) {
+                unsigned long generation;
+                int deleted;
+                long size, mtime;
+                int name_offset = 0;
+                if (sscanf(line, "%lu\t%d\t%ld\t%ld\t%n", &generation, &deleted,
+                           &size, &mtime, &name_offset) < 4 || name_offset == 0) {
+                    continue;
+                }
+                char *name = line + name_offset;
+                name[strcspn(name, "\n")] = '\0';
+                if (strlen(name) == 0) continue;
+
+                ManifestEntry *entry = stamp_entry(name, generation);
+                entry->deleted = deleted;
+                entry->size = size;
+                entry->mtime = (time_t)mtime;
+                records++;
+            }
+        }
+        fclose(fp);
+    }
+
+    if (epoch == 0) {
+        // Fresh manifest - pick a new identity so the NS can tell it apart
+        epoch = ((unsigned long)time(NULL) << 16) ^ (unsigned long)getpid();
+        if (epoch == 0) epoch = 1;
+        records = 0;
+        high_water = 0;
+    }
+
+    // Stamp files that appeared or changed while the server was offline
+    static char files[MAX_FILES][MAX_FILENAME];
+    int file_count = list_files(files);
+    int changed = 0;
+    for (int i = 0; i < file_count; i++) {
+        char filepath[MAX_PATH + MAX_FILENAME];
+        struct stat st;
+        snprintf(filepath, sizeof(filepath), "%s%s", storage_dir, files[i]);
+        if (stat(filepath, &st) != 0) continue;
+
+        ManifestEntry *entry = find_entry(files[i]);
+        if (entry == NULL || entry->deleted || entry->size != st.st_size ||
+            entry->mtime != st.st_mtime) {
+            entry = stamp_entry(files[i], high_water + 1);
+            entry->deleted = 0;
+            entry->size = st.st_size;
+            entry->mtime = st.st_mtime;
+            changed++;
+        }
+    }
+
+    // Tombstone files that disappeared while the server was offline
+    ManifestEntry *entry = gen_head;
+    while (entry != NULL) {
+        ManifestEntry *next = entry->next_gen;
+        char filepath[MAX_PATH + MAX_FILENAME];
+        struct stat st;
+        snprintf(filepath, sizeof(filepath), "%s%s", storage_dir, entry->filename);
+        if (!entry->deleted && stat(filepath, &st) != 0) {
+            stamp_entry(entry->filename, high_water + 1);
+            entry->deleted = 1;
+            entry->size = 0;
+            entry->mtime = 0;
+            changed++;
+        }
+        entry = next;
+    }
+
+    if (records == 0 || changed > 0 || records > 2 * entry_count + 16) {
+        compact_log();
+    }
+
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "Manifest loaded: epoch=%lu generation=%lu files=%d (%d changed offline)",
+             epoch, high_water, entry_count, changed);
+    log_message("storage_server", log_msg);
+}
+
+// Stamp a file with a new generation after it was created or modified
+unsigned long manifest_bump(const char *filename) {
+    pthread_mutex_lock(&manifest_mutex);
+    ManifestEntry *entry = stamp_entry(filename, high_water + 1);
+    entry->deleted = 0;
+    record_stat(entry);
+    persist_entry(entry);
+    unsigned long generation = entry->generation;
+    pthread_cond_broadcast(&manifest_changed);
+    pthread_mutex_unlock(&manifest_mutex);
+    return generation;
+}
+
+// Record a tombstone for a deleted file
+void manifest_remove(const char *filename) {
+    pthread_mutex_lock(&manifest_mutex);
+    ManifestEntry *entry = stamp_entry(filename, high_water + 1);
+    entry->deleted = 1;
+    entry->size = 0;
+    entry->mtime = 0;
+    persist_entry(entry);
+    pthread_cond_broadcast(&manifest_changed);
+    pthread_mutex_unlock(&manifest_mutex);
+}
+
+unsigned long manifest_get_generation(const char *filename) {
+    pthread_mutex_lock(&manifest_mutex);
+    ManifestEntry *entry = find_entry(filename);
+    unsigned long generation = (entry && !entry->deleted) ? entry->generation : 0;
+    pthread_mutex_unlock(&manifest_mutex);
+    return generation;
+}
+
+unsigned long manifest_epoch() {
+    return epoch;
+}
+
+unsigned long manifest_high_water() {
+    pthread_mutex_lock(&manifest_mutex);
+    unsigned long generation = high_water;
+    pthread_mutex_unlock(&manifest_mutex);
+    return generation;
+}
+
+// Block until the high-water generation passes 'since' or the timeout expires.
+// Returns the current high-water generation.
+unsigned long manifest_wait_for_change(unsigned long since, int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&manifest_mutex);
+    while (high_water <= since) {
+        if (pthread_cond_timedwait(&manifest_changed, &manifest_mutex, &deadline) != 0) break;
+    }
+    unsigned long generation = high_water;
+    pthread_mutex_unlock(&manifest_mutex);
+    return generation;
+}
+
+// Snapshot every entry newer than 'since', oldest generation first.
+// Returns the count; *changes is malloc'd and owned by the caller.
+int manifest_changes_since(unsigned long since, ManifestChange **changes) {
+    pthread_mutex_lock(&manifest_mutex);
+    int count = 0;
+    ManifestEntry *entry = gen_tail;
+    while (entry != NULL && entry->generation > since) {
+        count++;
+        entry = entry->prev_gen;
+    }
+
+    *changes = NULL;
+    if (count > 0) {
+        *changes = malloc(sizeof(ManifestChange) * count);
+        // entry now points just before the first changed entry
+        ManifestEntry *current = entry ? entry->next_gen : gen_head;
+        for (int i = 0; i < count && current != NULL; i++, current = current->next_gen) {
+            strncpy((*changes)[i].filename, current->filename, sizeof((*changes)[i].filename));
+            (*changes)[i].generation = current->generation;
+            (*changes)[i].deleted = current->deleted;
+        }
+    }
+    pthread_mutex_unlock(&manifest_mutex);
+    return count;
+}
+
+// Send every entry newer than 'since' as MSG_SYNC_DELTA batches and report
+// the newest generation included in *through.
+// Walks the generation list from the newest end, so cost scales with churn.
+static int send_delta_batches(int socket, unsigned long since, unsigned long *through, int *batches) {
+    ManifestChange *items;
+    int count = manifest_changes_since(since, &items);
+    *through = count > 0 ? items[count - 1].generation : since;
+
+    struct Message msg;
+    int sent = 0;
+    int i = 0;
+    do {
+        memset(&msg, 0, sizeof(msg));
+        msg.type = MSG_SYNC_DELTA;
+        snprintf(msg.checkpoint_tag, sizeof(msg.checkpoint_tag), "%lu", epoch);
+        size_t used = 0;
+        while (i < count) {
+            char line[MAX_FILENAME + 64];
+            int len = snprintf(line, sizeof(line), "%lu\t%d\t%s\n",
+                               items[i].generation, items[i].deleted, items[i].filename);
+            if (used + len >= sizeof(msg.data)) break;
+            memcpy(msg.data + used, line, len);
+            used += len;
+            i++;
+        }
+        msg.data[used] = '\0';
+        msg.data_length = used;
+        if (i >= count) msg.flags = SYNC_FLAG_LAST;
+        if (send_message(socket, &msg) < 0) {
+            free(items);
+            return -1;
+        }
+        sent++;
+    } while (i < count);
+
+    free(items);
+    *batches = sent;
+    return count;
+}
+
+int manifest_send_delta(int socket, unsigned long since) {
+    unsigned long through;
+    int sent = 0;
+    int count = send_delta_batches(socket, since, &through, &sent);
+    if (count < 0) return -1;
+
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "Delta sync sent: %d entries since generation %lu in %d batch(es)",
+             count, since, sent);
+    log_message("storage_server", log_msg);
+    return count;
+}
+
+// Push variant of manifest_send_delta for the version channel: no logging
+// (it runs on every commit). Returns the entry count; *through is the
+// newest generation the NS will have after applying it.
+int manifest_push_delta(int socket, unsigned long since, unsigned long *through) {
+    int batches = 0;
+    return send_delta_batches(socket, since, through, &batches);
+}
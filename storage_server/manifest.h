@@ -0,0 +1,43 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <time.h>
+#include <pthread.h>
+#include "../common/protocol.h"
+
+#define MANIFEST_BUCKETS 1024
+
+// Per-file manifest entry. Every mutation of a file stamps it with the next
+// value of the server-wide generation counter, so "what changed since N" is
+// just the entries with generation > N.
+typedef struct ManifestEntry {
+    char filename[MAX_FILENAME];
+    unsigned long generation;
+    int deleted;                      // Tombstone for deleted files
+    long size;                        // Size/mtime at last stamp, used to
+    time_t mtime;                     // detect edits made while offline
+    struct ManifestEntry *next;       // Hash chain
+    struct ManifestEntry *prev_gen;   // Generation-ordered list (oldest first)
+    struct ManifestEntry *next_gen;
+} ManifestEntry;
+
+// Snapshot of one entry, as handed out by manifest_changes_since
+typedef struct {
+    char filename[MAX_FILENAME];
+    unsigned long generation;
+    int deleted;
+} ManifestChange;
+
+// Manifest functions
+void init_manifest();
+unsigned long manifest_bump(const char *filename);
+void manifest_remove(const char *filename);
+unsigned long manifest_get_generation(const char *filename);
+unsigned long manifest_epoch();
+unsigned long manifest_high_water();
+int manifest_changes_since(unsigned long since, ManifestChange **changes);
+int manifest_send_delta(int socket, unsigned long since);
+int manifest_push_delta(int socket, unsigned long since, unsigned long *through);
+unsigned long manifest_wait_for_change(unsigned long since, int timeout_ms);
+
+#endif // MANIFEST_H
@@ -0,0 +1,149 @@
+#include "sentence_index.h"
+#include "file_operations.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Index files live flat in meta_dir; folder separators are escaped
+static void sidx_path(const char *filename, char *path, size_t size) {
+    char flat[MAX_FILENAME];
+    strncpy(flat, filename, sizeof(flat) - 1);
+    flat[sizeof(flat) - 1] = '\0';
+    for (char *p = flat; *p; p++) {
+        if (*p == '/') *p = '#';
+    }
+    snprintf(path, size, "%s%s.sidx", meta_dir, flat);
+}
+
+static int header_matches(const SidxHeader *header, const struct stat *st) {
+    return header->magic == SIDX_MAGIC && header->version == SIDX_VERSION &&
+           header->file_size == (uint64_t)st->st_size &&
+           header->mtime_sec == (int64_t)st->st_mtim.tv_sec &&
+           header->mtime_nsec == (int64_t)st->st_mtim.tv_nsec &&
+           header->ino == (uint64_t)st->st_ino;
+}
+
+// Open the index if it exists and still describes the data file.
+// Returns a read-only fd (caller closes) or -1.
+int sidx_open(const char *filename, SidxHeader *header) {
+    char data_path[MAX_PATH], path[MAX_PATH];
+    snprintf(data_path, sizeof(data_path), "%s%s", storage_dir, filename);
+    sidx_path(filename, path, sizeof(path));
+
+    struct stat st;
+    if (stat(data_path, &st) != 0) return -1;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    if (pread(fd, header, sizeof(*header), 0) != (ssize_t)sizeof(*header) ||
+        !header_matches(header, &st)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int read_offset(int fd, uint64_t index, uint64_t *offset) {
+    off_t position = sizeof(SidxHeader) + index * sizeof(uint64_t);
+    return pread(fd, offset, sizeof(*offset), position) == (ssize_t)sizeof(*offset) ? 0 : -1;
+}
+
+// Byte range of one sentence: two reads, independent of document size
+int sidx_span(int fd, const SidxHeader *header, uint64_t index,
+              uint64_t *offset, uint64_t *length) {
+    if (index >= header->sentence_count) return -1;
+    if (read_offset(fd, index, offset) != 0) return -1;
+
+    uint64_t end = header->file_size;
+    if (index + 1 < header->sentence_count) {
+        uint64_t next;
+        if (read_offset(fd, index + 1, &next) != 0) return -1;
+        end = next - 1;   // Minus the separating space
+    }
+    if (end < *offset) return -1;
+    *length = end - *offset;
+    return 0;
+}
+
+// Sentence containing a byte offset (binary search over the index)
+long sidx_find(int fd, const SidxHeader *header, uint64_t byte_offset) {
+    if (header->sentence_count == 0) return -1;
+    uint64_t low = 0, high = header->sentence_count - 1;
+    while (low < high) {
+        uint64_t mid = low + (high - low + 1) / 2;
+        uint64_t offset;
+        if (read_offset(fd, mid, &offset) != 0) return -1;
+        if (offset <= byte_offset) low = mid;
+        else high = mid - 1;
+    }
+    return (long)low;
+}
+
+// Read every sentence offset (offsets must hold sentence_count entries)
+int sidx_read_offsets(int fd, const SidxHeader *header, uint64_t *offsets) {
+    size_t bytes = header->sentence_count * sizeof(uint64_t);
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t got = pread(fd, (char*)offsets + done, bytes - done, sizeof(SidxHeader) + done);
+        if (got <= 0) return -1;
+        done += got;
+    }
+    return 0;
+}
+
+// Write entries [from, count) (entries[0] is sentence 'from') and a fresh
+// header. Entries before 'from' are unchanged by a commit, so an append only
+// costs the entries it adds. Returns 0, or 1 if the caller must resend
+// from sentence 0 because the existing index is too short, or -1.
+int sidx_write(const char *filename, const uint64_t *entries, uint64_t from,
+               uint64_t count, const struct stat *data_stat) {
+    char path[MAX_PATH];
+    sidx_path(filename, path, sizeof(path));
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return -1;
+
+    // An index shorter than 'from' entries cannot be patched
+    struct stat st;
+    if (from > 0 && (fstat(fd, &st) != 0 ||
+                     (uint64_t)st.st_size < sizeof(SidxHeader) + from * sizeof(uint64_t))) {
+        close(fd);
+        return 1;
+    }
+
+    SidxHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SIDX_MAGIC;
+    header.version = SIDX_VERSION;
+    header.file_size = data_stat->st_size;
+    header.mtime_sec = data_stat->st_mtim.tv_sec;
+    header.mtime_nsec = data_stat->st_mtim.tv_nsec;
+    header.ino = data_stat->st_ino;
+    header.sentence_count = count;
+
+    int result = 0;
+    size_t bytes = (count - from) * sizeof(uint64_t);
+    if (bytes > 0 && pwrite(fd, entries, bytes, sizeof(header) + from * sizeof(uint64_t)) != (ssize_t)bytes) {
+        result = -1;
+    }
+    if (result == 0 && ftruncate(fd, sizeof(header) + count * sizeof(uint64_t)) != 0) result = -1;
+    // Header last: until it lands, the old header no longer matches the
+    // rewritten data file, so readers treat the index as stale
+    if (result == 0 && pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) result = -1;
+    close(fd);
+
+    if (result != 0) {
+        log_error("storage_server", "Failed to update sentence index");
+        unlink(path);
+    }
+    return result;
+}
+
+void sidx_remove(const char *filename) {
+    char path[MAX_PATH];
+    sidx_path(filename, path, sizeof(path));
+    unlink(path);
+}
@@ -0,0 +1,36 @@
+#ifndef SENTENCE_INDEX_H
+#define SENTENCE_INDEX_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+// Sidecar sentence index: meta/<file>.sidx holds the byte offset where each
+// sentence of the (normalized) file starts. Sentences are separated by one
+// space on disk, so sentence i spans [offset[i], offset[i+1] - 1) and the
+// last one runs to the end of the file. The header records the identity of
+// the data file it describes; any other writer makes it stale, and stale
+// or missing indexes are rebuilt the next time the document is parsed.
+#define SIDX_MAGIC 0x58444953u   // "SIDX"
+#define SIDX_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t file_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t ino;
+    uint64_t sentence_count;
+} SidxHeader;
+
+// Sentence index functions
+int sidx_open(const char *filename, SidxHeader *header);
+int sidx_span(int fd, const SidxHeader *header, uint64_t index,
+              uint64_t *offset, uint64_t *length);
+long sidx_find(int fd, const SidxHeader *header, uint64_t byte_offset);
+int sidx_read_offsets(int fd, const SidxHeader *header, uint64_t *offsets);
+int sidx_write(const char *filename, const uint64_t *entries, uint64_t from,
+               uint64_t count, const struct stat *data_stat);
+void sidx_remove(const char *filename);
+
+#endif // SENTENCE_INDEX_H
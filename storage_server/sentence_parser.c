@@ -1,4 +1,5 @@
 #include "sentence_parser.h"
+#include "../common/protocol.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -126,7 +127,8 @@ char** parse_sentences(const char *content, int *sentence_count) {
     return sentences;
 }
 
-// Parse sentence into words
+// Parse sentence into words. Re-entrant (strtok_r), as handler threads
+// parse concurrently.
 char** parse_words(const char *sentence, int *word_count) {
     if (!sentence || strlen(sentence) == 0) {
         *word_count = 0;
@@ -137,10 +139,11 @@ char** parse_words(const char *sentence, int *word_count) {
     *word_count = 0;
     
     // Count words
-    char *token = strtok(copy, " \t\n");
+    char *saveptr = NULL;
+    char *token = strtok_r(copy, " \t\n", &saveptr);
     while (token != NULL) {
         (*word_count)++;
-        token = strtok(NULL, " \t\n");
+        token = strtok_r(NULL, " \t\n", &saveptr);
     }
     
     if (*word_count == 0) {
@@ -154,11 +157,11 @@ char** parse_words(const char *sentence, int *word_count) {
     // Extract words
     strcpy(copy, sentence);
     int idx = 0;
-    token = strtok(copy, " \t\n");
+    token = strtok_r(copy, " \t\n", &saveptr);
     while (token != NULL && idx < *word_count) {
         words[idx] = strdup(token);
         idx++;
-        token = strtok(NULL, " \t\n");
+        token = strtok_r(NULL, " \t\n", &saveptr);
     }
     
     free(copy);
@@ -184,3 +187,99 @@ char* rebuild_sentence(char **words, int word_count) {
     
     return result;
 }
+
+// Split text into whitespace-separated words and insert them at 'at'
+static void insert_words(char ***words, int *word_count, int at, const char *text) {
+    const char *p = text;
+    while (*p) {
+        while (*p && isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+        const char *start = p;
+        while (*p && !isspace((unsigned char)*p)) p++;
+        *words = realloc(*words, sizeof(char*) * (*word_count + 1));
+        memmove(*words + at + 1, *words + at, sizeof(char*) * (*word_count - at));
+        (*words)[at++] = strndup(start, p - start);
+        (*word_count)++;
+    }
+}
+
+static void free_words(char **words, int word_count) {
+    for (int i = 0; i < word_count; i++) free(words[i]);
+    free(words);
+}
+
+// Apply a batch of word edits (see WRITE_FLAG_BATCH) all or nothing. On
+// failure the words are left as they were and 'error' names the bad line.
+// Returns a protocol code.
+int apply_word_edits(char ***words, int *word_count, const char *batch, char *error, size_t error_size) {
+    // Work on a copy so a bad line leaves the session untouched
+    int count = *word_count;
+    char **edited = malloc(sizeof(char*) * (count + 1));
+    for (int i = 0; i < count; i++) edited[i] = strdup((*words)[i]);
+
+    int line_no = 0;
+    const char *line = batch;
+    while (*line) {
+        const char *end = strchr(line, '\n');
+        size_t length = end ? (size_t)(end - line) : strlen(line);
+        char *copy = strndup(line, length);
+        line = end ? end + 1 : line + length;
+        line_no++;
+
+        char op = 0;
+        int index = -1, consumed = 0;
+        if (sscanf(copy, " %c %d%n", &op, &index, &consumed) < 2) {
+            free(copy);
+            if (length == 0) continue;
+            snprintf(error, error_size, "Edit %d: expected '<I|D|R> <index> [text]'", line_no);
+            free_words(edited, count);
+            return ERR_INVALID_REQUEST;
+        }
+        const char *text = copy + consumed;
+        while (isspace((unsigned char)*text)) text++;
+
+        int result = RESP_SUCCESS;
+        if ((op == 'I' || op == 'R') && *text == '\0') {
+            result = ERR_INVALID_REQUEST;   // Deleting is D's job
+        } else if (op == 'I' && index >= 0 && index <= count) {
+            insert_words(&edited, &count, index, text);
+        } else if (op == 'D' && index >= 0 && index < count) {
+            int remove = *text ? atoi(text) : 1;
+            if (remove < 1 || index + remove > count) {
+                result = ERR_WORD_OUT_OF_RANGE;
+            } else {
+                for (int i = index; i < index + remove; i++) free(edited[i]);
+                memmove(edited + index, edited + index + remove, sizeof(char*) * (count - index - remove));
+                count -= remove;
+            }
+        } else if (op == 'R' && index >= 0 && index < count) {
+            free(edited[index]);
+            memmove(edited + index, edited + index + 1, sizeof(char*) * (count - index - 1));
+            count--;
+            insert_words(&edited, &count, index, text);
+        } else if (op == 'I' || op == 'D' || op == 'R') {
+            result = ERR_WORD_OUT_OF_RANGE;
+        } else {
+            result = ERR_INVALID_REQUEST;
+        }
+        free(copy);
+
+        if (result != RESP_SUCCESS) {
+            if (result == ERR_WORD_OUT_OF_RANGE) {
+                snprintf(error, error_size, "Edit %d: word index out of range (sentence has %d word(s) there)",
+                         line_no, count);
+            } else if (op == 'I' || op == 'R') {
+                snprintf(error, error_size, "Edit %d: '%c' needs text (use D to delete)", line_no, op);
+            } else {
+                snprintf(error, error_size, "Edit %d: unknown operation '%c'", line_no, op);
+            }
+            free_words(edited, count);
+            return result;
+        }
+    }
+
+    free_words(*words, *word_count);
+    *words = edited;
+    *word_count = count;
+    return RESP_SUCCESS;
+}
@@ -126,6 +126,7 @@ int register_with_ns() {
     
     // Prepare registration message
     struct SSRegistration reg;
+    memset(&reg, 0, sizeof(reg));  // epoch = 0: no delta sync support
     strncpy(reg.ss_id, ss_id, sizeof(reg.ss_id));
 
     // Determine a routable local IP address to advertise to the Naming Server.
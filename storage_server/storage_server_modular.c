@@ -19,16 +19,30 @@
 #include <arpa/inet.h>
 #include <pthread.h>
 #include <dirent.h>
+#include <stdint.h>
 
 // Common includes
 #include "../common/protocol.h"
 #include "../common/utils.h"
+#include "../common/event_loop.h"
+#include "../common/text_count.h"
 
 // Module includes
 #include "file_operations.h"
 #include "sentence_parser.h"
 #include "lock_manager.h"
 #include "undo_manager.h"
+#include "chunk_store.h"
+#include "diff_engine.h"
+#include "word_stream.h"
+#include "manifest.h"
+#include "anti_entropy.h"
+#include "load_stats.h"
+#include "version_push.h"
+#include "backup_stream.h"
+#include "document.h"
+#include "durable_io.h"
+#include "io_engine.h"
 
 // Global state
 char ns_ip[16];
@@ -38,11 +52,12 @@ int client_port;  // Port for client communication
 char ss_id[64];
 char storage_dir[MAX_PATH];  // Dynamic: ./storage/SS1/
 char backup_dir[MAX_PATH];   // Dynamic: ./backups/SS1/
+char meta_dir[MAX_PATH];     // Dynamic: ./meta/SS1/
 
 // Forward declarations
-void* handle_client(void *arg);
-void* handle_ns_commands(void *arg);
-void* accept_ns_connections(void *arg);
+static void client_event(Connection *conn, int event);
+static void ns_event(Connection *conn, int event);
+void* heartbeat_responder(void *arg);
 
 // Register with naming server
 int register_with_ns() {
@@ -64,7 +79,8 @@ int register_with_ns() {
     }
     
     // Prepare registration message
-    struct SSRegistration reg;
+    static struct SSRegistration reg;
+    memset(&reg, 0, sizeof(reg));
     strncpy(reg.ss_id, ss_id, sizeof(reg.ss_id));
 
     // Determine a routable local IP address to advertise to the Naming Server.
@@ -91,7 +107,10 @@ int register_with_ns() {
     strncpy(reg.ip, local_ip, sizeof(reg.ip));
     reg.nm_port = nm_port;
     reg.client_port = client_port;
-    reg.file_count = list_files(reg.files);
+    // The file list is exchanged as a manifest delta after the handshake
+    reg.epoch = manifest_epoch();
+    reg.generation = manifest_high_water();
+    reg.file_count = 0;
     
     struct Message msg;
     msg.type = MSG_REGISTER_SS;
@@ -113,825 +132,1255 @@ int register_with_ns() {
         return -1;
     }
     
+    // NS answers with the generation it already has; send only what changed since
+    unsigned long since = 0;
+    if (sscanf(msg.data, "SYNC %lu", &since) == 1) {
+        int changed = manifest_send_delta(sock, since);
+        memset(&msg, 0, sizeof(msg));
+        if (changed < 0 || recv_message(sock, &msg) <= 0 || msg.error_code != RESP_SUCCESS) {
+            log_error("storage_server", "Delta sync with Naming Server failed");
+            close(sock);
+            return -1;
+        }
+        printf("Registered with NS. Synced %d changed file(s) since generation %lu.\n", changed, since);
+    } else {
+        printf("Registered with NS (no delta sync requested).\n");
+    }
+    
     log_message("storage_server", "Successfully registered with Naming Server");
-    printf("Registered with NS. Advertised %d files.\n", reg.file_count);
     printf("✓ Persistent connection to NS established\n");
     
     return sock;
 }
 
-// Accept NS connections (runs in separate thread)
-void* accept_ns_connections(void *arg) {
-    int nm_listener = *(int*)arg;
+// Answer NS heartbeat pings on the UDP NM port
+// ("PING <seq> <id>" -> "PONG <seq> <id> <load report>"). Pongs stop while
+// the worker pool is wedged, so the NS sees a server that cannot serve
+// requests as failed even though this thread is still running.
+void* heartbeat_responder(void *arg) {
+    int udp_socket = *(int*)arg;
+    free(arg);
+    long long stall_us = (long long)get_config_int("DOCSPP_SS_STALL_MS", DEFAULT_STALL_MS) * 1000;
+    int stalled = 0;
     
     while (1) {
-        struct sockaddr_in ns_addr;
-        socklen_t ns_len = sizeof(ns_addr);
-        int *ns_sock = malloc(sizeof(int));
-        *ns_sock = accept(nm_listener, (struct sockaddr*)&ns_addr, &ns_len);
-        
-        if (*ns_sock < 0) {
-            free(ns_sock);
-            continue;
-        }
+        char datagram[128];
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t bytes = recvfrom(udp_socket, datagram, sizeof(datagram) - 1, 0,
+                                 (struct sockaddr*)&from, &from_len);
+        if (bytes <= 0) continue;
+        datagram[bytes] = '\0';
         
-        printf("✓ Naming Server connected for commands\n");
+        unsigned long seq;
+        if (sscanf(datagram, "PING %lu", &seq) != 1) continue;
         
-        pthread_t thread;
-        if (pthread_create(&thread, NULL, handle_ns_commands, ns_sock) != 0) {
-            free(ns_sock);
+        if (stall_us > 0 && event_loop_stalled(stall_us)) {
+            if (!stalled) log_error("storage_server", "Worker pool stalled - withholding heartbeats");
+            stalled = 1;
             continue;
         }
+        if (stalled) log_message("storage_server", "Worker pool making progress again - heartbeats resumed");
+        stalled = 0;
         
-        pthread_detach(thread);
+        struct SSLoadReport report;
+        load_fill_report(&report);
+        char reply[512];
+        int len = snprintf(reply, sizeof(reply), "PONG %lu %s ", seq, ss_id);
+        len += format_load_report(&report, reply + len, sizeof(reply) - len);
+        sendto(udp_socket, reply, len, 0, (struct sockaddr*)&from, from_len);
     }
     
     return NULL;
 }
 
-// Handle NS commands
-void* handle_ns_commands(void *arg) {
-    int nm_socket = *(int*)arg;
-    free(arg);
+// One NS command
+static void ns_request(Connection *conn, int event) {
+    (void)event;
+    int nm_socket = conn->fd;
+    struct Message msg = conn->request;
     
-    struct Message msg;
+    char log_msg[512];
+    snprintf(log_msg, sizeof(log_msg), "Received command from NS: type=%d, file=%s", 
+             msg.type, msg.filename);
+    log_message("storage_server", log_msg);
     
-    printf("✓ NS connection handler started\n");
+    int result = RESP_SUCCESS;
     
-    while (1) {
-        if (recv_message(nm_socket, &msg) <= 0) {
-            printf("✗ Lost connection to Naming Server\n");
+    switch (msg.type) {
+        case MSG_CREATE:
+            printf("→ CREATE command for '%s'\n", msg.filename);
+            result = create_file(msg.filename);
+            if (result == RESP_SUCCESS) {
+                snprintf(msg.data, sizeof(msg.data), "File created on storage server");
+                printf("  ✓ File created\n");
+                snprintf(log_msg, sizeof(log_msg), "Created file: %s", msg.filename);
+                log_message("storage_server", log_msg);
+            } else if (result == ERR_FILE_EXISTS) {
+                snprintf(msg.data, sizeof(msg.data), "File already exists");
+                printf("  ✗ File already exists\n");
+                snprintf(log_msg, sizeof(log_msg), "File already exists: %s", msg.filename);
+                log_message("storage_server", log_msg);
+            } else {
+                snprintf(msg.data, sizeof(msg.data), "Failed to create file");
+                printf("  ✗ Failed to create file\n");
+                log_error("storage_server", "Failed to create file");
+            }
             break;
-        }
-        
-        char log_msg[512];
-        snprintf(log_msg, sizeof(log_msg), "Received command from NS: type=%d, file=%s", 
-                 msg.type, msg.filename);
-        log_message("storage_server", log_msg);
-        
-        int result = RESP_SUCCESS;
-        
-        switch (msg.type) {
-            case MSG_CREATE:
-                printf("→ CREATE command for '%s'\n", msg.filename);
-                result = create_file(msg.filename);
-                if (result == RESP_SUCCESS) {
-                    snprintf(msg.data, sizeof(msg.data), "File created on storage server");
-                    printf("  ✓ File created\n");
-                    snprintf(log_msg, sizeof(log_msg), "Created file: %s", msg.filename);
-                    log_message("storage_server", log_msg);
-                } else if (result == ERR_FILE_EXISTS) {
-                    snprintf(msg.data, sizeof(msg.data), "File already exists");
-                    printf("  ✗ File already exists\n");
-                    snprintf(log_msg, sizeof(log_msg), "File already exists: %s", msg.filename);
-                    log_message("storage_server", log_msg);
-                } else {
-                    snprintf(msg.data, sizeof(msg.data), "Failed to create file");
-                    printf("  ✗ Failed to create file\n");
-                    log_error("storage_server", "Failed to create file");
-                }
-                break;
-                
-            case MSG_DELETE:
-                printf("→ DELETE command for '%s'\n", msg.filename);
-                result = delete_file(msg.filename);
-                if (result == RESP_SUCCESS) {
-                    snprintf(msg.data, sizeof(msg.data), "File deleted from storage server");
-                    printf("  ✓ File deleted\n");
-                    snprintf(log_msg, sizeof(log_msg), "Deleted file: %s", msg.filename);
-                    log_message("storage_server", log_msg);
-                } else if (result == ERR_FILE_NOT_FOUND) {
-                    snprintf(msg.data, sizeof(msg.data), "File not found");
-                    printf("  ✗ File not found\n");
-                } else {
-                    snprintf(msg.data, sizeof(msg.data), "Failed to delete file");
-                    printf("  ✗ Failed to delete file\n");
-                    log_error("storage_server", "Failed to delete file");
-                }
-                break;
-                
-            case MSG_CREATEFOLDER: {
-                printf("→ CREATEFOLDER command for '%s'\n", msg.filename);
-                
-                char dirpath[MAX_PATH];
-                snprintf(dirpath, sizeof(dirpath), "%s%s", storage_dir, msg.filename);
-                
-                char *path_copy = strdup(dirpath);
-                char *p = path_copy + strlen(storage_dir);
-                
-                for (; *p; p++) {
-                    if (*p == '/') {
-                        *p = '\0';
-                        mkdir(path_copy, 0777);
-                        *p = '/';
-                    }
-                }
-                mkdir(path_copy, 0777);
-                
-                free(path_copy);
-                
-                result = RESP_SUCCESS;
-                snprintf(msg.data, sizeof(msg.data), "Folder created on storage server");
-                printf("  ✓ Directory created: %s\n", dirpath);
-                snprintf(log_msg, sizeof(log_msg), "Created folder: %s", msg.filename);
+            
+        case MSG_DELETE:
+            printf("→ DELETE command for '%s'\n", msg.filename);
+            result = delete_file(msg.filename);
+            if (result == RESP_SUCCESS) {
+                snprintf(msg.data, sizeof(msg.data), "File deleted from storage server");
+                printf("  ✓ File deleted\n");
+                snprintf(log_msg, sizeof(log_msg), "Deleted file: %s", msg.filename);
                 log_message("storage_server", log_msg);
-                break;
+            } else if (result == ERR_FILE_NOT_FOUND) {
+                snprintf(msg.data, sizeof(msg.data), "File not found");
+                printf("  ✗ File not found\n");
+            } else {
+                snprintf(msg.data, sizeof(msg.data), "Failed to delete file");
+                printf("  ✗ Failed to delete file\n");
+                log_error("storage_server", "Failed to delete file");
             }
+            break;
             
-            case MSG_MOVE: {
-                printf("→ MOVE command: '%s' to folder '%s'\n", msg.filename, msg.folder);
-                
-                char old_path[MAX_PATH], new_path[MAX_PATH];
-                snprintf(old_path, sizeof(old_path), "%s%s", storage_dir, msg.filename);
-                
-                if (strlen(msg.folder) == 0) {
-                    snprintf(new_path, sizeof(new_path), "%s%s", storage_dir, msg.filename);
-                } else {
-                    char folder_path[MAX_PATH];
-                    snprintf(folder_path, sizeof(folder_path), "%s%s", storage_dir, msg.folder);
-                    mkdir(folder_path, 0777);
-                    
-                    snprintf(new_path, sizeof(new_path), "%s%s/%s", storage_dir, msg.folder, msg.filename);
-                }
-                
-                if (rename(old_path, new_path) == 0) {
-                    result = RESP_SUCCESS;
-                    printf("  ✓ File moved from %s to %s\n", old_path, new_path);
-                    snprintf(log_msg, sizeof(log_msg), "Moved file '%s' to folder '%s'", 
-                             msg.filename, msg.folder);
-                    log_message("storage_server", log_msg);
-                } else {
-                    result = ERR_SERVER_ERROR;
-                    printf("  ✗ Failed to move file\n");
-                    log_error("storage_server", "Failed to move file");
+        case MSG_CREATEFOLDER: {
+            printf("→ CREATEFOLDER command for '%s'\n", msg.filename);
+            
+            char dirpath[MAX_PATH];
+            snprintf(dirpath, sizeof(dirpath), "%s%s", storage_dir, msg.filename);
+            
+            char *path_copy = strdup(dirpath);
+            char *p = path_copy + strlen(storage_dir);
+            
+            for (; *p; p++) {
+                if (*p == '/') {
+                    *p = '\0';
+                    mkdir(path_copy, 0777);
+                    *p = '/';
                 }
-                
-                snprintf(msg.data, sizeof(msg.data), "File moved on storage server");
-                break;
             }
-
-            case MSG_CHECKPOINT: {
-                printf("→ CHECKPOINT command: '%s' with tag '%s'\n", msg.filename, msg.checkpoint_tag);
-                
-                char checkpoints_dir[MAX_PATH];
-                snprintf(checkpoints_dir, sizeof(checkpoints_dir), "%scheckpoints/", storage_dir);
-                mkdir(checkpoints_dir, 0777);
-                
-                char src_path[MAX_PATH], checkpoint_path[MAX_PATH];
-                snprintf(src_path, sizeof(src_path), "%s%s", storage_dir, msg.filename);
-                snprintf(checkpoint_path, sizeof(checkpoint_path), "%scheckpoints/%s.%s", 
-                         storage_dir, msg.filename, msg.checkpoint_tag);
-                
-                int src_fd = open(src_path, O_RDONLY);
-                if (src_fd < 0) {
-                    result = ERR_FILE_NOT_FOUND;
-                    snprintf(msg.data, sizeof(msg.data), "Error: Source file not found");
-                    printf("  ✗ Source file not found\n");
-                    break;
-                }
-                
-                int dest_fd = open(checkpoint_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-                if (dest_fd < 0) {
-                    close(src_fd);
-                    result = ERR_SERVER_ERROR;
-                    snprintf(msg.data, sizeof(msg.data), "Error: Failed to create checkpoint file");
-                    printf("  ✗ Failed to create checkpoint file\n");
-                    break;
-                }
-                
-                char buffer[4096];
-                ssize_t bytes;
-                while ((bytes = read(src_fd, buffer, sizeof(buffer))) > 0) {
-                    write(dest_fd, buffer, bytes);
-                }
-                
-                close(src_fd);
-                close(dest_fd);
-                
+            mkdir(path_copy, 0777);
+            
+            free(path_copy);
+            
+            result = RESP_SUCCESS;
+            snprintf(msg.data, sizeof(msg.data), "Folder created on storage server");
+            printf("  ✓ Directory created: %s\n", dirpath);
+            snprintf(log_msg, sizeof(log_msg), "Created folder: %s", msg.filename);
+            log_message("storage_server", log_msg);
+            break;
+        }
+        
+        case MSG_MOVE: {
+            printf("→ MOVE command: '%s' to folder '%s'\n", msg.filename, msg.folder);
+            
+            char old_path[MAX_PATH], new_path[MAX_PATH];
+            char new_name[MAX_FILENAME + MAX_PATH];  // Relative to storage_dir
+            snprintf(old_path, sizeof(old_path), "%s%s", storage_dir, msg.filename);
+            
+            if (strlen(msg.folder) == 0) {
+                snprintf(new_name, sizeof(new_name), "%s", msg.filename);
+                snprintf(new_path, sizeof(new_path), "%s%s", storage_dir, msg.filename);
+            } else {
+                char folder_path[MAX_PATH];
+                snprintf(folder_path, sizeof(folder_path), "%s%s", storage_dir, msg.folder);
+                mkdir(folder_path, 0777);
+                
+                snprintf(new_name, sizeof(new_name), "%s/%s", msg.folder, msg.filename);
+                snprintf(new_path, sizeof(new_path), "%s%s/%s", storage_dir, msg.folder, msg.filename);
+            }
+            
+            if (rename(old_path, new_path) == 0) {
                 result = RESP_SUCCESS;
-                snprintf(msg.data, sizeof(msg.data), "Checkpoint '%s' created successfully", msg.checkpoint_tag);
-                printf("  ✓ Checkpoint created: %s\n", checkpoint_path);
-                snprintf(log_msg, sizeof(log_msg), "Created checkpoint '%s' for '%s'", 
-                         msg.checkpoint_tag, msg.filename);
+                document_invalidate(msg.filename);
+                journal_remove(msg.filename);
+                // The old name is gone; backups and the NS follow the new one
+                if (strcmp(new_name, msg.filename) != 0) manifest_remove(msg.filename);
+                wait_version_pushed(manifest_bump(new_name));
+                printf("  ✓ File moved from %s to %s\n", old_path, new_path);
+                snprintf(log_msg, sizeof(log_msg), "Moved file '%s' to folder '%s'", 
+                         msg.filename, msg.folder);
                 log_message("storage_server", log_msg);
-                break;
+            } else {
+                result = ERR_SERVER_ERROR;
+                printf("  ✗ Failed to move file\n");
+                log_error("storage_server", "Failed to move file");
             }
+            
+            snprintf(msg.data, sizeof(msg.data), "File moved on storage server");
+            break;
+        }
 
-            case MSG_VIEWCHECKPOINT: {
-                printf("→ VIEWCHECKPOINT command: '%s' with tag '%s'\n", msg.filename, msg.checkpoint_tag);
-                
-                char checkpoint_path[MAX_PATH];
-                snprintf(checkpoint_path, sizeof(checkpoint_path), "%scheckpoints/%s.%s",
-                         storage_dir, msg.filename, msg.checkpoint_tag);
-                
-                int fd = open(checkpoint_path, O_RDONLY);
-                if (fd < 0) {
-                    result = ERR_CHECKPOINT_NOT_FOUND;
-                    snprintf(msg.data, sizeof(msg.data), "Error: Checkpoint not found");
-                    printf("  ✗ Checkpoint not found\n");
-                    break;
-                }
-                
-                ssize_t bytes = read(fd, msg.data, sizeof(msg.data) - 1);
-                close(fd);
-                
-                if (bytes < 0) {
-                    result = ERR_SERVER_ERROR;
-                    snprintf(msg.data, sizeof(msg.data), "Error: Failed to read checkpoint");
-                } else {
-                    msg.data[bytes] = '\0';
-                    result = RESP_SUCCESS;
-                    printf("  ✓ Checkpoint read (%zd bytes)\n", bytes);
-                }
+        case MSG_CHECKPOINT: {
+            printf("→ CHECKPOINT command: '%s' with tag '%s'\n", msg.filename, msg.checkpoint_tag);
+            
+            char checkpoints_dir[MAX_PATH];
+            snprintf(checkpoints_dir, sizeof(checkpoints_dir), "%scheckpoints/", storage_dir);
+            mkdir(checkpoints_dir, 0777);
+            
+            // Stored as content-defined chunks; only chunks not already
+            // held by an earlier checkpoint are written. Taken in the
+            // commit queue so it never reads a commit patched in half way.
+            ChunkStats stats;
+            Document *doc = document_open(msg.filename);
+            if (doc != NULL) document_commit_begin(doc);
+            result = checkpoint_create(msg.filename, msg.checkpoint_tag, &stats);
+            if (doc != NULL) {
+                document_commit_end(doc);
+                document_close(doc);
+            }
+            if (result == ERR_FILE_NOT_FOUND) {
+                snprintf(msg.data, sizeof(msg.data), "Error: Source file not found");
+                printf("  ✗ Source file not found\n");
+                break;
+            } else if (result != RESP_SUCCESS) {
+                snprintf(msg.data, sizeof(msg.data), "Error: Failed to create checkpoint file");
+                printf("  ✗ Failed to create checkpoint file\n");
                 break;
             }
+            
+            snprintf(msg.data, sizeof(msg.data), "Checkpoint '%s' created successfully", msg.checkpoint_tag);
+            printf("  ✓ Checkpoint created: %d chunk(s), %d new, %zu of %zu bytes stored\n",
+                   stats.chunks, stats.new_chunks, stats.new_bytes, stats.bytes);
+            snprintf(log_msg, sizeof(log_msg), "Created checkpoint '%s' for '%s' (%zu new bytes)", 
+                     msg.checkpoint_tag, msg.filename, stats.new_bytes);
+            log_message("storage_server", log_msg);
+            break;
+        }
 
-            case MSG_REVERT: {
-                printf("→ REVERT command: '%s' to tag '%s'\n", msg.filename, msg.checkpoint_tag);
-                
-                char file_path[MAX_PATH], checkpoint_path[MAX_PATH];
-                snprintf(file_path, sizeof(file_path), "%s%s", storage_dir, msg.filename);
-                snprintf(checkpoint_path, sizeof(checkpoint_path), "%scheckpoints/%s.%s",
-                         storage_dir, msg.filename, msg.checkpoint_tag);
-                
-                int cp_fd = open(checkpoint_path, O_RDONLY);
-                if (cp_fd < 0) {
-                    result = ERR_CHECKPOINT_NOT_FOUND;
-                    snprintf(msg.data, sizeof(msg.data), "Error: Checkpoint not found");
-                    printf("  ✗ Checkpoint not found\n");
-                    break;
-                }
-                
-                char buffer[4096];
-                ssize_t bytes = read(cp_fd, buffer, sizeof(buffer));
-                close(cp_fd);
-                
-                if (bytes < 0) {
-                    result = ERR_SERVER_ERROR;
-                    snprintf(msg.data, sizeof(msg.data), "Error: Failed to read checkpoint");
-                    break;
-                }
-                
-                int file_fd = open(file_path, O_WRONLY | O_TRUNC);
-                if (file_fd < 0) {
-                    result = ERR_FILE_NOT_FOUND;
-                    snprintf(msg.data, sizeof(msg.data), "Error: File not found");
-                    printf("  ✗ File not found\n");
-                    break;
-                }
-                
-                write(file_fd, buffer, bytes);
-                close(file_fd);
-                
-                result = RESP_SUCCESS;
-                snprintf(msg.data, sizeof(msg.data), "File reverted to checkpoint '%s'", msg.checkpoint_tag);
-                printf("  ✓ File reverted to checkpoint '%s'\n", msg.checkpoint_tag);
-                snprintf(log_msg, sizeof(log_msg), "Reverted '%s' to checkpoint '%s'", 
-                         msg.filename, msg.checkpoint_tag);
-                log_message("storage_server", log_msg);
+        case MSG_REVERT: {
+            printf("→ REVERT command: '%s' to tag '%s'\n", msg.filename, msg.checkpoint_tag);
+            
+            // A revert is an ordinary commit: ordered with WRITEs and undoable
+            Document *doc = document_open(msg.filename);
+            if (doc == NULL) {
+                result = ERR_FILE_NOT_FOUND;
+                snprintf(msg.data, sizeof(msg.data), "Error: File not found");
+                printf("  ✗ File not found\n");
                 break;
             }
-
-            case MSG_HEARTBEAT: {
-                // Respond to heartbeat immediately
-                result = RESP_SUCCESS;
-                snprintf(msg.data, sizeof(msg.data), "alive");
-                // Log heartbeat (optional - can be commented out to reduce spam)
-                // printf("[DEBUG] Heartbeat response sent\n");
+            document_commit_begin(doc);
+            result = checkpoint_restore(msg.filename, msg.checkpoint_tag);
+            document_commit_end(doc);
+            document_close(doc);
+            
+            if (result == ERR_CHECKPOINT_NOT_FOUND) {
+                snprintf(msg.data, sizeof(msg.data), "Error: Checkpoint not found");
+                printf("  ✗ Checkpoint not found\n");
+                break;
+            } else if (result == ERR_FILE_NOT_FOUND) {
+                snprintf(msg.data, sizeof(msg.data), "Error: File not found");
+                printf("  ✗ File not found\n");
+                break;
+            } else if (result != RESP_SUCCESS) {
+                snprintf(msg.data, sizeof(msg.data), "Error: Failed to write file");
+                printf("  ✗ Failed to write file\n");
                 break;
             }
+            document_invalidate(msg.filename);
+            wait_version_pushed(manifest_bump(msg.filename));
+            
+            snprintf(msg.data, sizeof(msg.data), "File reverted to checkpoint '%s'", msg.checkpoint_tag);
+            printf("  ✓ File reverted to checkpoint '%s'\n", msg.checkpoint_tag);
+            snprintf(log_msg, sizeof(log_msg), "Reverted '%s' to checkpoint '%s'", 
+                     msg.filename, msg.checkpoint_tag);
+            log_message("storage_server", log_msg);
+            break;
+        }
 
-            case MSG_SHUTDOWN: {
-                printf("→ SHUTDOWN command received from naming server\n");
-                result = RESP_SUCCESS;
-                snprintf(msg.data, sizeof(msg.data), "Shutting down");
-                send_message(nm_socket, &msg);
-                printf("✓ Storage server %s shutting down\n", ss_id);
-                exit(0);
+        case MSG_SYNC_REQUEST: {
+            // NS asks for everything changed since a generation it already has
+            unsigned long since = 0, epoch = 0;
+            sscanf(msg.data, "%lu %lu", &since, &epoch);
+            if (epoch != manifest_epoch() || since > manifest_high_water()) {
+                since = 0;  // Different manifest - full resync
             }
+            printf("→ SYNC request from NS (since generation %lu)\n", since);
+            manifest_send_delta(nm_socket, since);
+            return;  // Delta batches are the response
+        }
 
-            case MSG_REPLICATE: {
-                printf("→ REPLICATE command: replicating data\n");
-                result = RESP_SUCCESS;
-                snprintf(msg.data, sizeof(msg.data), "Replication received");
+        case MSG_HEARTBEAT: {
+            // Respond to heartbeat immediately, piggybacking the load report
+            result = RESP_SUCCESS;
+            struct SSLoadReport report;
+            load_fill_report(&report);
+            int len = snprintf(msg.data, sizeof(msg.data), "alive ");
+            format_load_report(&report, msg.data + len, sizeof(msg.data) - len);
+            // Log heartbeat (optional - can be commented out to reduce spam)
+            // printf("[DEBUG] Heartbeat response sent\n");
+            break;
+        }
+
+        case MSG_SHUTDOWN: {
+            printf("→ SHUTDOWN command received from naming server\n");
+            result = RESP_SUCCESS;
+            snprintf(msg.data, sizeof(msg.data), "Shutting down");
+            send_message(nm_socket, &msg);
+            printf("✓ Storage server %s shutting down\n", ss_id);
+            exit(0);
+        }
+
+        case MSG_REPLICATE: {
+            printf("→ REPLICATE command: replicating data\n");
+            result = RESP_SUCCESS;
+            snprintf(msg.data, sizeof(msg.data), "Replication received");
+            break;
+        }
+
+        case MSG_INFO: {
+            printf("→ INFO request for '%s' from naming server\n", msg.filename);
+            
+            char *text = NULL;
+            size_t text_length = 0;
+            int status = document_read(msg.filename, &text, &text_length);
+            if (status == ERR_FILE_NOT_FOUND) {
+                result = ERR_FILE_NOT_FOUND;
+                snprintf(msg.data, sizeof(msg.data), "File not found");
+                printf("  ✗ File not found\n");
                 break;
             }
-
-            case MSG_INFO: {
-                printf("→ INFO request for '%s' from naming server\n", msg.filename);
-                
-                char filepath[MAX_PATH];
-                snprintf(filepath, sizeof(filepath), "%s%s", storage_dir, msg.filename);
-                
-                if (!file_exists(filepath)) {
-                    result = ERR_FILE_NOT_FOUND;
-                    snprintf(msg.data, sizeof(msg.data), "File not found");
-                    printf("  ✗ File not found\n");
-                    break;
-                }
-                
-                FILE *fp = fopen(filepath, "r");
-                if (!fp) {
-                    result = ERR_SERVER_ERROR;
-                    snprintf(msg.data, sizeof(msg.data), "Failed to open file");
-                    printf("  ✗ Failed to open file\n");
-                    break;
-                }
-                
-                long size = 0;
-                int word_count = 0;
-                int char_count = 0;
-                int in_word = 0;
-                int c;
-                
-                while ((c = fgetc(fp)) != EOF) {
-                    size++;
-                    
-                    if (c != '\n' && c != '\r') {
-                        char_count++;
-                    }
-                    
-                    if (isspace(c)) {
-                        in_word = 0;
-                    } else {
-                        if (!in_word) {
-                            word_count++;
-                            in_word = 1;
-                        }
-                    }
-                }
-                fclose(fp);
-                
-                result = RESP_SUCCESS;
-                snprintf(msg.data, sizeof(msg.data), "%ld:%d:%d", size, word_count, char_count);
-                printf("  ✓ File stats: %ld bytes, %d words, %d chars\n", size, word_count, char_count);
-                
-                snprintf(log_msg, sizeof(log_msg), "INFO completed for '%s' - %ld bytes, %d words, %d chars", 
-                         msg.filename, size, word_count, char_count);
-                log_message("storage_server", log_msg);
+            if (status != RESP_SUCCESS) {
+                result = ERR_SERVER_ERROR;
+                snprintf(msg.data, sizeof(msg.data), "Failed to open file");
+                printf("  ✗ Failed to open file\n");
                 break;
             }
-                
-            default:
-                result = ERR_INVALID_REQUEST;
-                snprintf(msg.data, sizeof(msg.data), "Invalid command");
-                printf("→ Invalid command type: %d\n", msg.type);
+            
+            TextCounts counts;
+            text_count_buffer(text, text_length, &counts);
+            free(text);
+            long size = (long)counts.bytes;
+            int word_count = (int)counts.words;
+            int char_count = (int)counts.chars;
+            
+            result = RESP_SUCCESS;
+            snprintf(msg.data, sizeof(msg.data), "%ld:%d:%d", size, word_count, char_count);
+            printf("  ✓ File stats: %ld bytes, %d words, %d chars, %llu sentences\n",
+                   size, word_count, char_count, counts.sentences);
+            
+            snprintf(log_msg, sizeof(log_msg), "INFO completed for '%s' - %ld bytes, %d words, %d chars (%s count)", 
+                     msg.filename, size, word_count, char_count, text_count_kernel());
+            log_message("storage_server", log_msg);
+            break;
         }
-        
-        msg.error_code = result;
-        send_message(nm_socket, &msg);
+            
+        case MSG_TREE_NODES:
+            handle_tree_nodes(nm_socket, &msg);
+            return;
+
+        case MSG_TREE_BUCKET:
+            handle_tree_bucket(nm_socket, &msg);
+            return;
+
+        case MSG_FETCH_BACKUP:
+            handle_fetch_backup(nm_socket, &msg);
+            return;
+
+        default:
+            result = ERR_INVALID_REQUEST;
+            snprintf(msg.data, sizeof(msg.data), "Invalid command");
+            printf("→ Invalid command type: %d\n", msg.type);
     }
     
-    close(nm_socket);
-    return NULL;
+    
+    msg.error_code = result;
+    send_message(nm_socket, &msg);
 }
 
-// Handle client connection (this function is quite large - contains READ, WRITE, STREAM, UNDO logic)
-void* handle_client(void *arg) {
-    int client_socket = *(int*)arg;
-    free(arg);
-    
-    struct Message msg;
-    
-    while (1) {
-        if (recv_message(client_socket, &msg) <= 0) {
-            break;
+// Handle NS commands, one per event. Checkpoints, reverts and moves wait
+// for fsyncs, commit turns and the version push; sync requests, hash tree
+// reads and backup fetches read or stream whole files. Those run on the
+// blocking pool.
+static void ns_event(Connection *conn, int event) {
+    if (event == CONN_EVENT_OPEN) {
+        printf("✓ NS connection handler started\n");
+        conn->want_input = 1;
+        return;
+    }
+    if (event == CONN_EVENT_CLOSE) {
+        printf("✗ Lost connection to Naming Server\n");
+        return;
+    }
+    if (event != CONN_EVENT_MESSAGE) return;
+
+    int type = conn->request.type;
+    if (type == MSG_CHECKPOINT || type == MSG_REVERT || type == MSG_MOVE || type == MSG_SYNC_REQUEST ||
+        type == MSG_TREE_NODES || type == MSG_TREE_BUCKET || type == MSG_FETCH_BACKUP) {
+        conn->offload = ns_request;
+        return;
+    }
+    ns_request(conn, event);
+}
+
+// Text sent to a client as a run of RESP_DATA frames, each filled up to
+// the message payload size
+typedef struct {
+    int socket;
+    struct Message frame;
+    size_t used;
+} DataFrames;
+
+static int send_data_frame(DataFrames *out) {
+    if (out->used == 0) return 0;
+    out->frame.error_code = RESP_DATA;
+    out->frame.data[out->used] = '\0';
+    out->used = 0;
+    return send_message(out->socket, &out->frame) < 0 ? -1 : 0;
+}
+
+static int frame_sink(void *context, const char *data, size_t length) {
+    DataFrames *out = context;
+    while (length > 0) {
+        size_t room = sizeof(out->frame.data) - 1 - out->used;
+        size_t take = length < room ? length : room;
+        memcpy(out->frame.data + out->used, data, take);
+        out->used += take;
+        data += take;
+        length -= take;
+        if (out->used == sizeof(out->frame.data) - 1 && send_data_frame(out) != 0) return -1;
+    }
+    return 0;
+}
+
+// A client connection's state between events. Requests are handled one per
+// event; a WRITE session, a WRITE -w waiting in line and a STREAM span many
+// events and keep what they need here instead of holding a thread.
+#define CLIENT_IDLE 0
+#define CLIENT_LOCK_WAIT 1       // WRITE -w queued for a locked sentence
+#define CLIENT_WRITING 2         // WRITE session open, one edit per message
+#define CLIENT_STREAMING 3
+
+typedef struct {
+    int mode;
+    struct Message request;      // The WRITE or STREAM in progress
+    Document *doc;
+
+    // WRITE session
+    unsigned long lock_id;
+    char *opened_sentence;       // Detects another commit swallowing the sentence
+    char **words;
+    int word_count;
+    LockWaiter *waiter;          // While queued
+    int position;                // Queue position last reported
+    long long deadline_us;
+    char holder[MAX_USERNAME];
+
+    // STREAM
+    WordStream stream;
+    long long stream_started_us;
+    int stream_blocked;          // A frame is due but the socket has no room
+} ClientSession;
+
+// End a WRITE session or wait. A session that ends without ETIRW (client
+// dropped) releases its lock.
+static void release_write_session(ClientSession *session) {
+    const char *filename = session->request.filename;
+    if (session->waiter) {
+        cancel_sentence_wait(filename, session->waiter);
+        session->waiter = NULL;
+    }
+    if (session->words) {
+        for (int i = 0; i < session->word_count; i++) {
+            free(session->words[i]);
         }
-        
-        char log_msg[512];
-        snprintf(log_msg, sizeof(log_msg), "Client request: type=%d, file=%s", 
-                 msg.type, msg.filename);
-        log_message("storage_server", log_msg);
-        
-        switch (msg.type) {
-            case MSG_READ: {
+        free(session->words);
+        session->words = NULL;
+    }
+    session->word_count = 0;
+    free(session->opened_sentence);
+    session->opened_sentence = NULL;
+    if (session->lock_id) {
+        remove_sentence_lock(filename, session->lock_id);
+        session->lock_id = 0;
+    }
+    if (session->doc) {
+        document_close(session->doc);
+        session->doc = NULL;
+    }
+    session->mode = CLIENT_IDLE;
+}
+
+// The sentence lock is held: send the sentence and take edits
+static void open_write_session(Connection *conn, ClientSession *session, int waited) {
+    struct Message *request = &session->request;
+    if (waited) {
+        // Other commits may have moved or changed the sentence meanwhile
+        Document *doc = session->doc;
+        int sentence_count = 0;
+        pthread_mutex_lock(&doc->lock);
+        request->sentence_num = sentence_lock_position(request->filename, session->lock_id);
+        session->opened_sentence = document_refresh(doc) >= 0 ?
+                                   document_peek(doc, request->sentence_num, &sentence_count) : NULL;
+        pthread_mutex_unlock(&doc->lock);
+        if (session->opened_sentence == NULL) {
+            struct Message reply = *request;
+            reply.error_code = ERR_FILE_NOT_FOUND;
+            snprintf(reply.data, sizeof(reply.data), "File not found");
+            send_message(conn->fd, &reply);
+            printf("  ✗ File removed while waiting\n");
+            release_write_session(session);
+            conn->want_input = 1;
+            return;
+        }
+    }
+
+    printf("  ✓ Sentence locked for %s\n", request->username);
+
+    // Send current sentence
+    struct Message reply = *request;
+    reply.error_code = RESP_SUCCESS;
+    snprintf(reply.data, sizeof(reply.data), "%s", session->opened_sentence);
+    send_message(conn->fd, &reply);
+
+    // Parse sentence into words using module function
+    session->word_count = 0;
+    session->words = parse_words(session->opened_sentence, &session->word_count);
+    if (session->word_count == 0 || session->words == NULL) {
+        printf("  → Sentence is empty, no words yet\n");
+        session->word_count = 0;
+        session->words = NULL;
+    }
+    printf("  → Sentence has %d word(s)\n", session->word_count);
+
+    session->mode = CLIENT_WRITING;
+    conn->want_input = 1;
+}
+
+static void wake_connection(void *context) {
+    event_loop_wake(context);
+}
+
+// WRITE -w: check the queue, telling the client its place in line as it
+// moves up. The lock manager wakes the connection when the line changes.
+static void lock_wait_step(Connection *conn, ClientSession *session) {
+    struct Message *request = &session->request;
+    int position = session->position;
+    unsigned long lock_id = await_sentence_lock(request->filename, session->waiter, 0, &position);
+    if (lock_id != 0) {
+        session->waiter = NULL;  // Freed once granted
+        session->lock_id = lock_id;
+        open_write_session(conn, session, 1);
+        return;
+    }
+
+    if (position != session->position) {
+        struct Message update;
+        memset(&update, 0, sizeof(update));
+        update.type = MSG_WRITE;
+        update.error_code = RESP_QUEUED;
+        update.word_index = position;
+        strncpy(update.filename, request->filename, sizeof(update.filename) - 1);
+        snprintf(update.data, sizeof(update.data), "%s", session->holder);
+        if (send_message(conn->fd, &update) < 0) {
+            conn->closing = 1;
+            return;
+        }
+        printf("  → %s queued at position %d\n", request->username, position);
+        session->position = position;
+    }
+
+    long long now = load_now_us();
+    if (now >= session->deadline_us) {
+        struct Message reply = *request;
+        reply.error_code = ERR_FILE_LOCKED;
+        snprintf(reply.data, sizeof(reply.data), "%s", session->holder);
+        send_message(conn->fd, &reply);
+        printf("  ✗ Sentence locked by %s\n", session->holder);
+        release_write_session(session);
+        conn->want_input = 1;
+        return;
+    }
+
+    // Look again at least once a second to notice expired leases
+    conn->wake_us = session->deadline_us < now + 1000000 ? session->deadline_us : now + 1000000;
+    conn->want_input = 0;
+}
+
+static void client_offloaded(Connection *conn, int event);
+
+// One message of an open WRITE session: a word edit, a batch or ETIRW
+static void write_edit(Connection *conn, ClientSession *session, struct Message *update_msg) {
+    int client_socket = conn->fd;
+    struct Message *msg = &session->request;
+    unsigned long lock_id = session->lock_id;
+
+    // An idle session past its lease has lost the sentence to the next
+    // writer; nothing it sends from now on can be committed
+    if (!renew_sentence_lock(msg->filename, lock_id)) {
+        session->lock_id = 0;
+        update_msg->error_code = ERR_FILE_LOCKED;
+        snprintf(update_msg->data, sizeof(update_msg->data),
+                 "Lock on sentence %d expired - edit session closed", msg->sentence_num);
+        send_message(client_socket, update_msg);
+        printf("  ✗ Lock lease expired for %s\n", msg->username);
+        release_write_session(session);
+        return;
+    }
+
+    int commit = strcmp(update_msg->data, "ETIRW") == 0;
+    if (update_msg->flags & WRITE_FLAG_BATCH) {
+        // A whole list of edits in one round trip, applied all or nothing
+        char error[256];
+        int result = apply_word_edits(&session->words, &session->word_count, update_msg->data,
+                                      error, sizeof(error));
+        if (result != RESP_SUCCESS) {
+            update_msg->error_code = result;
+            update_msg->word_index = session->word_count;
+            snprintf(update_msg->data, sizeof(update_msg->data), "%s", error);
+            send_message(client_socket, update_msg);
+            printf("  ✗ Edit batch rejected: %s\n", error);
+            return;
+        }
+        printf("  → Applied edit batch (%d word(s) now)\n", session->word_count);
+        if (!(update_msg->flags & WRITE_FLAG_COMMIT)) {
+            char *sentence = rebuild_sentence(session->words, session->word_count);
+            update_msg->error_code = RESP_SUCCESS;
+            update_msg->word_index = session->word_count;
+            snprintf(update_msg->data, sizeof(update_msg->data), "%s", sentence);
+            free(sentence);
+            send_message(client_socket, update_msg);
+            return;
+        }
+        commit = 1;
+    }
+
+    if (commit) {
+        // Waits for the file's commit turn, the flush and the NS push
+        conn->offload = client_offloaded;
+        return;
+    }
+
+    // Handle word insert/replace/delete
+    int word_idx = update_msg->word_index;
+    int word_count = session->word_count;
+    char **words = session->words;
+
+    if (word_idx < 0 || word_idx > word_count) {
+        update_msg->error_code = ERR_WORD_OUT_OF_RANGE;
+        update_msg->word_index = word_count;
+        snprintf(update_msg->data, sizeof(update_msg->data),
+                 "Invalid word index. Can insert at 0 to %d", word_count);
+        send_message(client_socket, update_msg);
+        return;
+    }
+
+    if (strlen(update_msg->data) == 0) {
+        // Delete word
+        if (word_idx < word_count) {
+            free(words[word_idx]);
+            for (int i = word_idx; i < word_count - 1; i++) {
+                words[i] = words[i + 1];
+            }
+            word_count--;
+            words = realloc(words, sizeof(char*) * word_count);
+            printf("  → Deleted word at index %d\n", word_idx);
+        }
+    } else {
+        // ALWAYS INSERT (not replace)
+        // Insert at word_idx means: shift everything from word_idx onwards to the right
+        word_count++;
+        words = realloc(words, sizeof(char*) * word_count);
+
+        // Shift words to make space
+        for (int i = word_count - 1; i > word_idx; i--) {
+            words[i] = words[i - 1];
+        }
+
+        // Insert new word
+        words[word_idx] = strdup(update_msg->data);
+        printf("  → Inserted word '%s' at index %d\n", update_msg->data, word_idx);
+    }
+    session->words = words;
+    session->word_count = word_count;
+
+    update_msg->error_code = RESP_SUCCESS;
+    update_msg->word_index = word_count;
+    send_message(client_socket, update_msg);
+}
+
+// ETIRW, or a batch with WRITE_FLAG_COMMIT, once its edits are applied
+static void write_commit(Connection *conn, ClientSession *session, struct Message *update_msg) {
+    int client_socket = conn->fd;
+    struct Message *msg = &session->request;
+    Document *doc = session->doc;
+    unsigned long lock_id = session->lock_id;
+    char log_msg[512];
+
+    printf("  ✓ ETIRW received - finalizing changes\n");
+    long long commit_started = load_now_us();
+
+    // Rebuild sentence using module function
+    char *new_sentence = rebuild_sentence(session->words, session->word_count);
+
+    // Commits on a file are applied one at a time against the
+    // current text; other writers' commits may have moved our
+    // sentence since the session opened
+    document_commit_begin(doc);
+    document_refresh(doc);
+    int loaded = document_load(doc) == 0;
+    int index = sentence_lock_position(msg->filename, lock_id);
+    int intact = 0;
+    if (loaded && index >= 0) {
+        char *now = document_sentence(doc, index);
+        intact = strcmp(now, session->opened_sentence) == 0;
+        free(now);
+    }
+
+    // Splice the sentence in place and write back the changed
+    // tail; the flush journals the replaced bytes for UNDO
+    int first = index, last = index;
+    int old_count = doc->sentence_count;
+    int spliced = intact ? document_replace_sentence(doc, index, new_sentence, &first, &last) : -1;
+    int flushed = spliced >= 0 ? document_flush(doc) : -1;
+    if (flushed == 0) {
+        remap_sentence_locks(msg->filename, first, last,
+                             spliced - old_count + (last - first + 1), lock_id);
+    }
+    remove_sentence_lock(msg->filename, lock_id);
+    session->lock_id = 0;
+    document_commit_end(doc);
+    free(new_sentence);
+
+    if (spliced >= 0 && flushed != 0) {
+        // The disk still holds the old text; drop the cached edit with it
+        document_invalidate(msg->filename);
+        update_msg->error_code = ERR_SERVER_ERROR;
+        strcpy(update_msg->data, "Failed to save changes");
+        send_message(client_socket, update_msg);
+        printf("  ✗ Failed to save changes\n");
+        release_write_session(session);
+        return;
+    }
+
+    if (spliced < 0) {
+        update_msg->error_code = ERR_SENTENCE_OUT_OF_RANGE;
+        snprintf(update_msg->data, sizeof(update_msg->data),
+                 "File changed during edit - sentence %d was changed by another writer or its lock expired", msg->sentence_num);
+        send_message(client_socket, update_msg);
+        printf("  ✗ Sentence changed during edit\n");
+        release_write_session(session);
+        return;
+    }
+
+    // Make sure the NS has dropped stale cached copies before we ack
+    wait_version_pushed(manifest_bump(msg->filename));
+
+    update_msg->error_code = RESP_SUCCESS;
+    strcpy(update_msg->data, "Changes saved");
+    send_message(client_socket, update_msg);
+    load_record_latency(LOAD_OP_WRITE, load_now_us() - commit_started);
+
+    printf("  ✓ Changes saved and lock released\n");
+    snprintf(log_msg, sizeof(log_msg), "WRITE completed for '%s' sentence %d by %s",
+             msg->filename, index, msg->username);
+    log_message("storage_server", log_msg);
+    release_write_session(session);
+}
+
+// STREAM: send whatever is due when the socket has room, and otherwise
+// sleep in the event loop until the next word is due. A client that leaves
+// a due frame unread for the stall timeout is dropped.
+static void stream_step(Connection *conn, ClientSession *session, int event) {
+    WordStream *stream = &session->stream;
+    struct Message *request = &session->request;
+    long long now = load_now_us();
+
+    if (event == CONN_EVENT_TIMER && session->stream_blocked) {
+        printf("  ⚠ Client stopped reading; stream dropped\n");
+        shutdown(conn->fd, SHUT_RDWR);
+        conn->closing = 1;
+        return;
+    }
+    if (event == CONN_EVENT_WRITABLE) {
+        struct Message frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.type = MSG_STREAM;
+        strncpy(frame.filename, request->filename, sizeof(frame.filename) - 1);
+        if (word_stream_frame(stream, &frame, now) > 0 && send_message(conn->fd, &frame) < 0) {
+            conn->closing = 1;
+            return;
+        }
+    }
+
+    long long due = word_stream_due_us(stream);
+    if (due >= 0) {
+        session->stream_blocked = due <= now;
+        conn->want_writable = session->stream_blocked;
+        conn->wake_us = session->stream_blocked ? now + word_stream_stall_ms() * 1000LL : due;
+        return;
+    }
+
+    struct Message reply = *request;
+    reply.error_code = RESP_SUCCESS;
+    snprintf(reply.data, sizeof(reply.data), "STREAM_END %ld %ld %d",
+             stream->words_sent, stream->frames_sent, stream->rate);
+    send_message(conn->fd, &reply);
+    printf("  ✓ Stream completed (%ld words in %ld frames)\n", stream->words_sent, stream->frames_sent);
+    char log_msg[512];
+    snprintf(log_msg, sizeof(log_msg), "STREAM completed for '%s' - %ld words, %ld frames",
+             request->filename, stream->words_sent, stream->frames_sent);
+    log_message("storage_server", log_msg);
+    load_record_latency(LOAD_OP_STREAM, load_now_us() - session->stream_started_us);
+
+    word_stream_close(stream);
+    session->mode = CLIENT_IDLE;
+    conn->want_writable = 0;
+    conn->want_input = 1;
+}
+
+// A request from an idle client connection
+static void client_request(Connection *conn, ClientSession *session, struct Message *request) {
+    int client_socket = conn->fd;
+    struct Message msg = *request;
+
+    char log_msg[512];
+    snprintf(log_msg, sizeof(log_msg), "Client request: type=%d, file=%s",
+             msg.type, msg.filename);
+    log_message("storage_server", log_msg);
+
+    switch (msg.type) {
+
+        case MSG_READ: {
+            char *text = NULL;
+            size_t offset = 0, length = SIZE_MAX, size = 0;
+            int first = msg.sentence_num, last = msg.word_index, count = 0;
+            int result;
+            if (msg.flags & READ_FLAG_SENTENCES) {
+                printf("→ READ request for '%s' (sentences %d..%d)\n", msg.filename, first, last);
+                result = document_read_sentences(msg.filename, &first, &last, &count,
+                                                 &offset, &length, &text, &size);
+            } else if (msg.flags & READ_FLAG_RANGE) {
+                sscanf(msg.data, "%zu %zu", &offset, &length);
+                printf("→ READ request for '%s' (bytes from %zu)\n", msg.filename, offset);
+                result = document_read_range(msg.filename, &offset, &length, &text, &size);
+            } else {
                 printf("→ READ request for '%s'\n", msg.filename);
-                
-                char buffer[MAX_DATA];
-                int result = read_file(msg.filename, buffer, sizeof(buffer));
-                
-                if (result == RESP_SUCCESS) {
-                    msg.error_code = RESP_SUCCESS;
-                    strncpy(msg.data, buffer, sizeof(msg.data) - 1);
-                    msg.data[sizeof(msg.data) - 1] = '\0';
-                    printf("  ✓ File read successfully (%ld bytes)\n", strlen(buffer));
-                    snprintf(log_msg, sizeof(log_msg), "READ completed for '%s' - %ld bytes", 
-                             msg.filename, strlen(buffer));
-                    log_message("storage_server", log_msg);
+                result = document_read(msg.filename, &text, &length);
+                size = length;
+            }
+            
+            if (result != RESP_SUCCESS) {
+                msg.error_code = result;
+                if (result == ERR_FILE_NOT_FOUND) {
+                    snprintf(msg.data, sizeof(msg.data), "File not found");
+                    printf("  ✗ File not found\n");
                 } else {
-                    msg.error_code = result;
-                    if (result == ERR_FILE_NOT_FOUND) {
-                        snprintf(msg.data, sizeof(msg.data), "File not found");
-                        printf("  ✗ File not found\n");
-                    } else {
-                        snprintf(msg.data, sizeof(msg.data), "Failed to read file");
-                        printf("  ✗ Failed to read file\n");
-                    }
+                    snprintf(msg.data, sizeof(msg.data), "Failed to read file");
+                    printf("  ✗ Failed to read file\n");
                 }
-                
                 send_message(client_socket, &msg);
                 break;
             }
             
-            case MSG_STREAM: {
+            DataFrames out;
+            memset(&out, 0, sizeof(out));
+            out.socket = client_socket;
+            out.frame = msg;
+            int sent = frame_sink(&out, text, length) == 0 && send_data_frame(&out) == 0;
+            free(text);
+            if (!sent) break;
+            
+            // Closing frame: "<offset> <length> <size>" [" <first> <last> <count>"]
+            msg.error_code = RESP_SUCCESS;
+            if (msg.flags & READ_FLAG_SENTENCES) {
+                snprintf(msg.data, sizeof(msg.data), "%zu %zu %zu %d %d %d",
+                         offset, length, size, first, last, count);
+            } else {
+                snprintf(msg.data, sizeof(msg.data), "%zu %zu %zu", offset, length, size);
+            }
+            send_message(client_socket, &msg);
+            printf("  ✓ File read successfully (%zu of %zu bytes)\n", length, size);
+            snprintf(log_msg, sizeof(log_msg), "READ completed for '%s' - %zu bytes at %zu",
+                     msg.filename, length, offset);
+            log_message("storage_server", log_msg);
+            break;
+        }
+        
+        case MSG_VIEWCHECKPOINT: {
+            // Optional byte range in data: "<offset> <length>"
+            size_t offset = 0, length = SIZE_MAX;
+            sscanf(msg.data, "%zu %zu", &offset, &length);
+            printf("→ VIEWCHECKPOINT request for '%s' tag '%s'\n", msg.filename, msg.checkpoint_tag);
+            
+            size_t size = 0;
+            int result = checkpoint_size(msg.filename, msg.checkpoint_tag, &size);
+            if (result != RESP_SUCCESS) {
+                msg.error_code = result;
+                snprintf(msg.data, sizeof(msg.data), result == ERR_CHECKPOINT_NOT_FOUND ?
+                         "Checkpoint not found" : "Failed to read checkpoint");
+                send_message(client_socket, &msg);
+                printf("  ✗ %s\n", msg.data);
+                break;
+            }
+            if (offset > size) offset = size;
+            if (length > size - offset) length = size - offset;
+            
+            DataFrames out;
+            memset(&out, 0, sizeof(out));
+            out.socket = client_socket;
+            out.frame = msg;
+            result = checkpoint_read(msg.filename, msg.checkpoint_tag, offset, length, frame_sink, &out);
+            if (result == RESP_SUCCESS && send_data_frame(&out) != 0) result = ERR_SERVER_ERROR;
+            
+            // Closing frame: "<offset> <length> <checkpoint size>"
+            msg.error_code = result;
+            if (result == RESP_SUCCESS) {
+                snprintf(msg.data, sizeof(msg.data), "%zu %zu %zu", offset, length, size);
+            } else {
+                snprintf(msg.data, sizeof(msg.data), "Failed to read checkpoint");
+            }
+            send_message(client_socket, &msg);
+            printf("  %s Checkpoint sent (%zu of %zu bytes)\n",
+                   result == RESP_SUCCESS ? "✓" : "✗", length, size);
+            break;
+        }
+        
+        case MSG_DIFF: {
+            // Old version in checkpoint_tag, new one in data (a tag or "live")
+            if (strnlen(msg.data, sizeof(msg.data)) >= MAX_FILENAME) {
+                msg.error_code = ERR_INVALID_REQUEST;
+                snprintf(msg.data, sizeof(msg.data), "Error: Checkpoint tag too long");
+                send_message(client_socket, &msg);
+                printf("  ✗ DIFF rejected: checkpoint tag too long\n");
+                break;
+            }
+            char new_tag[MAX_FILENAME];
+            snprintf(new_tag, sizeof(new_tag), "%.*s", MAX_FILENAME - 1, msg.data[0] ? msg.data : "live");
+            printf("→ DIFF request for '%s': '%s' vs '%s'\n", msg.filename, msg.checkpoint_tag, new_tag);
+            
+            char *old_text = NULL, *new_text = NULL;
+            size_t old_length = 0, new_length = 0;
+            int result = checkpoint_load(msg.filename, msg.checkpoint_tag, &old_text, &old_length);
+            if (result == RESP_SUCCESS) {
+                result = strcmp(new_tag, "live") == 0 ?
+                         document_read(msg.filename, &new_text, &new_length) :
+                         checkpoint_load(msg.filename, new_tag, &new_text, &new_length);
+            }
+            if (result != RESP_SUCCESS) {
+                free(old_text);
+                msg.error_code = result;
+                snprintf(msg.data, sizeof(msg.data), result == ERR_CHECKPOINT_NOT_FOUND ?
+                         "Checkpoint not found" : result == ERR_FILE_NOT_FOUND ?
+                         "File not found" : "Failed to read versions");
+                send_message(client_socket, &msg);
+                printf("  ✗ %s\n", msg.data);
+                break;
+            }
+            
+            DiffStats stats;
+            size_t script_length;
+            char *script = diff_texts(old_text, new_text, &script_length, &stats);
+            free(old_text);
+            free(new_text);
+            
+            DataFrames out;
+            memset(&out, 0, sizeof(out));
+            out.socket = client_socket;
+            out.frame = msg;
+            if (frame_sink(&out, script, script_length) != 0 || send_data_frame(&out) != 0) {
+                free(script);
+                break;
+            }
+            free(script);
+            
+            // Closing frame: "<hunks> <added> <removed> <changed>"
+            msg.error_code = RESP_SUCCESS;
+            snprintf(msg.data, sizeof(msg.data), "%d %d %d %d",
+                     stats.hunks, stats.added, stats.removed, stats.changed);
+            send_message(client_socket, &msg);
+            printf("  ✓ Diff sent: %d hunk(s), %zu bytes\n", stats.hunks, script_length);
+            break;
+        }
+        
+        case MSG_STREAM: {
+            WordStream *stream = &session->stream;
+            int result = word_stream_open(stream, msg.filename, msg.word_index);
+            if (result != RESP_SUCCESS) {
                 printf("→ STREAM request for '%s'\n", msg.filename);
-                
-                char filepath[MAX_PATH];
-                snprintf(filepath, sizeof(filepath), "%s%s", storage_dir, msg.filename);
-                
-                char buffer[MAX_DATA];
-                int result = read_file(msg.filename, buffer, sizeof(buffer));
-                
-                if (result != RESP_SUCCESS) {
-                    msg.error_code = result;
-                    snprintf(msg.data, sizeof(msg.data), "Failed to read file");
-                    send_message(client_socket, &msg);
-                    break;
-                }
-                
-                int word_count = 0;
-                char **words = parse_words(buffer, &word_count);
-                
-                for (int i = 0; i < word_count; i++) {
-                    msg.error_code = RESP_DATA;
-                    strncpy(msg.data, words[i], sizeof(msg.data) - 1);
-                    send_message(client_socket, &msg);
-                    free(words[i]);
-                    usleep(100000); // 0.1s delay
-                }
-                
-                if (words) free(words);
-                
-                msg.error_code = RESP_SUCCESS;
-                strcpy(msg.data, "STREAM_END");
+                msg.error_code = result;
+                snprintf(msg.data, sizeof(msg.data), "Failed to read file");
                 send_message(client_socket, &msg);
-                printf("  ✓ Stream completed (%d words)\n", word_count);
-                snprintf(log_msg, sizeof(log_msg), "STREAM completed for '%s' - %d words", 
-                         msg.filename, word_count);
-                log_message("storage_server", log_msg);
                 break;
             }
+            if (stream->rate > 0) {
+                printf("→ STREAM request for '%s' (%zu bytes, %d words/s)\n",
+                       msg.filename, stream->length, stream->rate);
+            } else {
+                printf("→ STREAM request for '%s' (%zu bytes, unthrottled)\n",
+                       msg.filename, stream->length);
+            }
             
-            case MSG_UNDO: {
-                printf("→ UNDO request for '%s' by %s\n", msg.filename, msg.username);
-                
-                UndoState *undo = get_undo_state(msg.filename);
-                
-                if (undo && undo->undo_performed) {
-                    msg.error_code = ERR_INVALID_REQUEST;
-                    snprintf(msg.data, sizeof(msg.data), "Cannot undo twice consecutively");
-                    send_message(client_socket, &msg);
-                    printf("  ✗ Cannot undo twice consecutively\n");
-                    break;
-                }
-                
-                char filepath[MAX_PATH], backup_path[MAX_PATH];
-                snprintf(filepath, sizeof(filepath), "%s%s", storage_dir, msg.filename);
-                snprintf(backup_path, sizeof(backup_path), "%s%s.backup", backup_dir, msg.filename);
-                
-                if (!file_exists(backup_path)) {
-                    msg.error_code = ERR_FILE_NOT_FOUND;
-                    snprintf(msg.data, sizeof(msg.data), "No backup available to undo");
-                    send_message(client_socket, &msg);
-                    printf("  ✗ No backup available\n");
-                    break;
-                }
-                
-                // Copy backup back to original
-                FILE *src = fopen(backup_path, "r");
-                FILE *dest = fopen(filepath, "w");
-                
-                if (!src || !dest) {
-                    if (src) fclose(src);
-                    if (dest) fclose(dest);
-                    msg.error_code = ERR_SERVER_ERROR;
-                    snprintf(msg.data, sizeof(msg.data), "Failed to restore backup");
-                    send_message(client_socket, &msg);
-                    break;
-                }
-                
-                char buffer[4096];
-                size_t bytes;
-                while ((bytes = fread(buffer, 1, sizeof(buffer), src)) > 0) {
-                    fwrite(buffer, 1, bytes, dest);
-                }
-                
-                fclose(src);
-                fclose(dest);
-                
-                set_undo_state(msg.filename, 1);
-                
-                msg.error_code = RESP_SUCCESS;
-                snprintf(msg.data, sizeof(msg.data), "Undo successful");
+            // Frames go out from stream_step as they fall due; a pipelined
+            // request waits for the stream to end
+            session->mode = CLIENT_STREAMING;
+            session->request = msg;
+            session->stream_started_us = conn->request_us;
+            session->stream_blocked = 0;
+            conn->want_input = 0;
+            stream_step(conn, session, CONN_EVENT_MESSAGE);
+            break;
+        }
+        
+        case MSG_UNDO: {
+            // word_index carries how many edits to step back (default one)
+            int steps = msg.word_index > 0 ? msg.word_index : 1;
+            printf("→ UNDO request for '%s' by %s (%d step%s)\n",
+                   msg.filename, msg.username, steps, steps == 1 ? "" : "s");
+            
+            Document *doc = document_open(msg.filename);
+            if (doc == NULL) {
+                msg.error_code = ERR_FILE_NOT_FOUND;
+                snprintf(msg.data, sizeof(msg.data), "File not found");
                 send_message(client_socket, &msg);
-                printf("  ✓ Undo completed\n");
-                snprintf(log_msg, sizeof(log_msg), "UNDO completed for '%s' by %s", 
-                         msg.filename, msg.username);
-                log_message("storage_server", log_msg);
+                printf("  ✗ File not found\n");
                 break;
             }
             
-            case MSG_WRITE: {
-                printf("→ WRITE request for '%s' sentence %d from %s\n", 
-                       msg.filename, msg.sentence_num, msg.username);
-                
-                char filepath[MAX_PATH];
-                snprintf(filepath, sizeof(filepath), "%s%s", storage_dir, msg.filename);
-                
-                if (!file_exists(filepath)) {
-                    msg.error_code = ERR_FILE_NOT_FOUND;
-                    snprintf(msg.data, sizeof(msg.data), "File not found");
-                    send_message(client_socket, &msg);
-                    printf("  ✗ File not found\n");
-                    break;
+            // Ordered with WRITE commits so the journal and file stay in step
+            int undone = 0;
+            document_commit_begin(doc);
+            int result = journal_undo(msg.filename, steps, &undone);
+            document_commit_end(doc);
+            document_close(doc);
+            
+            if (result != RESP_SUCCESS) {
+                msg.error_code = result;
+                snprintf(msg.data, sizeof(msg.data), result == ERR_INVALID_REQUEST ?
+                         "Nothing to undo" : "Failed to restore previous version");
+                send_message(client_socket, &msg);
+                printf("  ✗ %s\n", msg.data);
+                break;
+            }
+            document_invalidate(msg.filename);
+            wait_version_pushed(manifest_bump(msg.filename));
+            
+            msg.error_code = RESP_SUCCESS;
+            snprintf(msg.data, sizeof(msg.data), "Undid %d edit%s (%d more available)",
+                     undone, undone == 1 ? "" : "s", journal_depth(msg.filename));
+            send_message(client_socket, &msg);
+            printf("  ✓ Undo completed (%d step%s)\n", undone, undone == 1 ? "" : "s");
+            snprintf(log_msg, sizeof(log_msg), "UNDO of %d edit(s) completed for '%s' by %s", 
+                     undone, msg.filename, msg.username);
+            log_message("storage_server", log_msg);
+            break;
+        }
+        
+        case MSG_WRITE: {
+            printf("→ WRITE request for '%s' sentence %d from %s\n", 
+                   msg.filename, msg.sentence_num, msg.username);
+            
+            char filepath[MAX_PATH];
+            snprintf(filepath, sizeof(filepath), "%s%s", storage_dir, msg.filename);
+            
+            // Shared document; opening a session reads only the requested
+            // sentence through the sidecar index
+            Document *doc = document_open(msg.filename);
+            char *current_sentence = NULL;
+            int sentence_count = 0;
+            if (doc != NULL) {
+                pthread_mutex_lock(&doc->lock);
+                if (document_refresh(doc) >= 0) {
+                    current_sentence = document_peek(doc, msg.sentence_num, &sentence_count);
                 }
-                
-                // Read file content
-                FILE *fp = fopen(filepath, "r");
-                if (!fp) {
-                    msg.error_code = ERR_SERVER_ERROR;
-                    snprintf(msg.data, sizeof(msg.data), "Failed to open file");
-                    send_message(client_socket, &msg);
-                    printf("  ✗ Failed to open file\n");
-                    break;
+                if (current_sentence == NULL) {
+                    pthread_mutex_unlock(&doc->lock);
+                    document_close(doc);
+                    doc = NULL;
                 }
-                
-                char content[MAX_DATA * 4] = "";
-                char line[MAX_DATA];
-                while (fgets(line, sizeof(line), fp)) {
-                    size_t len = strlen(line);
-                    if (len > 0 && line[len - 1] == '\n') {
-                        line[len - 1] = '\0';
-                    }
-                    if (len > 0 && line[len - 1] == '\r') {
-                        line[len - 1] = '\0';
-                    }
-                    strncat(content, line, sizeof(content) - strlen(content) - 1);
-                    if (strlen(content) < sizeof(content) - 1) {
-                        strncat(content, " ", sizeof(content) - strlen(content) - 1);
-                    }
+            }
+            if (doc == NULL) {
+                msg.error_code = ERR_FILE_NOT_FOUND;
+                snprintf(msg.data, sizeof(msg.data), "File not found");
+                send_message(client_socket, &msg);
+                printf("  ✗ File not found\n");
+                break;
+            }
+            
+            // Validate sentence access (same logic as original)
+            int valid = 1;
+            if (sentence_count == 0) {
+                if (msg.sentence_num != 0) {
+                    msg.error_code = ERR_SENTENCE_OUT_OF_RANGE;
+                    msg.word_index = 0;
+                    snprintf(msg.data, sizeof(msg.data), 
+                             "File is empty. Only sentence 0 is accessible.");
+                    printf("  ✗ File empty, only sentence 0 allowed\n");
+                    valid = 0;
                 }
-                fclose(fp);
-                
-                // Parse into sentences using module function
-                int sentence_count = 0;
-                char **sentences = parse_sentences(content, &sentence_count);
-                
-                if (strlen(content) == 0 || sentence_count == 0) {
-                    sentences = NULL;
-                    sentence_count = 0;
+            } else if (msg.sentence_num < 0) {
+                msg.error_code = ERR_SENTENCE_OUT_OF_RANGE;
+                msg.word_index = sentence_count - 1;
+                snprintf(msg.data, sizeof(msg.data), 
+                         "Invalid sentence number. Must be non-negative.");
+                valid = 0;
+            } else if (msg.sentence_num == sentence_count) {
+                char *last_sentence = document_peek(doc, sentence_count - 1, &sentence_count);
+                if (last_sentence == NULL || !sentence_has_delimiter(last_sentence)) {
+                    msg.error_code = ERR_SENTENCE_OUT_OF_RANGE;
+                    msg.word_index = sentence_count - 1;
+                    snprintf(msg.data, sizeof(msg.data), 
+                             "Cannot access sentence %d. Previous sentence must end with delimiter.",
+                             msg.sentence_num);
+                    valid = 0;
                 }
-                
-                // Validate sentence access (same logic as original)
-                if (sentence_count == 0) {
-                    if (msg.sentence_num != 0) {
-                        msg.error_code = ERR_SENTENCE_OUT_OF_RANGE;
-                        msg.word_index = 0;
-                        snprintf(msg.data, sizeof(msg.data), 
-                                 "File is empty. Only sentence 0 is accessible.");
-                        send_message(client_socket, &msg);
-                        printf("  ✗ File empty, only sentence 0 allowed\n");
-                        break;
-                    }
-                    sentence_count = 1;
-                    sentences = malloc(sizeof(char*));
-                    sentences[0] = strdup("");
-                } else {
-                    if (msg.sentence_num < 0) {
-                        msg.error_code = ERR_SENTENCE_OUT_OF_RANGE;
-                        msg.word_index = sentence_count - 1;
-                        snprintf(msg.data, sizeof(msg.data), 
-                                 "Invalid sentence number. Must be non-negative.");
-                        send_message(client_socket, &msg);
-                        if (sentences) {
-                            for (int i = 0; i < sentence_count; i++) {
-                                free(sentences[i]);
-                            }
-                            free(sentences);
-                        }
-                        break;
-                    }
-                    
-                    if (msg.sentence_num == sentence_count) {
-                        if (sentence_count > 0 && !sentence_has_delimiter(sentences[sentence_count - 1])) {
-                            msg.error_code = ERR_SENTENCE_OUT_OF_RANGE;
-                            msg.word_index = sentence_count - 1;
-                            snprintf(msg.data, sizeof(msg.data), 
-                                     "Cannot access sentence %d. Previous sentence must end with delimiter.",
-                                     msg.sentence_num);
-                            send_message(client_socket, &msg);
-                            if (sentences) {
-                                for (int i = 0; i < sentence_count; i++) {
-                                    free(sentences[i]);
-                                }
-                                free(sentences);
-                            }
-                            break;
-                        }
-                        
-                        sentence_count++;
-                        sentences = realloc(sentences, sizeof(char*) * sentence_count);
-                        sentences[msg.sentence_num] = strdup("");
-                    } else if (msg.sentence_num > sentence_count) {
-                        msg.error_code = ERR_SENTENCE_OUT_OF_RANGE;
-                        msg.word_index = sentence_count;
-                        snprintf(msg.data, sizeof(msg.data), 
-                                 "Cannot skip sentences. Can access 0 to %d.", sentence_count);
-                        send_message(client_socket, &msg);
-                        if (sentences) {
-                            for (int i = 0; i < sentence_count; i++) {
-                                free(sentences[i]);
-                            }
-                            free(sentences);
-                        }
-                        break;
-                    }
+                free(last_sentence);
+            } else if (msg.sentence_num > sentence_count) {
+                msg.error_code = ERR_SENTENCE_OUT_OF_RANGE;
+                msg.word_index = sentence_count;
+                snprintf(msg.data, sizeof(msg.data), 
+                         "Cannot skip sentences. Can access 0 to %d.", sentence_count);
+                valid = 0;
+            }
+            
+            // Lock the sentence while the document cannot change, so the
+            // lock and the text we send refer to the same sentence
+            unsigned long lock_id = valid ? add_sentence_lock(msg.filename, msg.sentence_num, msg.username) : 0;
+            pthread_mutex_unlock(&doc->lock);
+            
+            if (!valid) {
+                send_message(client_socket, &msg);
+                free(current_sentence);
+                document_close(doc);
+                break;
+            }
+            if (lock_id == 0) {
+                char holder[MAX_USERNAME];
+                if (!find_sentence_lock(msg.filename, msg.sentence_num, holder, sizeof(holder))) {
+                    snprintf(holder, sizeof(holder), "another user");
                 }
                 
-                // Try to lock sentence using module function
-                if (!add_sentence_lock(msg.filename, msg.sentence_num, msg.username)) {
-                    SentenceLock *lock = find_sentence_lock(msg.filename, msg.sentence_num);
+                if (!(msg.flags & WRITE_FLAG_WAIT)) {
                     msg.error_code = ERR_FILE_LOCKED;
-                    snprintf(msg.data, sizeof(msg.data), "%s", lock->username);
+                    snprintf(msg.data, sizeof(msg.data), "%s", holder);
                     send_message(client_socket, &msg);
-                    printf("  ✗ Sentence locked by %s\n", lock->username);
+                    printf("  ✗ Sentence locked by %s\n", holder);
                     
-                    for (int i = 0; i < sentence_count; i++) {
-                        free(sentences[i]);
-                    }
-                    free(sentences);
+                    free(current_sentence);
+                    document_close(doc);
                     break;
                 }
                 
-                printf("  ✓ Sentence locked for %s\n", msg.username);
-                
-                // Send current sentence
-                char *current_sentence = sentences[msg.sentence_num];
-                msg.error_code = RESP_SUCCESS;
-                strncpy(msg.data, current_sentence, sizeof(msg.data) - 1);
-                send_message(client_socket, &msg);
-                
-                // Parse sentence into words using module function
-                int word_count = 0;
-                char **words = parse_words(current_sentence, &word_count);
-                
-                if (word_count == 0 || words == NULL) {
-                    printf("  → Sentence is empty, no words yet\n");
-                    word_count = 0;
-                    words = NULL;
-                }
-                
-                printf("  → Sentence has %d word(s)\n", word_count);
-                
-                // Enter edit loop
-                int editing = 1;
-                while (editing) {
-                    struct Message update_msg;
-                    memset(&update_msg, 0, sizeof(update_msg));
-                    
-                    if (recv_message(client_socket, &update_msg) <= 0) {
-                        printf("  ✗ Connection lost during edit\n");
-                        editing = 0;
-                        break;
-                    }
-                    
-                    if (strcmp(update_msg.data, "ETIRW") == 0) {
-                        printf("  ✓ ETIRW received - finalizing changes\n");
-                        
-                        // Rebuild sentence using module function
-                        char *new_sentence = rebuild_sentence(words, word_count);
-                        free(sentences[msg.sentence_num]);
-                        sentences[msg.sentence_num] = new_sentence;
-                        
-                        // Create backup
-                        char backup_path[MAX_PATH];
-                        snprintf(backup_path, sizeof(backup_path), "%s%s.backup", backup_dir, msg.filename);
-                        
-                        FILE *orig = fopen(filepath, "r");
-                        FILE *backup = fopen(backup_path, "w");
-                        
-                        if (orig && backup) {
-                            char buf[4096];
-                            size_t bytes;
-                            while ((bytes = fread(buf, 1, sizeof(buf), orig)) > 0) {
-                                fwrite(buf, 1, bytes, backup);
-                            }
-                        }
-                        if (orig) fclose(orig);
-                        if (backup) fclose(backup);
-                        
-                        // Write updated content
-                        FILE *out = fopen(filepath, "w");
-                        if (out) {
-                            for (int i = 0; i < sentence_count; i++) {
-                                fputs(sentences[i], out);
-                                if (i < sentence_count - 1) {
-                                    fputs(" ", out);
-                                }
-                            }
-                            fclose(out);
-                        }
-                        
-                        // Release lock using module function
-                        remove_sentence_lock(msg.filename, msg.sentence_num, msg.username);
-                        
-                        // Update undo state using module function
-                        set_undo_state(msg.filename, 0);
-                        
-                        update_msg.error_code = RESP_SUCCESS;
-                        strcpy(update_msg.data, "Changes saved");
-                        send_message(client_socket, &update_msg);
-                        
-                        // Update backup file with new content (non-.backup format)
-                        char final_backup_path[MAX_PATH];
-                        snprintf(final_backup_path, sizeof(final_backup_path), "%s%s", backup_dir, msg.filename);
-                        
-                        FILE *backup_src = fopen(filepath, "r");
-                        FILE *backup_dst = fopen(final_backup_path, "w");
-                        if (backup_src && backup_dst) {
-                            char buffer[MAX_DATA * 10];
-                            size_t bytes = fread(buffer, 1, sizeof(buffer), backup_src);
-                            fwrite(buffer, 1, bytes, backup_dst);
-                            fclose(backup_src);
-                            fclose(backup_dst);
-                            printf("  ✓ Backup updated for '%s'\n", msg.filename);
-                        }
-                        
-                        printf("  ✓ Changes saved and lock released\n");
-                        snprintf(log_msg, sizeof(log_msg), "WRITE completed for '%s' sentence %d by %s", 
-                                 msg.filename, msg.sentence_num, msg.username);
-                        log_message("storage_server", log_msg);
-                        editing = 0;
-                    } else {
-                        // Handle word insert/replace/delete
-                        int word_idx = update_msg.word_index;
-                        
-                        if (word_idx < 0 || word_idx > word_count) {
-                            update_msg.error_code = ERR_WORD_OUT_OF_RANGE;
-                            update_msg.word_index = word_count;
-                            snprintf(update_msg.data, sizeof(update_msg.data), 
-                                     "Invalid word index. Can insert at 0 to %d", word_count);
-                            send_message(client_socket, &update_msg);
-                            continue;
-                        }
-                        
-                        if (strlen(update_msg.data) == 0) {
-                            // Delete word
-                            if (word_idx < word_count) {
-                                free(words[word_idx]);
-                                for (int i = word_idx; i < word_count - 1; i++) {
-                                    words[i] = words[i + 1];
-                                }
-                                word_count--;
-                                words = realloc(words, sizeof(char*) * word_count);
-                                printf("  → Deleted word at index %d\n", word_idx);
-                            }
-                        } else {
-                            // ALWAYS INSERT (not replace)
-                            // Insert at word_idx means: shift everything from word_idx onwards to the right
-                            word_count++;
-                            words = realloc(words, sizeof(char*) * word_count);
-                            
-                            // Shift words to make space
-                            for (int i = word_count - 1; i > word_idx; i--) {
-                                words[i] = words[i - 1];
-                            }
-                            
-                            // Insert new word
-                            words[word_idx] = strdup(update_msg.data);
-                            printf("  → Inserted word '%s' at index %d\n", update_msg.data, word_idx);
-                        }
-                        
-                        update_msg.error_code = RESP_SUCCESS;
-                        update_msg.word_index = word_count;
-                        send_message(client_socket, &update_msg);
-                    }
-                }
-                
-                // Cleanup
-                for (int i = 0; i < sentence_count; i++) {
-                    free(sentences[i]);
-                }
-                free(sentences);
-                
-                if (words) {
-                    for (int i = 0; i < word_count; i++) {
-                        free(words[i]);
-                    }
-                    free(words);
-                }
+                // Queue for the sentence; lock_wait_step runs whenever the
+                // line moves and opens the session once it is our turn
+                free(current_sentence);
+                int timeout_sec = msg.word_index > 0 ? msg.word_index : DEFAULT_LOCK_WAIT_SEC;
+                if (timeout_sec > MAX_LOCK_WAIT_SEC) timeout_sec = MAX_LOCK_WAIT_SEC;
+                int position = 0;
+                session->mode = CLIENT_LOCK_WAIT;
+                session->request = msg;
+                session->doc = doc;
+                session->position = 0;
+                session->deadline_us = load_now_us() + (long long)timeout_sec * 1000000LL;
+                snprintf(session->holder, sizeof(session->holder), "%s", holder);
+                session->waiter = queue_sentence_lock(msg.filename, msg.sentence_num, msg.username,
+                                                      &position, wake_connection, conn);
+                lock_wait_step(conn, session);
                 break;
             }
             
-            default:
-                printf("→ Invalid command type: %d\n", msg.type);
+            session->request = msg;
+            session->doc = doc;
+            session->lock_id = lock_id;
+            session->opened_sentence = current_sentence;
+            open_write_session(conn, session, 0);
+            break;
         }
+        
+        default:
+            printf("→ Invalid command type: %d\n", msg.type);
     }
     
-    close(client_socket);
-    return NULL;
+    int op = load_op_for_message(request->type);
+    if (session->mode == CLIENT_IDLE && op >= 0) {
+        load_record_latency(op, load_now_us() - conn->request_us);
+    }
+}
+
+// Commits, UNDO and whole-file requests on the blocking pool: commits queue
+// for the file's commit turn, flush and wait for the NS to see the new
+// version; READ, VIEWCHECKPOINT and DIFF read (and DIFF compares) whole
+// files and send them in one go
+static void client_offloaded(Connection *conn, int event) {
+    (void)event;
+    ClientSession *session = conn->state;
+    if (session->mode == CLIENT_WRITING) {
+        write_commit(conn, session, &conn->request);
+    } else {
+        client_request(conn, session, &conn->request);
+    }
+}
+
+static int offloaded_request(int type) {
+    return type == MSG_UNDO || type == MSG_READ || type == MSG_VIEWCHECKPOINT || type == MSG_DIFF;
+}
+
+// Handle client connection events: requests, and the WRITE sessions and
+// STREAMs they start
+static void client_event(Connection *conn, int event) {
+    ClientSession *session = conn->state;
+    switch (event) {
+        case CONN_EVENT_OPEN: {
+            conn->state = calloc(1, sizeof(ClientSession));
+            struct sockaddr_in peer;
+            socklen_t peer_len = sizeof(peer);
+            char peer_ip[INET_ADDRSTRLEN] = "unknown";
+            memset(&peer, 0, sizeof(peer));
+            if (getpeername(conn->fd, (struct sockaddr*)&peer, &peer_len) == 0) {
+                inet_ntop(AF_INET, &peer.sin_addr, peer_ip, sizeof(peer_ip));
+            }
+            printf("Client connected from %s:%d\n", peer_ip, ntohs(peer.sin_port));
+            conn->want_input = 1;
+            break;
+        }
+        
+        case CONN_EVENT_MESSAGE:
+            if (session->mode == CLIENT_WRITING) {
+                write_edit(conn, session, &conn->request);
+            } else if (session->mode == CLIENT_IDLE && offloaded_request(conn->request.type)) {
+                conn->offload = client_offloaded;
+            } else if (session->mode == CLIENT_IDLE) {
+                client_request(conn, session, &conn->request);
+            }
+            break;
+        
+        case CONN_EVENT_TIMER:
+            if (session->mode == CLIENT_LOCK_WAIT) {
+                lock_wait_step(conn, session);
+            } else if (session->mode == CLIENT_STREAMING) {
+                stream_step(conn, session, event);
+            }
+            break;
+        
+        case CONN_EVENT_WRITABLE:
+            if (session->mode == CLIENT_STREAMING) {
+                stream_step(conn, session, event);
+            }
+            break;
+        
+        case CONN_EVENT_CLOSE:
+            if (session == NULL) break;
+            if (session->mode == CLIENT_WRITING) {
+                printf("  ✗ Connection lost during edit\n");
+            } else if (session->mode == CLIENT_STREAMING) {
+                printf("  ✗ Stream aborted after %ld words\n", session->stream.words_sent);
+                char log_msg[512];
+                snprintf(log_msg, sizeof(log_msg), "STREAM aborted for '%s' after %ld words",
+                         session->request.filename, session->stream.words_sent);
+                log_message("storage_server", log_msg);
+                word_stream_close(&session->stream);
+            }
+            release_write_session(session);
+            free(session);
+            conn->state = NULL;
+            break;
+    }
 }
 
+
 int main(int argc, char *argv[]) {
     if (argc != 5) {
         printf("Usage: %s <ss_id> <ns_ip> <ns_port> <client_port>\n", argv[0]);
@@ -952,6 +1401,19 @@ int main(int argc, char *argv[]) {
     
     // Initialize storage using module function
     init_storage();
+    init_manifest();
+    init_document_cache();
+    init_lock_manager();
+    init_io_engine();
+    init_durable_io();
+    init_undo_journal();
+    init_chunk_store();
+    init_word_stream();
+    init_load_stats();
+    init_event_loop(get_config_int("DOCSPP_SS_WORKERS", DEFAULT_EVENT_WORKERS),
+                    get_config_int("DOCSPP_SS_BLOCKING_WORKERS", DEFAULT_BLOCKING_WORKERS),
+                    get_config_int("DOCSPP_SS_MAX_CONNECTIONS", DEFAULT_MAX_CONNECTIONS),
+                    get_config_int("DOCSPP_SS_SEND_TIMEOUT_SEC", DEFAULT_SEND_TIMEOUT_SEC));
     
     // Register with naming server
     int ns_socket = register_with_ns();
@@ -960,16 +1422,62 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
-    // Start NS command handler thread
-    int *ns_sock_ptr = malloc(sizeof(int));
-    *ns_sock_ptr = ns_socket;
-    pthread_t ns_thread;
-    if (pthread_create(&ns_thread, NULL, handle_ns_commands, ns_sock_ptr) != 0) {
-        fprintf(stderr, "Failed to create NS command handler thread\n");
+    // Client and NS connections are all served by one event loop
+    if (event_loop_start() != 0) {
+        fprintf(stderr, "Failed to start event loop\n");
         close(ns_socket);
         return 1;
     }
-    pthread_detach(ns_thread);
+    event_loop_add(ns_socket, ns_event);
+    
+    // Push file versions to the NS as they change (cache coherence)
+    start_version_push(ss_id, ns_ip, ns_port);
+    
+    // Ship committed contents to the NS in the background (failover copies)
+    start_backup_stream(ss_id, ns_ip, ns_port);
+    
+    // Listen on the NM port for side connections from the NS (anti-entropy)
+    int nm_listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (nm_listener >= 0) {
+        int reuse = 1;
+        setsockopt(nm_listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        
+        struct sockaddr_in nm_addr;
+        memset(&nm_addr, 0, sizeof(nm_addr));
+        nm_addr.sin_family = AF_INET;
+        nm_addr.sin_addr.s_addr = INADDR_ANY;
+        nm_addr.sin_port = htons(nm_port);
+        
+        if (bind(nm_listener, (struct sockaddr*)&nm_addr, sizeof(nm_addr)) == 0 &&
+            listen(nm_listener, 4) == 0) {
+            event_loop_listen(nm_listener, ns_event, 0);
+        } else {
+            perror("NM port bind failed");
+            close(nm_listener);
+        }
+    }
+    
+    // Heartbeats arrive as UDP datagrams on the same port number
+    int udp_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp_socket >= 0) {
+        struct sockaddr_in udp_addr;
+        memset(&udp_addr, 0, sizeof(udp_addr));
+        udp_addr.sin_family = AF_INET;
+        udp_addr.sin_addr.s_addr = INADDR_ANY;
+        udp_addr.sin_port = htons(nm_port);
+        
+        int *udp_socket_ptr = malloc(sizeof(int));
+        *udp_socket_ptr = udp_socket;
+        pthread_t udp_thread;
+        if (bind(udp_socket, (struct sockaddr*)&udp_addr, sizeof(udp_addr)) == 0 &&
+            pthread_create(&udp_thread, NULL, heartbeat_responder, udp_socket_ptr) == 0) {
+            pthread_detach(udp_thread);
+        } else {
+            perror("Heartbeat socket setup failed");
+            free(udp_socket_ptr);
+            close(udp_socket);
+        }
+    }
     
     // Create client listener socket
     int client_listener = socket(AF_INET, SOCK_STREAM, 0);
@@ -991,25 +1499,51 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
-    if (listen(client_listener, 10) < 0) {
+    if (listen(client_listener, 128) < 0) {
         perror("Client listen failed");
         return 1;
     }
+    event_loop_listen(client_listener, client_event, 1);
     
     printf("Storage Server is running and ready for client connections...\n");
-    printf("Type 'DISCONNECT' to shutdown\n\n");
+    printf("Type 'LOCKS' to list held sentence locks, 'DISCONNECT' to shutdown\n\n");
     log_message("storage_server", "Server started successfully");
     
     fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
     
-    // Accept client connections
+    // Console commands
     while (1) {
         char cmd[256];
         if (fgets(cmd, sizeof(cmd), stdin) != NULL) {
             cmd[strcspn(cmd, "\n")] = 0;
             
-            if (strcmp(cmd, "DISCONNECT") == 0) {
+            if (strcmp(cmd, "LOCKS") == 0) {
+                print_sentence_locks();
+            } else if (strcmp(cmd, "DISCONNECT") == 0) {
                 printf("\n⚠️  Shutting down...\n");
+                unsigned long backup_files;
+                unsigned long long backup_raw, backup_sent;
+                backup_stream_stats(&backup_files, &backup_raw, &backup_sent);
+                printf("  Backup stream: %lu file(s), %llu bytes sent as %llu\n",
+                       backup_files, backup_raw, backup_sent);
+                unsigned long doc_hits, doc_misses;
+                size_t doc_bytes;
+                document_cache_stats(&doc_hits, &doc_misses, &doc_bytes);
+                printf("  Document cache: %lu hit(s), %lu miss(es), %zu bytes idle\n",
+                       doc_hits, doc_misses, doc_bytes);
+                unsigned long durable_commits, durable_syncs;
+                durable_stats(&durable_commits, &durable_syncs);
+                printf("  Durable commits (%s): %lu commit(s), %lu group sync(s)\n",
+                       durability_name(durability_level()), durable_commits, durable_syncs);
+                unsigned long io_requests;
+                int io_pending;
+                io_engine_stats(&io_requests, &io_pending);
+                printf("  File I/O (%s): %lu request(s), %d in flight\n",
+                       io_engine_name(io_engine()), io_requests, io_pending);
+                int chunk_count;
+                size_t chunk_bytes;
+                chunk_store_stats(&chunk_count, &chunk_bytes);
+                printf("  Checkpoint chunks: %d chunk(s), %zu bytes\n", chunk_count, chunk_bytes);
                 printf("✓ Storage server %s shutdown complete\n", ss_id);
                 close(client_listener);
                 if (ns_socket >= 0) close(ns_socket);
@@ -1017,38 +1551,9 @@ int main(int argc, char *argv[]) {
             }
         }
         
-        fd_set readfds;
-        FD_ZERO(&readfds);
-        FD_SET(client_listener, &readfds);
-        
-        struct timeval tv;
-        tv.tv_sec = 0;
-        tv.tv_usec = 100000;
-        
-        int activity = select(client_listener + 1, &readfds, NULL, NULL, &tv);
-        
-        if (activity > 0 && FD_ISSET(client_listener, &readfds)) {
-            struct sockaddr_in client;
-            socklen_t client_len = sizeof(client);
-            int *client_sock = malloc(sizeof(int));
-            *client_sock = accept(client_listener, (struct sockaddr*)&client, &client_len);
-            
-            if (*client_sock < 0) {
-                free(client_sock);
-                continue;
-            }
-            
-            printf("Client connected from %s:%d\n", 
-                   inet_ntoa(client.sin_addr), ntohs(client.sin_port));
-            
-            pthread_t thread;
-            if (pthread_create(&thread, NULL, handle_client, client_sock) != 0) {
-                free(client_sock);
-                continue;
-            }
-            
-            pthread_detach(thread);
-        }
+        // Connections are served by the event loop; this thread only
+        // watches the console
+        usleep(100000);
     }
     
     close(client_listener);
@@ -1,51 +1,303 @@
 #include "undo_manager.h"
+#include "file_operations.h"
+#include "durable_io.h"
+#include "../common/utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <pthread.h>
-
-// Global undo state list
-UndoState *undo_states = NULL;
-pthread_mutex_t undo_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-// Get undo state for a file
-UndoState* get_undo_state(const char *filename) {
-    pthread_mutex_lock(&undo_mutex);
-    UndoState *current = undo_states;
-    
-    while (current != NULL) {
-        if (strcmp(current->filename, filename) == 0) {
-            pthread_mutex_unlock(&undo_mutex);
-            return current;
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define FNV_OFFSET 1469598103934665603ULL
+#define FNV_PRIME 1099511628211ULL
+
+static int undo_depth = DEFAULT_UNDO_DEPTH;
+static int undo_retention_sec = DEFAULT_UNDO_RETENTION_SEC;
+
+// Journals live flat in meta_dir next to the sentence indexes
+static void journal_path(const char *filename, char *path, size_t size) {
+    char flat[MAX_FILENAME];
+    strncpy(flat, filename, sizeof(flat) - 1);
+    flat[sizeof(flat) - 1] = '\0';
+    for (char *p = flat; *p; p++) {
+        if (*p == '/') *p = '#';
+    }
+    snprintf(path, size, "%s%s.journal", meta_dir, flat);
+}
+
+void init_undo_journal() {
+    undo_depth = get_config_int("DOCSPP_SS_UNDO_DEPTH", DEFAULT_UNDO_DEPTH);
+    if (undo_depth < 0) undo_depth = 0;
+    undo_retention_sec = get_config_int("DOCSPP_SS_UNDO_RETENTION_SEC", DEFAULT_UNDO_RETENTION_SEC);
+    if (undo_retention_sec < 0) undo_retention_sec = 0;
+}
+
+static uint64_t range_hash(const char *data, size_t length) {
+    uint64_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static int expired(const UndoRecord *record, time_t now) {
+    return undo_retention_sec > 0 && now - record->committed_at > undo_retention_sec;
+}
+
+// Find the valid records, oldest first. A torn tail (crash mid-append) ends
+// the walk; *valid_end is where the intact part of the journal stops.
+static int walk_journal(int fd, off_t *valid_end, off_t **positions, UndoRecord **records) {
+    struct stat st;
+    *positions = NULL;
+    *records = NULL;
+    *valid_end = 0;
+    if (fstat(fd, &st) != 0) return 0;
+
+    int count = 0, capacity = 0;
+    off_t pos = 0;
+    while (pos + (off_t)(sizeof(UndoRecord) + sizeof(uint64_t)) <= st.st_size) {
+        UndoRecord record;
+        if (pread(fd, &record, sizeof(record), pos) != sizeof(record) || record.magic != UNDO_MAGIC) break;
+        uint64_t length = sizeof(UndoRecord) + record.old_length + sizeof(uint64_t);
+        uint64_t trailer = 0;
+        if (pos + (off_t)length > st.st_size ||
+            pread(fd, &trailer, sizeof(trailer), pos + length - sizeof(trailer)) != sizeof(trailer) ||
+            trailer != length) {
+            break;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            *positions = realloc(*positions, sizeof(off_t) * capacity);
+            *records = realloc(*records, sizeof(UndoRecord) * capacity);
+        }
+        (*positions)[count] = pos;
+        (*records)[count] = record;
+        count++;
+        pos += length;
+    }
+    *valid_end = pos;
+    return count;
+}
+
+// Keep only the newest undo_depth unexpired records
+static void compact_journal(const char *path, int fd, int count, const off_t *positions,
+                            const UndoRecord *records, off_t end) {
+    time_t now = time(NULL);
+    int first = count > undo_depth ? count - undo_depth : 0;
+    while (first < count && expired(&records[first], now)) first++;
+    if (first == 0) return;
+
+    size_t length = end - (first < count ? positions[first] : end);
+    char *kept = malloc(length + 1);
+    if (length > 0 && pread(fd, kept, length, positions[first]) != (ssize_t)length) {
+        free(kept);
+        return;
+    }
+    durable_write_file(path, kept, length);
+    free(kept);
+}
+
+// Record the reverse delta of one committed edit: the text at 'offset' was
+// old_text and is now new_text. Only the differing middle is stored.
+// Returns 1 if a record was added, 0 if there was nothing to record, -1.
+int journal_record(const char *filename, size_t offset, const char *old_text, size_t old_length,
+                   const char *new_text, size_t new_length, size_t size_after) {
+    if (undo_depth == 0) return 0;
+
+    size_t prefix = 0;
+    while (prefix < old_length && prefix < new_length && old_text[prefix] == new_text[prefix]) prefix++;
+    size_t suffix = 0;
+    while (suffix < old_length - prefix && suffix < new_length - prefix &&
+           old_text[old_length - 1 - suffix] == new_text[new_length - 1 - suffix]) {
+        suffix++;
+    }
+    old_length -= prefix + suffix;
+    new_length -= prefix + suffix;
+    if (old_length == 0 && new_length == 0) return 0;
+    if (old_length > UINT32_MAX) return -1;
+
+    char path[MAX_PATH];
+    journal_path(filename, path, sizeof(path));
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) return -1;
+
+    off_t end;
+    off_t *positions;
+    UndoRecord *records;
+    int count = walk_journal(fd, &end, &positions, &records);
+
+    UndoRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = UNDO_MAGIC;
+    record.old_length = (uint32_t)old_length;
+    record.offset = offset + prefix;
+    record.new_length = new_length;
+    record.size_after = size_after;
+    record.hash_after = range_hash(new_text + prefix, new_length);
+    record.committed_at = time(NULL);
+    uint64_t length = sizeof(record) + old_length + sizeof(uint64_t);
+
+    char *buffer = malloc(length);
+    memcpy(buffer, &record, sizeof(record));
+    memcpy(buffer + sizeof(record), old_text + prefix, old_length);
+    memcpy(buffer + sizeof(record) + old_length, &length, sizeof(length));
+
+    int result = (ftruncate(fd, end) == 0 &&
+                  pwrite(fd, buffer, length, end) == (ssize_t)length) ? 1 : -1;
+    free(buffer);
+    if (result > 0 && durability_level() == DURABILITY_COMMIT) fdatasync(fd);
+
+    if (result > 0) {
+        positions = realloc(positions, sizeof(off_t) * (count + 1));
+        records = realloc(records, sizeof(UndoRecord) * (count + 1));
+        positions[count] = end;
+        records[count] = record;
+        count++;
+        time_t now = time(NULL);
+        if (count > 2 * undo_depth || expired(&records[0], now)) {
+            compact_journal(path, fd, count, positions, records, end + length);
         }
-        current = current->next;
-    }
-    
-    pthread_mutex_unlock(&undo_mutex);
-    return NULL;
-}
-
-// Set undo state for a file (1 = undo performed, 0 = file modified)
-void set_undo_state(const char *filename, int undo_performed) {
-    pthread_mutex_lock(&undo_mutex);
-    
-    UndoState *current = undo_states;
-    while (current != NULL) {
-        if (strcmp(current->filename, filename) == 0) {
-            current->undo_performed = undo_performed;
-            pthread_mutex_unlock(&undo_mutex);
-            return;
+    }
+    free(positions);
+    free(records);
+    close(fd);
+    return result;
+}
+
+// Drop the newest record, for an edit whose commit failed after it was
+// journaled
+void journal_cancel(const char *filename) {
+    char path[MAX_PATH];
+    journal_path(filename, path, sizeof(path));
+    int fd = open(path, O_RDWR);
+    if (fd < 0) return;
+
+    off_t end;
+    off_t *positions;
+    UndoRecord *records;
+    int count = walk_journal(fd, &end, &positions, &records);
+    if (count > 0 && ftruncate(fd, positions[count - 1]) != 0) {
+        log_error("storage_server", "Failed to drop undo record");
+    }
+    free(positions);
+    free(records);
+    close(fd);
+}
+
+// Whether the file still holds what the record's edit wrote
+static int record_matches(const UndoRecord *record, const char *text, size_t size) {
+    return record->size_after == size && record->offset + record->new_length <= size &&
+           record->hash_after == range_hash(text + record->offset, record->new_length);
+}
+
+// Step the file back up to 'steps' edits, newest first. The journal is cut
+// back before the file is replaced, so a crash in between loses history but
+// never leaves the file inconsistent with it. Returns a protocol code.
+int journal_undo(const char *filename, int steps, int *undone) {
+    *undone = 0;
+    char path[MAX_PATH], data_path[MAX_PATH];
+    journal_path(filename, path, sizeof(path));
+    snprintf(data_path, sizeof(data_path), "%s%s", storage_dir, filename);
+
+    int fd = open(path, O_RDWR);
+    if (fd < 0) return ERR_INVALID_REQUEST;
+
+    off_t end;
+    off_t *positions;
+    UndoRecord *records;
+    int count = walk_journal(fd, &end, &positions, &records);
+    int oldest = count > undo_depth ? count - undo_depth : 0;
+
+    // Current contents
+    char *text = NULL;
+    size_t size = 0;
+    int data_fd = open(data_path, O_RDONLY);
+    struct stat st;
+    int result = RESP_SUCCESS;
+    if (data_fd < 0 || fstat(data_fd, &st) != 0) {
+        result = ERR_FILE_NOT_FOUND;
+    } else {
+        size = st.st_size;
+        text = malloc(size + 1);
+        if (pread(data_fd, text, size, 0) != (ssize_t)size) result = ERR_SERVER_ERROR;
+    }
+    if (data_fd >= 0) close(data_fd);
+
+    time_t now = time(NULL);
+    off_t cut = end;
+    for (int i = count - 1; result == RESP_SUCCESS && i >= oldest && *undone < steps; i--) {
+        UndoRecord *record = &records[i];
+        if (i == count - 1 && i > oldest && !record_matches(record, text, size) &&
+            record_matches(&records[i - 1], text, size)) {
+            cut = positions[i];   // Journaled, but its rename never happened
+            continue;
+        }
+        if (!record_matches(record, text, size) || expired(record, now)) {
+            break;   // File changed outside the journal, or the edit is too old
         }
-        current = current->next;
-    }
-    
-    // Create new undo state entry
-    UndoState *new_state = malloc(sizeof(UndoState));
-    strncpy(new_state->filename, filename, sizeof(new_state->filename) - 1);
-    new_state->filename[sizeof(new_state->filename) - 1] = '\0';
-    new_state->undo_performed = undo_performed;
-    new_state->next = undo_states;
-    undo_states = new_state;
-    
-    pthread_mutex_unlock(&undo_mutex);
+        size_t new_size = size - record->new_length + record->old_length;
+        char *previous = malloc(new_size + 1);
+        memcpy(previous, text, record->offset);
+        if (pread(fd, previous + record->offset, record->old_length,
+                  positions[i] + sizeof(UndoRecord)) != (ssize_t)record->old_length) {
+            free(previous);
+            result = ERR_SERVER_ERROR;
+            break;
+        }
+        memcpy(previous + record->offset + record->old_length,
+               text + record->offset + record->new_length,
+               size - record->offset - record->new_length);
+        free(text);
+        text = previous;
+        size = new_size;
+        cut = positions[i];
+        (*undone)++;
+    }
+
+    if (result == RESP_SUCCESS && *undone == 0) {
+        // Nothing applicable: a journal that no longer matches the file is useless
+        if (count > 0) ftruncate(fd, 0);
+        result = ERR_INVALID_REQUEST;
+    } else if (result == RESP_SUCCESS) {
+        if (ftruncate(fd, cut) != 0 || durable_write_file(data_path, text, size) != 0) {
+            result = ERR_SERVER_ERROR;
+        }
+    }
+
+    free(text);
+    free(positions);
+    free(records);
+    close(fd);
+    return result;
+}
+
+// Number of edits that can currently be undone
+int journal_depth(const char *filename) {
+    char path[MAX_PATH];
+    journal_path(filename, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    off_t end;
+    off_t *positions;
+    UndoRecord *records;
+    int count = walk_journal(fd, &end, &positions, &records);
+    close(fd);
+
+    time_t now = time(NULL);
+    int oldest = count > undo_depth ? count - undo_depth : 0;
+    int depth = 0;
+    for (int i = count - 1; i >= oldest && !expired(&records[i], now); i--) depth++;
+    free(positions);
+    free(records);
+    return depth;
+}
+
+void journal_remove(const char *filename) {
+    char path[MAX_PATH];
+    journal_path(filename, path, sizeof(path));
+    unlink(path);
 }
@@ -1,23 +1,40 @@
 #ifndef UNDO_MANAGER_H
 #define UNDO_MANAGER_H
 
-#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "../common/protocol.h"
 
-// Undo state tracking structure
-typedef struct UndoState {
-    char filename[MAX_FILENAME];
-    int undo_performed;
-    struct UndoState *next;
-} UndoState;
+// Edit journal: meta/<file>.journal holds one reverse delta per committed
+// edit, oldest first. Undoing an edit replaces new_length bytes at offset
+// with the old bytes stored in the record; size_after (the file size the
+// edit produced) and hash_after (FNV-1a of the new_length bytes it wrote)
+// guard against applying it to a file changed elsewhere. Each record is
+// the header, old_length old bytes, then a uint64 copy of the record length
+// so the journal can be checked from its tail. Records are appended before
+// the edit's rename; a newest record that the file does not match is an
+// edit whose rename never happened and is skipped.
+#define UNDO_MAGIC 0x32444E55u            // "UND2"
+#define DEFAULT_UNDO_DEPTH 16             // DOCSPP_SS_UNDO_DEPTH: edits kept per file (0 disables)
+#define DEFAULT_UNDO_RETENTION_SEC 0      // DOCSPP_SS_UNDO_RETENTION_SEC: older edits expire (0 = never)
 
-// Undo management functions
-UndoState* get_undo_state(const char *filename);
-void set_undo_state(const char *filename, int undo_performed);
-void cleanup_undo_states();
+typedef struct {
+    uint32_t magic;
+    uint32_t old_length;
+    uint64_t offset;
+    uint64_t new_length;
+    uint64_t size_after;
+    uint64_t hash_after;
+    int64_t committed_at;
+} UndoRecord;
 
-// External global variables
-extern UndoState *undo_states;
-extern pthread_mutex_t undo_mutex;
+// Undo journal functions
+void init_undo_journal();
+int journal_record(const char *filename, size_t offset, const char *old_text, size_t old_length,
+                   const char *new_text, size_t new_length, size_t size_after);
+void journal_cancel(const char *filename);
+int journal_undo(const char *filename, int steps, int *undone);
+int journal_depth(const char *filename);
+void journal_remove(const char *filename);
 
 #endif // UNDO_MANAGER_H
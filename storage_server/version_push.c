@@ -0,0 +1,166 @@
+#include "version_push.h"
+#include "manifest.h"
+#include "../common/utils.h"
+#include "../common/protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// Version push channel: a dedicated connection to the NS over which every
+// new manifest generation is pushed as soon as it is stamped, so the NS can
+// drop cached copies of changed files before anyone reads them.
+static char push_ss_id[64];
+static char push_ns_ip[16];
+static int push_ns_port;
+static int push_wait_ms = DEFAULT_VERSION_PUSH_WAIT_MS;
+
+static unsigned long acked_generation = 0;   // Newest generation the NS has applied
+static int channel_up = 0;
+static pthread_mutex_t push_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t push_acked = PTHREAD_COND_INITIALIZER;
+
+static void set_acked(unsigned long generation, int up) {
+    pthread_mutex_lock(&push_mutex);
+    if (generation > acked_generation) acked_generation = generation;
+    channel_up = up;
+    pthread_cond_broadcast(&push_acked);
+    pthread_mutex_unlock(&push_mutex);
+}
+
+static int connect_to_ns() {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+
+    struct sockaddr_in ns_addr;
+    memset(&ns_addr, 0, sizeof(ns_addr));
+    ns_addr.sin_family = AF_INET;
+    ns_addr.sin_port = htons(push_ns_port);
+    inet_pton(AF_INET, push_ns_ip, &ns_addr.sin_addr);
+
+    if (connect(sock, (struct sockaddr*)&ns_addr, sizeof(ns_addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    // Pushes are tiny and latency-sensitive
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return sock;
+}
+
+// Hello handshake. Returns the generation the NS already has, or -1.
+static long handshake(int sock) {
+    struct Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_VERSION_PUSH;
+    snprintf(msg.data, sizeof(msg.data), "%s %lu %lu", push_ss_id,
+             manifest_epoch(), manifest_high_water());
+    msg.data_length = strlen(msg.data);
+    if (send_message(sock, &msg) < 0) return -1;
+
+    unsigned long since = 0;
+    if (recv_message(sock, &msg) <= 0 || msg.error_code != RESP_SUCCESS ||
+        sscanf(msg.data, "SINCE %lu", &since) != 1) {
+        return -1;
+    }
+    return (long)since;
+}
+
+// Push one delta exchange and wait for the NS ack
+static int push_changes(int sock, unsigned long since) {
+    unsigned long through;
+    if (manifest_push_delta(sock, since, &through) < 0) return -1;
+
+    struct Message msg;
+    if (recv_message(sock, &msg) <= 0 || msg.error_code != RESP_ACK) return -1;
+    set_acked(through, 1);
+    return 0;
+}
+
+static void* version_push_worker(void *arg) {
+    (void)arg;
+    while (1) {
+        int sock = connect_to_ns();
+        long since = sock >= 0 ? handshake(sock) : -1;
+        if (since < 0) {
+            if (sock >= 0) close(sock);
+            sleep(VERSION_PUSH_RETRY_SEC);
+            continue;
+        }
+
+        // The NS may be behind after a reconnect. Commits from here on wait
+        // for their push, and the NS is caught up first - with an empty
+        // delta if nothing changed, which tells it the channel is current.
+        pthread_mutex_lock(&push_mutex);
+        acked_generation = (unsigned long)since;
+        channel_up = 1;
+        pthread_mutex_unlock(&push_mutex);
+        log_message("storage_server", "Version push channel connected");
+
+        unsigned long pushed = (unsigned long)since;
+        int connected = push_changes(sock, pushed) == 0;
+        if (connected) pushed = version_push_acked();
+        while (connected) {
+            unsigned long high_water = manifest_wait_for_change(pushed, 1000);
+            if (high_water <= pushed) continue;
+            if (push_changes(sock, pushed) < 0) break;
+            pushed = version_push_acked();
+        }
+
+        log_error("storage_server", "Version push channel lost, reconnecting");
+        set_acked(0, 0);
+        close(sock);
+        sleep(VERSION_PUSH_RETRY_SEC);
+    }
+    return NULL;
+}
+
+int start_version_push(const char *id, const char *ip, int port) {
+    strncpy(push_ss_id, id, sizeof(push_ss_id) - 1);
+    strncpy(push_ns_ip, ip, sizeof(push_ns_ip) - 1);
+    push_ns_port = port;
+    push_wait_ms = get_config_int("DOCSPP_VERSION_PUSH_WAIT_MS", DEFAULT_VERSION_PUSH_WAIT_MS);
+    if (push_wait_ms < 0) push_wait_ms = 0;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, version_push_worker, NULL) != 0) {
+        log_error("storage_server", "Failed to start version push thread");
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+unsigned long version_push_acked() {
+    pthread_mutex_lock(&push_mutex);
+    unsigned long generation = acked_generation;
+    pthread_mutex_unlock(&push_mutex);
+    return generation;
+}
+
+// Wait (bounded) until the NS has applied 'generation', so a READ that
+// follows a commit never hits a stale NS cache entry. Returns 1 if acked.
+int wait_version_pushed(unsigned long generation) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += push_wait_ms / 1000;
+    deadline.tv_nsec += (long)(push_wait_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&push_mutex);
+    while (channel_up && acked_generation < generation) {
+        if (pthread_cond_timedwait(&push_acked, &push_mutex, &deadline) != 0) break;
+    }
+    int acked = acked_generation >= generation;
+    pthread_mutex_unlock(&push_mutex);
+    return acked;
+}
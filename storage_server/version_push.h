@@ -0,0 +1,12 @@
+#ifndef VERSION_PUSH_H
+#define VERSION_PUSH_H
+
+#define VERSION_PUSH_RETRY_SEC 1          // Reconnect delay after the channel drops
+#define DEFAULT_VERSION_PUSH_WAIT_MS 200  // DOCSPP_VERSION_PUSH_WAIT_MS: commit waits this long for the NS ack
+
+// Version push functions
+int start_version_push(const char *id, const char *ip, int port);
+int wait_version_pushed(unsigned long generation);
+unsigned long version_push_acked();
+
+#endif // VERSION_PUSH_H
@@ -0,0 +1,96 @@
+#include "word_stream.h"
+#include "document.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+static int default_rate = DEFAULT_STREAM_WPS;
+static int stall_ms = DEFAULT_STREAM_STALL_SEC * 1000;
+
+void init_word_stream() {
+    default_rate = get_config_int("DOCSPP_SS_STREAM_WPS", DEFAULT_STREAM_WPS);
+    if (default_rate < 0) default_rate = DEFAULT_STREAM_WPS;
+    int stall_sec = get_config_int("DOCSPP_SS_STREAM_STALL_SEC", DEFAULT_STREAM_STALL_SEC);
+    stall_ms = (stall_sec > 0 ? stall_sec : DEFAULT_STREAM_STALL_SEC) * 1000;
+}
+
+int word_stream_open(WordStream *stream, const char *filename, int requested_rate) {
+    memset(stream, 0, sizeof(*stream));
+    int result = document_read(filename, &stream->text, &stream->length);
+    if (result != RESP_SUCCESS) return result;
+
+    if (requested_rate == STREAM_UNTHROTTLED) stream->rate = 0;
+    else if (requested_rate <= 0) stream->rate = default_rate;
+    else stream->rate = requested_rate < MAX_STREAM_WPS ? requested_rate : MAX_STREAM_WPS;
+    return RESP_SUCCESS;
+}
+
+// Words the rate allows by now_us (-1: no limit); the first is due at once
+static long words_allowed(const WordStream *stream, long long now_us) {
+    if (stream->rate == 0) return -1;
+    if (stream->started_us == 0) return 1;
+    return (long)((now_us - stream->started_us) * stream->rate / 1000000LL) + 1;
+}
+
+// When the next frame may go out: -1 once everything is sent, 0 if now.
+// Paced frames are spaced by at least a tick so fast rates batch words.
+long long word_stream_due_us(const WordStream *stream) {
+    if (stream->position >= stream->length) return -1;
+    if (stream->rate == 0 || stream->started_us == 0) return 0;
+    long long word_due = stream->started_us + stream->words_sent * 1000000LL / stream->rate;
+    long long tick_due = stream->last_frame_us + STREAM_TICK_MS * 1000LL;
+    return word_due > tick_due ? word_due : tick_due;
+}
+
+// Fill frame with the words due by now_us, each with the whitespace after
+// it. A word longer than a frame is split and counted where it ends.
+// Returns the bytes placed (0 when nothing is due).
+int word_stream_frame(WordStream *stream, struct Message *frame, long long now_us) {
+    long allowed = words_allowed(stream, now_us);
+    if (allowed >= 0) allowed -= stream->words_sent;
+    size_t capacity = sizeof(frame->data) - 1;
+    size_t used = 0;
+    int words = 0;
+
+    while (stream->position < stream->length && (allowed < 0 || words < allowed)) {
+        const char *text = stream->text;
+        size_t start = stream->position, end = start;
+        while (end < stream->length && isspace((unsigned char)text[end])) end++;
+        size_t word_start = end;
+        while (end < stream->length && !isspace((unsigned char)text[end])) end++;
+        int complete = end > word_start;
+        while (end < stream->length && isspace((unsigned char)text[end])) end++;
+
+        size_t take = end - start;
+        if (used + take > capacity) {
+            if (used > 0) break;
+            take = capacity;
+            complete = 0;
+        }
+        memcpy(frame->data + used, text + start, take);
+        used += take;
+        stream->position += take;
+        if (complete) words++;
+    }
+
+    if (used == 0) return 0;
+    if (stream->started_us == 0) stream->started_us = now_us;
+    frame->data[used] = '\0';
+    frame->error_code = RESP_DATA;
+    frame->word_index = words;
+    stream->words_sent += words;
+    stream->frames_sent++;
+    stream->last_frame_us = now_us;
+    return (int)used;
+}
+
+int word_stream_stall_ms() {
+    return stall_ms;
+}
+
+void word_stream_close(WordStream *stream) {
+    free(stream->text);
+    stream->text = NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef WORD_STREAM_H
+#define WORD_STREAM_H
+
+#include <stddef.h>
+#include "../common/protocol.h"
+
+#define DEFAULT_STREAM_WPS 10        // DOCSPP_SS_STREAM_WPS: pace when the client asks for none
+#define MAX_STREAM_WPS 1000000       // Faster requests are capped here
+#define STREAM_TICK_MS 50            // Paced frames are sent at most this often
+#define DEFAULT_STREAM_STALL_SEC 30  // DOCSPP_SS_STREAM_STALL_SEC: drop a client that stops reading
+
+// One STREAM in progress: a snapshot of the text (from the document cache,
+// or the disk file while a commit is pending) and how far it has been sent.
+// Words become due at the negotiated rate; whatever is due when the socket
+// can take a frame goes out together, so a slow reader gets fewer, fuller
+// frames instead of holding a thread in sleeps.
+typedef struct {
+    char *text;
+    size_t length;
+    size_t position;                 // Next byte to send
+    int rate;                        // Words per second, 0 = unthrottled
+    long words_sent;
+    long frames_sent;
+    long long started_us;
+    long long last_frame_us;
+} WordStream;
+
+// Word stream functions
+void init_word_stream();
+int word_stream_open(WordStream *stream, const char *filename, int requested_rate);
+long long word_stream_due_us(const WordStream *stream);
+int word_stream_frame(WordStream *stream, struct Message *frame, long long now_us);
+int word_stream_stall_ms();
+void word_stream_close(WordStream *stream);
+
+#endif // WORD_STREAM_H
@@ -0,0 +1,103 @@
+#include "test_common.h"
+#include "../storage_server/chunk_store.h"
+#include "../storage_server/durable_io.h"
+#include "../storage_server/io_engine.h"
+#include "../storage_server/undo_manager.h"
+#include <sys/stat.h>
+
+char ss_id[64] = "TEST";
+char storage_dir[MAX_PATH];
+char backup_dir[MAX_PATH];
+char meta_dir[MAX_PATH];
+
+#define TEXT_SIZE (200 * 1024)
+
+// Deterministic sentences, so chunk boundaries are the same on every run
+static char* make_text(size_t size) {
+    static const char *words[] = { "alpha", "beta", "gamma", "delta", "epsilon", "zeta", "eta", "theta" };
+    char *text = malloc(size + 1);
+    unsigned int state = 12345;
+    size_t used = 0;
+    while (used < size) {
+        state = state * 1103515245 + 12345;
+        const char *word = words[(state >> 16) % 8];
+        int n = snprintf(text + used, size + 1 - used, "%s%s", word, (state >> 8) % 7 == 0 ? ". " : " ");
+        used += n;
+    }
+    text[size] = '\0';
+    return text;
+}
+
+int main() {
+    char root[64], path[MAX_PATH + 16];
+    make_scratch_dir(root, sizeof(root));
+    snprintf(storage_dir, sizeof(storage_dir), "%sstorage/", root);
+    snprintf(backup_dir, sizeof(backup_dir), "%sbackups/", root);
+    snprintf(meta_dir, sizeof(meta_dir), "%smeta/", root);
+    mkdir(storage_dir, 0755);
+    mkdir(backup_dir, 0755);
+    mkdir(meta_dir, 0755);
+    snprintf(path, sizeof(path), "%sbig.txt", storage_dir);
+
+    init_io_engine();
+    init_durable_io();
+    init_undo_journal();
+    init_chunk_store();
+
+    printf("chunk_store\n");
+    char *original = make_text(TEXT_SIZE);
+    write_text(path, original);
+
+    ChunkStats stats;
+    CHECK(checkpoint_create("big.txt", "v1", &stats) == RESP_SUCCESS, "checkpoint created");
+    CHECK(stats.chunks > 1 && stats.new_chunks == stats.chunks && stats.new_bytes == TEXT_SIZE,
+          "first checkpoint stores every chunk");
+
+    char *loaded;
+    size_t length;
+    CHECK(checkpoint_load("big.txt", "v1", &loaded, &length) == RESP_SUCCESS &&
+          length == TEXT_SIZE && memcmp(loaded, original, TEXT_SIZE) == 0, "round trip is byte-exact");
+    free(loaded);
+
+    // An insertion in the middle only changes the chunks around it
+    char *edited = malloc(TEXT_SIZE + 32);
+    size_t middle = TEXT_SIZE / 2;
+    memcpy(edited, original, middle);
+    strcpy(edited + middle, "INSERTED TEXT ");
+    strcpy(edited + middle + 14, original + middle);
+    write_text(path, edited);
+    int chunks_before;
+    size_t bytes_before;
+    chunk_store_stats(&chunks_before, &bytes_before);
+    CHECK(checkpoint_create("big.txt", "v2", &stats) == RESP_SUCCESS, "second checkpoint created");
+    CHECK(stats.new_chunks >= 1 && stats.new_chunks <= 2 && stats.new_bytes < TEXT_SIZE / 4,
+          "edit stores only the changed chunks");
+    int chunks_after;
+    size_t bytes_after;
+    chunk_store_stats(&chunks_after, &bytes_after);
+    CHECK(chunks_after == chunks_before + stats.new_chunks, "unchanged chunks are shared");
+
+    CHECK(checkpoint_load("big.txt", "v2", &loaded, &length) == RESP_SUCCESS &&
+          length == TEXT_SIZE + 14 && memcmp(loaded, edited, length) == 0, "edited checkpoint round trip");
+    free(loaded);
+
+    // Same content again under a new tag stores nothing
+    CHECK(checkpoint_create("big.txt", "v3", &stats) == RESP_SUCCESS && stats.new_chunks == 0,
+          "identical checkpoint is fully deduplicated");
+
+    // Replacing v3 with itself keeps every chunk v2 still needs
+    CHECK(checkpoint_create("big.txt", "v3", &stats) == RESP_SUCCESS, "tag reused");
+    CHECK(checkpoint_load("big.txt", "v2", &loaded, &length) == RESP_SUCCESS &&
+          length == TEXT_SIZE + 14, "shared chunks survive a replaced checkpoint");
+    free(loaded);
+
+    CHECK(checkpoint_restore("big.txt", "v1") == RESP_SUCCESS, "restore v1");
+    char *restored = read_text(path);
+    CHECK(restored && strcmp(restored, original) == 0, "restored file matches v1");
+    free(restored);
+
+    free(edited);
+    free(original);
+    remove_scratch_dir(root);
+    TEST_DONE("test_chunk_store");
+}
@@ -0,0 +1,73 @@
+#ifndef TEST_COMMON_H
+#define TEST_COMMON_H
+
+#define _GNU_SOURCE  // nftw
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ftw.h>
+
+// Minimal checks for the module tests: each prints ✓ or ✗ and the test
+// program exits non-zero if any failed
+static int test_failures = 0;
+
+#define CHECK(cond, what) do { \
+        if (cond) { \
+            printf("  ✓ %s\n", what); \
+        } else { \
+            printf("  ✗ %s (%s:%d)\n", what, __FILE__, __LINE__); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define TEST_DONE(name) do { \
+        printf("%s %s\n", test_failures ? "✗" : "✓", name); \
+        return test_failures ? 1 : 0; \
+    } while (0)
+
+// Fresh scratch directory under /tmp; 'path' gets it with a trailing '/'
+static inline void make_scratch_dir(char *path, size_t size) {
+    char dir[] = "/tmp/docspp_test_XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        exit(1);
+    }
+    snprintf(path, size, "%s/", dir);
+}
+
+static inline int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+static inline void remove_scratch_dir(const char *path) {
+    nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static inline void write_text(const char *path, const char *text) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fputs(text, file);
+    fclose(file);
+}
+
+// Whole file as a NUL-terminated string (caller frees), or NULL
+static inline char* read_text(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return NULL;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = malloc(size + 1);
+    size_t got = fread(text, 1, size, file);
+    text[got] = '\0';
+    fclose(file);
+    return text;
+}
+
+#endif // TEST_COMMON_H
@@ -0,0 +1,133 @@
+#include "test_common.h"
+#include "../common/compress.h"
+
+#define GUARD 64
+
+static unsigned int state = 2024;
+
+static unsigned char next_random() {
+    state = state * 1103515245 + 12345;
+    return (unsigned char)(state >> 16);
+}
+
+// Compress and decompress 'len' bytes; 1 if the copy is exact
+static int round_trip(const char *data, size_t len, size_t *compressed_size) {
+    char *packed = malloc(LZ_COMPRESS_BOUND(len));
+    char *unpacked = malloc(len + 1);
+    size_t packed_len = lz_compress(data, len, packed, LZ_COMPRESS_BOUND(len));
+    long unpacked_len = lz_decompress(packed, packed_len, unpacked, len);
+    int same = packed_len > 0 && unpacked_len == (long)len && memcmp(data, unpacked, len) == 0;
+    if (compressed_size) *compressed_size = packed_len;
+    free(packed);
+    free(unpacked);
+    return same;
+}
+
+// Decompress into exactly out_size bytes followed by a guard band; the
+// result must be -1 or fit, and the guard must be untouched
+static int decompress_is_safe(const char *in, size_t len, size_t out_size) {
+    unsigned char *out = malloc(out_size + GUARD);
+    memset(out + out_size, 0xA5, GUARD);
+    long result = lz_decompress(in, len, (char *)out, out_size);
+    int safe = result >= -1 && result <= (long)out_size;
+    for (int i = 0; i < GUARD; i++) safe = safe && out[out_size + i] == 0xA5;
+    free(out);
+    return safe;
+}
+
+int main() {
+    printf("round trips\n");
+    size_t packed_len = 0;
+    CHECK(round_trip("", 0, &packed_len) && packed_len == 1, "empty input is one token byte");
+    CHECK(round_trip("abc", 3, NULL), "input shorter than a match");
+
+    size_t len = 100000;
+    char *data = malloc(len);
+    for (size_t i = 0; i < len; i++) data[i] = (char)next_random();
+    CHECK(round_trip(data, len, &packed_len) && packed_len <= LZ_COMPRESS_BOUND(len),
+          "incompressible input stays within the bound");
+
+    memset(data, 'x', len);
+    CHECK(round_trip(data, len, &packed_len) && packed_len < len / 100,
+          "a run of one byte shrinks to almost nothing");
+    for (size_t i = 0; i < len; i++) data[i] = "The quick brown fox. "[i % 21];
+    CHECK(round_trip(data, len, &packed_len) && packed_len < len / 50, "repeated sentences compress");
+
+    // A block repeated exactly LZ_MAX_OFFSET bytes later, random in between
+    for (size_t i = 0; i < len; i++) data[i] = (char)next_random();
+    memcpy(data + LZ_MAX_OFFSET, data, 64);
+    CHECK(round_trip(data, LZ_MAX_OFFSET + 64 + 16, NULL), "a repeat at the maximum offset");
+
+    // The same by hand: 65535 literals, then a match reaching back to byte 0
+    size_t stream_len = 1 + (LZ_MAX_OFFSET - 15) / 255 + 1 + LZ_MAX_OFFSET + 2;
+    unsigned char *stream = malloc(stream_len);
+    unsigned char *p = stream;
+    *p++ = 0xF0;  // 15+ literals, match length 4
+    size_t extra = LZ_MAX_OFFSET - 15;
+    while (extra >= 255) {
+        *p++ = 255;
+        extra -= 255;
+    }
+    *p++ = (unsigned char)extra;
+    memcpy(p, data, LZ_MAX_OFFSET);
+    p += LZ_MAX_OFFSET;
+    *p++ = LZ_MAX_OFFSET & 0xff;
+    *p++ = LZ_MAX_OFFSET >> 8;
+    char *out = malloc(LZ_MAX_OFFSET + 4);
+    long out_len = lz_decompress((char *)stream, p - stream, out, LZ_MAX_OFFSET + 4);
+    CHECK(out_len == LZ_MAX_OFFSET + 4 && memcmp(out + LZ_MAX_OFFSET, data, 4) == 0,
+          "a hand-built match at offset 65535 decodes");
+    free(out);
+    free(stream);
+
+    printf("bad input\n");
+    for (size_t i = 0; i < 4096; i++) data[i] = "It was. It is. It will be. "[i % 27] + (i % 300 == 0);
+    char *packed = malloc(LZ_COMPRESS_BOUND(4096));
+    size_t packed_size = lz_compress(data, 4096, packed, LZ_COMPRESS_BOUND(4096));
+
+    int truncated_ok = 1;
+    for (size_t cut = 0; cut < packed_size; cut++) {
+        truncated_ok = truncated_ok && decompress_is_safe(packed, cut, 4096);
+        char *scratch = malloc(4096);
+        long result = lz_decompress(packed, cut, scratch, 4096);
+        truncated_ok = truncated_ok && result != 4096;
+        free(scratch);
+    }
+    CHECK(truncated_ok, "every truncation fails or comes up short, inside the buffer");
+
+    int small_ok = 1;
+    for (size_t out_size = 0; out_size < 4096; out_size += 7) {
+        small_ok = small_ok && decompress_is_safe(packed, packed_size, out_size);
+        char *scratch = malloc(out_size + 1);
+        small_ok = small_ok && lz_decompress(packed, packed_size, scratch, out_size) == -1;
+        free(scratch);
+    }
+    CHECK(small_ok, "an output buffer too small is rejected without overrun");
+
+    int corrupt_ok = 1;
+    char *damaged = malloc(packed_size);
+    for (int round = 0; round < 2000; round++) {
+        memcpy(damaged, packed, packed_size);
+        for (int flips = 1 + next_random() % 4; flips > 0; flips--) {
+            size_t at = ((size_t)next_random() << 8 | next_random()) % packed_size;
+            damaged[at] ^= (char)(1 << (next_random() % 8));
+        }
+        corrupt_ok = corrupt_ok && decompress_is_safe(damaged, packed_size, 4096);
+    }
+    CHECK(corrupt_ok, "corrupt input never writes past the buffer");
+
+    char garbage[512];
+    int garbage_ok = 1;
+    for (int round = 0; round < 2000; round++) {
+        size_t garbage_len = next_random() * 2;
+        for (size_t i = 0; i < garbage_len; i++) garbage[i] = (char)next_random();
+        garbage_ok = garbage_ok && decompress_is_safe(garbage, garbage_len, 1024);
+    }
+    CHECK(garbage_ok, "random bytes never write past the buffer");
+    CHECK(lz_decompress("\x00\x01\x00", 3, packed, 16) == -1, "a match before any output is rejected");
+
+    free(damaged);
+    free(packed);
+    free(data);
+    TEST_DONE("test_compress");
+}
@@ -0,0 +1,91 @@
+#include "test_common.h"
+#include "../storage_server/diff_engine.h"
+#include "../storage_server/sentence_parser.h"
+
+static int script_is(const char *old_text, const char *new_text, const char *expected) {
+    size_t length;
+    DiffStats stats;
+    char *script = diff_texts(old_text, new_text, &length, &stats);
+    int same = strcmp(script, expected) == 0;
+    if (!same) printf("    got:\n%s    expected:\n%s", script, expected);
+    free(script);
+    return same;
+}
+
+// Longest common subsequence of two sentence lists, by dynamic programming
+static int lcs_length(char **a, int n, char **b, int m) {
+    int *row = calloc(m + 1, sizeof(int)), *prev = calloc(m + 1, sizeof(int));
+    for (int i = 1; i <= n; i++) {
+        for (int j = 1; j <= m; j++) {
+            if (strcmp(a[i - 1], b[j - 1]) == 0) row[j] = prev[j - 1] + 1;
+            else row[j] = row[j - 1] > prev[j] ? row[j - 1] : prev[j];
+        }
+        int *swap = prev;
+        prev = row;
+        row = swap;
+    }
+    int result = prev[m];
+    free(row);
+    free(prev);
+    return result;
+}
+
+static void free_list(char **items, int count) {
+    for (int i = 0; i < count; i++) free(items[i]);
+    free(items);
+}
+
+// Random text of 'count' sentences drawn from a small set, so that there
+// are many repeats for the diff to line up
+static char* random_text(unsigned int *state, int count) {
+    static const char *sentences[] = { "Alpha one.", "Beta two!", "Gamma three?", "Delta four.",
+                                       "Epsilon five.", "Zeta six." };
+    char *text = malloc(count * 16 + 1);
+    text[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        *state = *state * 1103515245 + 12345;
+        strcat(text, sentences[(*state >> 16) % 6]);
+        strcat(text, " ");
+    }
+    return text;
+}
+
+int main() {
+    printf("diff_texts\n");
+    CHECK(script_is("One. Two. Three.", "One. Two. Three.", ""), "identical texts give an empty script");
+    CHECK(script_is("One. Two. Three.", "One. Two. Four. Three.",
+                    "@@ -2,0 +2,1 @@\n+ Four.\n"), "inserted sentence");
+    CHECK(script_is("One. Two. Three.", "One. Three.",
+                    "@@ -1,1 +1,0 @@\n- Two.\n"), "removed sentence");
+    CHECK(script_is("The quick brown fox. End.", "The slow brown fox. End.",
+                    "@@ -0,1 +0,1 @@\n~ The [-quick-] {+slow+} brown fox.\n"), "changed word is marked in place");
+    CHECK(script_is("Red. Green.", "Blue sky. Green.",
+                    "@@ -0,1 +0,1 @@\n- Red.\n+ Blue sky.\n"), "sentence with nothing in common is replaced");
+    CHECK(script_is("", "Hello.", "@@ -0,0 +0,1 @@\n+ Hello.\n"), "diff from an empty text");
+
+    // Myers finds a shortest script: every edit it reports is needed
+    unsigned int state = 42;
+    int minimal = 1;
+    for (int round = 0; round < 200 && minimal; round++) {
+        char *old_text = random_text(&state, 1 + round % 23);
+        char *new_text = random_text(&state, 1 + (round * 7) % 19);
+        int n, m;
+        char **a = parse_sentences(old_text, &n);
+        char **b = parse_sentences(new_text, &m);
+        size_t length;
+        DiffStats stats;
+        free(diff_texts(old_text, new_text, &length, &stats));
+        int edits = stats.removed + stats.added + 2 * stats.changed;
+        if (edits != n + m - 2 * lcs_length(a, n, b, m)) {
+            printf("    round %d: %d edits for %d/%d sentences\n", round, edits, n, m);
+            minimal = 0;
+        }
+        free_list(a, n);
+        free_list(b, m);
+        free(old_text);
+        free(new_text);
+    }
+    CHECK(minimal, "edit scripts are minimal on 200 random texts");
+
+    TEST_DONE("test_diff_engine");
+}
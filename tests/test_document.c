@@ -0,0 +1,131 @@
+#include "test_common.h"
+#include "../storage_server/document.h"
+#include "../storage_server/durable_io.h"
+#include "../storage_server/io_engine.h"
+#include "../storage_server/undo_manager.h"
+#include <stdint.h>
+#include <sys/stat.h>
+
+char ss_id[64] = "TEST";
+char storage_dir[MAX_PATH];
+char backup_dir[MAX_PATH];
+char meta_dir[MAX_PATH];
+
+static ino_t inode_of(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_ino : 0;
+}
+
+static off_t size_of(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+// Replace one sentence through the document and flush it, as a WRITE commit does
+static int commit_sentence(const char *filename, int index, const char *sentence) {
+    Document *doc = document_open(filename);
+    if (doc == NULL) return -1;
+    document_commit_begin(doc);
+    int first, last;
+    int result = document_load(doc) == 0 &&
+                 document_replace_sentence(doc, index, sentence, &first, &last) >= 0 ? document_flush(doc) : -1;
+    document_commit_end(doc);
+    document_close(doc);
+    return result;
+}
+
+// Leave a redo record behind, as a crash between it and the data write would
+static void write_redo(const char *filename, uint64_t ino, uint64_t offset, const char *tail, uint64_t size,
+                       int torn) {
+    RedoRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = REDO_MAGIC;
+    record.ino = ino;
+    record.offset = offset;
+    record.length = strlen(tail);
+    record.size = size;
+    record.hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < record.length; i++) {
+        record.hash ^= (unsigned char)tail[i];
+        record.hash *= 1099511628211ULL;
+    }
+    uint64_t total = sizeof(record) + record.length + sizeof(uint64_t);
+
+    char path[MAX_PATH + 16];
+    snprintf(path, sizeof(path), "%s%s.redo", meta_dir, filename);
+    FILE *file = fopen(path, "w");
+    fwrite(&record, sizeof(record), 1, file);
+    fwrite(tail, 1, record.length, file);
+    if (!torn) fwrite(&total, sizeof(total), 1, file);
+    fclose(file);
+}
+
+int main() {
+    char root[64], path[MAX_PATH + 16], redo[MAX_PATH + 16];
+    make_scratch_dir(root, sizeof(root));
+    snprintf(storage_dir, sizeof(storage_dir), "%sstorage/", root);
+    snprintf(backup_dir, sizeof(backup_dir), "%sbackups/", root);
+    snprintf(meta_dir, sizeof(meta_dir), "%smeta/", root);
+    mkdir(storage_dir, 0755);
+    mkdir(backup_dir, 0755);
+    mkdir(meta_dir, 0755);
+    snprintf(path, sizeof(path), "%sa.txt", storage_dir);
+    snprintf(redo, sizeof(redo), "%sa.txt.redo", meta_dir);
+
+    init_io_engine();
+    init_durable_io();
+    init_undo_journal();
+    init_document_cache();
+
+    printf("document_flush\n");
+    write_text(path, "One. Two. Three. Four. Five. Six.");
+    ino_t inode = inode_of(path);
+
+    CHECK(commit_sentence("a.txt", 5, "Seven.") == 0, "tail commit flushed");
+    char *text = read_text(path);
+    CHECK(text && strcmp(text, "One. Two. Three. Four. Five. Seven.") == 0, "tail commit on disk");
+    free(text);
+    CHECK(inode_of(path) == inode, "short tail patched in place");
+    CHECK(size_of(redo) == 0, "redo record emptied after the commit");
+    CHECK(journal_depth("a.txt") == 1, "in-place commit journaled for undo");
+
+    CHECK(commit_sentence("a.txt", 5, "Six.") == 0, "shrinking tail commit flushed");
+    text = read_text(path);
+    CHECK(text && strcmp(text, "One. Two. Three. Four. Five. Six.") == 0, "file truncated to the new length");
+    free(text);
+
+    CHECK(commit_sentence("a.txt", 0, "Zero.") == 0, "head commit flushed");
+    text = read_text(path);
+    CHECK(text && strcmp(text, "Zero. Two. Three. Four. Five. Six.") == 0, "head commit on disk");
+    free(text);
+    CHECK(inode_of(path) != inode, "large rewrite replaces the file");
+
+    printf("redo recovery\n");
+    document_invalidate("a.txt");
+    write_text(path, "Zero. Two. Three. Four. Five. Si");
+    write_redo("a.txt", inode_of(path), 30, "Six. Seven.", 41, 0);
+    init_document_cache();
+    text = read_text(path);
+    CHECK(text && strcmp(text, "Zero. Two. Three. Four. Five. Six. Seven.") == 0, "interrupted commit finished");
+    free(text);
+    CHECK(size_of(redo) == 0, "replayed record emptied");
+
+    write_text(path, "Zero. Two.");
+    write_redo("a.txt", inode_of(path) + 1, 6, "Ten.", 10, 0);
+    init_document_cache();
+    text = read_text(path);
+    CHECK(text && strcmp(text, "Zero. Two.") == 0, "record for a replaced file ignored");
+    free(text);
+
+    write_redo("a.txt", inode_of(path), 6, "Ten.", 10, 1);
+    init_document_cache();
+    text = read_text(path);
+    CHECK(text && strcmp(text, "Zero. Two.") == 0, "torn record ignored");
+    free(text);
+
+    document_invalidate("a.txt");
+    CHECK(access(redo, F_OK) != 0, "invalidate removes the redo record");
+
+    remove_scratch_dir(root);
+    TEST_DONE("test_document");
+}
@@ -0,0 +1,73 @@
+#include "test_common.h"
+#include "../storage_server/io_engine.h"
+#include "../common/protocol.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define FILES 8
+
+// The same batch on one engine; run in a child since the engine is chosen
+// once per process
+static int check_engine(const char *name, const char *root) {
+    setenv("DOCSPP_SS_IO_ENGINE", name, 1);
+    init_io_engine();
+    printf("%s engine (running as %s)\n", name, io_engine_name(io_engine()));
+
+    char temp[FILES][MAX_PATH], final[FILES][MAX_PATH];
+    const char *from[FILES + 1], *to[FILES + 1];
+    int fds[FILES + 1], results[FILES + 1];
+    int written = 1;
+    for (int i = 0; i < FILES; i++) {
+        snprintf(temp[i], sizeof(temp[i]), "%s%s.%d.tmp", root, name, i);
+        snprintf(final[i], sizeof(final[i]), "%s%s.%d", root, name, i);
+        fds[i] = open(temp[i], O_RDWR | O_CREAT | O_TRUNC, 0644);
+        char text[32];
+        int length = snprintf(text, sizeof(text), "file %d", i);
+        written = written && io_pwrite(fds[i], text, length, 0) == length;
+        from[i] = temp[i];
+        to[i] = final[i];
+    }
+    CHECK(written, "writes complete");
+
+    fds[FILES] = -1;
+    io_fsync_batch(FILES + 1, fds, 1, results);
+    int synced = 1;
+    for (int i = 0; i < FILES; i++) synced = synced && results[i] == 0;
+    CHECK(synced, "a batch of fsyncs all succeed");
+    CHECK(results[FILES] == -EBADF, "a bad fd fails alone with its errno");
+
+    from[FILES] = "/nonexistent/from";
+    to[FILES] = "/nonexistent/to";
+    io_rename_batch(FILES + 1, from, to, results);
+    int renamed = 1;
+    for (int i = 0; i < FILES; i++) {
+        struct stat st;
+        renamed = renamed && results[i] == 0 && stat(final[i], &st) == 0 && stat(temp[i], &st) != 0;
+    }
+    CHECK(renamed, "a batch of renames all land");
+    CHECK(results[FILES] == -ENOENT, "a missing source fails alone with its errno");
+
+    char buffer[32] = "";
+    CHECK(io_pread(fds[3], buffer, sizeof(buffer) - 1, 0) == 6 && strcmp(buffer, "file 3") == 0,
+          "reads stop at end of file");
+    for (int i = 0; i < FILES; i++) close(fds[i]);
+    return test_failures;
+}
+
+int main() {
+    char root[64];
+    make_scratch_dir(root, sizeof(root));
+    const char *engines[] = { "sync", "threads", "uring" };
+    for (int e = 0; e < 3; e++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) exit(check_engine(engines[e], root));
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) test_failures++;
+    }
+    remove_scratch_dir(root);
+    TEST_DONE("test_io_engine");
+}
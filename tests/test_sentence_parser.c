@@ -0,0 +1,70 @@
+#include "test_common.h"
+#include "../storage_server/sentence_parser.h"
+#include "../common/protocol.h"
+
+static char **words;
+static int word_count;
+static char error[256];
+
+static void reset(const char *sentence) {
+    for (int i = 0; i < word_count; i++) free(words[i]);
+    free(words);
+    words = parse_words(sentence, &word_count);
+}
+
+static int apply(const char *batch) {
+    return apply_word_edits(&words, &word_count, batch, error, sizeof(error));
+}
+
+static int sentence_is(const char *expected) {
+    char *sentence = rebuild_sentence(words, word_count);
+    int same = strcmp(sentence, expected) == 0;
+    if (!same) printf("    got '%s', expected '%s'\n", sentence, expected);
+    free(sentence);
+    return same;
+}
+
+int main() {
+    printf("parse_words\n");
+    reset("  The quick\tbrown\nfox.  ");
+    CHECK(word_count == 4 && strcmp(words[0], "The") == 0 && strcmp(words[3], "fox.") == 0,
+          "splits on spaces, tabs and newlines");
+    reset("");
+    CHECK(word_count == 0 && words == NULL, "empty sentence has no words");
+
+    printf("apply_word_edits\n");
+    reset("one two three");
+    CHECK(apply("I 0 zero\nI 4 four") == RESP_SUCCESS && sentence_is("zero one two three four"),
+          "insert at the start and at the end");
+    CHECK(apply("D 1 2") == RESP_SUCCESS && sentence_is("zero three four"), "delete a range");
+    CHECK(apply("R 1 3 and more") == RESP_SUCCESS && sentence_is("zero 3 and more four"),
+          "replace one word with several");
+    CHECK(apply("D 0\n\nI 0 first") == RESP_SUCCESS && sentence_is("first 3 and more four"),
+          "blank lines are skipped; indexes follow earlier lines");
+
+    // Index rules: I may point one past the end, D and R may not
+    reset("a b");
+    CHECK(apply("I 3 x") == ERR_WORD_OUT_OF_RANGE, "insert past the end is out of range");
+    CHECK(apply("I -1 x") == ERR_WORD_OUT_OF_RANGE, "negative index is out of range");
+    CHECK(apply("D 2") == ERR_WORD_OUT_OF_RANGE, "delete at the end is out of range");
+    CHECK(apply("D 1 2") == ERR_WORD_OUT_OF_RANGE, "delete running past the end is out of range");
+    CHECK(apply("R 2 x") == ERR_WORD_OUT_OF_RANGE, "replace at the end is out of range");
+    CHECK(apply("I 2 c") == RESP_SUCCESS && sentence_is("a b c"), "insert exactly at the end");
+
+    // Empty text is not a delete in disguise
+    reset("a b");
+    CHECK(apply("I 1") == ERR_INVALID_REQUEST, "insert without text is rejected");
+    CHECK(apply("I 1   ") == ERR_INVALID_REQUEST, "insert of only spaces is rejected");
+    CHECK(apply("R 0") == ERR_INVALID_REQUEST, "replace without text is rejected");
+    CHECK(apply("X 0 y") == ERR_INVALID_REQUEST, "unknown operation is rejected");
+    CHECK(apply("I zero") == ERR_INVALID_REQUEST, "missing index is rejected");
+    CHECK(sentence_is("a b"), "rejected edits change nothing");
+
+    // All or nothing: a bad line after good ones leaves the words untouched
+    CHECK(apply("I 0 x\nD 0\nR 9 y") == ERR_WORD_OUT_OF_RANGE && strstr(error, "Edit 3") != NULL,
+          "error names the failing line");
+    CHECK(sentence_is("a b") && word_count == 2, "earlier lines of a failed batch are rolled back");
+
+    reset(NULL);
+    TEST_DONE("test_sentence_parser");
+}
@@ -0,0 +1,94 @@
+#include "test_common.h"
+#include "../common/text_count.h"
+#include <ctype.h>
+#include <sys/wait.h>
+
+// Straightforward byte-at-a-time counts, as text_count.h defines them
+static void reference_counts(const unsigned char *data, size_t length, TextCounts *counts) {
+    memset(counts, 0, sizeof(*counts));
+    int in_word = 0, open_sentence = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = data[i];
+        counts->bytes++;
+        if (c != '\n' && c != '\r') counts->chars++;
+        if (isspace(c)) {
+            in_word = 0;
+            continue;
+        }
+        if (!in_word) counts->words++;
+        in_word = 1;
+        if (c == '.' || c == '!' || c == '?') {
+            counts->sentences++;
+            open_sentence = 0;
+        } else {
+            open_sentence = 1;
+        }
+    }
+    if (open_sentence) counts->sentences++;
+}
+
+static int same_counts(const TextCounts *a, const TextCounts *b) {
+    return a->bytes == b->bytes && a->chars == b->chars &&
+           a->words == b->words && a->sentences == b->sentences;
+}
+
+// Text biased towards the bytes the kernels classify, including high bytes
+static void random_text(unsigned char *data, size_t length, unsigned int *state) {
+    static const char interesting[] = " \t\n\r\v\f.!?aZ";
+    for (size_t i = 0; i < length; i++) {
+        *state = *state * 1103515245 + 12345;
+        unsigned int r = *state >> 16;
+        data[i] = r % 3 == 0 ? (unsigned char)(r >> 4) : interesting[(r >> 4) % (sizeof(interesting) - 1)];
+    }
+}
+
+// Every length around the 64-byte block size, whole and in random pieces
+static int check_kernel(const char *kernel) {
+    setenv("DOCSPP_COUNT_KERNEL", kernel, 1);
+    printf("%s kernel (running %s)\n", kernel, text_count_kernel());
+
+    unsigned char data[1024];
+    unsigned int state = 42;
+    int whole_ok = 1, pieces_ok = 1;
+    for (size_t length = 0; length <= sizeof(data); length++) {
+        random_text(data, length, &state);
+        TextCounts expected, whole, pieces;
+        reference_counts(data, length, &expected);
+        text_count_buffer((const char *)data, length, &whole);
+        whole_ok = whole_ok && same_counts(&expected, &whole);
+
+        text_count_init(&pieces);
+        size_t done = 0;
+        while (done < length) {
+            state = state * 1103515245 + 12345;
+            size_t piece = (state >> 16) % 150;
+            if (piece > length - done) piece = length - done;
+            text_count_update(&pieces, (const char *)data + done, piece);
+            done += piece;
+        }
+        text_count_finish(&pieces);
+        pieces_ok = pieces_ok && same_counts(&expected, &pieces);
+    }
+    CHECK(whole_ok, "whole buffers of 0..1024 bytes match the reference");
+    CHECK(pieces_ok, "the same text fed in random pieces matches");
+
+    TextCounts counts;
+    text_count_buffer("One two.  Three\r\nfour", 21, &counts);
+    CHECK(counts.bytes == 21 && counts.chars == 19 && counts.words == 4 && counts.sentences == 2,
+          "a known text: 21 bytes, 19 chars, 4 words, 2 sentences");
+    return test_failures;
+}
+
+int main() {
+    // The kernel is picked once per process, so each runs in a child
+    const char *kernels[] = { "scalar", "sse2", "avx2" };
+    for (int k = 0; k < 3; k++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) exit(check_kernel(kernels[k]));
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) test_failures++;
+    }
+    TEST_DONE("test_text_count");
+}
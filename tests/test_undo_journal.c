@@ -0,0 +1,73 @@
+#include "test_common.h"
+#include "../storage_server/undo_manager.h"
+#include "../storage_server/durable_io.h"
+#include "../storage_server/io_engine.h"
+#include <sys/stat.h>
+
+char ss_id[64] = "TEST";
+char storage_dir[MAX_PATH];
+char backup_dir[MAX_PATH];
+char meta_dir[MAX_PATH];
+
+// Commit 'after' over 'before' the way document_flush does: journal, then replace
+static void commit_edit(const char *path, const char *before, const char *after) {
+    journal_record("a.txt", 0, before, strlen(before), after, strlen(after), strlen(after));
+    durable_write_file(path, after, strlen(after));
+}
+
+int main() {
+    char root[64], path[MAX_PATH + 16];
+    make_scratch_dir(root, sizeof(root));
+    snprintf(storage_dir, sizeof(storage_dir), "%sstorage/", root);
+    snprintf(backup_dir, sizeof(backup_dir), "%sbackups/", root);
+    snprintf(meta_dir, sizeof(meta_dir), "%smeta/", root);
+    mkdir(storage_dir, 0755);
+    mkdir(backup_dir, 0755);
+    mkdir(meta_dir, 0755);
+    snprintf(path, sizeof(path), "%sa.txt", storage_dir);
+
+    init_io_engine();
+    init_durable_io();
+    init_undo_journal();
+
+    printf("journal_undo\n");
+    write_text(path, "One. Two.");
+    commit_edit(path, "One. Two.", "One. Three.");
+    commit_edit(path, "One. Three.", "One. Four.");
+    CHECK(journal_depth("a.txt") == 2, "two edits journaled");
+
+    int undone = 0;
+    char *text;
+    CHECK(journal_undo("a.txt", 1, &undone) == RESP_SUCCESS && undone == 1, "undo one step");
+    text = read_text(path);
+    CHECK(text && strcmp(text, "One. Three.") == 0, "file is back at the previous version");
+    free(text);
+
+    // Same size, different bytes in the edited range: the record must not apply
+    write_text(path, "One. ThrXe.");
+    CHECK(journal_undo("a.txt", 1, &undone) == ERR_INVALID_REQUEST && undone == 0,
+          "rejects a file changed outside the journal");
+    text = read_text(path);
+    CHECK(text && strcmp(text, "One. ThrXe.") == 0, "changed file left alone");
+    free(text);
+    CHECK(journal_depth("a.txt") == 0, "stale journal dropped");
+
+    // A record whose rename never happened is skipped, not a reason to fail
+    write_text(path, "Alpha.");
+    commit_edit(path, "Alpha.", "Beta.");
+    journal_record("a.txt", 0, "Beta.", 5, "Gamma.", 6, 6);
+    CHECK(journal_undo("a.txt", 1, &undone) == RESP_SUCCESS && undone == 1,
+          "skips a journaled edit that was never committed");
+    text = read_text(path);
+    CHECK(text && strcmp(text, "Alpha.") == 0, "undid the committed edit");
+    free(text);
+
+    // journal_cancel drops the newest record only
+    commit_edit(path, "Alpha.", "Delta.");
+    journal_record("a.txt", 0, "Delta.", 6, "Epsilon.", 8, 8);
+    journal_cancel("a.txt");
+    CHECK(journal_depth("a.txt") == 1, "cancel drops only the newest record");
+
+    remove_scratch_dir(root);
+    TEST_DONE("test_undo_journal");
+}